@@ -0,0 +1,829 @@
+/*
+ * kref.c
+ * 
+ * Implementation of kref.h
+ * 
+ * See the header for further information.
+ * 
+ * The kernels in this file are frozen copies of the scalar kernels as
+ * they were when the kernel benchmark was introduced.  Do not optimize
+ * them; they define the output that optimized kernels must match.
+ */
+
+#include "kref.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sophistry.h"
+#include "ttable.h"
+
+/*
+ * Type declarations
+ * =================
+ */
+
+/*
+ * Stores an HSL color with floating-point channels.
+ * 
+ * This can not be used for grayscale values, which have an undefined
+ * hue.
+ */
+typedef struct {
+  
+  /* The hue, in range [0.0, 360.0) */
+  float h;
+  
+  /* The saturation, in range [0.0, 1.0] */
+  float s;
+  
+  /* The lightness, in range [0.0, 1.0] */
+  float l;
+  
+} HSL;
+
+/*
+ * Stores an RGB color with floating-point channels.
+ */
+typedef struct {
+  
+  /* Red, in range [0.0, 1.0] */
+  float r;
+  
+  /* Green, in range [0.0, 1.0] */
+  float g;
+  
+  /* Blue, in range [0.0, 1.0] */
+  float b;
+  
+} RGB;
+
+/*
+ * Local data
+ * ==========
+ */
+
+/*
+ * The reference gamma table.
+ */
+static int m_gamma_init = 0;
+static float m_gamma[256];
+
+/*
+ * The reference texture.
+ */
+static const uint32_t *m_tex_data = NULL;
+static int32_t m_tex_w = 0;
+static int32_t m_tex_h = 0;
+
+/*
+ * Local functions
+ * ===============
+ */
+
+/* Function prototypes */
+static void gammaVerify(void);
+static float hslval(float a, float b, float hue);
+static void rgb2hsl(RGB *pRGB, HSL *pHSL);
+static void hsl2rgb(HSL *pHSL, RGB *pRGB);
+
+/*
+ * Verify that the gamma table is initialized to proper values.
+ * 
+ * A fault occurs if the gamma table is not initialized or it contains
+ * improper values.
+ * 
+ * To contain proper values, the first record must be 0.0f and the last
+ * record must be 1.0f.  Furthermore, all records must be in strictly
+ * ascending order without any duplicates.  All records must be finite.
+ */
+static void gammaVerify(void) {
+  
+  int i = 0;
+  float v = 0.0f;
+  
+  /* Make sure initialized */
+  if (!m_gamma_init) {
+    abort();
+  }
+  
+  /* Check all values finite */
+  for(i = 0; i < 256; i++) {
+    if (!isfinite(m_gamma[i])) {
+      abort();
+    }
+  }
+  
+  /* Check boundary values */
+  if ((m_gamma[0] != 0.0f) || (m_gamma[255] != 1.0f)) {
+    abort();
+  }
+  
+  /* Check strict ascending order */
+  v = 0.0f;
+  for(i = 1; i < 256; i++) {
+    if (!(m_gamma[i] > v)) {
+      abort();
+    }
+    v = m_gamma[i];
+  }
+}
+
+/*
+ * Auxiliary function for HSL/RGB conversions.
+ * 
+ * See the conversion functions for further information.
+ */
+static float hslval(float a, float b, float hue) {
+  
+  float result = 0.0f;
+  
+  /* Adapted from The Revolutionary Guide to Bitmapped Graphics,
+   * Control-Zed, Wrox Press, 1994, pg. 124 */
+  
+  while (hue >= 360.0f) {
+    hue -= 360.0f;
+  }
+  while (hue < 0.0f) {
+    hue += 360.0f;
+  }
+  
+  if (hue < 60.0f) {
+    result = a + (b - a) * hue / 60.0f;
+  
+  } else if (hue < 180.0f) {
+    result = b;
+  
+  } else if (hue < 240.0f) {
+    result = a + (b - a) * (240.0f - hue) / 60.0f;
+  
+  } else {
+    result = a;
+  }
+  
+  return result;
+}
+
+/*
+ * Convert an RGB color to HSL.
+ * 
+ * pRGB points to the RGB color.  This structure is first adjusted in
+ * the following way.  Any component that is not a finite value is set
+ * to zero.  Then, each component is clamped to range [0.0, 1.0].
+ * 
+ * Note that the RGB channels must be in range [0.0, 1.0] rather than
+ * the integer range [0, 255].
+ * 
+ * Grayscale values may not be provided or a fault occurs.  This is
+ * because the hue is undefined in grayscale cases.  The grayscale check
+ * is done after the RGB values are adjusted as noted above.
+ * 
+ * The HSL result is written to pHSL.
+ * 
+ * Parameters:
+ * 
+ *   pRGB - pointer to the input RGB, which may be adjusted
+ * 
+ *   pHSL - pointer to the output HSL
+ */
+static void rgb2hsl(RGB *pRGB, HSL *pHSL) {
+  
+  float min = 0.0f;
+  float max = 0.0f;
+  float D = 0.0f;
+  
+  /* Check parameters */
+  if ((pRGB == NULL) || (pHSL == NULL)) {
+    abort();
+  }
+  
+  /* Fix non-finite channels */
+  if (!isfinite(pRGB->r)) {
+    pRGB->r = 0.0f;
+  }
+  if (!isfinite(pRGB->g)) {
+    pRGB->g = 0.0f;
+  }
+  if (!isfinite(pRGB->b)) {
+    pRGB->b = 0.0f;
+  }
+  
+  /* Clamp channel values */
+  if (!(pRGB->r >= 0.0f)) {
+    pRGB->r = 0.0f;
+  }
+  if (!(pRGB->g >= 0.0f)) {
+    pRGB->g = 0.0f;
+  }
+  if (!(pRGB->b >= 0.0f)) {
+    pRGB->b = 0.0f;
+  }
+  
+  if (!(pRGB->r <= 1.0f)) {
+    pRGB->r = 1.0f;
+  }
+  if (!(pRGB->g <= 1.0f)) {
+    pRGB->g = 1.0f;
+  }
+  if (!(pRGB->b <= 1.0f)) {
+    pRGB->b = 1.0f;
+  }
+  
+  /* Fault if grayscale */
+  if ((pRGB->r == pRGB->g) && (pRGB->r == pRGB->b)) {
+    abort();
+  }
+  
+  /* Adapted from The Revolutionary Guide to Bitmapped Graphics,
+   * Control-Zed, Wrox Press, 1994, pg. 122-123 */
+  
+  max = pRGB->r;
+  if (pRGB->g > max) {
+    max = pRGB->g;
+  }
+  if (pRGB->b > max) {
+    max = pRGB->b;
+  }
+  
+  min = pRGB->r;
+  if (pRGB->g < min) {
+    min = pRGB->g;
+  }
+  if (pRGB->b < min) {
+    min = pRGB->b;
+  }
+  
+  pHSL->l = (max + min) / 2.0f;
+  assert(max != min);
+  D = max - min;
+  
+  if (pHSL->l <= 0.5f) {
+    pHSL->s = D / (max + min);
+  } else {
+    pHSL->s = D / (2.0f - max - min);
+  }
+  
+  if (pRGB->r == max) {
+    pHSL->h = (pRGB->g - pRGB->b) / D;
+  
+  } else if (pRGB->g == max) {
+    pHSL->h = 2.0f + (pRGB->b - pRGB->r) / D;
+  
+  } else if (pRGB->b == max) {
+    pHSL->h = 4.0f + (pRGB->r - pRGB->g) / D;
+  
+  } else {
+    /* Shouldn't happen */
+    abort();
+  }
+  
+  pHSL->h *= 60.0f;
+  while(pHSL->h >= 360.0f) {
+    pHSL->h -= 360.0f;
+  }
+  while(pHSL->h < 0.0f) {
+    pHSL->h += 360.0f;
+  }
+}
+
+/*
+ * Convert an HSL color to RGB.
+ * 
+ * pHSL points to the HSL color.  This structure is first adjusted in
+ * the following way.  Any component that is not a finite value is set
+ * to zero.  Then, the S and L components are clamped to the range
+ * [0.0, 1.0].  Finally, the H component is adjusted to the degree range
+ * [0.0, 360.0).  The H component adjustment is by successive additions
+ * or subtractions, so do not pass a huge positive or negative value for
+ * H.
+ * 
+ * The RGB result is written to pRGB
+ * 
+ * Parameters:
+ * 
+ *   pHSL - pointer to the input HSL, which may be adjusted
+ * 
+ *   pRGB - pointer to the output RGB
+ */
+static void hsl2rgb(HSL *pHSL, RGB *pRGB) {
+  
+  float m = 0.0f;
+  float n = 0.0f;
+  
+  /* Check parameters */
+  if ((pHSL == NULL) || (pRGB == NULL)) {
+    abort();
+  }
+  
+  /* Fix non-finite channels */
+  if (!isfinite(pHSL->h)) {
+    pHSL->h = 0.0f;
+  }
+  if (!isfinite(pHSL->s)) {
+    pHSL->s = 0.0f;
+  }
+  if (!isfinite(pHSL->l)) {
+    pHSL->l = 0.0f;
+  }
+  
+  /* Clamp S and L values */
+  if (!(pHSL->s >= 0.0f)) {
+    pHSL->s = 0.0f;
+  }
+  if (!(pHSL->l >= 0.0f)) {
+    pHSL->l = 0.0f;
+  }
+  
+  if (!(pHSL->s <= 1.0f)) {
+    pHSL->s = 1.0f;
+  }
+  if (!(pHSL->l <= 1.0f)) {
+    pHSL->l = 1.0f;
+  }
+  
+  /* Adjust H value */
+  while (pHSL->h < 0.0f) {
+    pHSL->h += 360.0f;
+  }
+  while (pHSL->h >= 360.0f) {
+    pHSL->h -= 360.0f;
+  }
+  
+  /* Adapted from The Revolutionary Guide to Bitmapped Graphics,
+   * Control-Zed, Wrox Press, 1994, pg. 124 */
+  if (pHSL->l <= 0.5f) {
+    n = pHSL->l * (1.0f + pHSL->s);
+  } else {
+    n = pHSL->l + pHSL->s - pHSL->l * pHSL->s;
+  }
+  
+  m = 2.0f * pHSL->l - n;
+  
+  if (pHSL->s == 0) {
+    pRGB->r = pHSL->l;
+    pRGB->g = pHSL->l;
+    pRGB->b = pHSL->l;
+  
+  } else {
+    pRGB->r = hslval(m, n, pHSL->h + 120.0f);
+    pRGB->g = hslval(m, n, pHSL->h);
+    pRGB->b = hslval(m, n, pHSL->h - 120.0f);
+  }
+    
+  /* Assert finite */
+  assert(isfinite(pRGB->r));
+  assert(isfinite(pRGB->g));
+  assert(isfinite(pRGB->b));
+    
+  /* Clamp ranges */
+  if (pRGB->r < 0.0f) {
+    pRGB->r = 0.0f;
+  }
+  if (pRGB->g < 0.0f) {
+    pRGB->g = 0.0f;
+  }
+  if (pRGB->b < 0.0f) {
+    pRGB->b = 0.0f;
+  }
+    
+  if (pRGB->r > 1.0f) {
+    pRGB->r = 1.0f;
+  }
+  if (pRGB->g > 1.0f) {
+    pRGB->g = 1.0f;
+  }
+  if (pRGB->b > 1.0f) {
+    pRGB->b = 1.0f;
+  }
+}
+
+/*
+ * Public function implementations
+ * ===============================
+ * 
+ * See the header for specifications.
+ */
+
+/*
+ * kref_gamma_sRGB function.
+ */
+void kref_gamma_sRGB(void) {
+  
+  int x = 0;
+  double u = 0.0;
+  
+  /* Initialize and clear */
+  m_gamma_init = 1;
+  memset(m_gamma, 0, sizeof(float) * 256);
+  
+  /* Set boundaries */
+  m_gamma[0] = 0.0f;
+  m_gamma[255] = 1.0f;
+  
+  /* Set intermediate values according to sRGB */
+  for(x = 1; x < 255; x++) {
+    
+    /* Get floating-point value */
+    u = ((double) x) / 255.0;
+    
+    /* Compute value */
+    if (u <= 0.04045) {
+      u = u / 12.92;
+    
+    } else {
+      u = pow((u + 0.055) / 1.055 , 2.4);
+    }
+    
+    /* Store computed value */
+    m_gamma[x] = (float) u;
+  }
+  
+  /* Verify table */
+  gammaVerify();
+}
+
+/*
+ * kref_gamma_undo function.
+ */
+float kref_gamma_undo(int c) {
+  
+  /* Make sure gamma table initialized */
+  if (!m_gamma_init) {
+    abort();
+  }
+  
+  /* Clamp c */
+  if (c < 0) {
+    c = 0;
+  } else if (c > 255) {
+    c = 255;
+  }
+  
+  /* Return value from gamma table */
+  return m_gamma[c];
+}
+
+/*
+ * kref_gamma_correct function.
+ */
+int kref_gamma_correct(float v) {
+  
+  int result = 0;
+  int lbound = 0;
+  int hbound = 0;
+  int mid = 0;
+  float dl = 0.0f;
+  float dh = 0.0f;
+  
+  /* Make sure gamma table initialized */
+  if (!m_gamma_init) {
+    abort();
+  }
+  
+  /* Change non-finite values to zero */
+  if (!isfinite(v)) {
+    v = 0.0f;
+  }
+  
+  /* Handle cases */
+  if (v <= 0.0f) {
+    /* v is zero or less, so result is zero */
+    result = 0;
+    
+  } else if (v >= 1.0f) {
+    /* v is one or greater, so result is 255 */
+    result = 255;
+    
+  } else {
+    /* General case -- need to do reverse lookup */
+    lbound = 0;
+    hbound = 255;
+    while(lbound < hbound) {
+      
+      /* Choose midpoint halfway between but greater than lbound */
+      mid = lbound + ((hbound - lbound) / 2);
+      if (mid <= lbound) {
+        mid = lbound + 1;
+      }
+      
+      /* Compare value to midpoint */
+      if (v > m_gamma[mid]) {
+        /* v greater than midpoint, so midpoint is new lower bound */
+        lbound = mid;
+        
+      } else if (v < m_gamma[mid]) {
+        /* v less than midpoint, so upper bound below midpoint */
+        hbound = mid - 1;
+        
+      } else if (v == m_gamma[mid]) {
+        /* Found exact match, so zoom in on it */
+        lbound = mid;
+        hbound = mid;
+        
+      } else {
+        /* Shouldn't happen */
+        abort();
+      }
+    }
+    
+    /* lbound is now greatest value in gamma table that is less than or
+     * equal to v -- this shouldn't be the last entry */
+    assert(lbound < 255);
+    
+    /* Compute distances to lbound and to next higher value */
+    dl = v - m_gamma[lbound];
+    dh = m_gamma[lbound + 1] - v;
+    
+    /* If dh is less than dl, then result is one greater than lbound,
+     * else result is lbound */
+    if (dh < dl) {
+      result = lbound + 1;
+    } else {
+      result = lbound;
+    }
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * kref_fade function.
+ */
+uint32_t kref_fade(uint32_t rgb, int rate) {
+  
+  uint32_t result = 0;
+  SPH_ARGB argb;
+  
+  /* Initialize structure */
+  memset(&argb, 0, sizeof(SPH_ARGB));
+  
+  /* Check parameters */
+  if ((rate < 0) || (rate > 255)) {
+    abort();
+  }
+  
+  /* Handle cases */
+  if (rate >= 255) {
+    /* Full shading, so return RGB as-is */
+    result = rgb;
+    
+  } else if (rate < 1) {
+    /* No shading, so return fully transparent */
+    result = 0;
+    
+  } else {
+    /* Partial shading, so first unpack to ARGB */
+    sph_argb_unpack(rgb, &argb);
+    
+    /* Adjust alpha */
+    argb.a = (int) (
+                (((int32_t) argb.a) * ((int32_t) rate)) / 255
+              );
+    
+    /* Pack to get result */
+    result = sph_argb_pack(&argb);
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * kref_composite function.
+ */
+uint32_t kref_composite(uint32_t over, uint32_t under) {
+  
+  SPH_ARGB co;
+  SPH_ARGB cu;
+  SPH_ARGB cf;
+  float ao = 0.0f;
+  float au = 0.0f;
+  float af = 0.0f;
+  float mo = 0.0f;
+  float mu = 0.0f;
+  
+  /* Initialize structures */
+  memset(&co, 0, sizeof(SPH_ARGB));
+  memset(&cu, 0, sizeof(SPH_ARGB));
+  memset(&cf, 0, sizeof(SPH_ARGB));
+  
+  /* Unpack colors */
+  sph_argb_unpack(over, &co);
+  sph_argb_unpack(under, &cu);
+  
+  /* Get floating-point alpha values */
+  ao = ((float) co.a) / 255.0f;
+  au = ((float) cu.a) / 255.0f;
+  
+  /* Calculate output alpha */
+  af = ao + (au * (1.0f - ao));
+  if (af * 255.0f < 1.0f) {
+    af = 0.0f;
+  }
+  
+  /* Watch for zero output alpha case */
+  if (af != 0.0f) {
+    
+    /* Non-zero output alpha -- composite each component */
+    cf.a = (int) floor(((double) af) * 255.0);
+    
+    mo = kref_gamma_undo(co.r);
+    mu = kref_gamma_undo(cu.r);
+    cf.r = kref_gamma_correct(
+              ((mo * ao) + (mu * au * (1.0f - ao))) / af);
+    
+    mo = kref_gamma_undo(co.g);
+    mu = kref_gamma_undo(cu.g);
+    cf.g = kref_gamma_correct(
+              ((mo * ao) + (mu * au * (1.0f - ao))) / af);
+    
+    mo = kref_gamma_undo(co.b);
+    mu = kref_gamma_undo(cu.b);
+    cf.b = kref_gamma_correct(
+              ((mo * ao) + (mu * au * (1.0f - ao))) / af);
+    
+  } else {
+    /* Zero output alpha, so final is fully transparent */
+    cf.a = 0;
+    cf.r = 0;
+    cf.g = 0;
+    cf.b = 0;
+  }
+  
+  /* Pack for result */
+  return sph_argb_pack(&cf);
+}
+
+/*
+ * kref_colorize function.
+ */
+uint32_t kref_colorize(uint32_t rgb_in, uint32_t rgb_tint) {
+  
+  SPH_ARGB argb;
+  int gray_i = 0;
+  float gray = 0.0f;
+  RGB rgb;
+  HSL hsl;
+  
+  /* Initialize structures */
+  memset(&argb, 0, sizeof(SPH_ARGB));
+  memset(&rgb, 0, sizeof(RGB));
+  memset(&hsl, 0, sizeof(HSL));
+  
+  /* Down-convert input to grayscale */
+  sph_argb_unpack(rgb_in, &argb);
+  sph_argb_downGray(&argb);
+  gray_i = argb.r;
+  
+  /* Unpack RGB tint */
+  sph_argb_unpack(rgb_tint, &argb);
+ 
+  /* Check if tint is grayscale */
+  if ((argb.r == argb.g) && (argb.r == argb.b)) {
+    /* Grayscale tint, so result is just grayscale input */
+    argb.a = 255;
+    argb.r = gray_i;
+    argb.g = gray_i;
+    argb.b = gray_i;
+  
+  } else {
+    /* Not a grayscale tint, next check if input greyscale is pure white
+     * or black */
+    if (gray_i < 1) {
+      /* Input grayscale pure black, so result is black */
+      argb.a = 255;
+      argb.r = 0;
+      argb.g = 0;
+      argb.b = 0;
+      
+    } else if (gray_i > 254) {
+      /* Input grayscale pure white, so result is white */
+      argb.a = 255;
+      argb.r = 255;
+      argb.g = 255;
+      argb.b = 255;
+      
+    } else {
+      /* General case -- input grayscale not pure white or black and
+       * tint is not grayscale -- compute floating-point values */
+      gray = ((float) gray_i) / 255.0f;
+      
+      rgb.r = ((float) argb.r) / 255.0f;
+      rgb.g = ((float) argb.g) / 255.0f;
+      rgb.b = ((float) argb.b) / 255.0f;
+      
+      /* Convert RGB to HSL */
+      rgb2hsl(&rgb, &hsl);
+      
+      /* Set lightness to grayscale value */
+      hsl.l = gray;
+        
+      /* Convert adjusted HSL back to RGB */
+      hsl2rgb(&hsl, &rgb);
+        
+      /* Convert floating-point RGB to integer */
+      argb.a = 255;
+      argb.r = (int) floor(((double) rgb.r) * 255.0);
+      argb.g = (int) floor(((double) rgb.g) * 255.0);
+      argb.b = (int) floor(((double) rgb.b) * 255.0);
+        
+      if (argb.r < 0) {
+        argb.r = 0;
+      }
+      if (argb.g < 0) {
+        argb.g = 0;
+      }
+      if (argb.b < 0) {
+        argb.b = 0;
+      }
+        
+      if (argb.r > 255) {
+        argb.r = 255;
+      }
+      if (argb.g > 255) {
+        argb.g = 255;
+      }
+      if (argb.b > 255) {
+        argb.b = 255;
+      }
+    }
+  }
+  
+  /* Return packed value */
+  return sph_argb_pack(&argb);
+}
+
+/*
+ * kref_ttable_query function.
+ */
+int kref_ttable_query(SHADEREC *psr) {
+  
+  int result = -1;
+  int i = 0;
+  int count = 0;
+  SHADEREC sr;
+  
+  /* Initialize structures */
+  memset(&sr, 0, sizeof(SHADEREC));
+  
+  /* Check parameter */
+  if (psr == NULL) {
+    abort();
+  }
+  
+  /* Search every record */
+  count = ttable_count();
+  for(i = 0; i < count; i++) {
+    ttable_get(i, &sr);
+    if (sr.rgbidx == psr->rgbidx) {
+      result = i;
+      break;
+    }
+  }
+  
+  /* Fill in either with record from table or with default */
+  if (result >= 0) {
+    memcpy(psr, &sr, sizeof(SHADEREC));
+  } else {
+    psr->tidx = 1;
+    psr->srate = 0;
+    psr->drate = 255;
+    psr->rgbtint = UINT32_C(0xffffffff);
+  }
+  
+  /* Return the record index */
+  return result;
+}
+
+/*
+ * kref_texture_set function.
+ */
+void kref_texture_set(const uint32_t *pData, int32_t w, int32_t h) {
+  
+  /* Check parameters */
+  if ((pData == NULL) || (w < 1) || (h < 1)) {
+    abort();
+  }
+  
+  /* Store the texture */
+  m_tex_data = pData;
+  m_tex_w = w;
+  m_tex_h = h;
+}
+
+/*
+ * kref_texture_pixel function.
+ */
+uint32_t kref_texture_pixel(int32_t x, int32_t y) {
+  
+  /* Check state and parameters */
+  if ((m_tex_data == NULL) || (x < 0) || (y < 0)) {
+    abort();
+  }
+  
+  /* Tile the texture */
+  return m_tex_data[(x % m_tex_w) + ((y % m_tex_h) * m_tex_w)];
+}
@@ -0,0 +1,148 @@
+#ifndef KREF_H_INCLUDED
+#define KREF_H_INCLUDED
+
+/*
+ * kref.h
+ * 
+ * Reference kernels for the Lilac kernel benchmark.
+ * 
+ * Each function here is a frozen scalar copy of one of the per-pixel
+ * kernels of Lilac.  The kernel benchmark compares the current kernels
+ * against these, so that optimized kernels can be checked to produce
+ * exactly the same output as the originals.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ttable.h"
+
+/*
+ * Initialize the reference gamma table for sRGB.
+ * 
+ * This must be called before kref_gamma_undo(), kref_gamma_correct(),
+ * and kref_composite().
+ */
+void kref_gamma_sRGB(void);
+
+/*
+ * Reference version of gamma_undo().
+ * 
+ * Parameters:
+ * 
+ *   c - the component to undo gamma-correction for
+ * 
+ * Return:
+ * 
+ *   the linearized value
+ */
+float kref_gamma_undo(int c);
+
+/*
+ * Reference version of gamma_correct().
+ * 
+ * Parameters:
+ * 
+ *   v - the linear component to gamma-correct
+ * 
+ * Return:
+ * 
+ *   the gamma-corrected value
+ */
+int kref_gamma_correct(float v);
+
+/*
+ * Reference version of pixel_fade().
+ * 
+ * Parameters:
+ * 
+ *   rgb - the RGB value to fade
+ * 
+ *   rate - the shading rate
+ * 
+ * Return:
+ * 
+ *   the faded value
+ */
+uint32_t kref_fade(uint32_t rgb, int rate);
+
+/*
+ * Reference version of pixel_composite().
+ * 
+ * Parameters:
+ * 
+ *   over - the over color
+ * 
+ *   under - the under color
+ * 
+ * Return:
+ * 
+ *   the composited result
+ */
+uint32_t kref_composite(uint32_t over, uint32_t under);
+
+/*
+ * Reference version of pixel_colorize().
+ * 
+ * Parameters:
+ * 
+ *   rgb_in - the input RGB
+ * 
+ *   rgb_tint - the tint
+ * 
+ * Return:
+ * 
+ *   the colorized output
+ */
+uint32_t kref_colorize(uint32_t rgb_in, uint32_t rgb_tint);
+
+/*
+ * Reference version of ttable_query().
+ * 
+ * This searches every record of the texture table module in turn with
+ * ttable_get(), so it is independent of how ttable_query() indexes the
+ * table.
+ * 
+ * Parameters:
+ * 
+ *   psr - the shading record to fill in
+ * 
+ * Return:
+ * 
+ *   the index of the matching record, or -1 if there is none
+ */
+int kref_ttable_query(SHADEREC *psr);
+
+/*
+ * Set the pixel data used by kref_texture_pixel().
+ * 
+ * pData holds w times h ARGB pixels in row-major order.  The data is
+ * not copied, so it must remain valid while it is in use.
+ * 
+ * Parameters:
+ * 
+ *   pData - the texture pixels
+ * 
+ *   w - the texture width
+ * 
+ *   h - the texture height
+ */
+void kref_texture_set(const uint32_t *pData, int32_t w, int32_t h);
+
+/*
+ * Reference version of texture_pixel() for the texture set with
+ * kref_texture_set().
+ * 
+ * Parameters:
+ * 
+ *   x - the X coordinate
+ * 
+ *   y - the Y coordinate
+ * 
+ * Return:
+ * 
+ *   the ARGB value of the texture at the given coordinate
+ */
+uint32_t kref_texture_pixel(int32_t x, int32_t y);
+
+#endif
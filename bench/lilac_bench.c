@@ -0,0 +1,736 @@
+/*
+ * lilac_bench.c
+ * =============
+ * 
+ * Benchmark driver that renders synthetic workloads with lilac_draw
+ * and reports the results as CSV.
+ * 
+ * Syntax
+ * ------
+ * 
+ *   lilac_bench [lilac_draw] [runs] [dir_1] ... [dir_n]
+ * 
+ * [lilac_draw] is the path to the lilac_draw program to benchmark.
+ * 
+ * [runs] is the number of times to render each workload, which must be
+ * at least one.
+ * 
+ * [dir_1] ... [dir_n] are one or more workload directories, as written
+ * by lilac_bench_gen.
+ * 
+ * Each run starts lilac_draw with the --stats option in a separate
+ * process.  The output image is written to out.png in the workload
+ * directory, and anything lilac_draw writes to standard error goes to
+ * lilac_draw.log in the workload directory.
+ * 
+ * Output
+ * ------
+ * 
+ * CSV is written to standard output.  The first line is a header, and
+ * each run adds one line with the following columns:
+ * 
+ *   workload - the workload directory
+ *   run - the run number, counting from one
+ *   pixels - the number of output pixels
+ *   wall_s - wall-clock seconds for the whole lilac_draw process
+ *   wall_mpps - megapixels per second based on wall_s
+ *   render_mpps - megapixels per second based on total_s
+ *   maxrss_kb - peak resident set size of lilac_draw in kilobytes
+ *   total_s - seconds spent rendering, from the statistics report
+ * 
+ * These are followed by the seconds spent in each stage and the pixel
+ * counts for each mode, from the statistics report.  See the lilac_draw
+ * manual for their meanings.
+ * 
+ * wall_s includes process startup and loading of textures, the shading
+ * table, and the programmable shader, while total_s does not.
+ * 
+ * Compilation
+ * -----------
+ * 
+ * This program has no dependencies on other Lilac modules.  It requires
+ * a POSIX platform that also provides wait4(), such as Linux or BSD.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+ * Constants
+ * ---------
+ */
+
+/*
+ * The maximum length of a path built by this program, including the
+ * terminating nul.
+ */
+#define MAX_PATH (4096)
+
+/*
+ * The maximum number of textures read from a texture list.  This
+ * matches the limit in lilac_draw.
+ */
+#define MAX_TEXTURES (1024)
+
+/*
+ * The maximum length of a line in a texture list, including the line
+ * break and the terminating nul.
+ */
+#define MAX_LINE (1024)
+
+/*
+ * The maximum size of the statistics report read from lilac_draw.
+ */
+#define MAX_REPORT (1048576)
+
+/*
+ * The number of fixed arguments passed to lilac_draw before the
+ * textures, counting the program name, and the number of arguments
+ * after the textures, counting the terminating NULL.
+ */
+#define ARGS_BEFORE (8)
+#define ARGS_AFTER (1)
+
+/*
+ * Local data
+ * ----------
+ */
+
+/*
+ * The name of this executable module.
+ * 
+ * This is set at the start of the program entrypoint.  It should be
+ * included in error reports from the program.
+ */
+static const char *pModule = NULL;
+
+/*
+ * The names of the stage timings in the statistics report, in the
+ * order they appear in the CSV.
+ */
+static const char *m_stages[] = {
+  "total",
+  "decode",
+  "ttable",
+  "vtx_png",
+  "vtx_pshade",
+  "fade",
+  "composite1",
+  "composite2",
+  "colorize",
+  "tile",
+  "encode",
+  NULL
+};
+
+/*
+ * The names of the mode counts in the statistics report, in the order
+ * they appear in the CSV.
+ */
+static const char *m_modes[] = {
+  "blank",
+  "shade",
+  "pencil",
+  NULL
+};
+
+/*
+ * The buffer for the statistics report.
+ */
+static char m_report[MAX_REPORT + 1];
+
+/*
+ * The texture parameters of the current workload.
+ * 
+ * Each is a path or a procedural texture name, allocated with
+ * malloc().  m_tex_count is the number of textures.
+ */
+static char *m_tex[MAX_TEXTURES];
+static int m_tex_count = 0;
+
+/*
+ * Local functions
+ * ---------------
+ */
+
+/* Prototypes */
+static double wallclock(void);
+static int makePath(char *pBuf, const char *pDir, const char *pName);
+static void freeTextures(void);
+static int loadTextures(const char *pDir);
+static int findNumber(
+    const char   * pStart,
+    const char   * pKey,
+          double * pv);
+static int runOnce(
+    const char * pDraw,
+    const char * pDir,
+          int    run);
+
+/*
+ * Read the monotonic wall clock.
+ * 
+ * Return:
+ * 
+ *   the current time in seconds relative to an arbitrary epoch, or
+ *   zero if the clock could not be read
+ */
+static double wallclock(void) {
+  
+  double result = 0.0;
+  struct timespec ts;
+  
+  /* Initialize structures */
+  memset(&ts, 0, sizeof(struct timespec));
+  
+  /* Read the clock */
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+    result = ((double) ts.tv_sec) + (((double) ts.tv_nsec) / 1.0e9);
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * Join a directory and a file name into a path.
+ * 
+ * pBuf must have room for MAX_PATH characters.  If pName is already an
+ * absolute path, it is copied as-is.
+ * 
+ * Parameters:
+ * 
+ *   pBuf - the buffer to receive the path
+ * 
+ *   pDir - the directory
+ * 
+ *   pName - the file name
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the path is too long
+ */
+static int makePath(char *pBuf, const char *pDir, const char *pName) {
+  
+  int status = 1;
+  int rc = 0;
+  
+  /* Check parameters */
+  if ((pBuf == NULL) || (pDir == NULL) || (pName == NULL)) {
+    abort();
+  }
+  
+  /* Build the path */
+  if (pName[0] == '/') {
+    rc = snprintf(pBuf, MAX_PATH, "%s", pName);
+  } else {
+    rc = snprintf(pBuf, MAX_PATH, "%s/%s", pDir, pName);
+  }
+  if ((rc < 0) || (rc >= MAX_PATH)) {
+    fprintf(stderr, "%s: Path is too long!\n", pModule);
+    status = 0;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Release the texture parameters of the current workload.
+ */
+static void freeTextures(void) {
+  int i = 0;
+  for(i = 0; i < m_tex_count; i++) {
+    free(m_tex[i]);
+    m_tex[i] = NULL;
+  }
+  m_tex_count = 0;
+}
+
+/*
+ * Read the texture list of a workload.
+ * 
+ * Texture parameters that end in a closing parenthesis are procedural
+ * texture names and are used as-is.  All others are paths relative to
+ * the workload directory.
+ * 
+ * This function handles reporting errors to stderr.
+ * 
+ * Parameters:
+ * 
+ *   pDir - the workload directory
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int loadTextures(const char *pDir) {
+  
+  int status = 1;
+  size_t len = 0;
+  FILE *pf = NULL;
+  char path[MAX_PATH];
+  char line[MAX_LINE];
+  
+  /* Start with an empty list */
+  freeTextures();
+  
+  /* Open the list */
+  if (!makePath(path, pDir, "textures.txt")) {
+    status = 0;
+  }
+  
+  if (status) {
+    pf = fopen(path, "r");
+    if (pf == NULL) {
+      fprintf(stderr, "%s: Can't open '%s'!\n", pModule, path);
+      status = 0;
+    }
+  }
+  
+  /* Read each line */
+  while (status && (fgets(line, MAX_LINE, pf) != NULL)) {
+    
+    /* Strip the line break */
+    len = strlen(line);
+    if ((len > 0) && (line[len - 1] == '\n')) {
+      len--;
+      line[len] = (char) 0;
+    } else if (!feof(pf)) {
+      fprintf(stderr, "%s: Line too long in '%s'!\n", pModule, path);
+      status = 0;
+    }
+    
+    /* Skip blank lines */
+    if (status && (len < 1)) {
+      continue;
+    }
+    
+    /* Check the limit */
+    if (status && (m_tex_count >= MAX_TEXTURES)) {
+      fprintf(stderr, "%s: Too many textures in '%s'!\n",
+                pModule, path);
+      status = 0;
+    }
+    
+    /* Build the parameter */
+    if (status) {
+      if (line[len - 1] == ')') {
+        strcpy(path, line);
+      } else if (!makePath(path, pDir, line)) {
+        status = 0;
+      }
+    }
+    
+    /* Add the parameter to the list */
+    if (status) {
+      m_tex[m_tex_count] = (char *) malloc(strlen(path) + 1);
+      if (m_tex[m_tex_count] == NULL) {
+        fprintf(stderr, "%s: Out of memory!\n", pModule);
+        status = 0;
+      }
+    }
+    if (status) {
+      strcpy(m_tex[m_tex_count], path);
+      m_tex_count++;
+    }
+  }
+  
+  /* Must have at least two textures */
+  if (status && (m_tex_count < 2)) {
+    fprintf(stderr, "%s: Not enough textures in '%s/textures.txt'!\n",
+              pModule, pDir);
+    status = 0;
+  }
+  
+  /* Close the list */
+  if (pf != NULL) {
+    fclose(pf);
+    pf = NULL;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Find a number in the statistics report.
+ * 
+ * The search begins at pStart and finds the first occurrence of the
+ * key as a quoted JSON member name, followed by a colon and a number.
+ * 
+ * Parameters:
+ * 
+ *   pStart - where to begin searching in the report
+ * 
+ *   pKey - the member name, without quotes
+ * 
+ *   pv - pointer to variable to receive the number
+ * 
+ * Return:
+ * 
+ *   non-zero if found, zero if not
+ */
+static int findNumber(
+    const char   * pStart,
+    const char   * pKey,
+          double * pv) {
+  
+  int status = 1;
+  const char *pc = NULL;
+  char *pEnd = NULL;
+  char pattern[64];
+  
+  /* Check parameters */
+  if ((pStart == NULL) || (pKey == NULL) || (pv == NULL)) {
+    abort();
+  }
+  if (strlen(pKey) > sizeof(pattern) - 4) {
+    abort();
+  }
+  
+  /* Find the member name */
+  sprintf(pattern, "\"%s\":", pKey);
+  pc = strstr(pStart, pattern);
+  if (pc == NULL) {
+    status = 0;
+  }
+  
+  /* Parse the number */
+  if (status) {
+    pc += strlen(pattern);
+    *pv = strtod(pc, &pEnd);
+    if (pEnd == pc) {
+      status = 0;
+    }
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Render a workload once and write a CSV line with the results.
+ * 
+ * The texture list of the workload must already be loaded with
+ * loadTextures().
+ * 
+ * This function handles reporting errors to stderr.
+ * 
+ * Parameters:
+ * 
+ *   pDraw - the path to lilac_draw
+ * 
+ *   pDir - the workload directory
+ * 
+ *   run - the run number
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int runOnce(
+    const char * pDraw,
+    const char * pDir,
+          int    run) {
+  
+  int status = 1;
+  int i = 0;
+  int pfd[2];
+  int logfd = -1;
+  int wstatus = 0;
+  pid_t pid = -1;
+  ssize_t rc = 0;
+  size_t rlen = 0;
+  double t_start = 0.0;
+  double t_end = 0.0;
+  double pixels = 0.0;
+  double total = 0.0;
+  double v = 0.0;
+  const char *pModes = NULL;
+  struct rusage ru;
+  char discard[256];
+  
+  static char out_path[MAX_PATH];
+  static char mask_path[MAX_PATH];
+  static char pencil_path[MAX_PATH];
+  static char shading_path[MAX_PATH];
+  static char table_path[MAX_PATH];
+  static char shader_path[MAX_PATH];
+  static char log_path[MAX_PATH];
+  static char *args[ARGS_BEFORE + MAX_TEXTURES + ARGS_AFTER];
+  
+  /* Initialize structures */
+  memset(&ru, 0, sizeof(struct rusage));
+  pfd[0] = -1;
+  pfd[1] = -1;
+  
+  /* Check parameters */
+  if ((pDraw == NULL) || (pDir == NULL)) {
+    abort();
+  }
+  
+  /* Build the paths */
+  if (!(makePath(out_path, pDir, "out.png") &&
+        makePath(mask_path, pDir, "mask.png") &&
+        makePath(pencil_path, pDir, "pencil.png") &&
+        makePath(shading_path, pDir, "shading.png") &&
+        makePath(table_path, pDir, "table.txt") &&
+        makePath(shader_path, pDir, "shader.lua") &&
+        makePath(log_path, pDir, "lilac_draw.log"))) {
+    status = 0;
+  }
+  
+  /* Build the arguments, using no programmable shader if the workload
+   * doesn't have a script */
+  if (status) {
+    args[0] = (char *) pDraw;
+    args[1] = "--stats";
+    args[2] = out_path;
+    args[3] = mask_path;
+    args[4] = pencil_path;
+    args[5] = shading_path;
+    args[6] = table_path;
+    if (access(shader_path, F_OK) == 0) {
+      args[7] = shader_path;
+    } else {
+      args[7] = "-";
+    }
+    for(i = 0; i < m_tex_count; i++) {
+      args[ARGS_BEFORE + i] = m_tex[i];
+    }
+    args[ARGS_BEFORE + m_tex_count] = NULL;
+  }
+  
+  /* Open the log and a pipe for the report */
+  if (status) {
+    logfd = open(log_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (logfd < 0) {
+      fprintf(stderr, "%s: Can't open '%s'!\n", pModule, log_path);
+      status = 0;
+    }
+  }
+  
+  if (status) {
+    if (pipe(pfd)) {
+      fprintf(stderr, "%s: Can't create pipe!\n", pModule);
+      status = 0;
+    }
+  }
+  
+  /* Start lilac_draw with its output going to the pipe and its errors
+   * going to the log */
+  if (status) {
+    t_start = wallclock();
+    pid = fork();
+    if (pid < 0) {
+      fprintf(stderr, "%s: Can't fork!\n", pModule);
+      status = 0;
+    
+    } else if (pid == 0) {
+      close(pfd[0]);
+      if ((dup2(pfd[1], STDOUT_FILENO) < 0) ||
+          (dup2(logfd, STDERR_FILENO) < 0)) {
+        _exit(127);
+      }
+      execv(pDraw, args);
+      _exit(127);
+    }
+  }
+  
+  /* Close our copy of the write end so we see end of file when the
+   * child exits */
+  if (pfd[1] >= 0) {
+    close(pfd[1]);
+    pfd[1] = -1;
+  }
+  
+  /* Read the whole report; anything past the buffer is discarded */
+  if (status) {
+    rlen = 0;
+    for( ; ; ) {
+      if (rlen < MAX_REPORT) {
+        rc = read(pfd[0], m_report + rlen, MAX_REPORT - rlen);
+      } else {
+        rc = read(pfd[0], discard, sizeof(discard));
+      }
+      
+      if (rc > 0) {
+        if (rlen < MAX_REPORT) {
+          rlen += (size_t) rc;
+        }
+      } else if ((rc == 0) || (errno != EINTR)) {
+        break;
+      }
+    }
+    m_report[rlen] = (char) 0;
+  }
+  
+  /* Wait for lilac_draw and get its resource usage */
+  if (pid > 0) {
+    while (wait4(pid, &wstatus, 0, &ru) < 0) {
+      if (errno != EINTR) {
+        fprintf(stderr, "%s: Can't wait for lilac_draw!\n", pModule);
+        status = 0;
+        break;
+      }
+    }
+    t_end = wallclock();
+  }
+  
+  if (status) {
+    if ((!WIFEXITED(wstatus)) || (WEXITSTATUS(wstatus) != 0)) {
+      fprintf(stderr, "%s: lilac_draw failed on '%s'; see '%s'!\n",
+                pModule, pDir, log_path);
+      status = 0;
+    }
+  }
+  
+  /* Get the pixel count and render time from the report */
+  if (status) {
+    if (!(findNumber(m_report, "pixels", &pixels) &&
+          findNumber(m_report, "total", &total))) {
+      fprintf(stderr, "%s: Statistics report is missing!\n", pModule);
+      status = 0;
+    }
+  }
+  
+  /* Write the CSV line */
+  if (status) {
+    printf("%s,%d,%.0f,%.6f,%.3f,%.3f,%ld,",
+      pDir, run, pixels, t_end - t_start,
+      (t_end > t_start) ? (pixels / (t_end - t_start) / 1.0e6) : 0.0,
+      (total > 0.0) ? (pixels / total / 1.0e6) : 0.0,
+      (long) ru.ru_maxrss);
+    
+    for(i = 0; m_stages[i] != NULL; i++) {
+      v = 0.0;
+      findNumber(m_report, m_stages[i], &v);
+      printf("%.6f,", v);
+    }
+    
+    pModes = strstr(m_report, "\"modes\":");
+    for(i = 0; m_modes[i] != NULL; i++) {
+      v = 0.0;
+      if (pModes != NULL) {
+        findNumber(pModes, m_modes[i], &v);
+      }
+      printf("%.0f%s", v, (m_modes[i + 1] != NULL) ? "," : "\n");
+    }
+    fflush(stdout);
+  }
+  
+  /* Clean up */
+  if (pfd[0] >= 0) {
+    close(pfd[0]);
+    pfd[0] = -1;
+  }
+  if (logfd >= 0) {
+    close(logfd);
+    logfd = -1;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Program entrypoint
+ * ------------------
+ */
+
+int main(int argc, char *argv[]) {
+  
+  int status = 1;
+  int x = 0;
+  int i = 0;
+  int run = 0;
+  int runs = 0;
+  
+  /* Get module name */
+  pModule = NULL;
+  if ((argc > 0) && (argv != NULL)) {
+    pModule = argv[0];
+  }
+  if (pModule == NULL) {
+    pModule = "lilac_bench";
+  }
+  
+  /* Check argv */
+  if (argc > 0) {
+    if (argv == NULL) {
+      abort();
+    }
+    for(x = 0; x < argc; x++) {
+      if (argv[x] == NULL) {
+        abort();
+      }
+    }
+  }
+  
+  /* Check parameters */
+  if (argc < 4) {
+    fprintf(stderr, "%s: Not enough arguments!\n", pModule);
+    status = 0;
+  }
+  
+  if (status) {
+    runs = atoi(argv[2]);
+    if (runs < 1) {
+      fprintf(stderr, "%s: Invalid run count!\n", pModule);
+      status = 0;
+    }
+  }
+  
+  /* Write the CSV header */
+  if (status) {
+    printf("workload,run,pixels,wall_s,wall_mpps,render_mpps,"
+            "maxrss_kb");
+    for(i = 0; m_stages[i] != NULL; i++) {
+      printf(",%s_s", m_stages[i]);
+    }
+    for(i = 0; m_modes[i] != NULL; i++) {
+      printf(",%s", m_modes[i]);
+    }
+    printf("\n");
+    fflush(stdout);
+  }
+  
+  /* Run each workload */
+  for(i = 3; status && (i < argc); i++) {
+    if (!loadTextures(argv[i])) {
+      status = 0;
+    }
+    for(run = 1; status && (run <= runs); run++) {
+      if (!runOnce(argv[1], argv[i], run)) {
+        status = 0;
+      }
+    }
+  }
+  
+  /* Release the texture list */
+  freeTextures();
+  
+  /* Invert status and return */
+  if (status) {
+    status = 0;
+  } else {
+    status = 1;
+  }
+  return status;
+}
@@ -0,0 +1,1197 @@
+/*
+ * lilac_bench_gen.c
+ * =================
+ * 
+ * Synthetic workload generator for benchmarking lilac_draw.
+ * 
+ * Syntax
+ * ------
+ * 
+ *   lilac_bench_gen [dir] [width] [height] [regions] [records]
+ *                   [textures] [procedural] [seed]
+ * 
+ * [dir] is an existing directory to write the workload into.  Any
+ * workload files already there are overwritten.
+ * 
+ * [width] and [height] are the dimensions of the mask, pencil, and
+ * shading images, in pixels.
+ * 
+ * [regions] is the number of separately shaded regions in the shading
+ * image.
+ * 
+ * [records] is the number of records in the shading table, in range 1
+ * to 1024.  About one region in eight uses a shading color that is not
+ * in the table, so that the default record is also exercised.
+ * 
+ * [textures] is the number of PNG textures to generate.  The first is
+ * the paper texture and the second is the pencil texture.
+ * 
+ * [procedural] is the number of procedural textures to add after the
+ * PNG textures, which may be zero.  If it is not zero, a Lua script
+ * defining the procedural textures is written.  There must be at least
+ * two textures in total.
+ * 
+ * If [textures] is zero, the paper texture is procedural, and it is
+ * written as a generator shader that takes a random walk along each
+ * scanline.  Shading records that use the paper texture then query the
+ * same generator as the paper itself, which checks that lilac_draw
+ * requests each span of a generator only once and in order.  If there
+ * are also at least three procedural textures, the last one is a
+ * second generator with a different walk, which checks that records
+ * with a generator texture can be rendered over a different generator
+ * paper.
+ * 
+ * [seed] is an unsigned integer that seeds the pseudo-random generator.
+ * The same parameters and seed always produce the same workload.
+ * 
+ * Output files
+ * ------------
+ * 
+ * The following files are written into the workload directory:
+ * 
+ *   mask.png - the mask image
+ *   pencil.png - the pencil image
+ *   shading.png - the shading image
+ *   table.txt - the shading table
+ *   texN.png - the PNG textures, numbered from one
+ *   shader.lua - the procedural textures, if there are any
+ *   textures.txt - the texture parameters for lilac_draw, one per line
+ * 
+ * The lilac_bench driver program uses these files to run lilac_draw on
+ * the workload.
+ * 
+ * Compilation
+ * -----------
+ * 
+ * Build this program with Sophistry.  See the README in this directory
+ * for details.
+ */
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sophistry.h"
+
+/*
+ * Constants
+ * ---------
+ */
+
+/*
+ * The maximum length of a path built by this program, including the
+ * terminating nul.
+ */
+#define MAX_PATH (4096)
+
+/*
+ * Limits on the program parameters.
+ */
+#define MAX_DIM (65535)
+#define MAX_REGIONS (1048576)
+#define MAX_RECORDS (1024)
+#define MAX_TEXTURES (1024)
+
+/*
+ * The range of dimensions for generated PNG textures.
+ */
+#define TEX_MIN_DIM (32)
+#define TEX_MAX_DIM (256)
+
+/*
+ * The number of different procedural texture functions in the
+ * generated Lua script.  Procedural textures cycle through them.
+ */
+#define PROC_KINDS (3)
+
+/*
+ * Type declarations
+ * -----------------
+ */
+
+/*
+ * A shading region seed point, and the RGB shading index of its
+ * region.
+ */
+typedef struct {
+  int32_t x;
+  int32_t y;
+  uint32_t rgb;
+} SEED;
+
+/*
+ * Local data
+ * ----------
+ */
+
+/*
+ * The name of this executable module.
+ * 
+ * This is set at the start of the program entrypoint.  It should be
+ * included in error reports from the program.
+ */
+static const char *pModule = NULL;
+
+/*
+ * The state of the pseudo-random generator.
+ */
+static uint64_t m_rand = 0;
+
+/*
+ * Local functions
+ * ---------------
+ */
+
+/* Prototypes */
+static uint32_t rnd(void);
+static int32_t rndRange(int32_t lo, int32_t hi);
+static int parseInt(const char *pstr, int32_t lo, int32_t hi,
+                    int32_t *pv);
+static int makePath(char *pBuf, const char *pDir, const char *pName);
+
+static SPH_IMAGE_WRITER *openImage(
+    const char * pDir,
+    const char * pName,
+       int32_t   width,
+       int32_t   height);
+
+static int genMask(const char *pDir, int32_t width, int32_t height);
+static int genPencil(const char *pDir, int32_t width, int32_t height);
+static int genShading(
+    const char     * pDir,
+          int32_t    width,
+          int32_t    height,
+          int32_t    regions,
+    const uint32_t * pRGB,
+          int32_t    records);
+static int genTexture(const char *pDir, int32_t index);
+static int genTable(
+    const char     * pDir,
+    const uint32_t * pRGB,
+          int32_t    records,
+          int32_t    tcount);
+static int genScript(
+    const char    * pDir,
+          int32_t   procedural,
+          int       gen_paper);
+static int genTexList(
+    const char    * pDir,
+          int32_t   textures,
+          int32_t   procedural);
+
+/*
+ * Get the next pseudo-random value.
+ * 
+ * This is the xorshift64* generator, which is plenty for generating
+ * benchmark inputs and behaves the same on every platform.
+ * 
+ * Return:
+ * 
+ *   the next 32-bit pseudo-random value
+ */
+static uint32_t rnd(void) {
+  m_rand ^= m_rand >> 12;
+  m_rand ^= m_rand << 25;
+  m_rand ^= m_rand >> 27;
+  return (uint32_t) ((m_rand * UINT64_C(0x2545F4914F6CDD1D)) >> 32);
+}
+
+/*
+ * Get a pseudo-random integer in a given range.
+ * 
+ * Parameters:
+ * 
+ *   lo - the lowest value
+ * 
+ *   hi - the highest value, which must not be less than lo
+ * 
+ * Return:
+ * 
+ *   a value in range lo to hi inclusive
+ */
+static int32_t rndRange(int32_t lo, int32_t hi) {
+  if (hi < lo) {
+    abort();
+  }
+  return lo + (int32_t) (rnd() % ((uint32_t) (hi - lo) + 1));
+}
+
+/*
+ * Parse an unsigned decimal integer parameter.
+ * 
+ * Parameters:
+ * 
+ *   pstr - the string to parse
+ * 
+ *   lo - the lowest allowed value
+ * 
+ *   hi - the highest allowed value
+ * 
+ *   pv - pointer to variable to receive the value
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the string is not an integer in
+ *   range
+ */
+static int parseInt(const char *pstr, int32_t lo, int32_t hi,
+                    int32_t *pv) {
+  
+  int status = 1;
+  int32_t v = 0;
+  
+  /* Check parameters */
+  if ((pstr == NULL) || (pv == NULL)) {
+    abort();
+  }
+  
+  /* Must not be empty */
+  if (*pstr == 0) {
+    status = 0;
+  }
+  
+  /* Parse the digits */
+  for( ; status && (*pstr != 0); pstr++) {
+    if ((*pstr < '0') || (*pstr > '9')) {
+      status = 0;
+    }
+    if (status) {
+      if (v > (INT32_MAX - (*pstr - '0')) / 10) {
+        status = 0;
+      }
+    }
+    if (status) {
+      v = (v * 10) + (*pstr - '0');
+    }
+  }
+  
+  /* Check range */
+  if (status) {
+    if ((v < lo) || (v > hi)) {
+      status = 0;
+    }
+  }
+  
+  /* Store the value */
+  if (status) {
+    *pv = v;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Join a directory and a file name into a path.
+ * 
+ * pBuf must have room for MAX_PATH characters.
+ * 
+ * Parameters:
+ * 
+ *   pBuf - the buffer to receive the path
+ * 
+ *   pDir - the directory
+ * 
+ *   pName - the file name
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the path is too long
+ */
+static int makePath(char *pBuf, const char *pDir, const char *pName) {
+  
+  int status = 1;
+  int rc = 0;
+  
+  /* Check parameters */
+  if ((pBuf == NULL) || (pDir == NULL) || (pName == NULL)) {
+    abort();
+  }
+  
+  /* Build the path */
+  rc = snprintf(pBuf, MAX_PATH, "%s/%s", pDir, pName);
+  if ((rc < 0) || (rc >= MAX_PATH)) {
+    fprintf(stderr, "%s: Path is too long!\n", pModule);
+    status = 0;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Open an image writer for a file in the workload directory.
+ * 
+ * This function handles reporting errors to stderr.
+ * 
+ * Parameters:
+ * 
+ *   pDir - the workload directory
+ * 
+ *   pName - the file name of the image
+ * 
+ *   width - the width of the image
+ * 
+ *   height - the height of the image
+ * 
+ * Return:
+ * 
+ *   a new image writer, or NULL if error
+ */
+static SPH_IMAGE_WRITER *openImage(
+    const char * pDir,
+    const char * pName,
+       int32_t   width,
+       int32_t   height) {
+  
+  SPH_IMAGE_WRITER *pw = NULL;
+  int errcode = 0;
+  char path[MAX_PATH];
+  
+  /* Build the path */
+  if (makePath(path, pDir, pName)) {
+    
+    /* Open the writer */
+    pw = sph_image_writer_newFromPath(
+            path, width, height, SPH_IMAGE_DOWN_NONE, 0, &errcode);
+    if (pw == NULL) {
+      fprintf(stderr, "%s: Can't write '%s': %s!\n",
+                pModule, path, sph_image_errorString(errcode));
+    }
+  }
+  
+  /* Return the writer */
+  return pw;
+}
+
+/*
+ * Generate the mask image.
+ * 
+ * The mask is black, with white ellipses that mark blank areas.  About
+ * a quarter of the image is covered by the ellipses, though they may
+ * overlap.
+ * 
+ * Parameters:
+ * 
+ *   pDir - the workload directory
+ * 
+ *   width - the image width
+ * 
+ *   height - the image height
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int genMask(const char *pDir, int32_t width, int32_t height) {
+  
+  int status = 1;
+  int32_t count = 0;
+  int32_t i = 0;
+  int32_t x = 0;
+  int32_t y = 0;
+  double dx = 0.0;
+  double dy = 0.0;
+  double *pEll = NULL;
+  uint32_t *pScan = NULL;
+  SPH_IMAGE_WRITER *pw = NULL;
+  
+  /* Choose ellipses, each stored as centre X, centre Y, and the two
+   * radii; each covers about 1/32 of the image */
+  count = 8;
+  pEll = (double *) calloc((size_t) count * 4, sizeof(double));
+  if (pEll == NULL) {
+    fprintf(stderr, "%s: Out of memory!\n", pModule);
+    status = 0;
+  }
+  
+  if (status) {
+    for(i = 0; i < count; i++) {
+      pEll[i * 4    ] = (double) rndRange(0, width - 1);
+      pEll[i * 4 + 1] = (double) rndRange(0, height - 1);
+      pEll[i * 4 + 2] = ((double) width) * 0.1 *
+                          (0.5 + ((double) rndRange(0, 100)) / 100.0);
+      pEll[i * 4 + 3] = ((double) height) * 0.1 *
+                          (0.5 + ((double) rndRange(0, 100)) / 100.0);
+      if (pEll[i * 4 + 2] < 1.0) {
+        pEll[i * 4 + 2] = 1.0;
+      }
+      if (pEll[i * 4 + 3] < 1.0) {
+        pEll[i * 4 + 3] = 1.0;
+      }
+    }
+  }
+  
+  /* Open the image */
+  if (status) {
+    pw = openImage(pDir, "mask.png", width, height);
+    if (pw == NULL) {
+      status = 0;
+    }
+  }
+  
+  /* Draw each scanline */
+  if (status) {
+    pScan = sph_image_writer_ptr(pw);
+    for(y = 0; y < height; y++) {
+      for(x = 0; x < width; x++) {
+        pScan[x] = UINT32_C(0xff000000);
+        for(i = 0; i < count; i++) {
+          dx = (((double) x) - pEll[i * 4    ]) / pEll[i * 4 + 2];
+          dy = (((double) y) - pEll[i * 4 + 1]) / pEll[i * 4 + 3];
+          if ((dx * dx) + (dy * dy) <= 1.0) {
+            pScan[x] = UINT32_C(0xffffffff);
+            break;
+          }
+        }
+      }
+      sph_image_writer_write(pw);
+    }
+  }
+  
+  /* Clean up */
+  sph_image_writer_close(pw);
+  pw = NULL;
+  
+  if (pEll != NULL) {
+    free(pEll);
+    pEll = NULL;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Generate the pencil image.
+ * 
+ * The pencil image is white, with black diagonal strokes that cover
+ * about one pixel in eight.
+ * 
+ * Parameters:
+ * 
+ *   pDir - the workload directory
+ * 
+ *   width - the image width
+ * 
+ *   height - the image height
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int genPencil(const char *pDir, int32_t width, int32_t height) {
+  
+  int status = 1;
+  int32_t x = 0;
+  int32_t y = 0;
+  int32_t phase = 0;
+  uint32_t *pScan = NULL;
+  SPH_IMAGE_WRITER *pw = NULL;
+  
+  /* Open the image */
+  pw = openImage(pDir, "pencil.png", width, height);
+  if (pw == NULL) {
+    status = 0;
+  }
+  
+  /* Draw each scanline, with strokes two pixels wide every sixteen
+   * pixels, shifted by a random jitter on each line */
+  if (status) {
+    pScan = sph_image_writer_ptr(pw);
+    for(y = 0; y < height; y++) {
+      phase = y + rndRange(0, 1);
+      for(x = 0; x < width; x++) {
+        if (((x + phase) & 15) < 2) {
+          pScan[x] = UINT32_C(0xff000000);
+        } else {
+          pScan[x] = UINT32_C(0xffffffff);
+        }
+      }
+      sph_image_writer_write(pw);
+    }
+  }
+  
+  /* Clean up */
+  sph_image_writer_close(pw);
+  pw = NULL;
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Generate the shading image.
+ * 
+ * The image is divided into Voronoi regions around seed points that
+ * are jittered on a grid.  Each region is given the RGB shading index
+ * of a random table record, or about one time in eight an index that
+ * is not in the table.
+ * 
+ * Parameters:
+ * 
+ *   pDir - the workload directory
+ * 
+ *   width - the image width
+ * 
+ *   height - the image height
+ * 
+ *   regions - the approximate number of regions
+ * 
+ *   pRGB - the RGB shading indices of the table records
+ * 
+ *   records - the number of table records
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int genShading(
+    const char     * pDir,
+          int32_t    width,
+          int32_t    height,
+          int32_t    regions,
+    const uint32_t * pRGB,
+          int32_t    records) {
+  
+  int status = 1;
+  int32_t gx = 0;
+  int32_t gy = 0;
+  int32_t cw = 0;
+  int32_t ch = 0;
+  int32_t cx = 0;
+  int32_t cy = 0;
+  int32_t nx = 0;
+  int32_t ny = 0;
+  int32_t x = 0;
+  int32_t y = 0;
+  int64_t d = 0;
+  int64_t best = 0;
+  SEED *pSeed = NULL;
+  SEED *ps = NULL;
+  uint32_t *pScan = NULL;
+  SPH_IMAGE_WRITER *pw = NULL;
+  
+  /* Choose a grid of cells with about the same aspect ratio as the
+   * image, with one seed per cell */
+  gx = (int32_t) ceil(sqrt(((double) regions) *
+                            ((double) width) / ((double) height)));
+  if (gx < 1) {
+    gx = 1;
+  }
+  if (gx > width) {
+    gx = width;
+  }
+  gy = (regions + gx - 1) / gx;
+  if (gy < 1) {
+    gy = 1;
+  }
+  if (gy > height) {
+    gy = height;
+  }
+  cw = (width + gx - 1) / gx;
+  ch = (height + gy - 1) / gy;
+  
+  pSeed = (SEED *) calloc((size_t) gx * (size_t) gy, sizeof(SEED));
+  if (pSeed == NULL) {
+    fprintf(stderr, "%s: Out of memory!\n", pModule);
+    status = 0;
+  }
+  
+  /* Place the seeds and choose their shading indices; shading indices
+   * with the low bit of every channel set are never in the table */
+  if (status) {
+    for(cy = 0; cy < gy; cy++) {
+      for(cx = 0; cx < gx; cx++) {
+        ps = &(pSeed[cy * gx + cx]);
+        ps->x = cx * cw + rndRange(0, cw - 1);
+        ps->y = cy * ch + rndRange(0, ch - 1);
+        if (rndRange(0, 7) == 0) {
+          ps->rgb = (rnd() & UINT32_C(0xffffff)) | UINT32_C(0x010101);
+        } else {
+          ps->rgb = pRGB[rndRange(0, records - 1)];
+        }
+      }
+    }
+  }
+  
+  /* Open the image */
+  if (status) {
+    pw = openImage(pDir, "shading.png", width, height);
+    if (pw == NULL) {
+      status = 0;
+    }
+  }
+  
+  /* Give each pixel the shading index of the nearest seed in its own
+   * or a neighbouring cell */
+  if (status) {
+    pScan = sph_image_writer_ptr(pw);
+    for(y = 0; y < height; y++) {
+      cy = y / ch;
+      for(x = 0; x < width; x++) {
+        cx = x / cw;
+        best = -1;
+        for(ny = cy - 1; ny <= cy + 1; ny++) {
+          if ((ny < 0) || (ny >= gy)) {
+            continue;
+          }
+          for(nx = cx - 1; nx <= cx + 1; nx++) {
+            if ((nx < 0) || (nx >= gx)) {
+              continue;
+            }
+            ps = &(pSeed[ny * gx + nx]);
+            d = ((int64_t) (x - ps->x)) * ((int64_t) (x - ps->x)) +
+                ((int64_t) (y - ps->y)) * ((int64_t) (y - ps->y));
+            if ((best < 0) || (d < best)) {
+              best = d;
+              pScan[x] = UINT32_C(0xff000000) | ps->rgb;
+            }
+          }
+        }
+      }
+      sph_image_writer_write(pw);
+    }
+  }
+  
+  /* Clean up */
+  sph_image_writer_close(pw);
+  pw = NULL;
+  
+  if (pSeed != NULL) {
+    free(pSeed);
+    pSeed = NULL;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Generate a PNG texture.
+ * 
+ * The texture has random dimensions and random noise.  The paper
+ * texture (index one) is opaque and light, the pencil texture (index
+ * two) is dark with varying opacity, and all other textures have
+ * random colors and opacity.
+ * 
+ * Parameters:
+ * 
+ *   pDir - the workload directory
+ * 
+ *   index - the one-based index of the texture
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int genTexture(const char *pDir, int32_t index) {
+  
+  int status = 1;
+  int32_t width = 0;
+  int32_t height = 0;
+  int32_t x = 0;
+  int32_t y = 0;
+  uint32_t base = 0;
+  uint32_t v = 0;
+  uint32_t *pScan = NULL;
+  SPH_IMAGE_WRITER *pw = NULL;
+  SPH_ARGB argb;
+  char name[32];
+  
+  /* Initialize structures */
+  memset(&argb, 0, sizeof(SPH_ARGB));
+  
+  /* Choose dimensions and a base color */
+  width = rndRange(TEX_MIN_DIM, TEX_MAX_DIM);
+  height = rndRange(TEX_MIN_DIM, TEX_MAX_DIM);
+  base = rnd();
+  
+  /* Open the image */
+  sprintf(name, "tex%ld.png", (long) index);
+  pw = openImage(pDir, name, width, height);
+  if (pw == NULL) {
+    status = 0;
+  }
+  
+  /* Fill with noise around the base color */
+  if (status) {
+    pScan = sph_image_writer_ptr(pw);
+    for(y = 0; y < height; y++) {
+      for(x = 0; x < width; x++) {
+        v = rnd();
+        if (index == 1) {
+          argb.a = 255;
+          argb.r = 224 + (int) (v & 0x1f);
+          argb.g = 224 + (int) ((v >> 5) & 0x1f);
+          argb.b = 208 + (int) ((v >> 10) & 0x1f);
+        
+        } else if (index == 2) {
+          argb.a = (int) ((v >> 24) & 0xff);
+          argb.r = (int) (v & 0x3f);
+          argb.g = argb.r;
+          argb.b = argb.r;
+        
+        } else {
+          argb.a = (int) ((v >> 24) & 0xff);
+          argb.r = (int) (((base >> 16) & 0xc0) | (v & 0x3f));
+          argb.g = (int) (((base >> 8) & 0xc0) | ((v >> 6) & 0x3f));
+          argb.b = (int) ((base & 0xc0) | ((v >> 12) & 0x3f));
+        }
+        pScan[x] = sph_argb_pack(&argb);
+      }
+      sph_image_writer_write(pw);
+    }
+  }
+  
+  /* Clean up */
+  sph_image_writer_close(pw);
+  pw = NULL;
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Generate the shading table.
+ * 
+ * Parameters:
+ * 
+ *   pDir - the workload directory
+ * 
+ *   pRGB - the RGB shading indices of the records
+ * 
+ *   records - the number of records
+ * 
+ *   tcount - the total number of textures
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int genTable(
+    const char     * pDir,
+    const uint32_t * pRGB,
+          int32_t    records,
+          int32_t    tcount) {
+  
+  int status = 1;
+  int32_t i = 0;
+  FILE *pf = NULL;
+  char path[MAX_PATH];
+  
+  /* Open the file */
+  if (!makePath(path, pDir, "table.txt")) {
+    status = 0;
+  }
+  
+  if (status) {
+    pf = fopen(path, "w");
+    if (pf == NULL) {
+      fprintf(stderr, "%s: Can't write '%s'!\n", pModule, path);
+      status = 0;
+    }
+  }
+  
+  /* Write a record for each shading index, half of them with a tint */
+  if (status) {
+    fprintf(pf, "# Generated by lilac_bench_gen\n");
+    for(i = 0; i < records; i++) {
+      fprintf(pf, "%06lx %ld %ld %ld",
+                (unsigned long) pRGB[i],
+                (long) rndRange(1, tcount),
+                (long) rndRange(0, 255),
+                (long) rndRange(0, 255));
+      if (rndRange(0, 1)) {
+        fprintf(pf, " %06lx", (unsigned long) (rnd() & 0xffffff));
+      }
+      fprintf(pf, "\n");
+    }
+  }
+  
+  /* Close the file */
+  if (pf != NULL) {
+    if (fclose(pf)) {
+      fprintf(stderr, "%s: Error writing '%s'!\n", pModule, path);
+      status = 0;
+    }
+    pf = NULL;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Generate the Lua script for the procedural textures.
+ * 
+ * Procedural texture N (counting from one) is named bench_pN and uses
+ * one of a few functions of different cost, in rotation.  If gen_paper
+ * is non-zero, bench_p1 is instead a generator shader for the paper
+ * texture, and if there are at least three procedural textures, the
+ * last one is a generator shader too.
+ * 
+ * Parameters:
+ * 
+ *   pDir - the workload directory
+ * 
+ *   procedural - the number of procedural textures
+ * 
+ *   gen_paper - non-zero to make the first texture a generator
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int genScript(
+    const char    * pDir,
+          int32_t   procedural,
+          int       gen_paper) {
+  
+  int status = 1;
+  int32_t i = 0;
+  int32_t gen_last = 0;
+  FILE *pf = NULL;
+  char path[MAX_PATH];
+  
+  /* Determine whether the last texture is a generator too */
+  if (gen_paper && (procedural >= 3)) {
+    gen_last = procedural;
+  }
+  
+  /* Open the file */
+  if (!makePath(path, pDir, "shader.lua")) {
+    status = 0;
+  }
+  
+  if (status) {
+    pf = fopen(path, "w");
+    if (pf == NULL) {
+      fprintf(stderr, "%s: Can't write '%s'!\n", pModule, path);
+      status = 0;
+    }
+  }
+  
+  /* Write the shared functions, ordered from cheapest to most
+   * expensive */
+  if (status) {
+    fprintf(pf,
+      "-- Generated by lilac_bench_gen\n"
+      "\n"
+      "function bench_stripes(x, y, w, h, k)\n"
+      "  if ((x + y + k) // 8) %% 2 == 0 then\n"
+      "    return 0x80402010\n"
+      "  end\n"
+      "  return 0\n"
+      "end\n"
+      "\n"
+      "function bench_gradient(x, y, w, h, k)\n"
+      "  local v = math.floor(255 * ((x + k) %% w) / w)\n"
+      "  return 0xff000000 | (v << 16) | (v << 8) | v\n"
+      "end\n"
+      "\n"
+      "function bench_noise(x, y, w, h, k)\n"
+      "  local n = (x * 374761393 + y * 668265263 + k) & 0xffffffff\n"
+      "  n = ((n ~ (n >> 13)) * 1274126177) & 0xffffffff\n"
+      "  local a = (n >> 24) & 0xff\n"
+      "  local v = math.floor(a * ((n >> 8) & 0xff) / 255)\n"
+      "  return (a << 24) | (v << 16) | (v << 8) | v\n"
+      "end\n");
+  }
+  
+  /* Write the generator for the paper texture, which walks a light
+   * gray level along each scanline */
+  if (status && gen_paper) {
+    fprintf(pf,
+      "\n"
+      "lilac_meta = {}\n"
+      "lilac_meta.bench_p1 = {generator=true}\n"
+      "\n"
+      "function bench_p1(y, w, h)\n"
+      "  return coroutine.create(function()\n"
+      "    local s = (y * 2654435761 + 1) & 0x7fffffff\n"
+      "    local v = 224\n"
+      "    for x = 0, w - 1 do\n"
+      "      s = (s * 1103515245 + 12345) & 0x7fffffff\n"
+      "      v = v + ((s >> 16) %% 9) - 4\n"
+      "      v = math.max(192, math.min(255, v))\n"
+      "      coroutine.yield(0xff000000 | (v << 16) | (v << 8) | v)\n"
+      "    end\n"
+      "  end)\n"
+      "end\n");
+  }
+  
+  /* Write the generator for the last texture, which wraps a random
+   * walk through the whole gray range */
+  if (status && (gen_last > 0)) {
+    fprintf(pf,
+      "\n"
+      "lilac_meta.bench_p%ld = {generator=true}\n"
+      "\n"
+      "function bench_p%ld(y, w, h)\n"
+      "  return coroutine.create(function()\n"
+      "    local s = (y * 374761393 + %ld) & 0x7fffffff\n"
+      "    local v = 128\n"
+      "    for x = 0, w - 1 do\n"
+      "      s = (s * 1103515245 + 12345) & 0x7fffffff\n"
+      "      v = (v + ((s >> 16) %% 33) - 16) & 0xff\n"
+      "      coroutine.yield(0xff000000 | (v << 16) | (v << 8) | v)\n"
+      "    end\n"
+      "  end)\n"
+      "end\n",
+      (long) gen_last, (long) gen_last, (long) gen_last);
+  }
+  
+  /* Write each procedural texture */
+  for(i = 1; status && (i <= procedural); i++) {
+    if (((i == 1) && gen_paper) || (i == gen_last)) {
+      continue;
+    }
+    fprintf(pf, "\nfunction bench_p%ld(x, y, w, h)\n", (long) i);
+    switch ((i - 1) % PROC_KINDS) {
+      case 0:
+        fprintf(pf, "  return bench_stripes(x, y, w, h, %ld)\n",
+                  (long) i);
+        break;
+      case 1:
+        fprintf(pf, "  return bench_gradient(x, y, w, h, %ld)\n",
+                  (long) i);
+        break;
+      default:
+        fprintf(pf, "  return bench_noise(x, y, w, h, %ld)\n",
+                  (long) i);
+    }
+    fprintf(pf, "end\n");
+  }
+  
+  /* Close the file */
+  if (pf != NULL) {
+    if (fclose(pf)) {
+      fprintf(stderr, "%s: Error writing '%s'!\n", pModule, path);
+      status = 0;
+    }
+    pf = NULL;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Generate the texture parameter list.
+ * 
+ * Parameters:
+ * 
+ *   pDir - the workload directory
+ * 
+ *   textures - the number of PNG textures
+ * 
+ *   procedural - the number of procedural textures
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int genTexList(
+    const char    * pDir,
+          int32_t   textures,
+          int32_t   procedural) {
+  
+  int status = 1;
+  int32_t i = 0;
+  FILE *pf = NULL;
+  char path[MAX_PATH];
+  
+  /* Open the file */
+  if (!makePath(path, pDir, "textures.txt")) {
+    status = 0;
+  }
+  
+  if (status) {
+    pf = fopen(path, "w");
+    if (pf == NULL) {
+      fprintf(stderr, "%s: Can't write '%s'!\n", pModule, path);
+      status = 0;
+    }
+  }
+  
+  /* Write the PNG textures and then the procedural textures */
+  if (status) {
+    for(i = 1; i <= textures; i++) {
+      fprintf(pf, "tex%ld.png\n", (long) i);
+    }
+    for(i = 1; i <= procedural; i++) {
+      fprintf(pf, "bench_p%ld()\n", (long) i);
+    }
+  }
+  
+  /* Close the file */
+  if (pf != NULL) {
+    if (fclose(pf)) {
+      fprintf(stderr, "%s: Error writing '%s'!\n", pModule, path);
+      status = 0;
+    }
+    pf = NULL;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Program entrypoint
+ * ------------------
+ */
+
+int main(int argc, char *argv[]) {
+  
+  int status = 1;
+  int x = 0;
+  int32_t i = 0;
+  int32_t j = 0;
+  int32_t width = 0;
+  int32_t height = 0;
+  int32_t regions = 0;
+  int32_t records = 0;
+  int32_t textures = 0;
+  int32_t procedural = 0;
+  int32_t seed = 0;
+  const char *pDir = NULL;
+  
+  static uint32_t rgb[MAX_RECORDS];
+  
+  /* Get module name */
+  pModule = NULL;
+  if ((argc > 0) && (argv != NULL)) {
+    pModule = argv[0];
+  }
+  if (pModule == NULL) {
+    pModule = "lilac_bench_gen";
+  }
+  
+  /* Check argv */
+  if (argc > 0) {
+    if (argv == NULL) {
+      abort();
+    }
+    for(x = 0; x < argc; x++) {
+      if (argv[x] == NULL) {
+        abort();
+      }
+    }
+  }
+  
+  /* Parse parameters */
+  if (argc != 9) {
+    fprintf(stderr, "%s: Wrong number of arguments!\n", pModule);
+    status = 0;
+  }
+  
+  if (status) {
+    pDir = argv[1];
+    if (!parseInt(argv[2], 1, MAX_DIM, &width)) {
+      fprintf(stderr, "%s: Invalid width!\n", pModule);
+      status = 0;
+    }
+  }
+  if (status) {
+    if (!parseInt(argv[3], 1, MAX_DIM, &height)) {
+      fprintf(stderr, "%s: Invalid height!\n", pModule);
+      status = 0;
+    }
+  }
+  if (status) {
+    if (!parseInt(argv[4], 1, MAX_REGIONS, &regions)) {
+      fprintf(stderr, "%s: Invalid region count!\n", pModule);
+      status = 0;
+    }
+  }
+  if (status) {
+    if (!parseInt(argv[5], 1, MAX_RECORDS, &records)) {
+      fprintf(stderr, "%s: Invalid record count!\n", pModule);
+      status = 0;
+    }
+  }
+  if (status) {
+    if (!parseInt(argv[6], 0, MAX_TEXTURES, &textures)) {
+      fprintf(stderr, "%s: Invalid texture count!\n", pModule);
+      status = 0;
+    }
+  }
+  if (status) {
+    if (!parseInt(argv[7], 0, MAX_TEXTURES - textures, &procedural)) {
+      fprintf(stderr, "%s: Invalid procedural texture count!\n",
+                pModule);
+      status = 0;
+    }
+  }
+  if (status && (textures + procedural < 2)) {
+    fprintf(stderr, "%s: There must be at least two textures!\n",
+              pModule);
+    status = 0;
+  }
+  if (status) {
+    if (!parseInt(argv[8], 0, INT32_MAX, &seed)) {
+      fprintf(stderr, "%s: Invalid seed!\n", pModule);
+      status = 0;
+    }
+  }
+  
+  /* Seed the generator; the state must never be zero */
+  if (status) {
+    m_rand = (((uint64_t) seed) << 1) | 1;
+    for(i = 0; i < 16; i++) {
+      rnd();
+    }
+  }
+  
+  /* Choose distinct shading indices for the table records, all with
+   * the low bit of every channel clear so that they never collide with
+   * the indices genShading() uses for regions outside the table */
+  if (status) {
+    for(i = 0; i < records; i++) {
+      do {
+        rgb[i] = rnd() & UINT32_C(0xfefefe);
+        for(j = 0; j < i; j++) {
+          if (rgb[j] == rgb[i]) {
+            break;
+          }
+        }
+      } while (j < i);
+    }
+  }
+  
+  /* Generate each file */
+  if (status) {
+    status = genMask(pDir, width, height);
+  }
+  if (status) {
+    status = genPencil(pDir, width, height);
+  }
+  if (status) {
+    status = genShading(pDir, width, height, regions, rgb, records);
+  }
+  for(i = 1; status && (i <= textures); i++) {
+    status = genTexture(pDir, i);
+  }
+  if (status) {
+    status = genTable(pDir, rgb, records, textures + procedural);
+  }
+  if (status && (procedural > 0)) {
+    status = genScript(pDir, procedural, (textures == 0) ? 1 : 0);
+  }
+  if (status) {
+    status = genTexList(pDir, textures, procedural);
+  }
+  
+  /* Invert status and return */
+  if (status) {
+    status = 0;
+  } else {
+    status = 1;
+  }
+  return status;
+}
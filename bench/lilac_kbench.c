@@ -0,0 +1,1320 @@
+/*
+ * lilac_kbench.c
+ * ==============
+ * 
+ * Microbenchmark and bit-exactness checker for the per-pixel kernels
+ * of Lilac.
+ * 
+ * Syntax
+ * ------
+ * 
+ *   lilac_kbench [options] [kernel_1] ... [kernel_n]
+ * 
+ * The kernels are named on the command line.  If no kernels are named,
+ * all kernels are run.  The kernels are:
+ * 
+ *   fade - pixel_fade()
+ *   composite - pixel_composite()
+ *   colorize - pixel_colorize()
+ *   composite_memo - pixel_composite_memo()
+ *   colorize_memo - pixel_colorize_memo()
+ *   gamma_undo - gamma_undo()
+ *   gamma_correct - gamma_correct()
+ *   ttable_query - ttable_query()
+ *   texture_pixel - texture_pixel()
+ * 
+ * The options are:
+ * 
+ *   --samples N - the number of sampled inputs per kernel, default
+ *   1000000
+ * 
+ *   --reps N - the number of timed repetitions, default 5; the fastest
+ *   repetition is reported
+ * 
+ *   --seed N - the seed for generating inputs, default 1
+ * 
+ *   --exhaustive - also run the exhaustive checks of kernels that
+ *   have them, which can take a long time
+ * 
+ * Operation
+ * ---------
+ * 
+ * Each kernel is compared against a frozen scalar copy of itself in
+ * the kref module.  Inputs are generated with distributions that are
+ * typical of rendering, including the special cases each kernel
+ * handles.  Both versions are run on the same inputs and their outputs
+ * are compared bit for bit.  Both versions are also timed.
+ * 
+ * When a kernel is optimized, run this program to confirm that the
+ * optimized version produces exactly the same output as the original
+ * and to measure the speedup.
+ * 
+ * One line is written to standard output for each kernel, giving the
+ * nanoseconds per call of the current and reference versions, the
+ * speedup, and the number of mismatches.  Details of the first mismatch
+ * are written to standard error.  The exit status is non-zero if any
+ * mismatch was found.
+ * 
+ * Compilation
+ * -----------
+ * 
+ * Build this program together with kref.c in this directory and the
+ * gamma.c, pixel.c, texture.c, and ttable.c modules of Lilac, and with
+ * Sophistry.  See the README in this directory for details.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+
+#include "gamma.h"
+#include "kref.h"
+#include "pixel.h"
+#include "texture.h"
+#include "ttable.h"
+
+#include "sophistry.h"
+
+/*
+ * Constants
+ * ---------
+ */
+
+/*
+ * The maximum number of 32-bit output words per kernel call.
+ */
+#define MAX_WORDS (5)
+
+/*
+ * The number of records in the generated shading table.
+ */
+#define TABLE_RECORDS (256)
+
+/*
+ * The dimensions of the generated texture.  These are chosen to not be
+ * powers of two.
+ */
+#define TEX_W (97)
+#define TEX_H (61)
+
+/*
+ * The width of the virtual image scanned by texture_pixel().
+ */
+#define SCAN_W (4096)
+
+/*
+ * The maximum length of a temporary path, including the terminating
+ * nul.
+ */
+#define MAX_PATH (256)
+
+/*
+ * Type declarations
+ * -----------------
+ */
+
+/*
+ * Kernel benchmark structure.
+ */
+typedef struct {
+  
+  /*
+   * The name of the kernel.
+   */
+  const char *pName;
+  
+  /*
+   * The number of 32-bit output words per call.
+   */
+  int words;
+  
+  /*
+   * Fill in the input arrays with n generated inputs.
+   */
+  void (*fGen)(size_t n);
+  
+  /*
+   * Run the current or the reference kernel on the first n inputs and
+   * write the results to the given output array.
+   */
+  void (*fCur)(size_t n, uint32_t *pOut);
+  void (*fRef)(size_t n, uint32_t *pOut);
+  
+  /*
+   * Run an exhaustive check, or NULL if there is none.
+   *
+   * Returns the number of mismatches, and sets *pCount to the number
+   * of inputs checked.
+   */
+  uint64_t (*fExhaustive)(uint64_t *pCount);
+
+} KERNEL;
+
+/*
+ * Local data
+ * ----------
+ */
+
+/*
+ * The name of this executable module.
+ * 
+ * This is set at the start of the program entrypoint.  It should be
+ * included in error reports from the program.
+ */
+static const char *pModule = NULL;
+
+/*
+ * The state of the pseudo-random generator.
+ */
+static uint64_t m_rand = 0;
+
+/*
+ * Input arrays shared by all kernels.
+ */
+static uint32_t *m_in_a = NULL;
+static uint32_t *m_in_b = NULL;
+static float *m_in_f = NULL;
+
+/*
+ * Output arrays for the current and reference kernels.
+ */
+static uint32_t *m_out_cur = NULL;
+static uint32_t *m_out_ref = NULL;
+
+/*
+ * The RGB indices of the generated shading table.
+ */
+static uint32_t m_table_rgb[TABLE_RECORDS];
+
+/*
+ * The pixels of the generated texture, as read back from the file.
+ */
+static uint32_t m_tex[TEX_W * TEX_H];
+
+/*
+ * Local functions
+ * ---------------
+ */
+
+/* Prototypes */
+static uint32_t rnd(void);
+static double wallclock(void);
+static uint32_t floatBits(float f);
+
+static uint32_t genAlpha(void);
+static uint32_t genARGB(void);
+
+static void genFade(size_t n);
+static void curFade(size_t n, uint32_t *pOut);
+static void refFade(size_t n, uint32_t *pOut);
+static uint64_t exFade(uint64_t *pCount);
+
+static void genComposite(size_t n);
+static void curComposite(size_t n, uint32_t *pOut);
+static void refComposite(size_t n, uint32_t *pOut);
+
+static void genCompositeMemo(size_t n);
+static void curCompositeMemo(size_t n, uint32_t *pOut);
+
+static void genColorize(size_t n);
+static void curColorize(size_t n, uint32_t *pOut);
+static void refColorize(size_t n, uint32_t *pOut);
+static uint64_t exColorize(uint64_t *pCount);
+
+static void genColorizeMemo(size_t n);
+static void curColorizeMemo(size_t n, uint32_t *pOut);
+
+static void genGammaUndo(size_t n);
+static void curGammaUndo(size_t n, uint32_t *pOut);
+static void refGammaUndo(size_t n, uint32_t *pOut);
+static uint64_t exGammaUndo(uint64_t *pCount);
+
+static void genGammaCorrect(size_t n);
+static void curGammaCorrect(size_t n, uint32_t *pOut);
+static void refGammaCorrect(size_t n, uint32_t *pOut);
+static uint64_t exGammaCorrect(uint64_t *pCount);
+
+static void genTtable(size_t n);
+static void curTtable(size_t n, uint32_t *pOut);
+static void refTtable(size_t n, uint32_t *pOut);
+
+static void genTexture(size_t n);
+static void curTexture(size_t n, uint32_t *pOut);
+static void refTexture(size_t n, uint32_t *pOut);
+
+static int setupTable(const char *pDir);
+static int setupTexture(const char *pDir);
+static int runKernel(const KERNEL *pk, size_t n, int reps, int ex);
+
+/*
+ * The table of kernels.
+ */
+static const KERNEL m_kernels[] = {
+  {"fade", 1, &genFade, &curFade, &refFade, &exFade},
+  {"composite", 1, &genComposite, &curComposite, &refComposite, NULL},
+  {"colorize", 1, &genColorize, &curColorize, &refColorize,
+    &exColorize},
+  {"composite_memo", 1, &genCompositeMemo, &curCompositeMemo,
+    &refComposite, NULL},
+  {"colorize_memo", 1, &genColorizeMemo, &curColorizeMemo,
+    &refColorize, NULL},
+  {"gamma_undo", 1, &genGammaUndo, &curGammaUndo, &refGammaUndo,
+    &exGammaUndo},
+  {"gamma_correct", 1, &genGammaCorrect, &curGammaCorrect,
+    &refGammaCorrect, &exGammaCorrect},
+  {"ttable_query", 5, &genTtable, &curTtable, &refTtable, NULL},
+  {"texture_pixel", 1, &genTexture, &curTexture, &refTexture, NULL},
+  {NULL, 0, NULL, NULL, NULL, NULL}
+};
+
+/*
+ * Get the next pseudo-random value from the xorshift64* generator.
+ * 
+ * Return:
+ * 
+ *   the next 32-bit pseudo-random value
+ */
+static uint32_t rnd(void) {
+  m_rand ^= m_rand >> 12;
+  m_rand ^= m_rand << 25;
+  m_rand ^= m_rand >> 27;
+  return (uint32_t) ((m_rand * UINT64_C(0x2545F4914F6CDD1D)) >> 32);
+}
+
+/*
+ * Read the monotonic wall clock.
+ * 
+ * Return:
+ * 
+ *   the current time in seconds relative to an arbitrary epoch, or
+ *   zero if the clock could not be read
+ */
+static double wallclock(void) {
+  
+  double result = 0.0;
+  struct timespec ts;
+  
+  /* Initialize structures */
+  memset(&ts, 0, sizeof(struct timespec));
+  
+  /* Read the clock */
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+    result = ((double) ts.tv_sec) + (((double) ts.tv_nsec) / 1.0e9);
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * Get the bit pattern of a float.
+ * 
+ * Parameters:
+ * 
+ *   f - the float
+ * 
+ * Return:
+ * 
+ *   the bits of the float
+ */
+static uint32_t floatBits(float f) {
+  uint32_t result = 0;
+  memcpy(&result, &f, sizeof(uint32_t));
+  return result;
+}
+
+/*
+ * Generate an alpha value, in the most significant byte, with one
+ * quarter fully opaque, one eighth fully transparent, and the rest
+ * random.
+ * 
+ * Return:
+ * 
+ *   the alpha value shifted into the alpha channel
+ */
+static uint32_t genAlpha(void) {
+  
+  uint32_t r = 0;
+  
+  r = rnd() & 7;
+  if (r < 2) {
+    return UINT32_C(0xff000000);
+  } else if (r < 3) {
+    return 0;
+  }
+  return rnd() & UINT32_C(0xff000000);
+}
+
+/*
+ * Generate an ARGB value with genAlpha() and random channels.
+ * 
+ * Return:
+ * 
+ *   the ARGB value
+ */
+static uint32_t genARGB(void) {
+  return genAlpha() | (rnd() & UINT32_C(0xffffff));
+}
+
+/*
+ * Kernel: fade
+ * ------------
+ */
+
+static void genFade(size_t n) {
+  
+  size_t i = 0;
+  uint32_t r = 0;
+  
+  for(i = 0; i < n; i++) {
+    m_in_a[i] = genARGB();
+    
+    r = rnd() & 7;
+    if (r < 2) {
+      m_in_b[i] = 255;
+    } else if (r < 3) {
+      m_in_b[i] = 0;
+    } else {
+      m_in_b[i] = rnd() & 0xff;
+    }
+  }
+}
+
+static void curFade(size_t n, uint32_t *pOut) {
+  size_t i = 0;
+  for(i = 0; i < n; i++) {
+    pOut[i] = pixel_fade(m_in_a[i], (int) m_in_b[i]);
+  }
+}
+
+static void refFade(size_t n, uint32_t *pOut) {
+  size_t i = 0;
+  for(i = 0; i < n; i++) {
+    pOut[i] = kref_fade(m_in_a[i], (int) m_in_b[i]);
+  }
+}
+
+/*
+ * Exhaustive over every alpha value and rate, each with 256 random RGB
+ * values.
+ */
+static uint64_t exFade(uint64_t *pCount) {
+  
+  uint64_t mismatch = 0;
+  uint32_t a = 0;
+  uint32_t rgb = 0;
+  uint32_t v = 0;
+  uint32_t r_cur = 0;
+  uint32_t r_ref = 0;
+  int k = 0;
+  int rate = 0;
+  
+  *pCount = 0;
+  for(k = 0; k < 256; k++) {
+    rgb = rnd() & UINT32_C(0xffffff);
+    for(a = 0; a < 256; a++) {
+      v = (a << 24) | rgb;
+      for(rate = 0; rate < 256; rate++) {
+        r_cur = pixel_fade(v, rate);
+        r_ref = kref_fade(v, rate);
+        if (r_cur != r_ref) {
+          if (mismatch < 1) {
+            fprintf(stderr,
+              "%s: fade(%08lx, %d) is %08lx, expected %08lx\n",
+              pModule, (unsigned long) v, rate,
+              (unsigned long) r_cur, (unsigned long) r_ref);
+          }
+          mismatch++;
+        }
+        (*pCount)++;
+      }
+    }
+  }
+  
+  return mismatch;
+}
+
+/*
+ * Kernel: composite
+ * -----------------
+ * 
+ * The over color is a faded texture pixel.  The under color is half
+ * the time an opaque paper color, a quarter of the time opaque white,
+ * and otherwise a random texture pixel.
+ */
+
+static void genComposite(size_t n) {
+  
+  size_t i = 0;
+  uint32_t r = 0;
+  
+  for(i = 0; i < n; i++) {
+    m_in_a[i] = pixel_fade(genARGB(), (int) (rnd() & 0xff));
+    
+    r = rnd() & 3;
+    if (r < 2) {
+      m_in_b[i] = UINT32_C(0xffe0e0d0) | (rnd() & UINT32_C(0x1f1f1f));
+    } else if (r < 3) {
+      m_in_b[i] = UINT32_C(0xffffffff);
+    } else {
+      m_in_b[i] = genARGB();
+    }
+  }
+}
+
+static void curComposite(size_t n, uint32_t *pOut) {
+  size_t i = 0;
+  for(i = 0; i < n; i++) {
+    pOut[i] = pixel_composite(m_in_a[i], m_in_b[i]);
+  }
+}
+
+static void refComposite(size_t n, uint32_t *pOut) {
+  size_t i = 0;
+  for(i = 0; i < n; i++) {
+    pOut[i] = kref_composite(m_in_a[i], m_in_b[i]);
+  }
+}
+
+/*
+ * Kernel: composite_memo
+ * ----------------------
+ * 
+ * The same as composite, except that inputs are drawn from a small
+ * palette, as they are from textures with few distinct colors.
+ */
+
+static void genCompositeMemo(size_t n) {
+  
+  size_t i = 0;
+  uint32_t over[64];
+  uint32_t under[16];
+  
+  for(i = 0; i < 64; i++) {
+    over[i] = pixel_fade(genARGB(), (int) (rnd() & 0xff));
+  }
+  for(i = 0; i < 16; i++) {
+    under[i] = (i < 8) ? (UINT32_C(0xff000000) | rnd()) : genARGB();
+  }
+  
+  for(i = 0; i < n; i++) {
+    m_in_a[i] = over[rnd() % 64];
+    m_in_b[i] = under[rnd() % 16];
+  }
+}
+
+static void curCompositeMemo(size_t n, uint32_t *pOut) {
+  size_t i = 0;
+  pixel_memo_clear();
+  for(i = 0; i < n; i++) {
+    pOut[i] = pixel_composite_memo(m_in_a[i], m_in_b[i]);
+  }
+}
+
+/*
+ * Kernel: colorize
+ * ----------------
+ * 
+ * The input is an opaque color, as it is after compositing over white.
+ * One tint in eight is grayscale.
+ */
+
+static void genColorize(size_t n) {
+  
+  size_t i = 0;
+  uint32_t g = 0;
+  
+  for(i = 0; i < n; i++) {
+    m_in_a[i] = UINT32_C(0xff000000) | (rnd() & UINT32_C(0xffffff));
+    
+    if ((rnd() & 7) == 0) {
+      g = rnd() & 0xff;
+      m_in_b[i] = (g << 16) | (g << 8) | g;
+    } else {
+      m_in_b[i] = rnd() & UINT32_C(0xffffff);
+    }
+  }
+}
+
+static void curColorize(size_t n, uint32_t *pOut) {
+  size_t i = 0;
+  for(i = 0; i < n; i++) {
+    pOut[i] = pixel_colorize(m_in_a[i], m_in_b[i]);
+  }
+}
+
+static void refColorize(size_t n, uint32_t *pOut) {
+  size_t i = 0;
+  for(i = 0; i < n; i++) {
+    pOut[i] = kref_colorize(m_in_a[i], m_in_b[i]);
+  }
+}
+
+/*
+ * Exhaustive over every opaque input color, with a grayscale tint and
+ * three random tints.
+ */
+static uint64_t exColorize(uint64_t *pCount) {
+  
+  uint64_t mismatch = 0;
+  uint32_t tint = 0;
+  uint32_t v = 0;
+  uint32_t r_cur = 0;
+  uint32_t r_ref = 0;
+  int k = 0;
+  
+  *pCount = 0;
+  for(k = 0; k < 4; k++) {
+    if (k == 0) {
+      tint = UINT32_C(0x808080);
+    } else {
+      tint = rnd() & UINT32_C(0xffffff);
+    }
+    
+    for(v = 0; v < UINT32_C(0x1000000); v++) {
+      r_cur = pixel_colorize(UINT32_C(0xff000000) | v, tint);
+      r_ref = kref_colorize(UINT32_C(0xff000000) | v, tint);
+      if (r_cur != r_ref) {
+        if (mismatch < 1) {
+          fprintf(stderr,
+            "%s: colorize(%08lx, %06lx) is %08lx, expected %08lx\n",
+            pModule, (unsigned long) (UINT32_C(0xff000000) | v),
+            (unsigned long) tint,
+            (unsigned long) r_cur, (unsigned long) r_ref);
+        }
+        mismatch++;
+      }
+      (*pCount)++;
+    }
+  }
+  
+  return mismatch;
+}
+
+/*
+ * Kernel: colorize_memo
+ * ---------------------
+ * 
+ * The same as colorize, except that inputs and tints are drawn from
+ * small palettes.
+ */
+
+static void genColorizeMemo(size_t n) {
+  
+  size_t i = 0;
+  uint32_t in[256];
+  uint32_t tint[8];
+  
+  for(i = 0; i < 256; i++) {
+    in[i] = UINT32_C(0xff000000) | (rnd() & UINT32_C(0xffffff));
+  }
+  for(i = 0; i < 8; i++) {
+    tint[i] = rnd() & UINT32_C(0xffffff);
+  }
+  
+  for(i = 0; i < n; i++) {
+    m_in_a[i] = in[rnd() % 256];
+    m_in_b[i] = tint[rnd() % 8];
+  }
+}
+
+static void curColorizeMemo(size_t n, uint32_t *pOut) {
+  size_t i = 0;
+  pixel_memo_clear();
+  for(i = 0; i < n; i++) {
+    pOut[i] = pixel_colorize_memo(m_in_a[i], m_in_b[i]);
+  }
+}
+
+/*
+ * Kernel: gamma_undo
+ * ------------------
+ * 
+ * Inputs are mostly in range, with some outside to exercise clamping.
+ */
+
+static void genGammaUndo(size_t n) {
+  
+  size_t i = 0;
+  
+  for(i = 0; i < n; i++) {
+    m_in_a[i] = (uint32_t) (((int32_t) (rnd() % 288)) - 16);
+  }
+}
+
+static void curGammaUndo(size_t n, uint32_t *pOut) {
+  size_t i = 0;
+  for(i = 0; i < n; i++) {
+    pOut[i] = floatBits(gamma_undo((int) (int32_t) m_in_a[i]));
+  }
+}
+
+static void refGammaUndo(size_t n, uint32_t *pOut) {
+  size_t i = 0;
+  for(i = 0; i < n; i++) {
+    pOut[i] = floatBits(kref_gamma_undo((int) (int32_t) m_in_a[i]));
+  }
+}
+
+/*
+ * Exhaustive over a range much wider than the table.
+ */
+static uint64_t exGammaUndo(uint64_t *pCount) {
+  
+  uint64_t mismatch = 0;
+  int c = 0;
+  
+  *pCount = 0;
+  for(c = -65536; c <= 65536; c++) {
+    if (floatBits(gamma_undo(c)) != floatBits(kref_gamma_undo(c))) {
+      if (mismatch < 1) {
+        fprintf(stderr, "%s: gamma_undo(%d) is %.9g, expected %.9g\n",
+                  pModule, c, (double) gamma_undo(c),
+                  (double) kref_gamma_undo(c));
+      }
+      mismatch++;
+    }
+    (*pCount)++;
+  }
+  
+  return mismatch;
+}
+
+/*
+ * Kernel: gamma_correct
+ * ---------------------
+ * 
+ * Inputs are mostly linear values from the gamma table blended
+ * together, as compositing produces.  One in sixteen is a special
+ * value: zero, one, out of range, infinite, or not a number.
+ */
+
+static void genGammaCorrect(size_t n) {
+  
+  size_t i = 0;
+  float u = 0.0f;
+  float w = 0.0f;
+  
+  for(i = 0; i < n; i++) {
+    if ((rnd() & 15) == 0) {
+      switch (rnd() % 6) {
+        case 0:
+          m_in_f[i] = 0.0f;
+          break;
+        case 1:
+          m_in_f[i] = 1.0f;
+          break;
+        case 2:
+          m_in_f[i] = -((float) (rnd() & 0xffff)) / 65536.0f;
+          break;
+        case 3:
+          m_in_f[i] = 1.0f + ((float) (rnd() & 0xffff)) / 65536.0f;
+          break;
+        case 4:
+          m_in_f[i] = (float) INFINITY;
+          break;
+        default:
+          m_in_f[i] = (float) NAN;
+      }
+    
+    } else {
+      u = gamma_undo((int) (rnd() & 0xff));
+      w = ((float) (rnd() & 0xff)) / 255.0f;
+      m_in_f[i] = (u * w) + (gamma_undo((int) (rnd() & 0xff)) *
+                              (1.0f - w));
+    }
+  }
+}
+
+static void curGammaCorrect(size_t n, uint32_t *pOut) {
+  size_t i = 0;
+  for(i = 0; i < n; i++) {
+    pOut[i] = (uint32_t) gamma_correct(m_in_f[i]);
+  }
+}
+
+static void refGammaCorrect(size_t n, uint32_t *pOut) {
+  size_t i = 0;
+  for(i = 0; i < n; i++) {
+    pOut[i] = (uint32_t) kref_gamma_correct(m_in_f[i]);
+  }
+}
+
+/*
+ * Exhaustive over every float from zero up to and including one.
+ */
+static uint64_t exGammaCorrect(uint64_t *pCount) {
+  
+  uint64_t mismatch = 0;
+  uint32_t bits = 0;
+  float v = 0.0f;
+  
+  *pCount = 0;
+  for(bits = 0; bits <= UINT32_C(0x3f800000); bits++) {
+    memcpy(&v, &bits, sizeof(float));
+    if (gamma_correct(v) != kref_gamma_correct(v)) {
+      if (mismatch < 1) {
+        fprintf(stderr, "%s: gamma_correct(%.9g) is %d, expected %d\n",
+                  pModule, (double) v, gamma_correct(v),
+                  kref_gamma_correct(v));
+      }
+      mismatch++;
+    }
+    (*pCount)++;
+  }
+  
+  return mismatch;
+}
+
+/*
+ * Kernel: ttable_query
+ * --------------------
+ * 
+ * Queries come in runs of the same RGB index, as neighbouring pixels
+ * usually share a shading region.  Three runs in four are for indices
+ * in the table.
+ */
+
+static void genTtable(size_t n) {
+  
+  size_t i = 0;
+  uint32_t v = 0;
+  uint32_t run = 0;
+  
+  for(i = 0; i < n; i++) {
+    if (run < 1) {
+      if ((rnd() & 3) != 0) {
+        v = m_table_rgb[rnd() % TABLE_RECORDS];
+      } else {
+        v = rnd() & UINT32_C(0xffffff);
+      }
+      run = 1 + (rnd() % 64);
+    }
+    m_in_a[i] = v;
+    run--;
+  }
+}
+
+static void curTtable(size_t n, uint32_t *pOut) {
+  
+  size_t i = 0;
+  SHADEREC sr;
+  
+  memset(&sr, 0, sizeof(SHADEREC));
+  for(i = 0; i < n; i++) {
+    sr.rgbidx = (int32_t) m_in_a[i];
+    pOut[i * 5    ] = (uint32_t) ttable_query(&sr);
+    pOut[i * 5 + 1] = (uint32_t) sr.tidx;
+    pOut[i * 5 + 2] = (uint32_t) sr.srate;
+    pOut[i * 5 + 3] = (uint32_t) sr.drate;
+    pOut[i * 5 + 4] = sr.rgbtint;
+  }
+}
+
+static void refTtable(size_t n, uint32_t *pOut) {
+  
+  size_t i = 0;
+  SHADEREC sr;
+  
+  memset(&sr, 0, sizeof(SHADEREC));
+  for(i = 0; i < n; i++) {
+    sr.rgbidx = (int32_t) m_in_a[i];
+    pOut[i * 5    ] = (uint32_t) kref_ttable_query(&sr);
+    pOut[i * 5 + 1] = (uint32_t) sr.tidx;
+    pOut[i * 5 + 2] = (uint32_t) sr.srate;
+    pOut[i * 5 + 3] = (uint32_t) sr.drate;
+    pOut[i * 5 + 4] = sr.rgbtint;
+  }
+}
+
+/*
+ * Kernel: texture_pixel
+ * ---------------------
+ * 
+ * Coordinates scan across a virtual image in rendering order.
+ */
+
+static void genTexture(size_t n) {
+  
+  size_t i = 0;
+  
+  for(i = 0; i < n; i++) {
+    m_in_a[i] = (uint32_t) (i % SCAN_W);
+    m_in_b[i] = (uint32_t) (i / SCAN_W);
+  }
+}
+
+static void curTexture(size_t n, uint32_t *pOut) {
+  size_t i = 0;
+  for(i = 0; i < n; i++) {
+    pOut[i] = texture_pixel(
+                1, (int32_t) m_in_a[i], (int32_t) m_in_b[i]);
+  }
+}
+
+static void refTexture(size_t n, uint32_t *pOut) {
+  size_t i = 0;
+  for(i = 0; i < n; i++) {
+    pOut[i] = kref_texture_pixel(
+                (int32_t) m_in_a[i], (int32_t) m_in_b[i]);
+  }
+}
+
+/*
+ * Set up
+ * ------
+ */
+
+/*
+ * Write a random shading table to a temporary directory and load it
+ * into the texture table module.
+ * 
+ * This function handles reporting errors to stderr.  The table file is
+ * removed afterwards.
+ * 
+ * Parameters:
+ * 
+ *   pDir - the temporary directory
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int setupTable(const char *pDir) {
+  
+  int status = 1;
+  int i = 0;
+  int j = 0;
+  int errcode = 0;
+  int linenum = 0;
+  FILE *pf = NULL;
+  char path[MAX_PATH];
+  
+  /* Choose distinct RGB indices */
+  for(i = 0; i < TABLE_RECORDS; i++) {
+    do {
+      m_table_rgb[i] = rnd() & UINT32_C(0xffffff);
+      for(j = 0; j < i; j++) {
+        if (m_table_rgb[j] == m_table_rgb[i]) {
+          break;
+        }
+      }
+    } while (j < i);
+  }
+  
+  /* Write the table */
+  snprintf(path, MAX_PATH, "%s/table.txt", pDir);
+  pf = fopen(path, "w");
+  if (pf == NULL) {
+    fprintf(stderr, "%s: Can't write '%s'!\n", pModule, path);
+    status = 0;
+  }
+  
+  if (status) {
+    for(i = 0; i < TABLE_RECORDS; i++) {
+      fprintf(pf, "%06lx %d %d %d",
+        (unsigned long) m_table_rgb[i],
+        (int) (1 + (rnd() & 1)),
+        (int) (rnd() & 0xff),
+        (int) (rnd() & 0xff));
+      if (rnd() & 1) {
+        fprintf(pf, " %06lx", (unsigned long) (rnd() & 0xffffff));
+      }
+      fprintf(pf, "\n");
+    }
+    if (fclose(pf)) {
+      fprintf(stderr, "%s: Error writing '%s'!\n", pModule, path);
+      status = 0;
+    }
+    pf = NULL;
+  }
+  
+  /* Load the table */
+  if (status) {
+    if (!ttable_parse(path, &errcode, &linenum, 2)) {
+      fprintf(stderr, "%s: Can't load table: %s!\n",
+                pModule, ttable_errorString(errcode));
+      status = 0;
+    }
+  }
+  
+  /* Remove the file */
+  unlink(path);
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Write a random texture to a temporary directory and load it with the
+ * texture module.
+ * 
+ * The texture is also read back into m_tex for the reference kernel,
+ * so the reference sees exactly the pixels that the texture module
+ * loaded.
+ * 
+ * This function handles reporting errors to stderr.  The texture file
+ * is removed afterwards.
+ * 
+ * Parameters:
+ * 
+ *   pDir - the temporary directory
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int setupTexture(const char *pDir) {
+  
+  int status = 1;
+  int errcode = 0;
+  int32_t x = 0;
+  int32_t y = 0;
+  uint32_t *pScan = NULL;
+  SPH_IMAGE_WRITER *pw = NULL;
+  SPH_IMAGE_READER *pr = NULL;
+  char path[MAX_PATH];
+  
+  /* Write the texture */
+  snprintf(path, MAX_PATH, "%s/texture.png", pDir);
+  pw = sph_image_writer_newFromPath(
+          path, TEX_W, TEX_H, SPH_IMAGE_DOWN_NONE, 0, &errcode);
+  if (pw == NULL) {
+    fprintf(stderr, "%s: Can't write '%s': %s!\n",
+              pModule, path, sph_image_errorString(errcode));
+    status = 0;
+  }
+  
+  if (status) {
+    pScan = sph_image_writer_ptr(pw);
+    for(y = 0; y < TEX_H; y++) {
+      for(x = 0; x < TEX_W; x++) {
+        pScan[x] = genARGB();
+      }
+      sph_image_writer_write(pw);
+    }
+  }
+  sph_image_writer_close(pw);
+  pw = NULL;
+  
+  /* Read it back for the reference */
+  if (status) {
+    pr = sph_image_reader_newFromPath(path, &errcode);
+    if (pr == NULL) {
+      fprintf(stderr, "%s: Can't read '%s': %s!\n",
+                pModule, path, sph_image_errorString(errcode));
+      status = 0;
+    }
+  }
+  
+  for(y = 0; status && (y < TEX_H); y++) {
+    pScan = sph_image_reader_read(pr, &errcode);
+    if (pScan == NULL) {
+      fprintf(stderr, "%s: Can't read '%s': %s!\n",
+                pModule, path, sph_image_errorString(errcode));
+      status = 0;
+    }
+    if (status) {
+      memcpy(&(m_tex[y * TEX_W]), pScan, TEX_W * sizeof(uint32_t));
+    }
+  }
+  sph_image_reader_close(pr);
+  pr = NULL;
+  
+  if (status) {
+    kref_texture_set(m_tex, TEX_W, TEX_H);
+  }
+  
+  /* Load it into the texture module */
+  if (status) {
+    if (!texture_load(path, &errcode)) {
+      fprintf(stderr, "%s: Can't load texture: %s!\n",
+                pModule, sph_image_errorString(errcode));
+      status = 0;
+    }
+  }
+  
+  /* Remove the file */
+  unlink(path);
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Benchmark and check one kernel.
+ * 
+ * This function writes the result line to stdout and reports
+ * mismatches to stderr.
+ * 
+ * Parameters:
+ * 
+ *   pk - the kernel
+ * 
+ *   n - the number of sampled inputs
+ * 
+ *   reps - the number of timed repetitions
+ * 
+ *   ex - non-zero to run the exhaustive check, if there is one
+ * 
+ * Return:
+ * 
+ *   non-zero if no mismatches, zero if there were mismatches
+ */
+static int runKernel(const KERNEL *pk, size_t n, int reps, int ex) {
+  
+  int status = 1;
+  int r = 0;
+  int w = 0;
+  size_t i = 0;
+  uint64_t mismatch = 0;
+  uint64_t ex_count = 0;
+  uint64_t ex_mismatch = 0;
+  double t = 0.0;
+  double t_cur = -1.0;
+  double t_ref = -1.0;
+  
+  /* Check parameters */
+  if ((pk == NULL) || (n < 1) || (reps < 1)) {
+    abort();
+  }
+  
+  /* Generate inputs */
+  pk->fGen(n);
+  
+  /* Time each version, keeping the fastest repetition */
+  for(r = 0; r < reps; r++) {
+    t = wallclock();
+    pk->fCur(n, m_out_cur);
+    t = wallclock() - t;
+    if ((t_cur < 0.0) || (t < t_cur)) {
+      t_cur = t;
+    }
+    
+    t = wallclock();
+    pk->fRef(n, m_out_ref);
+    t = wallclock() - t;
+    if ((t_ref < 0.0) || (t < t_ref)) {
+      t_ref = t;
+    }
+  }
+  
+  /* Compare outputs */
+  for(i = 0; i < n; i++) {
+    for(w = 0; w < pk->words; w++) {
+      if (m_out_cur[i * pk->words + w] !=
+            m_out_ref[i * pk->words + w]) {
+        break;
+      }
+    }
+    if (w < pk->words) {
+      if (mismatch < 1) {
+        fprintf(stderr, "%s: %s mismatch on sample %lu "
+                  "(inputs %08lx %08lx %08lx), word %d is %08lx, "
+                  "expected %08lx\n",
+                  pModule, pk->pName, (unsigned long) i,
+                  (unsigned long) m_in_a[i],
+                  (unsigned long) m_in_b[i],
+                  (unsigned long) floatBits(m_in_f[i]), w,
+                  (unsigned long) m_out_cur[i * pk->words + w],
+                  (unsigned long) m_out_ref[i * pk->words + w]);
+      }
+      mismatch++;
+    }
+  }
+  
+  /* Run the exhaustive check if requested */
+  if (ex && (pk->fExhaustive != NULL)) {
+    ex_mismatch = pk->fExhaustive(&ex_count);
+  }
+  
+  /* Report */
+  printf("%-14s %10.3f ns %10.3f ns %7.2fx  %lu/%lu sampled",
+    pk->pName,
+    t_cur * 1.0e9 / ((double) n),
+    t_ref * 1.0e9 / ((double) n),
+    (t_cur > 0.0) ? (t_ref / t_cur) : 0.0,
+    (unsigned long) mismatch, (unsigned long) n);
+  if (ex && (pk->fExhaustive != NULL)) {
+    printf("  %llu/%llu exhaustive",
+      (unsigned long long) ex_mismatch, (unsigned long long) ex_count);
+  }
+  printf("\n");
+  fflush(stdout);
+  
+  if ((mismatch > 0) || (ex_mismatch > 0)) {
+    status = 0;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Program entrypoint
+ * ------------------
+ */
+
+int main(int argc, char *argv[]) {
+  
+  int status = 1;
+  int x = 0;
+  int i = 0;
+  int argi = 0;
+  int ex = 0;
+  int reps = 5;
+  int found = 0;
+  long samples = 1000000;
+  unsigned long seed = 1;
+  char tmpdir[MAX_PATH];
+  
+  /* Get module name */
+  pModule = NULL;
+  if ((argc > 0) && (argv != NULL)) {
+    pModule = argv[0];
+  }
+  if (pModule == NULL) {
+    pModule = "lilac_kbench";
+  }
+  
+  /* Check argv */
+  if (argc > 0) {
+    if (argv == NULL) {
+      abort();
+    }
+    for(x = 0; x < argc; x++) {
+      if (argv[x] == NULL) {
+        abort();
+      }
+    }
+  }
+  
+  /* Parse options */
+  for(argi = 1; status && (argi < argc); argi++) {
+    if (strncmp(argv[argi], "--", 2) != 0) {
+      break;
+    }
+    
+    if (strcmp(argv[argi], "--exhaustive") == 0) {
+      ex = 1;
+    
+    } else if ((strcmp(argv[argi], "--samples") == 0) &&
+                (argi + 1 < argc)) {
+      argi++;
+      samples = strtol(argv[argi], NULL, 10);
+      if ((samples < 1) || (samples > 100000000L)) {
+        fprintf(stderr, "%s: Invalid sample count!\n", pModule);
+        status = 0;
+      }
+    
+    } else if ((strcmp(argv[argi], "--reps") == 0) &&
+                (argi + 1 < argc)) {
+      argi++;
+      reps = atoi(argv[argi]);
+      if (reps < 1) {
+        fprintf(stderr, "%s: Invalid repetition count!\n", pModule);
+        status = 0;
+      }
+    
+    } else if ((strcmp(argv[argi], "--seed") == 0) &&
+                (argi + 1 < argc)) {
+      argi++;
+      seed = strtoul(argv[argi], NULL, 10);
+    
+    } else {
+      fprintf(stderr, "%s: Unrecognized option '%s'!\n",
+                pModule, argv[argi]);
+      status = 0;
+    }
+  }
+  
+  /* Check kernel names */
+  for(x = argi; status && (x < argc); x++) {
+    for(i = 0; m_kernels[i].pName != NULL; i++) {
+      if (strcmp(argv[x], m_kernels[i].pName) == 0) {
+        break;
+      }
+    }
+    if (m_kernels[i].pName == NULL) {
+      fprintf(stderr, "%s: Unknown kernel '%s'!\n", pModule, argv[x]);
+      status = 0;
+    }
+  }
+  
+  /* Seed the generator; the state must never be zero */
+  m_rand = (((uint64_t) seed) << 1) | 1;
+  
+  /* Allocate buffers */
+  if (status) {
+    m_in_a = (uint32_t *) calloc((size_t) samples, sizeof(uint32_t));
+    m_in_b = (uint32_t *) calloc((size_t) samples, sizeof(uint32_t));
+    m_in_f = (float *) calloc((size_t) samples, sizeof(float));
+    m_out_cur = (uint32_t *) calloc(
+                  (size_t) samples * MAX_WORDS, sizeof(uint32_t));
+    m_out_ref = (uint32_t *) calloc(
+                  (size_t) samples * MAX_WORDS, sizeof(uint32_t));
+    if ((m_in_a == NULL) || (m_in_b == NULL) || (m_in_f == NULL) ||
+        (m_out_cur == NULL) || (m_out_ref == NULL)) {
+      fprintf(stderr, "%s: Out of memory!\n", pModule);
+      status = 0;
+    }
+  }
+  
+  /* Initialize the gamma tables */
+  if (status) {
+    gamma_sRGB();
+    kref_gamma_sRGB();
+  }
+  
+  /* Set up the shading table and the texture in a temporary
+   * directory */
+  if (status) {
+    strcpy(tmpdir, "/tmp/lilac_kbench_XXXXXX");
+    if (mkdtemp(tmpdir) == NULL) {
+      fprintf(stderr, "%s: Can't create temporary directory!\n",
+                pModule);
+      status = 0;
+    }
+    if (status) {
+      if (!(setupTable(tmpdir) && setupTexture(tmpdir))) {
+        status = 0;
+      }
+      rmdir(tmpdir);
+    }
+  }
+  
+  /* Run the kernels */
+  if (status) {
+    printf("%-14s %13s %13s %8s  %s\n",
+      "kernel", "current", "reference", "speedup", "mismatches");
+    for(i = 0; m_kernels[i].pName != NULL; i++) {
+      found = (argi >= argc);
+      for(x = argi; x < argc; x++) {
+        if (strcmp(argv[x], m_kernels[i].pName) == 0) {
+          found = 1;
+        }
+      }
+      if (found) {
+        if (!runKernel(&(m_kernels[i]), (size_t) samples, reps, ex)) {
+          status = 0;
+        }
+      }
+    }
+  }
+  
+  /* Invert status and return */
+  if (status) {
+    status = 0;
+  } else {
+    status = 1;
+  }
+  return status;
+}
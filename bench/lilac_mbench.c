@@ -0,0 +1,485 @@
+/*
+ * lilac_mbench.c
+ * ==============
+ * 
+ * Parse throughput benchmark for Shastina mesh files.
+ * 
+ * Syntax
+ * ------
+ * 
+ *   lilac_mbench [options]
+ * 
+ * The options are:
+ * 
+ *   --grid N - the number of points along each side of the generated
+ *   mesh, default 512, in range 2 to 725
+ * 
+ *   --reps N - the number of timed repetitions, default 5; the fastest
+ *   repetition is reported
+ * 
+ *   --seed N - the seed for generating normals, default 1
+ * 
+ * Operation
+ * ---------
+ * 
+ * A mesh file is generated in memory.  The mesh is a square grid of
+ * points covering the whole coordinate range, with each grid cell
+ * split into two triangles, and with pseudo-random normals at each
+ * point.  The largest grid is close to the limit on the number of
+ * triangles.
+ * 
+ * The generated file is then read both with lilac_mesh_parse(), which
+ * normally takes the fast path, and with lilac_mesh_new() through a
+ * Shastina source on a memory stream.  Both are timed, and the two
+ * resulting meshes are compared.
+ * 
+ * One line is written to standard output for each method, giving the
+ * milliseconds to read the file and the throughput in megabytes per
+ * second, and then a line giving the speedup.  The exit status is
+ * non-zero if either method failed or the meshes differ.
+ * 
+ * Compilation
+ * -----------
+ * 
+ * Build this program together with the lilac_mesh.c module of Lilac and
+ * Shastina.  See the README in this directory for details.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lilac_mesh.h"
+#include "shastina.h"
+
+/*
+ * Constants
+ * ---------
+ */
+
+/*
+ * The largest grid size, which keeps the triangle count within
+ * LILAC_MESH_MAX_TRIS.
+ */
+#define MAX_GRID (725)
+
+/*
+ * The longest line written by the generator, including the line feed.
+ */
+#define MAX_LINE (64)
+
+/*
+ * Local data
+ * ----------
+ */
+
+/*
+ * The name of this executable module.
+ * 
+ * This is set at the start of the program entrypoint.  It should be
+ * included in error reports from the program.
+ */
+static const char *pModule = NULL;
+
+/*
+ * The state of the pseudo-random generator.
+ */
+static uint64_t m_rand = 0;
+
+/*
+ * Local functions
+ * ---------------
+ */
+
+/* Prototypes */
+static uint32_t rnd(void);
+static double wallclock(void);
+static char *genMesh(int32_t grid, size_t *pLen);
+static LILAC_MESH *readShastina(const char *pBuf, size_t len);
+static int sameMesh(const LILAC_MESH *pA, const LILAC_MESH *pB);
+
+/*
+ * Generate a pseudo-random value.
+ * 
+ * This is the xorshift64* generator.
+ * 
+ * Return:
+ * 
+ *   the next 32-bit pseudo-random value
+ */
+static uint32_t rnd(void) {
+  m_rand ^= m_rand >> 12;
+  m_rand ^= m_rand << 25;
+  m_rand ^= m_rand >> 27;
+  return (uint32_t) ((m_rand * UINT64_C(0x2545F4914F6CDD1D)) >> 32);
+}
+
+/*
+ * Read the monotonic wall clock.
+ * 
+ * Return:
+ * 
+ *   the current time in seconds relative to an arbitrary epoch, or
+ *   zero if the clock could not be read
+ */
+static double wallclock(void) {
+  
+  double result = 0.0;
+  struct timespec ts;
+  
+  /* Initialize structures */
+  memset(&ts, 0, sizeof(struct timespec));
+  
+  /* Read the clock */
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+    result = ((double) ts.tv_sec) + (((double) ts.tv_nsec) / 1.0e9);
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * Generate a grid mesh file in memory.
+ * 
+ * The points are written in row-major order.  Each grid cell with
+ * lower-left point a, lower-right point b, upper-left point c, and
+ * upper-right point d becomes the triangles (a, b, d) and (a, d, c),
+ * which are in counter-clockwise order, and writing the cells in
+ * row-major order keeps the triangles sorted.
+ * 
+ * Parameters:
+ * 
+ *   grid - the number of points along each side, in range 2 to
+ *   MAX_GRID
+ * 
+ *   pLen - receives the length of the file in bytes
+ * 
+ * Return:
+ * 
+ *   the dynamically allocated file, which is not nul-terminated
+ */
+static char *genMesh(int32_t grid, size_t *pLen) {
+  
+  char *pBuf = NULL;
+  size_t cap = 0;
+  size_t len = 0;
+  int32_t step = 0;
+  int32_t x = 0;
+  int32_t y = 0;
+  int32_t a = 0;
+  int32_t normd = 0;
+  int32_t norma = 0;
+  
+  /* Check parameters */
+  if ((grid < 2) || (grid > MAX_GRID) || (pLen == NULL)) {
+    abort();
+  }
+  
+  /* Allocate room for the header, every point, every triangle, and
+   * the end marker */
+  cap = ((size_t) grid) * ((size_t) grid) * 3 * MAX_LINE;
+  pBuf = (char *) malloc(cap);
+  if (pBuf == NULL) {
+    abort();
+  }
+  
+  /* Write the header */
+  len += (size_t) sprintf(pBuf + len, "%%lilac-mesh;\n%%dim %ld %ld;\n",
+                    (long) grid * (long) grid,
+                    2L * (long) (grid - 1) * (long) (grid - 1));
+  
+  /* Write the points */
+  step = LILAC_MESH_MAX_C / (grid - 1);
+  for(y = 0; y < grid; y++) {
+    for(x = 0; x < grid; x++) {
+      normd = (int32_t) (rnd() % (LILAC_MESH_MAX_C + 1));
+      norma = 0;
+      if (normd > 0) {
+        norma = (int32_t) (rnd() % LILAC_MESH_MAX_C);
+      }
+      len += (size_t) sprintf(pBuf + len, "%ld %ld %ld %ld p\n",
+                        (long) normd, (long) norma,
+                        (long) (x * step), (long) (y * step));
+    }
+  }
+  
+  /* Write the triangles */
+  for(y = 0; y < grid - 1; y++) {
+    for(x = 0; x < grid - 1; x++) {
+      a = (y * grid) + x;
+      len += (size_t) sprintf(pBuf + len, "%ld %ld %ld t\n",
+                        (long) a, (long) (a + 1),
+                        (long) (a + grid + 1));
+      len += (size_t) sprintf(pBuf + len, "%ld %ld %ld t\n",
+                        (long) a, (long) (a + grid + 1),
+                        (long) (a + grid));
+    }
+  }
+  
+  /* Write the end marker */
+  len += (size_t) sprintf(pBuf + len, "|;\n");
+  
+  *pLen = len;
+  return pBuf;
+}
+
+/*
+ * Read a mesh file in memory with lilac_mesh_new() through a Shastina
+ * source on a memory stream.
+ * 
+ * Errors are reported to standard error.
+ * 
+ * Parameters:
+ * 
+ *   pBuf - the mesh file
+ * 
+ *   len - the length of the file in bytes
+ * 
+ * Return:
+ * 
+ *   the mesh, or NULL if error
+ */
+static LILAC_MESH *readShastina(const char *pBuf, size_t len) {
+  
+  int errcode = 0;
+  long line_num = 0;
+  FILE *pf = NULL;
+  SNSOURCE *pSrc = NULL;
+  LILAC_MESH *pMesh = NULL;
+  
+  /* Check parameters */
+  if ((pBuf == NULL) || (len < 1)) {
+    abort();
+  }
+  
+  /* Open the buffer as a Shastina source */
+  pf = fmemopen((void *) pBuf, len, "r");
+  if (pf == NULL) {
+    fprintf(stderr, "%s: Can't open memory stream!\n", pModule);
+  }
+  
+  /* Interpret the mesh */
+  if (pf != NULL) {
+    pSrc = snsource_file(pf, 1);
+    pf = NULL;
+    
+    pMesh = lilac_mesh_new(pSrc, &errcode, &line_num);
+    if (pMesh == NULL) {
+      fprintf(stderr, "%s: [line %ld] %s!\n",
+                pModule, line_num, lilac_mesh_errstr(errcode));
+    }
+    
+    snsource_free(pSrc);
+    pSrc = NULL;
+  }
+  
+  return pMesh;
+}
+
+/*
+ * Check whether two meshes are the same.
+ * 
+ * Parameters:
+ * 
+ *   pA - the first mesh
+ * 
+ *   pB - the second mesh
+ * 
+ * Return:
+ * 
+ *   non-zero if the meshes have the same points and triangles, zero
+ *   otherwise
+ */
+static int sameMesh(const LILAC_MESH *pA, const LILAC_MESH *pB) {
+  
+  int result = 1;
+  
+  /* Check parameters */
+  if ((pA == NULL) || (pB == NULL)) {
+    abort();
+  }
+  
+  if ((pA->point_count != pB->point_count) ||
+      (pA->tri_count != pB->tri_count)) {
+    result = 0;
+  }
+  
+  if (result && (pA->point_count > 0)) {
+    if (memcmp(pA->pPoints, pB->pPoints,
+          ((size_t) pA->point_count) * sizeof(LILAC_MESH_POINT)) != 0) {
+      result = 0;
+    }
+  }
+  
+  if (result && (pA->tri_count > 0)) {
+    if (memcmp(pA->pTris, pB->pTris,
+          ((size_t) pA->tri_count) * 3 * sizeof(uint32_t)) != 0) {
+      result = 0;
+    }
+  }
+  
+  return result;
+}
+
+/*
+ * Program entrypoint
+ * ------------------
+ */
+
+int main(int argc, char *argv[]) {
+  
+  int status = 1;
+  int x = 0;
+  int argi = 0;
+  int r = 0;
+  int reps = 5;
+  int errcode = 0;
+  long line_num = 0;
+  long grid = 512;
+  unsigned long seed = 1;
+  
+  char *pBuf = NULL;
+  size_t len = 0;
+  
+  double t = 0.0;
+  double t_fast = 0.0;
+  double t_sn = 0.0;
+  
+  LILAC_MESH *pFast = NULL;
+  LILAC_MESH *pSn = NULL;
+  
+  /* Get module name */
+  pModule = NULL;
+  if ((argc > 0) && (argv != NULL)) {
+    pModule = argv[0];
+  }
+  if (pModule == NULL) {
+    pModule = "lilac_mbench";
+  }
+  
+  /* Check argv */
+  if (argc > 0) {
+    if (argv == NULL) {
+      abort();
+    }
+    for(x = 0; x < argc; x++) {
+      if (argv[x] == NULL) {
+        abort();
+      }
+    }
+  }
+  
+  /* Parse options */
+  for(argi = 1; status && (argi < argc); argi++) {
+    if ((strcmp(argv[argi], "--grid") == 0) && (argi + 1 < argc)) {
+      argi++;
+      grid = strtol(argv[argi], NULL, 10);
+      if ((grid < 2) || (grid > MAX_GRID)) {
+        fprintf(stderr, "%s: Invalid grid size!\n", pModule);
+        status = 0;
+      }
+    
+    } else if ((strcmp(argv[argi], "--reps") == 0) &&
+                (argi + 1 < argc)) {
+      argi++;
+      reps = atoi(argv[argi]);
+      if (reps < 1) {
+        fprintf(stderr, "%s: Invalid repetition count!\n", pModule);
+        status = 0;
+      }
+    
+    } else if ((strcmp(argv[argi], "--seed") == 0) &&
+                (argi + 1 < argc)) {
+      argi++;
+      seed = strtoul(argv[argi], NULL, 10);
+    
+    } else {
+      fprintf(stderr, "%s: Unrecognized option '%s'!\n",
+                pModule, argv[argi]);
+      status = 0;
+    }
+  }
+  
+  /* Seed the generator; the state must never be zero */
+  m_rand = (((uint64_t) seed) << 1) | 1;
+  
+  /* Generate the mesh file */
+  if (status) {
+    pBuf = genMesh((int32_t) grid, &len);
+  }
+  
+  /* Time both methods, keeping the last mesh from each */
+  for(r = 0; status && (r < reps); r++) {
+    lilac_mesh_free(pFast);
+    pFast = NULL;
+    
+    t = wallclock();
+    pFast = lilac_mesh_parse(pBuf, len, &errcode, &line_num);
+    t = wallclock() - t;
+    if (pFast == NULL) {
+      fprintf(stderr, "%s: [line %ld] %s!\n",
+                pModule, line_num, lilac_mesh_errstr(errcode));
+      status = 0;
+    } else if ((r == 0) || (t < t_fast)) {
+      t_fast = t;
+    }
+    
+    lilac_mesh_free(pSn);
+    pSn = NULL;
+    
+    if (status) {
+      t = wallclock();
+      pSn = readShastina(pBuf, len);
+      t = wallclock() - t;
+      if (pSn == NULL) {
+        status = 0;
+      } else if ((r == 0) || (t < t_sn)) {
+        t_sn = t;
+      }
+    }
+  }
+  
+  /* Compare the meshes */
+  if (status) {
+    if (!sameMesh(pFast, pSn)) {
+      fprintf(stderr, "%s: Meshes differ!\n", pModule);
+      status = 0;
+    }
+  }
+  
+  /* Report the results */
+  if (status) {
+    printf("mesh: %ld points, %ld triangles, %.1f MB\n",
+            (long) pFast->point_count, (long) pFast->tri_count,
+            ((double) len) / 1.0e6);
+    printf("%-10s %10.2f ms %10.1f MB/s\n", "parse",
+            t_fast * 1.0e3, ((double) len) / (t_fast * 1.0e6));
+    printf("%-10s %10.2f ms %10.1f MB/s\n", "shastina",
+            t_sn * 1.0e3, ((double) len) / (t_sn * 1.0e6));
+    printf("speedup: %.2fx\n", t_sn / t_fast);
+  }
+  
+  /* Release everything */
+  lilac_mesh_free(pFast);
+  pFast = NULL;
+  
+  lilac_mesh_free(pSn);
+  pSn = NULL;
+  
+  free(pBuf);
+  pBuf = NULL;
+  
+  /* Invert status and return */
+  if (status) {
+    status = 0;
+  } else {
+    status = 1;
+  }
+  return status;
+}
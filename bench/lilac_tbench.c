@@ -0,0 +1,466 @@
+/*
+ * lilac_tbench.c
+ * ==============
+ * 
+ * Load time benchmark for shading table files.
+ * 
+ * Syntax
+ * ------
+ * 
+ *   lilac_tbench [options]
+ * 
+ * The options are:
+ * 
+ *   --records N - the number of records in the generated table,
+ *   default 400000, in range 1 to 16777216
+ * 
+ *   --reps N - the number of timed repetitions, default 5; the fastest
+ *   repetition is reported
+ * 
+ *   --seed N - the seed for generating the records, default 1
+ * 
+ * Operation
+ * ---------
+ * 
+ * A shading table file is generated in a temporary file.  The records
+ * have distinct pseudo-random RGB indices in no particular order, with
+ * random texture indices, rates, and tints, and a comment line every
+ * 64 records, so that the file has the same shape as generated tables.
+ * A table of 400000 records is about 8 megabytes.
+ * 
+ * The file is then parsed with ttable_parse().  Since records can't be
+ * removed from the texture table, each repetition runs in a child
+ * process, which checks that every record was added and reports its
+ * time through a pipe.
+ * 
+ * The size of the table is written to standard output, and then a line
+ * giving the milliseconds to parse the file, the throughput in
+ * megabytes per second, and the records per second.  The exit status
+ * is non-zero if parsing failed.
+ * 
+ * The benchmark only uses ttable_parse(), so it can be built against
+ * the ttable.c module from before and after a change to compare them.
+ * 
+ * Compilation
+ * -----------
+ * 
+ * Build this program together with the ttable.c module of Lilac and
+ * the modules it depends on.  See the README in this directory for
+ * details.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ttable.h"
+
+/*
+ * Constants
+ * ---------
+ */
+
+/*
+ * The largest number of records, which is one for every RGB index.
+ */
+#define MAX_RECORDS (16777216L)
+
+/*
+ * The number of textures that generated records select from.
+ */
+#define TEX_COUNT (16)
+
+/*
+ * The number of records between comment lines.
+ */
+#define COMMENT_EVERY (64)
+
+/*
+ * Local data
+ * ----------
+ */
+
+/*
+ * The name of this executable module.
+ * 
+ * This is set at the start of the program entrypoint.  It should be
+ * included in error reports from the program.
+ */
+static const char *pModule = NULL;
+
+/*
+ * The state of the pseudo-random generator.
+ */
+static uint64_t m_rand = 0;
+
+/*
+ * Local functions
+ * ---------------
+ */
+
+/* Prototypes */
+static uint32_t rnd(void);
+static double wallclock(void);
+static int genTable(FILE *pf, int32_t records);
+static int timeParse(const char *pPath, int32_t records, double *pt);
+
+/*
+ * Generate a pseudo-random value.
+ * 
+ * This is the xorshift64* generator.
+ * 
+ * Return:
+ * 
+ *   the next 32-bit pseudo-random value
+ */
+static uint32_t rnd(void) {
+  m_rand ^= m_rand >> 12;
+  m_rand ^= m_rand << 25;
+  m_rand ^= m_rand >> 27;
+  return (uint32_t) ((m_rand * UINT64_C(0x2545F4914F6CDD1D)) >> 32);
+}
+
+/*
+ * Read the monotonic wall clock.
+ * 
+ * Return:
+ * 
+ *   the current time in seconds relative to an arbitrary epoch, or
+ *   zero if the clock could not be read
+ */
+static double wallclock(void) {
+  
+  double result = 0.0;
+  struct timespec ts;
+  
+  /* Initialize structures */
+  memset(&ts, 0, sizeof(struct timespec));
+  
+  /* Read the clock */
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+    result = ((double) ts.tv_sec) + (((double) ts.tv_nsec) / 1.0e9);
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * Write a generated shading table to a file.
+ * 
+ * The RGB index of record i is i times an odd multiplier plus a random
+ * offset, modulo 2^24, so the indices are distinct and scattered.
+ * Half of the records have a tint.
+ * 
+ * Parameters:
+ * 
+ *   pf - the file to write
+ * 
+ *   records - the number of records, in range 1 to MAX_RECORDS
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if a write failed
+ */
+static int genTable(FILE *pf, int32_t records) {
+  
+  int32_t i = 0;
+  uint32_t offset = 0;
+  uint32_t rgb = 0;
+  
+  /* Check parameters */
+  if ((pf == NULL) || (records < 1) || (records > MAX_RECORDS)) {
+    abort();
+  }
+  
+  offset = rnd();
+  for(i = 0; i < records; i++) {
+    if ((i % COMMENT_EVERY) == 0) {
+      fprintf(pf, "# Records %ld and up\n", (long) i);
+    }
+    
+    rgb = ((((uint32_t) i) * UINT32_C(0x9e3779)) + offset) &
+            UINT32_C(0xffffff);
+    fprintf(pf, "%06lx %ld %ld %ld",
+              (unsigned long) rgb,
+              (long) ((rnd() % TEX_COUNT) + 1),
+              (long) (rnd() % 256),
+              (long) (rnd() % 256));
+    if (rnd() & 1) {
+      fprintf(pf, " %06lx", (unsigned long) (rnd() & 0xffffff));
+    }
+    fprintf(pf, "\n");
+  }
+  
+  return (ferror(pf) || fflush(pf)) ? 0 : 1;
+}
+
+/*
+ * Time one parse of a table file in a child process.
+ * 
+ * Errors are reported to standard error.
+ * 
+ * Parameters:
+ * 
+ *   pPath - the path to the table file
+ * 
+ *   records - the number of records the table should have
+ * 
+ *   pt - receives the time to parse the file, in seconds
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int timeParse(const char *pPath, int32_t records, double *pt) {
+  
+  int status = 1;
+  int errcode = 0;
+  int line_num = 0;
+  int wstatus = 0;
+  int fd[2];
+  pid_t pid = 0;
+  double t = 0.0;
+  
+  /* Initialize arrays */
+  fd[0] = -1;
+  fd[1] = -1;
+  
+  /* Check parameters */
+  if ((pPath == NULL) || (pt == NULL)) {
+    abort();
+  }
+  
+  /* Start the child with a pipe to report its time */
+  if (pipe(fd)) {
+    fprintf(stderr, "%s: Can't create pipe!\n", pModule);
+    status = 0;
+  }
+  
+  if (status) {
+    fflush(stdout);
+    fflush(stderr);
+    pid = fork();
+    if (pid < 0) {
+      fprintf(stderr, "%s: Can't start child process!\n", pModule);
+      status = 0;
+    }
+  }
+  
+  /* In the child, parse the table and write the time to the pipe */
+  if (status && (pid == 0)) {
+    close(fd[0]);
+    
+    t = wallclock();
+    if (!ttable_parse(pPath, &errcode, &line_num, TEX_COUNT)) {
+      fprintf(stderr, "%s: [line %d] %s!\n",
+                pModule, line_num, ttable_errorString(errcode));
+      _exit(1);
+    }
+    t = wallclock() - t;
+    
+    if (ttable_count() != records) {
+      fprintf(stderr, "%s: Table has %ld records instead of %ld!\n",
+                pModule, (long) ttable_count(), (long) records);
+      _exit(1);
+    }
+    
+    if (write(fd[1], &t, sizeof(double)) != (ssize_t) sizeof(double)) {
+      _exit(1);
+    }
+    _exit(0);
+  }
+  
+  /* In the parent, read the time and wait for the child */
+  if (fd[1] >= 0) {
+    close(fd[1]);
+    fd[1] = -1;
+  }
+  
+  if (status) {
+    if (read(fd[0], &t, sizeof(double)) != (ssize_t) sizeof(double)) {
+      status = 0;
+    }
+    if (waitpid(pid, &wstatus, 0) != pid) {
+      status = 0;
+    } else if ((!WIFEXITED(wstatus)) || (WEXITSTATUS(wstatus) != 0)) {
+      status = 0;
+    }
+    if (!status) {
+      fprintf(stderr, "%s: Parsing failed!\n", pModule);
+    }
+  }
+  
+  if (fd[0] >= 0) {
+    close(fd[0]);
+    fd[0] = -1;
+  }
+  
+  if (status) {
+    *pt = t;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Program entrypoint
+ * ------------------
+ */
+
+int main(int argc, char *argv[]) {
+  
+  int status = 1;
+  int x = 0;
+  int argi = 0;
+  int r = 0;
+  int reps = 5;
+  int fd = -1;
+  long records = 400000;
+  unsigned long seed = 1;
+  
+  FILE *pf = NULL;
+  long len = 0;
+  char path[64];
+  
+  double t = 0.0;
+  double t_best = 0.0;
+  
+  /* Initialize buffer */
+  memset(path, 0, sizeof(path));
+  
+  /* Get module name */
+  pModule = NULL;
+  if ((argc > 0) && (argv != NULL)) {
+    pModule = argv[0];
+  }
+  if (pModule == NULL) {
+    pModule = "lilac_tbench";
+  }
+  
+  /* Check argv */
+  if (argc > 0) {
+    if (argv == NULL) {
+      abort();
+    }
+    for(x = 0; x < argc; x++) {
+      if (argv[x] == NULL) {
+        abort();
+      }
+    }
+  }
+  
+  /* Parse options */
+  for(argi = 1; status && (argi < argc); argi++) {
+    if ((strcmp(argv[argi], "--records") == 0) && (argi + 1 < argc)) {
+      argi++;
+      records = strtol(argv[argi], NULL, 10);
+      if ((records < 1) || (records > MAX_RECORDS)) {
+        fprintf(stderr, "%s: Invalid record count!\n", pModule);
+        status = 0;
+      }
+    
+    } else if ((strcmp(argv[argi], "--reps") == 0) &&
+                (argi + 1 < argc)) {
+      argi++;
+      reps = atoi(argv[argi]);
+      if (reps < 1) {
+        fprintf(stderr, "%s: Invalid repetition count!\n", pModule);
+        status = 0;
+      }
+    
+    } else if ((strcmp(argv[argi], "--seed") == 0) &&
+                (argi + 1 < argc)) {
+      argi++;
+      seed = strtoul(argv[argi], NULL, 10);
+    
+    } else {
+      fprintf(stderr, "%s: Unrecognized option '%s'!\n",
+                pModule, argv[argi]);
+      status = 0;
+    }
+  }
+  
+  /* Seed the generator; the state must never be zero */
+  m_rand = (((uint64_t) seed) << 1) | 1;
+  
+  /* Write the table to a temporary file */
+  if (status) {
+    strcpy(path, "/tmp/lilac_tbench_XXXXXX");
+    fd = mkstemp(path);
+    if (fd < 0) {
+      fprintf(stderr, "%s: Can't create temporary file!\n", pModule);
+      status = 0;
+    }
+  }
+  
+  if (status) {
+    pf = fdopen(fd, "w");
+    if (pf == NULL) {
+      fprintf(stderr, "%s: Can't open temporary file!\n", pModule);
+      close(fd);
+      status = 0;
+    }
+    fd = -1;
+  }
+  
+  if (status) {
+    if (!genTable(pf, (int32_t) records)) {
+      fprintf(stderr, "%s: Error writing temporary file!\n", pModule);
+      status = 0;
+    }
+    len = ftell(pf);
+  }
+  
+  if (pf != NULL) {
+    if (fclose(pf)) {
+      if (status) {
+        fprintf(stderr, "%s: Error writing temporary file!\n",
+                  pModule);
+        status = 0;
+      }
+    }
+    pf = NULL;
+  }
+  
+  /* Time the repetitions */
+  for(r = 0; status && (r < reps); r++) {
+    if (!timeParse(path, (int32_t) records, &t)) {
+      status = 0;
+    } else if ((r == 0) || (t < t_best)) {
+      t_best = t;
+    }
+  }
+  
+  /* Report the results */
+  if (status) {
+    printf("table: %ld records, %.1f MB\n",
+            records, ((double) len) / 1.0e6);
+    printf("%-10s %10.2f ms %10.1f MB/s %10.2f Mrec/s\n", "parse",
+            t_best * 1.0e3, ((double) len) / (t_best * 1.0e6),
+            ((double) records) / (t_best * 1.0e6));
+  }
+  
+  /* Remove the temporary file */
+  if (path[0] != 0) {
+    remove(path);
+  }
+  
+  /* Invert status and return */
+  if (status) {
+    status = 0;
+  } else {
+    status = 1;
+  }
+  return status;
+}
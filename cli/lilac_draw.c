@@ -8,8 +8,10 @@
  * README in this directory for build instructions.
  */
 
-#include <assert.h>
-#include <math.h>
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <signal.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -17,8 +19,22 @@
 #include <string.h>
 #include <time.h>
 
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "expr.h"
 #include "gamma.h"
+#include "jobproto.h"
+#include "ntex.h"
+#include "pixel.h"
+#include "plugin.h"
 #include "pshade.h"
+#include "splane.h"
+#include "stats.h"
+#include "tcache.h"
 #include "texture.h"
 #include "ttable.h"
 
@@ -35,6 +51,9 @@
  * Remember to update lilac_errorString()!
  */
 #define ERROR_MISMATCH (1)  /* Image dimensions mismatch */
+#define ERROR_SHADER   (2)  /* Programmable shader failed */
+#define ERROR_MEMORY   (3)  /* Out of memory */
+#define ERROR_PLANE    (4)  /* Can't read palette index plane */
 
 /* Error codes in this range are Sophistry error codes added to the
  * value ERROR_SPH_MIN */
@@ -56,6 +75,10 @@
 #define VTEX_UNDEF  (0)
 #define VTEX_PNG    (1)
 #define VTEX_PSHADE (2)
+#define VTEX_NTEX   (3)
+#define VTEX_PLUGIN (4)
+#define VTEX_EXPR   (5)
+#define VTEX_PSHGEN (6)
 
 /*
  * The maximum number of characters, including the opening dot and the
@@ -64,44 +87,27 @@
 #define MAX_EXT (16)
 
 /*
- * Type declarations
- * =================
+ * The maximum number of pending connections queued on the daemon
+ * socket.
  */
+#define DAEMON_BACKLOG (16)
 
 /*
- * Stores an HSL color with floating-point channels.
- * 
- * This can not be used for grayscale values, which have an undefined
- * hue.
+ * The number of seconds the daemon waits for a client to send its whole
+ * request, or to take its whole response, before dropping the
+ * connection.
  */
-typedef struct {
-  
-  /* The hue, in range [0.0, 360.0) */
-  float h;
-  
-  /* The saturation, in range [0.0, 1.0] */
-  float s;
-  
-  /* The lightness, in range [0.0, 1.0] */
-  float l;
-  
-} HSL;
+#define DAEMON_TIMEOUT (10)
 
 /*
- * Stores an RGB color with floating-point channels.
+ * The maximum number of nul-terminated strings in a daemon request.
+ */
+#define DAEMON_MAXARGS (8)
+
+/*
+ * Type declarations
+ * =================
  */
-typedef struct {
-  
-  /* Red, in range [0.0, 1.0] */
-  float r;
-  
-  /* Green, in range [0.0, 1.0] */
-  float g;
-  
-  /* Blue, in range [0.0, 1.0] */
-  float b;
-  
-} RGB;
 
 /*
  * Virtual texture structure.
@@ -135,10 +141,28 @@ typedef struct {
     
     /*
      * Pointer to a nul-terminated shader name string for use with
-     * programmable shaders.
+     * programmable shaders and generator shaders.
      */
     char *pShader;
     
+    /*
+     * Texture index in native texture module, used for native
+     * procedural textures.  This is also one-indexed.
+     */
+    int nidx;
+    
+    /*
+     * Shader index in plugin module, used for plugin shaders.  This is
+     * also one-indexed.
+     */
+    int pidx;
+    
+    /*
+     * Shader index in expression module, used for expression shaders.
+     * This is also one-indexed.
+     */
+    int eidx;
+    
   } v;
   
 } VTEX;
@@ -155,6 +179,15 @@ typedef struct {
  */
 const char *pModule = NULL;
 
+/*
+ * Flag indicating whether lilac() prints progress reports to standard
+ * error.
+ * 
+ * This is cleared in daemon mode, where many renders share the same
+ * standard error.
+ */
+static int m_progress = 1;
+
 /*
  * The virtual texture table.
  * 
@@ -176,11 +209,56 @@ const char *pModule = NULL;
  * Use vtx_query() to query a pixel from a texture, routing the call
  * appropriately to the correct texture handling module depending on the
  * texture type.
+ * 
+ * Image textures may be queried in any order.  The scanning order of
+ * procedural textures is kept by the programmable shader module for
+ * each of its contexts, and only applies to shaders that are not
+ * declared random-access.  Use vtx_rewind() to return to the top-left
+ * corner before a new render.
  */
 static int m_vtx_init = 0;
 static int m_vtx_count = 0;
 static VTEX m_vtx[TEXTURE_MAXCOUNT];
 
+/*
+ * The constant-folded output colors of the shading records.
+ * 
+ * When both the texture used by a shading record in a given mode and
+ * the first texture are uniform, every pixel rendered with that record
+ * in that mode has the same color.  fold_build() computes these colors
+ * once after setup.
+ * 
+ * m_fold has m_fold_count entries, which is twice the number of
+ * records plus one.  Use fold_get() to look up an entry.  Zero means
+ * the record is not constant in that mode, since rendered pixels are
+ * always opaque.
+ */
+static uint32_t *m_fold = NULL;
+static int m_fold_count = 0;
+
+/*
+ * Flag indicating whether the shading image gets a palette pre-pass.
+ * 
+ * This is set by the --palette option.  See splane.h.  Shading images
+ * that are indexed PNG files always get the pre-pass, since their
+ * palette is read directly from the file.
+ */
+static int m_palette = 0;
+
+/*
+ * The shading records of the palette of the current render.
+ * 
+ * When the palette pre-pass succeeds, lilac() resolves each palette
+ * entry to a shading record once.  m_pal_rec holds the filled-in
+ * record and m_pal_idx holds the record index returned by
+ * ttable_query() for each of the m_pal_count entries.  The index rows
+ * then hold palette indices instead of RGB indices.  m_pal_rec is NULL
+ * when there is no palette.
+ */
+static SHADEREC *m_pal_rec = NULL;
+static int *m_pal_idx = NULL;
+static int32_t m_pal_count = 0;
+
 /*
  * Local functions
  * ===============
@@ -188,7 +266,14 @@ static VTEX m_vtx[TEXTURE_MAXCOUNT];
 
 /* Function prototypes */
 static void vtx_init(void);
+static int vtx_threads(void);
+static int vtx_load_plugin(const char *pstr, const char *pColon);
+static int vtx_load_expr(const char *pstr);
 static int vtx_load(const char *pstr);
+static void vtx_rewind(void);
+static int vtx_stage(int tidx);
+static int vtx_uniform(int tidx);
+static int vtx_period(int tidx, int32_t *pw, int32_t *ph);
 uint32_t vtx_query(
     int       tidx,
     int32_t   x,
@@ -196,15 +281,44 @@ uint32_t vtx_query(
     int32_t   width,
     int32_t   height,
     int     * status);
+static int vtx_native(int tidx);
+static int vtx_same(int a, int b);
+static void vtx_span(
+    int        tidx,
+    int32_t    x,
+    int32_t    x_end,
+    int32_t    y,
+    int32_t    width,
+    int32_t    height,
+    uint32_t * pOut,
+    int      * status);
 
-static const char *lilac_errorString(int code);
+static int fold_build(void);
+static uint32_t fold_get(int rec, int mode);
+
+static int mask_high(uint32_t argb);
+static int row_classify(
+    const uint32_t      * pMaskScan,
+    const uint32_t      * pPencilScan,
+    const uint32_t      * pShadingScan,
+    const uint16_t      * pPalRow,
+          unsigned char * pModeRow,
+          int32_t       * pIndexRow,
+          int32_t         width);
+static int row_span(
+          int        mode,
+          uint32_t * pOutScan,
+    const int32_t  * pIndexRow,
+          uint32_t * pTexRow,
+          uint32_t * pBaseRow,
+          int32_t    x,
+          int32_t    x_end,
+          int32_t    y,
+          int32_t    width,
+          int32_t    height);
 
-static float hslval(float a, float b, float hue);
-static void rgb2hsl(RGB *pRGB, HSL *pHSL);
-static void hsl2rgb(HSL *pHSL, RGB *pRGB);
-static uint32_t fade(uint32_t rgb, int rate);
-static uint32_t composite(uint32_t over, uint32_t under);
-static uint32_t colorize(uint32_t rgb_in, uint32_t rgb_tint);
+static const char *lilac_errorString(int code);
+static const char *lilac_errorLocString(int errloc);
 
 static int lilac(
     const char * pOutPath,
@@ -214,6 +328,20 @@ static int lilac(
            int * pError,
            int * pErrLoc);
 
+static int lilac_setup(
+    const char *  pTablePath,
+    const char *  pShaderPath,
+          int     tcount,
+          char ** ppTex);
+
+static void daemon_job(
+    const unsigned char * pReq,
+          size_t          reqlen,
+          char          * pResp,
+          size_t          respsize,
+          int           * pQuit);
+static int lilac_daemon(const char *pSockPath);
+
 /*
  * Initialize the virtual texture table, if not already initialized.
  * 
@@ -237,6 +365,222 @@ static void vtx_init(void) {
   }
 }
 
+/*
+ * Choose the number of threads for baking procedural textures.
+ * 
+ * Return:
+ * 
+ *   the number of online processors, limited to the range one up to and
+ *   including PSHADE_MAXTHREADS
+ */
+static int vtx_threads(void) {
+  
+  long n = 0;
+  
+  n = sysconf(_SC_NPROCESSORS_ONLN);
+  if (n < 1) {
+    n = 1;
+  } else if (n > PSHADE_MAXTHREADS) {
+    n = PSHADE_MAXTHREADS;
+  }
+  
+  return (int) n;
+}
+
+/*
+ * Load a plugin shader into the virtual texture table.
+ * 
+ * This is called by vtx_load() for parameters of the form
+ * path.so:name, where pColon points to the last colon in pstr.  The
+ * virtual texture table must already be initialized and must not be
+ * full.
+ * 
+ * Pure plugin shaders are baked into image textures here.
+ * 
+ * This function will handle reporting errors to stderr.
+ * 
+ * Parameters:
+ * 
+ *   pstr - the parameter to parse
+ * 
+ *   pColon - the last colon in pstr
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if failure
+ */
+static int vtx_load_plugin(const char *pstr, const char *pColon) {
+  
+  int status = 1;
+  int errcode = 0;
+  int baked = 0;
+  const char *pc = NULL;
+  char *pPath = NULL;
+  int32_t pw = 0;
+  int32_t ph = 0;
+  int32_t y = 0;
+  uint32_t *pData = NULL;
+  
+  /* Check parameters */
+  if ((pstr == NULL) || (pColon == NULL)) {
+    abort();
+  }
+  
+  /* Check that the shader name has at least one character, that the
+   * first character is not a digit, and that it uses only ASCII
+   * alphanumerics and underscores */
+  if ((pColon[1] == 0) || ((pColon[1] >= '0') && (pColon[1] <= '9'))) {
+    status = 0;
+    fprintf(stderr, "%s: Plugin shader name in '%s' is invalid!\n",
+      pModule, pstr);
+  }
+  
+  if (status) {
+    for(pc = pColon + 1; *pc != 0; pc++) {
+      if (((*pc < 'A') || (*pc > 'Z')) &&
+            ((*pc < 'a') || (*pc > 'z')) &&
+            ((*pc < '0') || (*pc > '9')) &&
+            (*pc != '_')) {
+        status = 0;
+        fprintf(stderr, "%s: Plugin shader name in '%s' is invalid!\n",
+          pModule, pstr);
+        break;
+      }
+    }
+  }
+  
+  /* Make a dynamic copy of the path */
+  if (status) {
+    pPath = (char *) malloc((size_t) (pColon - pstr) + 1);
+    if (pPath == NULL) {
+      abort();
+    }
+    memcpy(pPath, pstr, (size_t) (pColon - pstr));
+    pPath[pColon - pstr] = 0;
+  }
+  
+  /* Load the shader */
+  if (status) {
+    if (!plugin_load(pPath, pColon + 1, &errcode)) {
+      status = 0;
+      fprintf(stderr, "%s: Error loading plugin shader '%s'...\n",
+        pModule, pstr);
+      fprintf(stderr, "%s: %s!\n",
+        pModule, plugin_errorString(errcode));
+    }
+  }
+  
+  /* If the shader is pure, bake one period into an image texture */
+  if (status) {
+    baked = plugin_pure(plugin_count(), &pw, &ph);
+  }
+  
+  if (status && baked) {
+    pData = (uint32_t *) malloc(
+              ((size_t) pw) * ((size_t) ph) * sizeof(uint32_t));
+    if (pData == NULL) {
+      abort();
+    }
+    for(y = 0; y < ph; y++) {
+      if (!plugin_span(plugin_count(), 0, y, pw, pw, ph,
+                        &(pData[y * pw]), &errcode)) {
+        status = 0;
+        fprintf(stderr, "%s: Error baking plugin shader '%s'...\n",
+          pModule, pstr);
+        fprintf(stderr, "%s: %s!\n",
+          pModule, plugin_errorString(errcode));
+        break;
+      }
+    }
+  }
+  
+  if (status && baked) {
+    if (!texture_add(pData, pw, ph)) {
+      status = 0;
+      fprintf(stderr, "%s: Too many textures defined!\n", pModule);
+    }
+  }
+  
+  /* Add the texture to the virtual texture table */
+  if (status && baked) {
+    m_vtx[m_vtx_count].vtype = VTEX_PNG;
+    m_vtx[m_vtx_count].v.tidx = texture_count();
+    m_vtx_count++;
+    pData = NULL;
+    
+  } else if (status) {
+    m_vtx[m_vtx_count].vtype = VTEX_PLUGIN;
+    m_vtx[m_vtx_count].v.pidx = plugin_count();
+    m_vtx_count++;
+  }
+  
+  /* Release the path and any pixels that were not added */
+  free(pPath);
+  pPath = NULL;
+  
+  free(pData);
+  pData = NULL;
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Compile an expression shader into the virtual texture table.
+ * 
+ * This is called by vtx_load() for parameters that begin with an
+ * equals sign, which is not part of the expression.  The virtual
+ * texture table must already be initialized and must not be full.
+ * 
+ * This function will handle reporting errors to stderr.
+ * 
+ * Parameters:
+ * 
+ *   pstr - the parameter to parse
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if failure
+ */
+static int vtx_load_expr(const char *pstr) {
+  
+  int status = 1;
+  int errcode = 0;
+  int pos = 0;
+  
+  /* Check parameter */
+  if (pstr == NULL) {
+    abort();
+  }
+  if (*pstr != '=') {
+    abort();
+  }
+  
+  /* Compile the expression */
+  if (!expr_add(pstr + 1, &errcode, &pos)) {
+    status = 0;
+    if (pos > 0) {
+      fprintf(stderr,
+        "%s: Error in expression shader '%s' at character %d...\n",
+        pModule, pstr, pos + 1);
+    } else {
+      fprintf(stderr, "%s: Error in expression shader '%s'...\n",
+        pModule, pstr);
+    }
+    fprintf(stderr, "%s: %s!\n", pModule, expr_errorString(errcode));
+  }
+  
+  /* Add the texture to the virtual texture table */
+  if (status) {
+    m_vtx[m_vtx_count].vtype = VTEX_EXPR;
+    m_vtx[m_vtx_count].v.eidx = expr_count();
+    m_vtx_count++;
+  }
+  
+  /* Return status */
+  return status;
+}
+
 /*
  * Load a virtual texture from a given command-line parameter value.
  * 
@@ -249,6 +593,24 @@ static void vtx_init(void) {
  * If successful, the texture will be added to the virtual texture
  * table.
  * 
+ * Parameters that end with a closing parenthesis are procedural
+ * textures of the form name() or name(params).  If there are
+ * parameters, or if the name is a native texture that the loaded
+ * script does not define as a shader function, the texture is a native
+ * texture from the ntex module.  Otherwise, it is a programmable
+ * shader.
+ * 
+ * Parameters that begin with an equals sign are expression shaders,
+ * which are handed over to vtx_load_expr().  Parameters of the form
+ * path.so:name are plugin shaders, which are handed over to
+ * vtx_load_plugin().
+ * 
+ * Procedural textures that are periodic, which are native textures
+ * that ntex_period() reports and shaders that the loaded script
+ * declares pure and periodic in its lilac_meta table, are baked into
+ * image textures here, so the programmable shader must be loaded
+ * before this is called.
+ * 
  * Parameters:
  * 
  *   pstr - the parameter to parse
@@ -263,8 +625,19 @@ static int vtx_load(const char *pstr) {
   int errcode = 0;
   const char *pExt = NULL;
   const char *pc = NULL;
+  const char *pParen = NULL;
+  const char *pColon = NULL;
   char *pb = NULL;
+  char *pParam = NULL;
   size_t slen = 0;
+  int32_t y = 0;
+  
+  int native = 0;
+  int nerr = 0;
+  int baked = 0;
+  int32_t pw = 0;
+  int32_t ph = 0;
+  uint32_t *pData = NULL;
   
   char ext[MAX_EXT];
   
@@ -279,12 +652,40 @@ static int vtx_load(const char *pstr) {
     abort();
   }
   
+  /* Expression shaders begin with an equals sign */
+  if (*pstr == '=') {
+    if (m_vtx_count >= TEXTURE_MAXCOUNT) {
+      fprintf(stderr, "%s: Too many textures defined!\n", pModule);
+      return 0;
+    }
+    return vtx_load_expr(pstr);
+  }
+  
+  /* Plugin shaders have a colon after a case-insensitive .so extension,
+   * followed by the shader name */
+  pColon = strrchr(pstr, ':');
+  if ((pColon != NULL) && (pColon - pstr >= 4) &&
+      (pColon[-3] == '.') &&
+      ((pColon[-2] == 's') || (pColon[-2] == 'S')) &&
+      ((pColon[-1] == 'o') || (pColon[-1] == 'O'))) {
+    if (m_vtx_count >= TEXTURE_MAXCOUNT) {
+      fprintf(stderr, "%s: Too many textures defined!\n", pModule);
+      return 0;
+    }
+    return vtx_load_plugin(pstr, pColon);
+  }
+  
   /* Set pExt to point to the last dot in the string, or set it to NULL
-   * if there is no dot in the string */
+   * if there is no dot in the string; procedural textures end with a
+   * closing parenthesis and never have an extension, even if their
+   * parameters have decimal points */
+  slen = strlen(pstr);
   pExt = NULL;
-  for(pc = pstr; *pc != 0; pc++) {
-    if (*pc == '.') {
-      pExt = pc;
+  if ((slen < 1) || (pstr[slen - 1] != ')')) {
+    for(pc = pstr; *pc != 0; pc++) {
+      if (*pc == '.') {
+        pExt = pc;
+      }
     }
   }
   
@@ -318,6 +719,7 @@ static int vtx_load(const char *pstr) {
         *pb = *pb + ('a' - 'A');
       }
     }
+    pb = NULL;
   }
   
   /* Make sure virtual texture table isn't full */
@@ -353,14 +755,22 @@ static int vtx_load(const char *pstr) {
     }
     
   } else if (status && (strcmp(ext, "-") == 0)) {
-    /* No file extension, so this should be a shader name token to use
-     * with a programmable shader -- first, check that the shader name
-     * uses only ASCII alphanumerics and underscores and parentheses,
-     * that it has at least one character, that the first character is
-     * not a digit, and that parentheses are only used in last two
-     * characters */
+    /* No file extension, so this should be a procedural texture of
+     * the form name() or name(params) -- first, find the opening
+     * parenthesis that ends the name, and make sure that there is a
+     * closing parenthesis at the end */
+    pParen = strchr(pstr, '(');
+    if ((pParen == NULL) || (slen < 1) || (pstr[slen - 1] != ')')) {
+      status = 0;
+      fprintf(stderr, "%s: Shader name '%s' is missing () at end!\n",
+        pModule, pstr);
+    }
+    
+    /* Second, check that the name has at least one character, that the
+     * first character is not a digit, and that it uses only ASCII
+     * alphanumerics and underscores */
     if (status) {
-      if ((*pstr == 0) || ((*pstr >= '0') && (*pstr <= '9'))) {
+      if ((pParen == pstr) || ((*pstr >= '0') && (*pstr <= '9'))) {
         status = 0;
         fprintf(stderr, "%s: Shader name '%s' is invalid!\n",
           pModule, pstr);
@@ -368,72 +778,152 @@ static int vtx_load(const char *pstr) {
     }
     
     if (status) {
-      for(pc = pstr; *pc != 0; pc++) {
+      for(pc = pstr; pc < pParen; pc++) {
         if (((*pc < 'A') || (*pc > 'Z')) &&
               ((*pc < 'a') || (*pc > 'z')) &&
               ((*pc < '0') || (*pc > '9')) &&
-              (*pc != '_') && (*pc != '(') && (*pc != ')')) {
+              (*pc != '_')) {
           status = 0;
           fprintf(stderr, "%s: Shader name '%s' is invalid!\n",
             pModule, pstr);
           break;
         }
-        if ((*pc == '(') || (*pc == ')')) {
-          if ((pc[1] != 0) && (pc[2] != 0)) {
-            status = 0;
-            fprintf(stderr, "%s: Shader name '%s' is invalid!\n",
-              pModule, pstr);
-            break;
-          }
-        }
       }
     }
     
-    /* Second, get the length of the shader name in slen, make sure it
-     * is at least three characters, and make sure that the last two
-     * characters are () */
+    /* Third, check that there are no other parentheses */
     if (status) {
-      slen = strlen(pstr);
-      if (slen >= 3) {
-        if ((pstr[slen - 2] != '(') || (pstr[slen - 1] != ')')) {
+      for(pc = pParen + 1; pc < pstr + slen - 1; pc++) {
+        if ((*pc == '(') || (*pc == ')')) {
           status = 0;
-          fprintf(stderr,
-            "%s: Shader name '%s' is missing () at end!\n",
+          fprintf(stderr, "%s: Shader name '%s' is invalid!\n",
             pModule, pstr);
+          break;
         }
-        
-      } else {
-        status = 0;
-        fprintf(stderr, "%s: Shader name '%s' is missing () at end!\n",
-          pModule, pstr);
       }
     }
     
-    /* Third, drop the last two () characters from the length so the
-     * copy will not include those characters */
+    /* Next make a dynamic copy without the closing parenthesis, and
+     * split it at the opening parenthesis into the name and the
+     * parameters */
     if (status) {
-      slen -= 2;
+      pb = (char *) malloc(slen);
+      if (pb == NULL) {
+        abort();
+      }
+      memcpy(pb, pstr, slen - 1);
+      pb[slen - 1] = 0;
+      pb[pParen - pstr] = 0;
+      pParam = &(pb[(pParen - pstr) + 1]);
     }
     
-    /* Next make a dynamic copy of the shader name, without the
-     * trailing () */
+    /* Use a native texture if there are parameters, or if the name is a
+     * native texture and the script does not define a shader with the
+     * same name */
     if (status) {
-      pb = (char *) malloc(slen + 1);
-      if (pb == NULL) {
+      if ((*pParam != 0) || (ntex_known(pb) && (!pshade_defined(pb)))) {
+        native = 1;
+      }
+    }
+    
+    if (status && native) {
+      if (!ntex_add(pb, pParam, &nerr)) {
+        status = 0;
+        fprintf(stderr, "%s: Error in native texture '%s'...\n",
+          pModule, pstr);
+        fprintf(stderr, "%s: %s!\n",
+          pModule, ntex_errorString(nerr));
+      }
+    }
+    
+    /* Periodic native textures are baked into an image texture */
+    if (status && native) {
+      baked = ntex_period(ntex_count(), &pw, &ph);
+    }
+    
+    if (status && native && baked) {
+      pData = (uint32_t *) malloc(
+                ((size_t) pw) * ((size_t) ph) * sizeof(uint32_t));
+      if (pData == NULL) {
         abort();
       }
-      memset(pb, 0, slen + 1);
-      memcpy(pb, pstr, slen);
+      for(y = 0; y < ph; y++) {
+        ntex_span(ntex_count(), 0, y, pw, pw, ph, &(pData[y * pw]));
+      }
     }
     
-    /* Add the procedural texture to the virtual texture table */
-    if (status) {
-      m_vtx[m_vtx_count].vtype = VTEX_PSHADE;
+    /* Otherwise, check whether the script declares the shader pure and
+     * periodic */
+    if (status && (!native)) {
+      baked = pshade_meta(pb, &pw, &ph, &errcode);
+      if (errcode != PSHADE_ERR_NONE) {
+        status = 0;
+      }
+    }
+    
+    /* If so, bake one period of the shader into an image texture */
+    if (status && (!native) && baked) {
+      pData = (uint32_t *) malloc(
+                ((size_t) pw) * ((size_t) ph) * sizeof(uint32_t));
+      if (pData == NULL) {
+        abort();
+      }
+      if (!pshade_bake(pb, pw, ph, pData, vtx_threads(), &errcode)) {
+        status = 0;
+      }
+    }
+    
+    if (status && baked) {
+      if (!texture_add(pData, pw, ph)) {
+        status = 0;
+        fprintf(stderr, "%s: Too many textures defined!\n", pModule);
+      }
+    }
+    
+    if ((!status) && (errcode != PSHADE_ERR_NONE)) {
+      fprintf(stderr, "%s: Error baking shader '%s'...\n",
+        pModule, pb);
+      fprintf(stderr, "%s: %s!\n",
+        pModule, pshade_errorString(errcode));
+    }
+    
+    /* Add the texture to the virtual texture table, as an image texture
+     * if it was baked, as a native texture, or as a programmable
+     * shader, which is generated a span at a time if it is declared a
+     * generator */
+    if (status && baked) {
+      m_vtx[m_vtx_count].vtype = VTEX_PNG;
+      m_vtx[m_vtx_count].v.tidx = texture_count();
+      m_vtx_count++;
+      pData = NULL;
+      
+    } else if (status && native) {
+      m_vtx[m_vtx_count].vtype = VTEX_NTEX;
+      m_vtx[m_vtx_count].v.nidx = ntex_count();
+      m_vtx_count++;
+      
+    } else if (status) {
+      if (pshade_generator(pb)) {
+        m_vtx[m_vtx_count].vtype = VTEX_PSHGEN;
+      } else {
+        m_vtx[m_vtx_count].vtype = VTEX_PSHADE;
+      }
       m_vtx[m_vtx_count].v.pShader = pb;
       m_vtx_count++;
       pb = NULL;
     }
     
+    /* Release the shader name and pixels if they were not added to the
+     * table */
+    if (pb != NULL) {
+      free(pb);
+      pb = NULL;
+    }
+    if (pData != NULL) {
+      free(pData);
+      pData = NULL;
+    }
+    
   } else if (status) {
     /* Unrecognized extension */
     status = 0;
@@ -447,19 +937,188 @@ static int vtx_load(const char *pstr) {
 }
 
 /*
- * Get the ARGB pixel value of a given virtual texture at a given
- * coordinate.
+ * Reset the scanning order of procedural textures queried through
+ * vtx_query() and vtx_span().
  * 
- * This function will automatically initialize the virtual texture table
- * if necessary with vtx_init().
+ * Call this before each render so that queries of shaders that are not
+ * random-access may begin again at the top-left corner.
+ */
+static void vtx_rewind(void) {
+  pshade_rewind();
+  plugin_rewind();
+}
+
+/*
+ * Return the statistics stage code for queries of a given virtual
+ * texture.
  * 
- * tidx is the texture index.  It must be in range one up to and
- * including m_vtx_count or a fault occurs.  Note that the indices given
- * to this function are one-indexed!
+ * tidx is the one-indexed texture index, as for vtx_query().  It must
+ * be in range one up to and including m_vtx_count.
  * 
- * x and y are the image coordinates.  This function enforces that
- * pixels may only be queries in order left-to-right through scanlines,
- * and scanlines from top to bottom through image.
+ * Parameters:
+ * 
+ *   tidx - the virtual texture
+ * 
+ * Return:
+ * 
+ *   STATS_VTX_PNG for image textures or STATS_VTX_PSHADE for procedural
+ *   textures
+ */
+static int vtx_stage(int tidx) {
+  
+  int result = 0;
+  
+  /* Check parameter */
+  if ((tidx < 1) || (tidx > m_vtx_count)) {
+    abort();
+  }
+  
+  /* Choose stage based on texture type; native textures, plugin
+   * shaders, expression shaders, and generator shaders are also
+   * procedural */
+  if ((m_vtx[tidx - 1].vtype == VTEX_PSHADE) ||
+      (m_vtx[tidx - 1].vtype == VTEX_PSHGEN) ||
+      (m_vtx[tidx - 1].vtype == VTEX_NTEX) ||
+      (m_vtx[tidx - 1].vtype == VTEX_PLUGIN) ||
+      (m_vtx[tidx - 1].vtype == VTEX_EXPR)) {
+    result = STATS_VTX_PSHADE;
+  } else {
+    result = STATS_VTX_PNG;
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * Check whether a virtual texture is uniform.
+ * 
+ * tidx is the one-indexed texture index, as for vtx_query().  It must
+ * be in range one up to and including m_vtx_count.
+ * 
+ * Parameters:
+ * 
+ *   tidx - the virtual texture
+ * 
+ * Return:
+ * 
+ *   non-zero if the texture is an image texture with the same color at
+ *   every pixel, zero otherwise
+ */
+static int vtx_uniform(int tidx) {
+  
+  /* Check parameter */
+  if ((tidx < 1) || (tidx > m_vtx_count)) {
+    abort();
+  }
+  
+  /* Only image textures are checked for uniformity */
+  if (m_vtx[tidx - 1].vtype != VTEX_PNG) {
+    return 0;
+  }
+  
+  return texture_uniform(m_vtx[tidx - 1].v.tidx);
+}
+
+/*
+ * Get the period of the rendered output for a given virtual texture.
+ * 
+ * tidx is the one-indexed texture index, as for vtx_query().  It must
+ * be in range one up to and including m_vtx_count.
+ * 
+ * If both the given texture and the first texture are image textures,
+ * then pixels that fade the given texture and composite it over the
+ * first texture repeat with a period that is the least common multiple
+ * of their dimensions.  Uniform textures count as one pixel in each
+ * dimension.  In that case, the period is written to *pw and *ph and
+ * non-zero is returned.
+ * 
+ * Zero is returned if either texture is procedural, or if either
+ * dimension of the period exceeds TCACHE_MAX_PIXELS.
+ * 
+ * Parameters:
+ * 
+ *   tidx - the virtual texture
+ * 
+ *   pw - receives the width of the period
+ * 
+ *   ph - receives the height of the period
+ * 
+ * Return:
+ * 
+ *   non-zero if the output is periodic, zero otherwise
+ */
+static int vtx_period(int tidx, int32_t *pw, int32_t *ph) {
+  
+  int i = 0;
+  int64_t dim[2];
+  int64_t a = 0;
+  int64_t b = 0;
+  int64_t r = 0;
+  
+  /* Check parameters */
+  if ((tidx < 1) || (tidx > m_vtx_count) || (m_vtx_count < 1) ||
+      (pw == NULL) || (ph == NULL)) {
+    abort();
+  }
+  
+  /* Only image textures are periodic */
+  if ((m_vtx[tidx - 1].vtype != VTEX_PNG) ||
+      (m_vtx[0].vtype != VTEX_PNG)) {
+    return 0;
+  }
+  
+  /* Get the least common multiple of each dimension */
+  for(i = 0; i < 2; i++) {
+    if (i == 0) {
+      a = texture_width(m_vtx[tidx - 1].v.tidx);
+      b = texture_width(m_vtx[0].v.tidx);
+    } else {
+      a = texture_height(m_vtx[tidx - 1].v.tidx);
+      b = texture_height(m_vtx[0].v.tidx);
+    }
+    if (vtx_uniform(tidx)) {
+      a = 1;
+    }
+    if (vtx_uniform(1)) {
+      b = 1;
+    }
+    
+    dim[i] = a * b;
+    while (b != 0) {
+      r = a % b;
+      a = b;
+      b = r;
+    }
+    dim[i] = dim[i] / a;
+    
+    if (dim[i] > TCACHE_MAX_PIXELS) {
+      return 0;
+    }
+  }
+  
+  *pw = (int32_t) dim[0];
+  *ph = (int32_t) dim[1];
+  return 1;
+}
+
+/*
+ * Get the ARGB pixel value of a given virtual texture at a given
+ * coordinate.
+ * 
+ * This function will automatically initialize the virtual texture table
+ * if necessary with vtx_init().
+ * 
+ * tidx is the texture index.  It must be in range one up to and
+ * including m_vtx_count or a fault occurs.  Note that the indices given
+ * to this function are one-indexed!
+ * 
+ * x and y are the image coordinates.  Image textures may be queried in
+ * any order.  Procedural textures that are not declared random-access
+ * may only be queried in order left-to-right through scanlines, and
+ * scanlines from top to bottom through image, which the programmable
+ * shader module enforces.  Use vtx_rewind() to start again at the
+ * top-left corner.
  * 
  * width and height are the width and height in pixels of the output
  * image that is being rendered.  x and y must both be greater than or
@@ -504,9 +1163,6 @@ uint32_t vtx_query(
   uint32_t result = 0;
   int errcode = 0;
   
-  static int32_t s_last_x = 0;
-  static int32_t s_last_y = 0;
-  
   /* Initialize virtual texture table if needed */
   vtx_init();
   
@@ -522,29 +1178,6 @@ uint32_t vtx_query(
     abort();
   }
   
-  /* Enforce proper scanning order and update statistics */
-  if (y > s_last_y) {
-    /* We've advanced a scanline, so update to new position */
-    s_last_x = x;
-    s_last_y = y;
-  
-  } else if (y == s_last_y) {
-    /* Still in same scanline, so next check x */
-    if (x > s_last_x) {
-      /* We've advanced within scanline, so update x */
-      s_last_x = x;
-    
-    } else if (x != s_last_x) {
-      /* We must have gone backwards, which is not allowed */
-      abort();
-    }
-  
-  } else {
-    /* We must have gone backwards in scan order, which is not
-     * allowed */
-    abort();
-  }
-  
   /* Make sure given texture index is in range of table */
   if ((tidx >= 1) && (tidx <= m_vtx_count)) {
     
@@ -553,7 +1186,27 @@ uint32_t vtx_query(
       /* PNG texture, so dispatch to texture module */
       result = texture_pixel(m_vtx[tidx - 1].v.tidx, x, y);
       
-    } else if (m_vtx[tidx - 1].vtype == VTEX_PSHADE) {
+    } else if (m_vtx[tidx - 1].vtype == VTEX_NTEX) {
+      /* Native texture, so dispatch to native texture module */
+      result = ntex_pixel(m_vtx[tidx - 1].v.nidx, x, y, width, height);
+      
+    } else if (m_vtx[tidx - 1].vtype == VTEX_EXPR) {
+      /* Expression shader, so dispatch to expression module */
+      result = expr_pixel(m_vtx[tidx - 1].v.eidx, x, y, width, height);
+      
+    } else if (m_vtx[tidx - 1].vtype == VTEX_PLUGIN) {
+      /* Plugin shader, so dispatch a span of one pixel to the plugin
+       * module */
+      if (!plugin_span(m_vtx[tidx - 1].v.pidx, x, y, 1, width, height,
+                        &result, &errcode)) {
+        *status = 0;
+        result = 0;
+        fprintf(stderr, "%s: %s!\n",
+          pModule, plugin_errorString(errcode));
+      }
+      
+    } else if ((m_vtx[tidx - 1].vtype == VTEX_PSHADE) ||
+                (m_vtx[tidx - 1].vtype == VTEX_PSHGEN)) {
       /* Procedural texture, so dispatch to programmable shader
        * module */
       result = pshade_pixel(
@@ -586,561 +1239,799 @@ uint32_t vtx_query(
 }
 
 /*
- * Given a Lilac error code, return a string for the error message.
- * 
- * The error message does not have any punctuation at the end of the
- * string nor does it have a line break.  The first letter is
- * capitalized.
- * 
- * If zero is passed (meaning no error), the string is "No error"
+ * Check whether a virtual texture is generated a span at a time.
  * 
- * If the error code is in one of the module ranges, this function
- * invokes the error string function in the appropriate module to get
- * the error message.
+ * tidx is the one-indexed texture index, as for vtx_query().  It must
+ * be in range one up to and including m_vtx_count.
  * 
- * If an unrecognized error code is passed, the string is "Unknown
- * error".
+ * Native textures, plugin shaders, expression shaders, and generator
+ * shaders are best queried a span at a time with vtx_span().
  * 
  * Parameters:
  * 
- *   code - the Lilac error code
+ *   tidx - the virtual texture
  * 
  * Return:
  * 
- *   an error message
+ *   non-zero if the texture is a native texture, a plugin shader, an
+ *   expression shader, or a generator shader, zero otherwise
  */
-static const char *lilac_errorString(int code) {
-  
-  const char *pResult = "Unknown error";
-  
-  if ((code >= ERROR_SPH_MIN) && (code <= ERROR_SPH_MAX)) {
-    pResult = sph_image_errorString(code - ERROR_SPH_MIN);
+static int vtx_native(int tidx) {
   
-  } else if (code == ERROR_MISMATCH) {
-    pResult =
-      "Mask, pencil, and shading files must have same dimensions";
+  /* Check parameter */
+  if ((tidx < 1) || (tidx > m_vtx_count)) {
+    abort();
   }
   
-  return pResult;
+  return ((m_vtx[tidx - 1].vtype == VTEX_NTEX) ||
+          (m_vtx[tidx - 1].vtype == VTEX_PLUGIN) ||
+          (m_vtx[tidx - 1].vtype == VTEX_EXPR) ||
+          (m_vtx[tidx - 1].vtype == VTEX_PSHGEN)) ? 1 : 0;
 }
 
 /*
- * Auxiliary function for HSL/RGB conversions.
+ * Check whether two virtual textures are the same texture.
+ * 
+ * a and b are one-indexed texture indices, as for vtx_query().  They
+ * must be in range one up to and including m_vtx_count.
+ * 
+ * Besides a texture being the same as itself, programmable shaders
+ * with the same name are the same, since they share the scanning
+ * position and generator state of the shader.
+ * 
+ * Parameters:
  * 
- * See the conversion functions for further information.
+ *   a - the first virtual texture
+ * 
+ *   b - the second virtual texture
+ * 
+ * Return:
+ * 
+ *   non-zero if the textures are the same, zero otherwise
  */
-static float hslval(float a, float b, float hue) {
+static int vtx_same(int a, int b) {
   
-  float result = 0.0f;
-  
-  /* Adapted from The Revolutionary Guide to Bitmapped Graphics,
-   * Control-Zed, Wrox Press, 1994, pg. 124 */
-  
-  while (hue >= 360.0f) {
-    hue -= 360.0f;
-  }
-  while (hue < 0.0f) {
-    hue += 360.0f;
+  /* Check parameters */
+  if ((a < 1) || (a > m_vtx_count) || (b < 1) || (b > m_vtx_count)) {
+    abort();
   }
   
-  if (hue < 60.0f) {
-    result = a + (b - a) * hue / 60.0f;
-  
-  } else if (hue < 180.0f) {
-    result = b;
-  
-  } else if (hue < 240.0f) {
-    result = a + (b - a) * (240.0f - hue) / 60.0f;
-  
-  } else {
-    result = a;
+  if (a == b) {
+    return 1;
   }
   
-  return result;
+  return (((m_vtx[a - 1].vtype == VTEX_PSHADE) ||
+            (m_vtx[a - 1].vtype == VTEX_PSHGEN)) &&
+          (m_vtx[b - 1].vtype == m_vtx[a - 1].vtype) &&
+          (strcmp(m_vtx[a - 1].v.pShader,
+                  m_vtx[b - 1].v.pShader) == 0)) ? 1 : 0;
 }
 
 /*
- * Convert an RGB color to HSL.
+ * Get the ARGB pixel values of a given virtual texture along a span of
+ * a scanline.
+ * 
+ * This is the same as calling vtx_query() for each pixel from (x, y)
+ * up to but excluding (x_end, y) in left-to-right order, except that
+ * the results are written to pOut indexed by X coordinate, so pOut
+ * must have room for at least x_end pixels.  Native textures, plugin
+ * shaders, expression shaders, and generator shaders generate the whole
+ * span in one call.
+ * 
+ * If a query fails, *status is set to zero and the rest of the span is
+ * left alone.
  * 
- * pRGB points to the RGB color.  This structure is first adjusted in
- * the following way.  Any component that is not a finite value is set
- * to zero.  Then, each component is clamped to range [0.0, 1.0].
+ * Parameters:
  * 
- * Note that the RGB channels must be in range [0.0, 1.0] rather than
- * the integer range [0, 255].
+ *   tidx - the virtual texture to query
  * 
- * Grayscale values may not be provided or a fault occurs.  This is
- * because the hue is undefined in grayscale cases.  The grayscale check
- * is done after the RGB values are adjusted as noted above.
+ *   x - the first X coordinate
  * 
- * The HSL result is written to pHSL.
+ *   x_end - one past the last X coordinate
  * 
- * Parameters:
+ *   y - the Y coordinate
+ * 
+ *   width - the width of the output image
+ * 
+ *   height - the height of the output image
  * 
- *   pRGB - pointer to the input RGB, which may be adjusted
+ *   pOut - receives the ARGB values
  * 
- *   pHSL - pointer to the output HSL
+ *   status - pointer to the status flag
  */
-static void rgb2hsl(RGB *pRGB, HSL *pHSL) {
+static void vtx_span(
+    int        tidx,
+    int32_t    x,
+    int32_t    x_end,
+    int32_t    y,
+    int32_t    width,
+    int32_t    height,
+    uint32_t * pOut,
+    int      * status) {
   
-  float min = 0.0f;
-  float max = 0.0f;
-  float D = 0.0f;
+  int errcode = 0;
   
   /* Check parameters */
-  if ((pRGB == NULL) || (pHSL == NULL)) {
-    abort();
-  }
-  
-  /* Fix non-finite channels */
-  if (!isfinite(pRGB->r)) {
-    pRGB->r = 0.0f;
-  }
-  if (!isfinite(pRGB->g)) {
-    pRGB->g = 0.0f;
-  }
-  if (!isfinite(pRGB->b)) {
-    pRGB->b = 0.0f;
-  }
-  
-  /* Clamp channel values */
-  if (!(pRGB->r >= 0.0f)) {
-    pRGB->r = 0.0f;
-  }
-  if (!(pRGB->g >= 0.0f)) {
-    pRGB->g = 0.0f;
-  }
-  if (!(pRGB->b >= 0.0f)) {
-    pRGB->b = 0.0f;
-  }
-  
-  if (!(pRGB->r <= 1.0f)) {
-    pRGB->r = 1.0f;
-  }
-  if (!(pRGB->g <= 1.0f)) {
-    pRGB->g = 1.0f;
-  }
-  if (!(pRGB->b <= 1.0f)) {
-    pRGB->b = 1.0f;
-  }
-
-  /* Fault if grayscale */
-  if ((pRGB->r == pRGB->g) && (pRGB->r == pRGB->b)) {
+  if ((pOut == NULL) || (status == NULL) ||
+      (x < 0) || (x_end < x) || (x_end > width)) {
     abort();
   }
   
-  /* Adapted from The Revolutionary Guide to Bitmapped Graphics,
-   * Control-Zed, Wrox Press, 1994, pg. 122-123 */
-  
-  max = pRGB->r;
-  if (pRGB->g > max) {
-    max = pRGB->g;
-  }
-  if (pRGB->b > max) {
-    max = pRGB->b;
-  }
-  
-  min = pRGB->r;
-  if (pRGB->g < min) {
-    min = pRGB->g;
-  }
-  if (pRGB->b < min) {
-    min = pRGB->b;
-  }
-
-  pHSL->l = (max + min) / 2.0f;
-  assert(max != min);
-  D = max - min;
-  
-  if (pHSL->l <= 0.5f) {
-    pHSL->s = D / (max + min);
-  } else {
-    pHSL->s = D / (2.0f - max - min);
-  }
-  
-  if (pRGB->r == max) {
-    pHSL->h = (pRGB->g - pRGB->b) / D;
-  
-  } else if (pRGB->g == max) {
-    pHSL->h = 2.0f + (pRGB->b - pRGB->r) / D;
-  
-  } else if (pRGB->b == max) {
-    pHSL->h = 4.0f + (pRGB->r - pRGB->g) / D;
-  
+  /* Native textures, plugin shaders, expression shaders, and generator
+   * shaders generate the whole span at once; everything else goes
+   * through vtx_query() */
+  if (m_vtx[tidx - 1].vtype == VTEX_NTEX) {
+    ntex_span(m_vtx[tidx - 1].v.nidx, x, y, x_end - x, width, height,
+                &(pOut[x]));
+    
+  } else if (m_vtx[tidx - 1].vtype == VTEX_EXPR) {
+    expr_span(m_vtx[tidx - 1].v.eidx, x, y, x_end - x, width, height,
+                &(pOut[x]));
+    
+  } else if (m_vtx[tidx - 1].vtype == VTEX_PLUGIN) {
+    if (!plugin_span(m_vtx[tidx - 1].v.pidx, x, y, x_end - x,
+                      width, height, &(pOut[x]), &errcode)) {
+      *status = 0;
+      fprintf(stderr, "%s: %s!\n",
+        pModule, plugin_errorString(errcode));
+    }
+    
+  } else if (m_vtx[tidx - 1].vtype == VTEX_PSHGEN) {
+    if (!pshade_span(m_vtx[tidx - 1].v.pShader, x, y, x_end - x,
+                      width, height, &(pOut[x]), &errcode)) {
+      *status = 0;
+      fprintf(stderr, "%s: Programmable shader error...\n",
+                pModule);
+      fprintf(stderr, "%s: %s!\n",
+        pModule, pshade_errorString(errcode));
+    }
+    
   } else {
-    /* Shouldn't happen */
-    abort();
-  }
-
-  pHSL->h *= 60.0f;
-  while(pHSL->h >= 360.0f) {
-    pHSL->h -= 360.0f;
-  }
-  while(pHSL->h < 0.0f) {
-    pHSL->h += 360.0f;
+    for( ; x < x_end; x++) {
+      pOut[x] = vtx_query(tidx, x, y, width, height, status);
+      if (!(*status)) {
+        break;
+      }
+    }
   }
 }
 
 /*
- * Convert an HSL color to RGB.
+ * Compute the constant-folded colors of all shading records.
  * 
- * pHSL points to the HSL color.  This structure is first adjusted in
- * the following way.  Any component that is not a finite value is set
- * to zero.  Then, the S and L components are clamped to the range
- * [0.0, 1.0].  Finally, the H component is adjusted to the degree range
- * [0.0, 360.0).  The H component adjustment is by successive additions
- * or subtractions, so do not pass a huge positive or negative value for
- * H.
+ * This must be called after the textures and the shading table have
+ * been loaded.  It replaces any colors computed earlier.
  * 
- * The RGB result is written to pRGB
+ * For each shading record, including the default record, and for each
+ * of the SHADE and PENCIL modes, if the faded texture and the first
+ * texture are both uniform, the whole pipeline is evaluated once and
+ * the result is stored in m_fold.
  * 
- * Parameters:
+ * This function handles reporting errors to stderr.
  * 
- *   pHSL - pointer to the input HSL, which may be adjusted
+ * Return:
  * 
- *   pRGB - pointer to the output RGB
+ *   non-zero if successful, zero if out of memory
  */
-static void hsl2rgb(HSL *pHSL, RGB *pRGB) {
-  
-  float m = 0.0f;
-  float n = 0.0f;
-  
-  /* Check parameters */
-  if ((pHSL == NULL) || (pRGB == NULL)) {
-    abort();
-  }
+static int fold_build(void) {
   
-  /* Fix non-finite channels */
-  if (!isfinite(pHSL->h)) {
-    pHSL->h = 0.0f;
-  }
-  if (!isfinite(pHSL->s)) {
-    pHSL->s = 0.0f;
-  }
-  if (!isfinite(pHSL->l)) {
-    pHSL->l = 0.0f;
-  }
+  int status = 1;
+  int rec = 0;
+  int m = 0;
+  int tidx = 0;
+  int rate = 0;
+  uint32_t c = 0;
+  SHADEREC srec;
   
-  /* Clamp S and L values */
-  if (!(pHSL->s >= 0.0f)) {
-    pHSL->s = 0.0f;
-  }
-  if (!(pHSL->l >= 0.0f)) {
-    pHSL->l = 0.0f;
-  }
+  /* Initialize structures */
+  memset(&srec, 0, sizeof(SHADEREC));
   
-  if (!(pHSL->s <= 1.0f)) {
-    pHSL->s = 1.0f;
-  }
-  if (!(pHSL->l <= 1.0f)) {
-    pHSL->l = 1.0f;
-  }
+  /* Release any previous colors */
+  free(m_fold);
+  m_fold = NULL;
+  m_fold_count = 0;
   
-  /* Adjust H value */
-  while (pHSL->h < 0.0f) {
-    pHSL->h += 360.0f;
-  }
-  while (pHSL->h >= 360.0f) {
-    pHSL->h -= 360.0f;
+  /* Allocate the colors, with the default record first */
+  if (status) {
+    m_fold = (uint32_t *) calloc(
+                ((size_t) ttable_count() + 1) * 2, sizeof(uint32_t));
+    if (m_fold == NULL) {
+      fprintf(stderr, "%s: Out of memory!\n", pModule);
+      status = 0;
+    }
   }
   
-  /* Adapted from The Revolutionary Guide to Bitmapped Graphics,
-   * Control-Zed, Wrox Press, 1994, pg. 124 */
-  if (pHSL->l <= 0.5f) {
-    n = pHSL->l * (1.0f + pHSL->s);
-  } else {
-    n = pHSL->l + pHSL->s - pHSL->l * pHSL->s;
+  /* Gamma tables are needed for compositing */
+  if (status) {
+    m_fold_count = (ttable_count() + 1) * 2;
+    gamma_sRGB();
   }
   
-  m = 2.0f * pHSL->l - n;
-  
-  if (pHSL->s == 0) {
-    pRGB->r = pHSL->l;
-    pRGB->g = pHSL->l;
-    pRGB->b = pHSL->l;
-  
-  } else {
-    pRGB->r = hslval(m, n, pHSL->h + 120.0f);
-    pRGB->g = hslval(m, n, pHSL->h);
-    pRGB->b = hslval(m, n, pHSL->h - 120.0f);
-  }
-    
-  /* Assert finite */
-  assert(isfinite(pRGB->r));
-  assert(isfinite(pRGB->g));
-  assert(isfinite(pRGB->b));
-    
-  /* Clamp ranges */
-  if (pRGB->r < 0.0f) {
-    pRGB->r = 0.0f;
-  }
-  if (pRGB->g < 0.0f) {
-    pRGB->g = 0.0f;
-  }
-  if (pRGB->b < 0.0f) {
-    pRGB->b = 0.0f;
-  }
+  /* Fold each record in each mode where possible */
+  for(rec = -1; status && (rec < ttable_count()); rec++) {
+    if (rec < 0) {
+      srec.rgbidx = -1;
+      ttable_query(&srec);
+    } else {
+      ttable_get(rec, &srec);
+    }
     
-  if (pRGB->r > 1.0f) {
-    pRGB->r = 1.0f;
-  }
-  if (pRGB->g > 1.0f) {
-    pRGB->g = 1.0f;
-  }
-  if (pRGB->b > 1.0f) {
-    pRGB->b = 1.0f;
+    for(m = 0; m < 2; m++) {
+      if (m == 0) {
+        tidx = srec.tidx;
+        rate = srec.srate;
+      } else {
+        tidx = 2;
+        rate = srec.drate;
+      }
+      
+      if ((tidx > m_vtx_count) || (!vtx_uniform(tidx)) ||
+          (!vtx_uniform(1))) {
+        continue;
+      }
+      
+      c = pixel_fade(
+            texture_pixel(m_vtx[tidx - 1].v.tidx, 0, 0), rate);
+      c = pixel_composite(c, texture_pixel(m_vtx[0].v.tidx, 0, 0));
+      c = pixel_composite(c, UINT32_C(0xffffffff));
+      if (srec.rgbtint != UINT32_C(0xffffffff)) {
+        c = pixel_colorize(c, srec.rgbtint);
+      }
+      
+      m_fold[((rec + 1) * 2) + m] = c;
+    }
   }
+  
+  /* Return status */
+  return status;
 }
 
 /*
- * Apply fading to an RGB value.
+ * Look up the constant-folded color of a shading record.
  * 
- * rgb is the 32-bit ARGB color to fade.
- * 
- * rate is a value in range [0, 255].  If 255, then rgb is returned
- * as-is.  If zero, then a fully transparent pixel is returned.  If in
- * between, the alpha value in the original RGB value is scaled.
+ * rec is the record index returned by ttable_query(), or -1 for the
+ * default record.  mode is STATS_MODE_SHADE or STATS_MODE_PENCIL.
  * 
  * Parameters:
  * 
- *   rgb - the RGB value to fade
+ *   rec - the shading record index or -1
  * 
- *   rate - the shading rate
+ *   mode - the mode
  * 
  * Return:
  * 
- *   the faded value
+ *   the folded color, or zero if the record is not constant in this
+ *   mode
  */
-static uint32_t fade(uint32_t rgb, int rate) {
-  
-  uint32_t result = 0;
-  SPH_ARGB argb;
+static uint32_t fold_get(int rec, int mode) {
   
-  /* Initialize structure */
-  memset(&argb, 0, sizeof(SPH_ARGB));
+  int i = 0;
   
   /* Check parameters */
-  if ((rate < 0) || (rate > 255)) {
+  if ((mode != STATS_MODE_SHADE) && (mode != STATS_MODE_PENCIL)) {
     abort();
   }
   
-  /* Handle cases */
-  if (rate >= 255) {
-    /* Full shading, so return RGB as-is */
-    result = rgb;
-    
-  } else if (rate < 1) {
-    /* No shading, so return fully transparent */
-    result = 0;
-    
-  } else {
-    /* Partial shading, so first unpack to ARGB */
-    sph_argb_unpack(rgb, &argb);
-    
-    /* Adjust alpha */
-    argb.a = (int) (
-                (((int32_t) argb.a) * ((int32_t) rate)) / 255
-              );
-    
-    /* Pack to get result */
-    result = sph_argb_pack(&argb);
+  /* Find the entry */
+  i = ((rec + 1) * 2) + ((mode == STATS_MODE_PENCIL) ? 1 : 0);
+  if ((i < 0) || (i >= m_fold_count)) {
+    return 0;
   }
   
-  /* Return result */
-  return result;
+  return m_fold[i];
 }
 
 /*
- * Apply alpha compositing.
+ * Threshold a mask or pencil pixel.
  * 
- * over is the 32-bit ARGB color that is on top.
+ * The pixel is down-converted to grayscale and compared against the
+ * midpoint.  Opaque black and opaque white, which make up nearly all of
+ * a typical mask or pencil image, are decided without unpacking.
  * 
- * under is the 32-bit ARGB color that is underneath.
+ * Parameters:
  * 
- * Gamma table must be initialized before calling.
+ *   argb - the packed ARGB pixel
+ * 
+ * Return:
+ * 
+ *   non-zero if the grayscale value is 128 or greater, zero otherwise
+ */
+static int mask_high(uint32_t argb) {
+  
+  SPH_ARGB ua;
+  
+  /* Fast paths for opaque black and white */
+  if (argb == UINT32_C(0xff000000)) {
+    return 0;
+  } else if (argb == UINT32_C(0xffffffff)) {
+    return 1;
+  }
+  
+  /* Unpack, down-convert to grayscale, and threshold */
+  memset(&ua, 0, sizeof(SPH_ARGB));
+  sph_argb_unpack(argb, &ua);
+  sph_argb_downGray(&ua);
+  
+  return (ua.g >= 128) ? 1 : 0;
+}
+
+/*
+ * Classify each pixel of a scanline.
+ * 
+ * The mode of each pixel is written to pModeRow as one of the
+ * STATS_MODE constants.  For pixels that are not BLANK, the RGB index
+ * of the shading pixel is written to pIndexRow.  pIndexRow is left
+ * alone for BLANK pixels.
+ * 
+ * If pPalRow is not NULL, it holds the palette indices of the shading
+ * scanline from the palette pre-pass.  These are written to pIndexRow
+ * instead, and pShadingScan is ignored and may be NULL.
+ * 
+ * The mask scanline is classified first.  The pencil and shading
+ * scanlines are only looked at for pixels that the mask leaves
+ * visible, so a fully masked scanline costs one pass over the mask.
+ * 
+ * Consecutive pixels with the same value are common in all three
+ * inputs, so the result for the previous value is reused when the
+ * value repeats.
  * 
  * Parameters:
  * 
- *   over - the over color
+ *   pMaskScan - the mask scanline
+ * 
+ *   pPencilScan - the pencil scanline
+ * 
+ *   pShadingScan - the shading scanline
+ * 
+ *   pPalRow - the palette indices of the shading scanline, or NULL
  * 
- *   under - the under color
+ *   pModeRow - receives the mode of each pixel
+ * 
+ *   pIndexRow - receives the RGB index of each visible pixel
+ * 
+ *   width - the number of pixels in each scanline
  * 
  * Return:
  * 
- *   the composited result
+ *   non-zero if any pixel is not BLANK, zero if the whole scanline is
+ *   BLANK
  */
-static uint32_t composite(uint32_t over, uint32_t under) {
-  
-  SPH_ARGB co;
-  SPH_ARGB cu;
-  SPH_ARGB cf;
-  float ao = 0.0f;
-  float au = 0.0f;
-  float af = 0.0f;
-  float mo = 0.0f;
-  float mu = 0.0f;
-  
-  /* Initialize structures */
-  memset(&co, 0, sizeof(SPH_ARGB));
-  memset(&cu, 0, sizeof(SPH_ARGB));
-  memset(&cf, 0, sizeof(SPH_ARGB));
-  
-  /* Unpack colors */
-  sph_argb_unpack(over, &co);
-  sph_argb_unpack(under, &cu);
+static int row_classify(
+    const uint32_t      * pMaskScan,
+    const uint32_t      * pPencilScan,
+    const uint32_t      * pShadingScan,
+    const uint16_t      * pPalRow,
+          unsigned char * pModeRow,
+          int32_t       * pIndexRow,
+          int32_t         width) {
+  
+  int visible = 0;
+  int32_t x = 0;
   
-  /* Get floating-point alpha values */
-  ao = ((float) co.a) / 255.0f;
-  au = ((float) cu.a) / 255.0f;
+  uint32_t last_in = 0;
+  int last_out = 0;
+  uint32_t last_shade = 0;
+  int32_t last_index = 0;
   
-  /* Calculate output alpha */
-  af = ao + (au * (1.0f - ao));
-  if (af * 255.0f < 1.0f) {
-    af = 0.0f;
+  /* Check parameters */
+  if ((pMaskScan == NULL) || (pPencilScan == NULL) ||
+      ((pShadingScan == NULL) && (pPalRow == NULL)) ||
+      (pModeRow == NULL) || (pIndexRow == NULL) || (width < 1)) {
+    abort();
   }
   
-  /* Watch for zero output alpha case */
-  if (af != 0.0f) {
-    
-    /* Non-zero output alpha -- composite each component */
-    cf.a = (int) floor(((double) af) * 255.0);
-    
-    mo = gamma_undo(co.r);
-    mu = gamma_undo(cu.r);
-    cf.r = gamma_correct(((mo * ao) + (mu * au * (1.0f - ao))) / af);
-    
-    mo = gamma_undo(co.g);
-    mu = gamma_undo(cu.g);
-    cf.g = gamma_correct(((mo * ao) + (mu * au * (1.0f - ao))) / af);
+  /* Classify the mask */
+  last_in = pMaskScan[0];
+  last_out = mask_high(last_in);
+  for(x = 0; x < width; x++) {
+    if (pMaskScan[x] != last_in) {
+      last_in = pMaskScan[x];
+      last_out = mask_high(last_in);
+    }
     
-    mo = gamma_undo(co.b);
-    mu = gamma_undo(cu.b);
-    cf.b = gamma_correct(((mo * ao) + (mu * au * (1.0f - ao))) / af);
+    if (last_out) {
+      pModeRow[x] = (unsigned char) STATS_MODE_BLANK;
+    } else {
+      pModeRow[x] = (unsigned char) STATS_MODE_SHADE;
+      visible = 1;
+    }
+  }
+  
+  /* Classify pencil and get shading indices of visible pixels */
+  if (visible) {
+    last_in = pPencilScan[0];
+    last_out = mask_high(last_in);
+    if (pPalRow == NULL) {
+      last_shade = pShadingScan[0];
+      last_index = splane_rgb(last_shade);
+    }
     
-  } else {
-    /* Zero output alpha, so final is fully transparent */
-    cf.a = 0;
-    cf.r = 0;
-    cf.g = 0;
-    cf.b = 0;
+    for(x = 0; x < width; x++) {
+      if (pModeRow[x] == STATS_MODE_BLANK) {
+        continue;
+      }
+      
+      if (pPencilScan[x] != last_in) {
+        last_in = pPencilScan[x];
+        last_out = mask_high(last_in);
+      }
+      if (!last_out) {
+        pModeRow[x] = (unsigned char) STATS_MODE_PENCIL;
+      }
+      
+      if (pPalRow != NULL) {
+        pIndexRow[x] = (int32_t) pPalRow[x];
+        continue;
+      }
+      
+      if (pShadingScan[x] != last_shade) {
+        last_shade = pShadingScan[x];
+        last_index = splane_rgb(last_shade);
+      }
+      pIndexRow[x] = last_index;
+    }
   }
   
-  /* Pack for result */
-  return sph_argb_pack(&cf);
+  /* Return whether anything is visible */
+  return visible;
 }
 
 /*
- * Apply colorization to the given RGB color.
+ * Render a span of SHADE or PENCIL pixels.
+ * 
+ * mode is STATS_MODE_SHADE or STATS_MODE_PENCIL, and every pixel in the
+ * span from x up to but excluding x_end must have that mode.  The
+ * output pixels are written to pOutScan and the RGB indices are read
+ * from pIndexRow, both indexed by X coordinate.  If there is a palette
+ * for the current render, pIndexRow holds palette indices instead, and
+ * the records are taken from the palette.
+ * 
+ * SHADE pixels use the texture and shading rate of their shading
+ * record.  PENCIL pixels use the second texture and the drawing rate.
+ * In both cases, the result is composited over the first texture, then
+ * over white, and then colorized if the record has a tint.
+ * 
+ * Neighbouring pixels usually share a shading region, so the shading
+ * table is only queried again when the index changes.
+ * 
+ * If both textures are uniform, every pixel of the record gets the
+ * color computed by fold_build().  Otherwise, if both textures are
+ * image textures, the result is periodic, and pixels are copied from a
+ * cached tile when possible.  Rendered pixels
+ * are stored in the tile.  See tcache.h for further information.
+ * 
+ * Native textures are generated with vtx_span() into pTexRow for each
+ * run of pixels that share a shading record, and into pBaseRow for the
+ * whole span if the first texture is native.  Both are indexed by X
+ * coordinate and must have room for width pixels.  Records whose
+ * texture is the same as a native first texture (see vtx_same()) read
+ * it from pBaseRow, so each texture is requested at most once for any
+ * pixel of the span, in left-to-right order, as generator and plugin
+ * shaders require.  Different shaders keep separate scanning
+ * positions, so the runs of a record texture may go ahead of the first
+ * texture.
+ * 
+ * This function handles reporting errors to stderr.
  * 
- * rgb_in is the 32-bit ARGB color to colorize.
+ * Parameters:
  * 
- * rgb_tint is the 24-bit RGB color to use as a tint.  The eight most
- * significant bits are ignored.
+ *   mode - the mode of the span
  * 
- * Parameters:
+ *   pOutScan - the output scanline
+ * 
+ *   pIndexRow - the RGB indices of the scanline
+ * 
+ *   pTexRow - scratch buffer for the faded texture
+ * 
+ *   pBaseRow - scratch buffer for the first texture
+ * 
+ *   x - the first X coordinate of the span
  * 
- *   rgb_in - the input RGB
+ *   x_end - one past the last X coordinate of the span
  * 
- *   rgb_tint - the tint
+ *   y - the Y coordinate of the scanline
+ * 
+ *   width - the width of the image
+ * 
+ *   height - the height of the image
  * 
  * Return:
  * 
- *   the colorized output
+ *   non-zero if successful, zero if a programmable shader failed
  */
-static uint32_t colorize(uint32_t rgb_in, uint32_t rgb_tint) {
+static int row_span(
+          int        mode,
+          uint32_t * pOutScan,
+    const int32_t  * pIndexRow,
+          uint32_t * pTexRow,
+          uint32_t * pBaseRow,
+          int32_t    x,
+          int32_t    x_end,
+          int32_t    y,
+          int32_t    width,
+          int32_t    height) {
   
-  SPH_ARGB argb;
-  int gray_i = 0;
-  float gray = 0.0f;
-  RGB rgb;
-  HSL hsl;
+  int status = 1;
+  int timed = 0;
+  int rec = 0;
+  int tidx = 0;
+  int rate = 0;
+  int have_rec = 0;
+  int32_t key = 0;
+  int tex_native = 0;
+  int tex_fill = 0;
+  int tex_base = 0;
+  int base_native = 0;
+  int base_fill = 0;
+  int32_t run_end = 0;
+  uint32_t tex = 0;
+  uint32_t c = 0;
+  uint32_t fold = 0;
+  double t = 0.0;
+  SHADEREC srec;
+  
+  int32_t tw = 0;
+  int32_t th = 0;
+  uint32_t *pTile = NULL;
+  uint32_t *pCell = NULL;
   
   /* Initialize structures */
-  memset(&argb, 0, sizeof(SPH_ARGB));
-  memset(&rgb, 0, sizeof(RGB));
-  memset(&hsl, 0, sizeof(HSL));
-  
-  /* Down-convert input to grayscale */
-  sph_argb_unpack(rgb_in, &argb);
-  sph_argb_downGray(&argb);
-  gray_i = argb.r;
-
-  /* Unpack RGB tint */
-  sph_argb_unpack(rgb_tint, &argb);
- 
-  /* Check if tint is grayscale */
-  if ((argb.r == argb.g) && (argb.r == argb.b)) {
-    /* Grayscale tint, so result is just grayscale input */
-    argb.a = 255;
-    argb.r = gray_i;
-    argb.g = gray_i;
-    argb.b = gray_i;
+  memset(&srec, 0, sizeof(SHADEREC));
   
-  } else {
-    /* Not a grayscale tint, next check if input greyscale is pure white
-     * or black */
-    if (gray_i < 1) {
-      /* Input grayscale pure black, so result is black */
-      argb.a = 255;
-      argb.r = 0;
-      argb.g = 0;
-      argb.b = 0;
+  /* Check parameters */
+  if (((mode != STATS_MODE_SHADE) && (mode != STATS_MODE_PENCIL)) ||
+      (pOutScan == NULL) || (pIndexRow == NULL) ||
+      (pTexRow == NULL) || (pBaseRow == NULL) ||
+      (x < 0) || (x_end < x) || (x_end > width)) {
+    abort();
+  }
+  
+  /* A native first texture is generated for the whole span when it is
+   * first needed */
+  if (x < x_end) {
+    base_native = vtx_native(1);
+    base_fill = base_native;
+  }
+  
+  /* Go through each pixel */
+  for( ; x < x_end; x++) {
+    
+    timed = stats_pixel(mode);
+    if (timed) {
+      t = stats_clock();
+    }
+    
+    /* Get the shading record, unless it is the same as the last one */
+    if ((!have_rec) || (pIndexRow[x] != key)) {
+      key = pIndexRow[x];
+      if (m_pal_rec != NULL) {
+        memcpy(&srec, &(m_pal_rec[key]), sizeof(SHADEREC));
+        rec = m_pal_idx[key];
+      } else {
+        srec.rgbidx = key;
+        rec = ttable_query(&srec);
+      }
+      have_rec = 1;
+      
+      if (mode == STATS_MODE_PENCIL) {
+        tidx = 2;
+        rate = srec.drate;
+      } else {
+        tidx = srec.tidx;
+        rate = srec.srate;
+      }
       
-    } else if (gray_i > 254) {
-      /* Input grayscale pure white, so result is white */
-      argb.a = 255;
-      argb.r = 255;
-      argb.g = 255;
-      argb.b = 255;
+      fold = fold_get(rec, mode);
       
-    } else {
-      /* General case -- input grayscale not pure white or black and
-       * tint is not grayscale -- compute floating-point values */
-      gray = ((float) gray_i) / 255.0f;
-
-      rgb.r = ((float) argb.r) / 255.0f;
-      rgb.g = ((float) argb.g) / 255.0f;
-      rgb.b = ((float) argb.b) / 255.0f;
-
-      /* Convert RGB to HSL */
-      rgb2hsl(&rgb, &hsl);
-
-      /* Set lightness to grayscale value */
-      hsl.l = gray;
-        
-      /* Convert adjusted HSL back to RGB */
-      hsl2rgb(&hsl, &rgb);
-        
-      /* Convert floating-point RGB to integer */
-      argb.a = 255;
-      argb.r = (int) floor(((double) rgb.r) * 255.0);
-      argb.g = (int) floor(((double) rgb.g) * 255.0);
-      argb.b = (int) floor(((double) rgb.b) * 255.0);
-        
-      if (argb.r < 0) {
-        argb.r = 0;
+      /* A native texture is generated for the run of pixels that share
+       * this record when it is first needed, unless it is the same as
+       * the native first texture, which is taken from the whole span so
+       * that no part of the scanline is requested twice */
+      tex_native = vtx_native(tidx);
+      tex_base = base_native && vtx_same(tidx, 1);
+      tex_fill = tex_native && (!tex_base);
+      if (tex_fill) {
+        for(run_end = x + 1; run_end < x_end; run_end++) {
+          if (pIndexRow[run_end] != key) {
+            break;
+          }
+        }
       }
-      if (argb.g < 0) {
-        argb.g = 0;
+      
+      pTile = NULL;
+      if ((fold == 0) && vtx_period(tidx, &tw, &th)) {
+        pTile = tcache_get(tidx, rate, srec.rgbtint, tw, th);
+      }
+    }
+    stats_record(mode, rec);
+    if (timed) {
+      stats_lap(STATS_TTABLE, &t);
+    }
+    
+    /* Use the folded color if the record is constant */
+    if (fold != 0) {
+      pOutScan[x] = fold;
+      if (timed) {
+        stats_lap(STATS_TILE, &t);
       }
-      if (argb.b < 0) {
-        argb.b = 0;
+      continue;
+    }
+    
+    /* Copy from the tile if this position has already been rendered */
+    if (pTile != NULL) {
+      pCell = &(pTile[(x % tw) + ((y % th) * tw)]);
+      if (*pCell != 0) {
+        pOutScan[x] = *pCell;
+        if (timed) {
+          stats_lap(STATS_TILE, &t);
+        }
+        continue;
       }
-        
-      if (argb.r > 255) {
-        argb.r = 255;
+    }
+    
+    /* Begin with the selected texture faded by the selected rate */
+    if (tex_fill) {
+      vtx_span(tidx, x, run_end, y, width, height, pTexRow, &status);
+      tex_fill = 0;
+    }
+    if (tex_base) {
+      if (base_fill) {
+        vtx_span(1, x, x_end, y, width, height, pBaseRow, &status);
+        base_fill = 0;
       }
-      if (argb.g > 255) {
-        argb.g = 255;
+      tex = pBaseRow[x];
+    } else if (tex_native) {
+      tex = pTexRow[x];
+    } else {
+      tex = vtx_query(tidx, x, y, width, height, &status);
+    }
+    if (timed) {
+      stats_lap(vtx_stage(tidx), &t);
+    }
+    if (!status) {
+      break;
+    }
+    
+    c = pixel_fade(tex, rate);
+    if (timed) {
+      stats_lap(STATS_FADE, &t);
+    }
+    
+    /* Composite over the first texture and then pure white */
+    if (base_fill) {
+      vtx_span(1, x, x_end, y, width, height, pBaseRow, &status);
+      base_fill = 0;
+    }
+    if (base_native) {
+      tex = pBaseRow[x];
+    } else {
+      tex = vtx_query(1, x, y, width, height, &status);
+    }
+    if (timed) {
+      stats_lap(vtx_stage(1), &t);
+    }
+    if (!status) {
+      break;
+    }
+    
+    c = pixel_composite_memo(c, tex);
+    if (timed) {
+      stats_lap(STATS_COMPOSITE1, &t);
+    }
+    
+    c = pixel_composite_memo(c, UINT32_C(0xffffffff));
+    if (timed) {
+      stats_lap(STATS_COMPOSITE2, &t);
+    }
+    
+    /* Colorize the output (unless disabled), using the precomputed
+     * results of compiled tables when available */
+    if (srec.pTint != NULL) {
+      c = srec.pTint[pixel_gray(c)];
+      if (timed) {
+        stats_lap(STATS_COLORIZE, &t);
       }
-      if (argb.b > 255) {
-        argb.b = 255;
+      
+    } else if (srec.rgbtint != UINT32_C(0xffffffff)) {
+      c = pixel_colorize_memo(c, srec.rgbtint);
+      if (timed) {
+        stats_lap(STATS_COLORIZE, &t);
       }
     }
+    
+    pOutScan[x] = c;
+    if (pTile != NULL) {
+      *pCell = c;
+    }
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Given a Lilac error code, return a string for the error message.
+ * 
+ * The error message does not have any punctuation at the end of the
+ * string nor does it have a line break.  The first letter is
+ * capitalized.
+ * 
+ * If zero is passed (meaning no error), the string is "No error"
+ * 
+ * If the error code is in one of the module ranges, this function
+ * invokes the error string function in the appropriate module to get
+ * the error message.
+ * 
+ * If an unrecognized error code is passed, the string is "Unknown
+ * error".
+ * 
+ * Parameters:
+ * 
+ *   code - the Lilac error code
+ * 
+ * Return:
+ * 
+ *   an error message
+ */
+static const char *lilac_errorString(int code) {
+  
+  const char *pResult = "Unknown error";
+  
+  if ((code >= ERROR_SPH_MIN) && (code <= ERROR_SPH_MAX)) {
+    pResult = sph_image_errorString(code - ERROR_SPH_MIN);
+  
+  } else if (code == ERROR_MISMATCH) {
+    pResult =
+      "Mask, pencil, and shading files must have same dimensions";
+  
+  } else if (code == ERROR_SHADER) {
+    pResult = "Programmable shader failed";
+  
+  } else if (code == ERROR_MEMORY) {
+    pResult = "Out of memory";
+  
+  } else if (code == ERROR_PLANE) {
+    pResult = "Can't read palette index plane";
+  }
+  
+  return pResult;
+}
+
+/*
+ * Given a Lilac error location, return a string describing which file
+ * the error applies to.
+ * 
+ * The string has the first letter capitalized and no punctuation or
+ * line break at the end.
+ * 
+ * NULL is returned for ERRORLOC_UNKNOWN and for unrecognized locations.
+ * 
+ * Parameters:
+ * 
+ *   errloc - the error location
+ * 
+ * Return:
+ * 
+ *   a description of the error location, or NULL
+ */
+static const char *lilac_errorLocString(int errloc) {
+  
+  const char *pResult = NULL;
+  
+  if (errloc == ERRORLOC_OUTFILE) {
+    pResult = "Error writing output file";
+  
+  } else if (errloc == ERRORLOC_MASKFILE) {
+    pResult = "Error reading mask file";
+  
+  } else if (errloc == ERRORLOC_PENCILFILE) {
+    pResult = "Error reading pencil file";
+  
+  } else if (errloc == ERRORLOC_SHADINGFILE) {
+    pResult = "Error reading shading file";
   }
   
-  /* Return packed value */
-  return sph_argb_pack(&argb);
+  return pResult;
 }
 
 /*
@@ -1205,12 +2096,20 @@ static int lilac(
   SPH_IMAGE_READER *pPencilRead = NULL;
   SPH_IMAGE_READER *pShadingRead = NULL;
   
-  SPH_ARGB argb;
+  int mode = 0;
+  double t = 0.0;
+  
+  int have_plane = 0;
+  int32_t plane_w = 0;
+  int32_t plane_h = 0;
+  int32_t i = 0;
   SHADEREC srec;
   
-  int maskval = 0;
-  int pencilval = 0;
-  int32_t rgbindex = 0;
+  unsigned char *pModeRow = NULL;
+  int32_t *pIndexRow = NULL;
+  uint16_t *pPalRow = NULL;
+  uint32_t *pTexRow = NULL;
+  uint32_t *pBaseRow = NULL;
   
   uint32_t *pOutScan = NULL;
   uint32_t *pMaskScan = NULL;
@@ -1221,13 +2120,13 @@ static int lilac(
   int32_t height = 0;
   
   int32_t x = 0;
+  int32_t x_end = 0;
   int32_t y = 0;
   
   time_t last_update = (time_t) 0;
   time_t current = (time_t) 0;
   
   /* Initialize structures */
-  memset(&argb, 0, sizeof(SPH_ARGB));
   memset(&srec, 0, sizeof(SHADEREC));
   
   /* Check parameters */
@@ -1251,6 +2150,12 @@ static int lilac(
   /* Initialize gamma correction tables for sRGB */
   gamma_sRGB();
   
+  /* Each render starts its texture queries at the top-left corner */
+  vtx_rewind();
+  
+  /* Start timing the whole render */
+  stats_begin();
+  
   /* Open readers on each input file */
   if (status) {
     pMaskRead = sph_image_reader_newFromPath(pMaskPath, &errcode);
@@ -1270,7 +2175,24 @@ static int lilac(
     }
   }
   
-  if (status) {
+  /* With the palette pre-pass, or for an indexed shading file, wait for
+   * the index plane of the shading file, starting the pass now if
+   * main() didn't start it early; if there is no plane, the shading
+   * file is read normally, which also reports any error in it */
+  if (status && (m_palette || splane_indexed(pShadingPath))) {
+    t = stats_clock();
+    if (!splane_started()) {
+      splane_start(pShadingPath);
+    }
+    have_plane = splane_finish(&errcode);
+    stats_lap(STATS_DECODE, &t);
+    
+    if (have_plane) {
+      splane_size(&plane_w, &plane_h);
+    }
+  }
+  
+  if (status && (!have_plane)) {
     pShadingRead = sph_image_reader_newFromPath(pShadingPath, &errcode);
     if (pShadingRead == NULL) {
       *pError = errcode + ERROR_SPH_MIN;
@@ -1293,7 +2215,13 @@ static int lilac(
       status = 0;
     }
   }
-  if (status) {
+  if (status && have_plane) {
+    if ((width != plane_w) || (height != plane_h)) {
+      *pError = ERROR_MISMATCH;
+      status = 0;
+    }
+  }
+  if (status && (!have_plane)) {
     if (width != sph_image_reader_width(pShadingRead)) {
       *pError = ERROR_MISMATCH;
       status = 0;
@@ -1305,13 +2233,34 @@ static int lilac(
       status = 0;
     }
   }
-  if (status) {
+  if (status && (!have_plane)) {
     if (height != sph_image_reader_height(pShadingRead)) {
       *pError = ERROR_MISMATCH;
       status = 0;
     }
   }
   
+  /* Resolve each palette entry to its shading record once */
+  if (status && have_plane) {
+    m_pal_count = splane_colors();
+    m_pal_rec = (SHADEREC *) malloc(
+                  ((size_t) m_pal_count) * sizeof(SHADEREC));
+    m_pal_idx = (int *) malloc(((size_t) m_pal_count) * sizeof(int));
+    pPalRow = (uint16_t *) malloc(((size_t) width) * sizeof(uint16_t));
+    if ((m_pal_rec == NULL) || (m_pal_idx == NULL) ||
+        (pPalRow == NULL)) {
+      *pError = ERROR_MEMORY;
+      status = 0;
+    }
+  }
+  if (status && have_plane) {
+    for(i = 0; i < m_pal_count; i++) {
+      srec.rgbidx = splane_color(i);
+      m_pal_idx[i] = ttable_query(&srec);
+      memcpy(&(m_pal_rec[i]), &srec, sizeof(SHADEREC));
+    }
+  }
+  
   /* Open a writer for the output file with the same image dimensions */
   if (status) {
     pWriter = sph_image_writer_newFromPath(
@@ -1333,6 +2282,20 @@ static int lilac(
     pOutScan = sph_image_writer_ptr(pWriter);
   }
   
+  /* Allocate the mode and index buffers for classifying scanlines, and
+   * the buffers for generating native textures */
+  if (status) {
+    pModeRow = (unsigned char *) malloc((size_t) width);
+    pIndexRow = (int32_t *) malloc(((size_t) width) * sizeof(int32_t));
+    pTexRow = (uint32_t *) malloc(((size_t) width) * sizeof(uint32_t));
+    pBaseRow = (uint32_t *) malloc(((size_t) width) * sizeof(uint32_t));
+    if ((pModeRow == NULL) || (pIndexRow == NULL) ||
+        (pTexRow == NULL) || (pBaseRow == NULL)) {
+      *pError = ERROR_MEMORY;
+      status = 0;
+    }
+  }
+  
   /* Begin with the update timer and current time set to the current
    * time (or -1 if error) */
   if (status) {
@@ -1346,7 +2309,8 @@ static int lilac(
 
       /* If there hasn't been a timer error, see if we need a status
        * update */
-      if ((last_update != (time_t)-1) && (current != (time_t)-1)) {
+      if (m_progress &&
+          (last_update != (time_t)-1) && (current != (time_t)-1)) {
         /* Get current time */
         current = time(NULL);
         
@@ -1364,6 +2328,7 @@ static int lilac(
       }
 
       /* Load each scanline from the input files */
+      t = stats_clock();
       if (status) {
         pMaskScan = sph_image_reader_read(pMaskRead, &errcode);
         if (pMaskScan == NULL) {
@@ -1382,7 +2347,13 @@ static int lilac(
         }
       }
       
-      if (status) {
+      if (status && have_plane) {
+        if (!splane_row(y, pPalRow)) {
+          *pError = ERROR_PLANE;
+          *pErrLoc = ERRORLOC_SHADINGFILE;
+          status = 0;
+        }
+      } else if (status) {
         pShadingScan = sph_image_reader_read(pShadingRead, &errcode);
         if (pShadingScan == NULL) {
           *pError = errcode + ERROR_SPH_MIN;
@@ -1390,121 +2361,50 @@ static int lilac(
           status = 0;
         }
       }
+      stats_lap(STATS_DECODE, &t);
 
-      /* Go through each pixel */
+      /* Classify the scanline; a fully masked scanline is blank */
       if (status) {
-        for(x = 0; x < width; x++) {
-
-          /* Unpack the mask file pixel */
-          sph_argb_unpack(pMaskScan[x], &argb);
-          
-          /* Down-convert mask file pixel to grayscale */
-          sph_argb_downGray(&argb);
-          
-          /* If grayscale value 128 or greater, set mask value; else,
-           * clear it */
-          if (argb.g >= 128) {
-            maskval = 1;
-          } else {
-            maskval = 0;
-          }
-          
-          /* Unpack the pencil file pixel */
-          sph_argb_unpack(pPencilScan[x], &argb);
-          
-          /* Down-convert pencil file pixel to grayscale */
-          sph_argb_downGray(&argb);
-          
-          /* If grayscale value 128 or greater, set pencil value; else,
-           * clear it */
-          if (argb.g >= 128) {
-            pencilval = 1;
-          } else {
-            pencilval = 0;
-          }
-      
-          /* Unpack the shading file pixel */
-          sph_argb_unpack(pShadingScan[x], &argb);
-          
-          /* Down-convert shading file pixel to RGB and set the alpha
-           * channel to zero so we only have the RGB */
-          sph_argb_downRGB(&argb);
-          argb.a = 0;
-          
-          /* Pack the down-converted shading pixel with zero alpha to
-           * get the RGB index */
-          rgbindex = (int32_t) sph_argb_pack(&argb);
-          
-          /* Check for cases */
-          if (maskval) {
-            /* Mask file white, so output fully transparent */
-            pOutScan[x] = 0;
-
-          } else if (!pencilval) {
-            /* Mask file black, pencil file black -- get shade record */
-            srec.rgbidx = rgbindex;
-            ttable_query(&srec);
-            
-            /* Begin with the second texture faded by the drawing
-             * rate */
-            pOutScan[x] = fade(
-                            vtx_query(2, x, y, width, height, &status),
-                            srec.drate);
-            
-            /* Get the faded pencil texture over the first texture over
-             * white */
-            if (status) {
-              pOutScan[x] = composite(
-                              composite(
-                                pOutScan[x],
-                                vtx_query(
-                                  1, x, y, width, height, &status)),
-                              UINT32_C(0xffffffff));
-            }
-            
-            /* Colorize the output (unless disabled) */
-            if (status && (srec.rgbtint != UINT32_C(0xffffffff))) {
-              pOutScan[x] = colorize(pOutScan[x], srec.rgbtint);
-            }
-          
-          } else {
-            /* Mask file black, pencil file white -- get shade record */
-            srec.rgbidx = rgbindex;
-            ttable_query(&srec);
+        if (!row_classify(pMaskScan, pPencilScan, pShadingScan,
+                            pPalRow, pModeRow, pIndexRow, width)) {
+          memset(pOutScan, 0, ((size_t) width) * sizeof(uint32_t));
+          stats_span(STATS_MODE_BLANK, width);
+          x = width;
+        } else {
+          x = 0;
+        }
+      }
       
-            /* Begin with the requested texture faded by the shading
-             * rate */
-            pOutScan[x] = fade(
-                            vtx_query(
-                              srec.tidx, x, y, width, height, &status),
-                            srec.srate);
-            
-            /* Composite over the first texture and then pure white */
-            if (status) {
-              pOutScan[x] = composite(
-                              composite(
-                                pOutScan[x],
-                                vtx_query(
-                                  1, x, y, width, height, &status)),
-                              UINT32_C(0xffffffff));
-            }
-            
-            /* Colorize the output (unless disabled) */
-            if (status && (srec.rgbtint != UINT32_C(0xffffffff))) {
-              pOutScan[x] = colorize(pOutScan[x], srec.rgbtint);
-            }
-          }
-          
-          /* Leave loop if error */
-          if (!status) {
+      /* Render each span of pixels that share a mode */
+      while (status && (x < width)) {
+        mode = pModeRow[x];
+        for(x_end = x + 1; x_end < width; x_end++) {
+          if (pModeRow[x_end] != mode) {
             break;
           }
         }
+        
+        if (mode == STATS_MODE_BLANK) {
+          /* Mask file white, so output fully transparent */
+          memset(&(pOutScan[x]), 0,
+                  ((size_t) (x_end - x)) * sizeof(uint32_t));
+          stats_span(STATS_MODE_BLANK, x_end - x);
+          
+        } else {
+          /* Shaded or pencil span */
+          status = row_span(mode, pOutScan, pIndexRow,
+                              pTexRow, pBaseRow,
+                              x, x_end, y, width, height);
+        }
+        
+        x = x_end;
       }
       
       /* Write the output scanline */
       if (status) {
+        t = stats_clock();
         sph_image_writer_write(pWriter);
+        stats_lap(STATS_ENCODE, &t);
       }
       
       /* Leave loop if error */
@@ -1514,9 +2414,12 @@ static int lilac(
     }
   }
   
-  /* Close writer object if open */
+  /* Close writer object if open, which flushes the rest of the
+   * output */
+  t = stats_clock();
   sph_image_writer_close(pWriter);
   pWriter = NULL;
+  stats_lap(STATS_ENCODE, &t);
   
   /* Close reader objects if open */
   sph_image_reader_close(pMaskRead);
@@ -1528,6 +2431,412 @@ static int lilac(
   sph_image_reader_close(pShadingRead);
   pShadingRead = NULL;
   
+  /* Free the scanline buffers */
+  free(pModeRow);
+  pModeRow = NULL;
+  
+  free(pIndexRow);
+  pIndexRow = NULL;
+  
+  free(pTexRow);
+  pTexRow = NULL;
+  
+  free(pBaseRow);
+  pBaseRow = NULL;
+  
+  /* Release the palette and the index plane */
+  free(pPalRow);
+  pPalRow = NULL;
+  
+  free(m_pal_rec);
+  m_pal_rec = NULL;
+  
+  free(m_pal_idx);
+  m_pal_idx = NULL;
+  m_pal_count = 0;
+  
+  splane_close();
+  
+  /* Failures that have no other error code came from a programmable
+   * shader, which has already reported details to standard error */
+  if ((!status) && (*pError == 0)) {
+    *pError = ERROR_SHADER;
+  }
+  
+  /* Stop timing the whole render */
+  stats_end();
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Load the programmable shader, the virtual textures, and the shading
+ * table.
+ * 
+ * This function handles reporting errors to stderr.
+ * 
+ * pTablePath is the path to the shading table file.  Paths with a
+ * case-insensitive .ltt extension are loaded as compiled tables, and
+ * other paths are parsed as text tables.
+ * 
+ * pShaderPath is the path to the Lua script for the programmable
+ * shader, or "-" if there is no programmable shader.
+ * 
+ * tcount is the number of texture parameters in ppTex, which must be
+ * in range zero to TEXTURE_MAXCOUNT.
+ * 
+ * Parameters:
+ * 
+ *   pTablePath - path to the shading table file
+ * 
+ *   pShaderPath - path to the shader script, or "-"
+ * 
+ *   tcount - the number of texture parameters
+ * 
+ *   ppTex - the texture parameters
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if failure
+ */
+static int lilac_setup(
+    const char *  pTablePath,
+    const char *  pShaderPath,
+          int     tcount,
+          char ** ppTex) {
+  
+  int status = 1;
+  int i = 0;
+  int errcode = 0;
+  int errloc = 0;
+  size_t slen = 0;
+  const char *pExt = NULL;
+  
+  /* Check parameters */
+  if ((pTablePath == NULL) || (pShaderPath == NULL) ||
+      (tcount < 0) || (tcount > TEXTURE_MAXCOUNT) ||
+      ((tcount > 0) && (ppTex == NULL))) {
+    abort();
+  }
+  
+  /* Initialize the programmable shader module, unless the shader path
+   * has the special value "-" */
+  if (status) {
+    if (strcmp(pShaderPath, "-") != 0) {
+      if (!pshade_load(pShaderPath, &errcode)) {
+        status = 0;
+        fprintf(stderr, "%s: Error loading programmable shader...\n",
+          pModule);
+        fprintf(stderr, "%s: %s!\n",
+          pModule, pshade_errorString(errcode));
+      }
+    }
+  }
+  
+  /* Load each texture in the virtual texture table */
+  if (status) {
+    for(i = 0; i < tcount; i++) {
+      if (!vtx_load(ppTex[i])) {
+        status = 0;
+        break;
+      }
+    }
+  }
+  
+  /* Initialize the shading table, either from a compiled table or by
+   * parsing a text table */
+  slen = strlen(pTablePath);
+  if (slen >= 4) {
+    pExt = &(pTablePath[slen - 4]);
+  }
+  if (status && (pExt != NULL) && (pExt[0] == '.') &&
+      ((pExt[1] == 'l') || (pExt[1] == 'L')) &&
+      ((pExt[2] == 't') || (pExt[2] == 'T')) &&
+      ((pExt[3] == 't') || (pExt[3] == 'T'))) {
+    if (!ttable_load(pTablePath, &errcode, m_vtx_count)) {
+      fprintf(stderr, "%s: Error loading compiled table file...\n",
+                pModule);
+      fprintf(stderr, "%s: %s!\n", pModule,
+              ttable_errorString(errcode));
+      status = 0;
+    }
+    
+  } else if (status) {
+    if (!ttable_parse(pTablePath, &errcode, &errloc, m_vtx_count)) {
+      fprintf(stderr, "%s: Error reading table file...\n", pModule);
+      if (errloc >= 0) {
+        fprintf(stderr, "%s: Error on line %d...\n", pModule, errloc);
+      }
+      fprintf(stderr, "%s: %s!\n", pModule,
+              ttable_errorString(errcode));
+      status = 0;
+    }
+  }
+  
+  /* Compute the colors of constant records */
+  if (status) {
+    if (!fold_build()) {
+      status = 0;
+    }
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Handle a single daemon request.
+ * 
+ * pReq points to the request payload of reqlen bytes.  The payload is a
+ * sequence of nul-terminated strings, the first of which is the command
+ * name.  See the manual in the doc directory for the commands.
+ * 
+ * The response is written as a nul-terminated string into the pResp
+ * buffer, which has respsize bytes.  The first line of the response is
+ * either "ok" or "error" followed by a space and an error message.  For
+ * successful renders, the remaining lines report per-job timings.
+ * 
+ * *pQuit is set to non-zero if the daemon should shut down after
+ * sending the response.  Otherwise, it is left alone.
+ * 
+ * Parameters:
+ * 
+ *   pReq - the request payload
+ * 
+ *   reqlen - the number of bytes in the request payload
+ * 
+ *   pResp - the buffer to receive the response
+ * 
+ *   respsize - the size of the response buffer
+ * 
+ *   pQuit - pointer to the shutdown flag
+ */
+static void daemon_job(
+    const unsigned char * pReq,
+          size_t          reqlen,
+          char          * pResp,
+          size_t          respsize,
+          int           * pQuit) {
+  
+  const char *argv[DAEMON_MAXARGS];
+  int argc = 0;
+  size_t i = 0;
+  size_t start = 0;
+  
+  int errcode = 0;
+  int errloc = 0;
+  const char *pLoc = NULL;
+  
+  double t_start = 0.0;
+  double t_end = 0.0;
+  
+  /* Initialize array */
+  memset((void *) argv, 0, sizeof(const char *) * DAEMON_MAXARGS);
+  
+  /* Check parameters */
+  if ((pReq == NULL) || (pResp == NULL) || (respsize < 1) ||
+      (pQuit == NULL)) {
+    abort();
+  }
+  
+  /* Split the payload into its nul-terminated strings */
+  start = 0;
+  for(i = 0; i < reqlen; i++) {
+    if (pReq[i] == 0) {
+      if (argc >= DAEMON_MAXARGS) {
+        argc = -1;
+        break;
+      }
+      argv[argc] = (const char *) (pReq + start);
+      argc++;
+      start = i + 1;
+    }
+  }
+  
+  /* Every string, including the last, must be nul-terminated */
+  if (start != reqlen) {
+    argc = -1;
+  }
+  
+  /* Dispatch the command */
+  if ((argc == 1) && (strcmp(argv[0], "shutdown") == 0)) {
+    /* Shut down after responding */
+    *pQuit = 1;
+    snprintf(pResp, respsize, "ok\n");
+  
+  } else if ((argc == 5) && (strcmp(argv[0], "render") == 0)) {
+    /* Render job, so time the core program function */
+    t_start = stats_clock();
+    if (lilac(argv[1], argv[2], argv[3], argv[4], &errcode, &errloc)) {
+      t_end = stats_clock();
+      snprintf(pResp, respsize, "ok\nseconds %.6f\n", t_end - t_start);
+      
+    } else {
+      pLoc = lilac_errorLocString(errloc);
+      if (pLoc != NULL) {
+        snprintf(pResp, respsize, "error %s: %s\n",
+                  pLoc, lilac_errorString(errcode));
+      } else {
+        snprintf(pResp, respsize, "error %s\n",
+                  lilac_errorString(errcode));
+      }
+    }
+  
+  } else {
+    /* Unrecognized request */
+    snprintf(pResp, respsize, "error Invalid request\n");
+  }
+}
+
+/*
+ * Run the render daemon.
+ * 
+ * The virtual texture table and shading table module must be
+ * initialized before calling this function.  They remain loaded for the
+ * lifetime of the daemon, so every job renders with the same warm set
+ * of textures, shading table, and programmable shader.
+ * 
+ * pSockPath is the path of the Unix domain socket to listen on.  If a
+ * stale socket already exists at that path, it is replaced.  The socket
+ * is removed again when the daemon shuts down.
+ * 
+ * Each connection carries exactly one request frame and one response
+ * frame.  Requests are handled one at a time in the order they are
+ * accepted.  The daemon runs until it receives a shutdown request.
+ * 
+ * This function handles reporting errors to stderr.
+ * 
+ * Parameters:
+ * 
+ *   pSockPath - path to the socket to listen on
+ * 
+ * Return:
+ * 
+ *   non-zero if the daemon shut down normally, zero if failure
+ */
+static int lilac_daemon(const char *pSockPath) {
+  
+  int status = 1;
+  int bound = 0;
+  int quit = 0;
+  int sfd = -1;
+  int cfd = -1;
+  size_t reqlen = 0;
+  struct sockaddr_un addr;
+  int flags = 0;
+  struct stat st;
+  
+  static unsigned char req[JOBPROTO_MAXFRAME + 1];
+  static char resp[JOBPROTO_MAXFRAME];
+  
+  /* Initialize structures */
+  memset(&addr, 0, sizeof(struct sockaddr_un));
+  memset(&st, 0, sizeof(struct stat));
+  
+  /* Check parameter */
+  if (pSockPath == NULL) {
+    abort();
+  }
+  
+  /* Make sure the socket path fits in the address */
+  if (strlen(pSockPath) >= sizeof(addr.sun_path)) {
+    status = 0;
+    fprintf(stderr, "%s: Socket path is too long!\n", pModule);
+  }
+  
+  /* Remove a stale socket left behind by an earlier daemon */
+  if (status) {
+    if (stat(pSockPath, &st) == 0) {
+      if (S_ISSOCK(st.st_mode)) {
+        unlink(pSockPath);
+      }
+    }
+  }
+  
+  /* Create the socket, bind it to the path, and start listening */
+  if (status) {
+    sfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sfd < 0) {
+      status = 0;
+      fprintf(stderr, "%s: Can't create socket!\n", pModule);
+    }
+  }
+  
+  if (status) {
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, pSockPath);
+    if (bind(sfd, (struct sockaddr *) &addr,
+              sizeof(struct sockaddr_un))) {
+      status = 0;
+      fprintf(stderr, "%s: Can't bind socket '%s'!\n",
+                pModule, pSockPath);
+    } else {
+      bound = 1;
+    }
+  }
+  
+  if (status) {
+    if (listen(sfd, DAEMON_BACKLOG)) {
+      status = 0;
+      fprintf(stderr, "%s: Can't listen on socket!\n", pModule);
+    }
+  }
+  
+  /* Clients that disconnect early must not terminate the daemon */
+  if (status) {
+    signal(SIGPIPE, SIG_IGN);
+    fprintf(stderr, "%s: Listening on '%s'\n", pModule, pSockPath);
+  }
+  
+  /* Handle connections until shutdown */
+  while (status && (!quit)) {
+    
+    /* Wait for the next connection */
+    cfd = accept(sfd, NULL, NULL);
+    if (cfd < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      status = 0;
+      fprintf(stderr, "%s: Can't accept connection!\n", pModule);
+      break;
+    }
+    
+    /* Jobs are handled one at a time, so the connection is made
+     * non-blocking and the whole request and the whole response each
+     * have a time limit */
+    flags = fcntl(cfd, F_GETFL);
+    if ((flags < 0) || (fcntl(cfd, F_SETFL, flags | O_NONBLOCK) < 0)) {
+      close(cfd);
+      cfd = -1;
+      continue;
+    }
+    
+    /* Read the request, run it, and send the response; a client that
+     * sends a malformed frame, goes away, or times out is simply
+     * dropped */
+    if (jobproto_read_timed(cfd, req, sizeof(req), &reqlen,
+                              DAEMON_TIMEOUT * 1000)) {
+      daemon_job(req, reqlen, resp, sizeof(resp), &quit);
+      jobproto_write_timed(cfd, (const unsigned char *) resp,
+                            strlen(resp), DAEMON_TIMEOUT * 1000);
+    }
+    
+    /* Close the connection */
+    close(cfd);
+    cfd = -1;
+  }
+  
+  /* Close the socket and remove it from the file system */
+  if (sfd >= 0) {
+    close(sfd);
+    sfd = -1;
+  }
+  if (bound) {
+    unlink(pSockPath);
+  }
+  
   /* Return status */
   return status;
 }
@@ -1543,6 +2852,11 @@ int main(int argc, char *argv[]) {
   int i = 0;
   int errcode = 0;
   int errloc = 0;
+  int argi = 0;
+  int daemon_mode = 0;
+  int stats_mode = 0;
+  int gc_mode = PSHADE_GC_INCREMENTAL;
+  const char *pLoc = NULL;
 
   /* Get module name */
   if (argc > 0) {
@@ -1566,77 +2880,123 @@ int main(int argc, char *argv[]) {
       abort();
     }
   }
-
-  /* In addition to the module name, we must have at least eight
-   * additional parameters */
-  if (argc < 9) {
-    fprintf(stderr, "%s: Not enough parameters!\n", pModule);
-    status = 0;
-  }
   
-  /* The number of textures passed may not exceed the maximum number of
-   * textures */
-  if (status) {
-    if (argc - 7 > TEXTURE_MAXCOUNT) {
-      fprintf(stderr, "%s: Too many textures!\n", pModule);
+  /* Parse any leading options */
+  argi = 1;
+  while (argi < argc) {
+    if (strncmp(argv[argi], "--", 2) != 0) {
+      break;
+    }
+    
+    if (strcmp(argv[argi], "--daemon") == 0) {
+      daemon_mode = 1;
+    } else if (strcmp(argv[argi], "--stats") == 0) {
+      stats_mode = 1;
+    } else if (strcmp(argv[argi], "--palette") == 0) {
+      m_palette = 1;
+    } else if (strcmp(argv[argi], "--gc=incremental") == 0) {
+      gc_mode = PSHADE_GC_INCREMENTAL;
+    } else if (strcmp(argv[argi], "--gc=generational") == 0) {
+      gc_mode = PSHADE_GC_GENERATIONAL;
+    } else if (strcmp(argv[argi], "--gc=rows") == 0) {
+      gc_mode = PSHADE_GC_ROWS;
+    } else {
+      fprintf(stderr, "%s: Unrecognized option '%s'!\n",
+                pModule, argv[argi]);
       status = 0;
+      break;
     }
+    argi++;
   }
   
-  /* Use parameter index six to initialize the programmable shader
-   * module, unless it has the special value "-" */
+  /* Select the garbage collector mode before any script is loaded */
   if (status) {
-    if (strcmp(argv[6], "-") != 0) {
-      if (!pshade_load(argv[6], &errcode)) {
+    pshade_gcmode(gc_mode);
+  }
+  
+  if (status && daemon_mode) {
+    /* In daemon mode, we must have the socket, table, and shader
+     * parameters and at least two textures */
+    if (argc - argi < 5) {
+      fprintf(stderr, "%s: Not enough parameters!\n", pModule);
+      status = 0;
+    }
+    
+    /* The number of textures passed may not exceed the maximum number
+     * of textures */
+    if (status) {
+      if (argc - argi - 3 > TEXTURE_MAXCOUNT) {
+        fprintf(stderr, "%s: Too many textures!\n", pModule);
         status = 0;
-        fprintf(stderr, "%s: Error loading programmable shader...\n",
-          pModule);
-        fprintf(stderr, "%s: %s!\n",
-          pModule, pshade_errorString(errcode));
       }
     }
-  }
-  
-  /* Starting at parameter index seven and proceeding through the
-   * remaining parameters, load each path in the virtual texture
-   * table */
-  if (status) {
-    for(i = 7; i < argc; i++) {
-      if (!vtx_load(argv[i])) {
+    
+    /* The socket is the first parameter, followed by the shading
+     * table, the programmable shader, and then the textures */
+    if (status) {
+      if (!lilac_setup(argv[argi + 1], argv[argi + 2],
+                        argc - argi - 3, &(argv[argi + 3]))) {
+        status = 0;
+      }
+    }
+    
+  } else if (status) {
+    /* We must have at least eight parameters */
+    if (argc - argi < 8) {
+      fprintf(stderr, "%s: Not enough parameters!\n", pModule);
+      status = 0;
+    }
+    
+    /* The number of textures passed may not exceed the maximum number
+     * of textures */
+    if (status) {
+      if (argc - argi - 6 > TEXTURE_MAXCOUNT) {
+        fprintf(stderr, "%s: Too many textures!\n", pModule);
+        status = 0;
+      }
+    }
+    
+    /* Start the palette pre-pass over the shading file, so that it
+     * runs while the textures load */
+    if (status && (m_palette || splane_indexed(argv[argi + 3]))) {
+      splane_start(argv[argi + 3]);
+    }
+    
+    /* The four image paths come first, followed by the shading table,
+     * the programmable shader, and then the textures */
+    if (status) {
+      if (!lilac_setup(argv[argi + 4], argv[argi + 5],
+                        argc - argi - 6, &(argv[argi + 6]))) {
         status = 0;
-        break;
       }
     }
   }
   
-  /* Use parameter index five to initialize the shading table */
-  if (status) {
-    if (!ttable_parse(argv[5], &errcode, &errloc, m_vtx_count)) {
-      fprintf(stderr, "%s: Error reading table file...\n", pModule);
-      if (errloc >= 0) {
-        fprintf(stderr, "%s: Error on line %d...\n", pModule, errloc);
-      }
-      fprintf(stderr, "%s: %s!\n", pModule,
-              ttable_errorString(errcode));
+  /* Start gathering statistics if requested, now that the shading
+   * table is loaded */
+  if (status && stats_mode) {
+    if (!stats_enable(ttable_count())) {
+      fprintf(stderr, "%s: Out of memory!\n", pModule);
       status = 0;
     }
   }
   
-  /* Begin the core program function */
-  if (status) {
-    if (!lilac(argv[1], argv[2], argv[3], argv[4], &errcode, &errloc)) {
-      
-      if (errloc == ERRORLOC_OUTFILE) {
-        fprintf(stderr, "%s: Error writing output file...\n", pModule);
-      
-      } else if (errloc == ERRORLOC_MASKFILE) {
-        fprintf(stderr, "%s: Error reading mask file...\n", pModule);
+  /* In daemon mode, serve render jobs on the socket until shut down */
+  if (status && daemon_mode) {
+    m_progress = 0;
+    if (!lilac_daemon(argv[argi])) {
+      status = 0;
+    }
+  }
+  
+  /* Otherwise, begin the core program function */
+  if (status && (!daemon_mode)) {
+    if (!lilac(argv[argi], argv[argi + 1], argv[argi + 2],
+                argv[argi + 3], &errcode, &errloc)) {
       
-      } else if (errloc == ERRORLOC_PENCILFILE) {
-        fprintf(stderr, "%s: Error reading pencil file...\n", pModule);
-        
-      } else if (errloc == ERRORLOC_SHADINGFILE) {
-        fprintf(stderr, "%s: Error reading shading file...\n", pModule);
+      pLoc = lilac_errorLocString(errloc);
+      if (pLoc != NULL) {
+        fprintf(stderr, "%s: %s...\n", pModule, pLoc);
       }
       
       fprintf(stderr, "%s: %s!\n", pModule, lilac_errorString(errcode));
@@ -1644,8 +3004,18 @@ int main(int argc, char *argv[]) {
     }
   }
   
-  /* Close down Lua interpreter if open */
+  /* Write the statistics report, even if rendering failed; does
+   * nothing unless statistics were enabled */
+  stats_report(stdout);
+  
+  /* Close down Lua interpreter if open, unload plugins, and release
+   * cached tiles and any palette pre-pass */
   pshade_close();
+  plugin_close();
+  tcache_reset();
+  splane_close();
+  free(m_fold);
+  m_fold = NULL;
   
   /* Invert status and return */
   if (status) {
@@ -0,0 +1,290 @@
+/*
+ * lilac_meshbin.c
+ * ===============
+ * 
+ * Binary mesh tool of Lilac.
+ * 
+ * Syntax
+ * ------
+ * 
+ *   lilac_meshbin compile [in] [out]
+ *   lilac_meshbin decompile [in] [out]
+ * 
+ * The compile command reads the Shastina mesh file [in], checks it
+ * against all the rules of the mesh format, and writes it to [out] as a
+ * binary mesh file.  See MeshFormat.md in the doc directory for the
+ * Shastina format, and lilac_mesh.h for the binary format.
+ * 
+ * The decompile command loads the binary mesh file [in] and writes it
+ * to [out] as a Shastina mesh file.  Compiling the result gives back
+ * the same binary mesh file.
+ * 
+ * Binary mesh files can only be loaded on machines with the same byte
+ * order as the machine that compiled them.
+ * 
+ * Compilation
+ * -----------
+ * 
+ * Build this program together with the lilac_mesh.c module of Lilac and
+ * Shastina.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lilac_mesh.h"
+#include "shastina.h"
+
+/*
+ * Local data
+ * ----------
+ */
+
+/*
+ * The name of this executable module.
+ * 
+ * This is set at the start of the program entrypoint.  It should be
+ * included in error reports from the program.
+ */
+static const char *pModule = NULL;
+
+/*
+ * Local functions
+ * ---------------
+ */
+
+/* Prototypes */
+static int compileMesh(const char *pInPath, const char *pOutPath);
+static int decompileMesh(const char *pInPath, const char *pOutPath);
+
+/*
+ * Read a Shastina mesh file and write it as a binary mesh file.
+ * 
+ * Errors are reported to standard error.
+ * 
+ * Parameters:
+ * 
+ *   pInPath - path to the Shastina mesh file
+ * 
+ *   pOutPath - path to the binary mesh file to write
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int compileMesh(const char *pInPath, const char *pOutPath) {
+  
+  int status = 1;
+  int errcode = 0;
+  long line_num = 0;
+  
+  LILAC_MESH *pMesh = NULL;
+  
+  /* Check parameters */
+  if ((pInPath == NULL) || (pOutPath == NULL)) {
+    abort();
+  }
+  
+  /* Read the input file */
+  if (status) {
+    pMesh = lilac_mesh_read(pInPath, &errcode, &line_num);
+    if (pMesh == NULL) {
+      status = 0;
+      if (line_num > 0) {
+        fprintf(stderr, "%s: [line %ld] %s!\n",
+                  pModule, line_num, lilac_mesh_errstr(errcode));
+      } else {
+        fprintf(stderr, "%s: %s!\n",
+                  pModule, lilac_mesh_errstr(errcode));
+      }
+    }
+  }
+  
+  /* Write the binary mesh */
+  if (status) {
+    if (!lilac_mesh_save(pMesh, pOutPath, &errcode)) {
+      status = 0;
+      fprintf(stderr, "%s: Error writing binary mesh file...\n",
+                pModule);
+      fprintf(stderr, "%s: %s!\n", pModule,
+                lilac_mesh_errstr(errcode));
+    }
+  }
+  
+  /* Release the mesh */
+  lilac_mesh_free(pMesh);
+  pMesh = NULL;
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Load a binary mesh file and write it as a Shastina mesh file.
+ * 
+ * Errors are reported to standard error.
+ * 
+ * Parameters:
+ * 
+ *   pInPath - path to the binary mesh file
+ * 
+ *   pOutPath - path to the Shastina mesh file to write
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int decompileMesh(const char *pInPath, const char *pOutPath) {
+  
+  int status = 1;
+  int errcode = 0;
+  int32_t i = 0;
+  
+  FILE *pOut = NULL;
+  LILAC_MESH *pMesh = NULL;
+  const LILAC_MESH_POINT *pp = NULL;
+  const uint32_t *pt = NULL;
+  
+  /* Check parameters */
+  if ((pInPath == NULL) || (pOutPath == NULL)) {
+    abort();
+  }
+  
+  /* Load the binary mesh */
+  pMesh = lilac_mesh_load(pInPath, &errcode);
+  if (pMesh == NULL) {
+    status = 0;
+    fprintf(stderr, "%s: Error reading binary mesh file...\n",
+              pModule);
+    fprintf(stderr, "%s: %s!\n", pModule,
+              lilac_mesh_errstr(errcode));
+  }
+  
+  /* Open the output file */
+  if (status) {
+    pOut = fopen(pOutPath, "w");
+    if (pOut == NULL) {
+      status = 0;
+      fprintf(stderr, "%s: Can't open output file!\n", pModule);
+    }
+  }
+  
+  /* Write the header, then all the points, and then all the triangles,
+   * so that every triangle comes after its points */
+  if (status) {
+    fprintf(pOut, "%%lilac-mesh;\n%%dim %ld %ld;\n",
+              (long) pMesh->point_count,
+              (long) pMesh->tri_count);
+    
+    for(i = 0; i < pMesh->point_count; i++) {
+      pp = &((pMesh->pPoints)[i]);
+      fprintf(pOut, "%d %d %d %d p\n",
+                (int) (pp->normd),
+                (int) (pp->norma),
+                (int) (pp->x),
+                (int) (pp->y));
+    }
+    
+    for(i = 0; i < pMesh->tri_count; i++) {
+      pt = &((pMesh->pTris)[((size_t) i) * 3]);
+      fprintf(pOut, "%ld %ld %ld t\n",
+                (long) pt[0],
+                (long) pt[1],
+                (long) pt[2]);
+    }
+    
+    fprintf(pOut, "|;\n");
+  }
+  
+  /* Close the output file */
+  if (pOut != NULL) {
+    if (ferror(pOut)) {
+      status = 0;
+    }
+    if (fclose(pOut)) {
+      status = 0;
+    }
+    pOut = NULL;
+    
+    if (!status) {
+      fprintf(stderr, "%s: Error writing output file!\n", pModule);
+    }
+  }
+  
+  /* Release the mesh */
+  lilac_mesh_free(pMesh);
+  pMesh = NULL;
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Program entrypoint
+ * ------------------
+ */
+
+int main(int argc, char *argv[]) {
+  
+  int status = 1;
+  int x = 0;
+  
+  /* Get module name */
+  pModule = NULL;
+  if ((argc > 0) && (argv != NULL)) {
+    pModule = argv[0];
+  }
+  if (pModule == NULL) {
+    pModule = "lilac_meshbin";
+  }
+  
+  /* Check argv */
+  if (argc > 0) {
+    if (argv == NULL) {
+      abort();
+    }
+    for(x = 0; x < argc; x++) {
+      if (argv[x] == NULL) {
+        abort();
+      }
+    }
+  }
+  
+  /* Run the command */
+  if ((argc >= 2) && (strcmp(argv[1], "compile") == 0)) {
+    if (argc == 4) {
+      status = compileMesh(argv[2], argv[3]);
+    } else {
+      status = 0;
+      fprintf(stderr, "%s: Wrong number of arguments!\n", pModule);
+    }
+  
+  } else if ((argc >= 2) && (strcmp(argv[1], "decompile") == 0)) {
+    if (argc == 4) {
+      status = decompileMesh(argv[2], argv[3]);
+    } else {
+      status = 0;
+      fprintf(stderr, "%s: Wrong number of arguments!\n", pModule);
+    }
+  
+  } else if (argc >= 2) {
+    status = 0;
+    fprintf(stderr, "%s: Unrecognized command '%s'!\n",
+              pModule, argv[1]);
+  
+  } else {
+    status = 0;
+    fprintf(stderr, "%s: Missing command!\n", pModule);
+  }
+  
+  /* Invert status and return */
+  if (status) {
+    status = 0;
+  } else {
+    status = 1;
+  }
+  return status;
+}
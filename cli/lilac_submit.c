@@ -0,0 +1,330 @@
+/*
+ * lilac_submit.c
+ * ==============
+ * 
+ * Client program that submits render jobs to a lilac_draw daemon.
+ * 
+ * Syntax
+ * ------
+ * 
+ *   lilac_submit [socket] [out] [mask] [pencil] [shading]
+ *   lilac_submit [socket] --shutdown
+ * 
+ * [socket] is the path to the Unix domain socket that the daemon is
+ * listening on.
+ * 
+ * The first form submits a render job.  The four paths have the same
+ * meaning as in lilac_draw.  Relative paths are resolved against the
+ * current working directory of this program before they are sent, so
+ * the daemon may be running in a different directory.  If the job
+ * succeeds, the per-job timings reported by the daemon are written to
+ * standard output.
+ * 
+ * The second form asks the daemon to shut down.
+ * 
+ * See the lilac_draw manual in the doc directory for the protocol.
+ * 
+ * Compilation
+ * -----------
+ * 
+ * Build this program together with the jobproto.c module of Lilac.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "jobproto.h"
+
+/*
+ * Local data
+ * ----------
+ */
+
+/*
+ * The name of this executable module.
+ * 
+ * This is set at the start of the program entrypoint.  It should be
+ * included in error reports from the program.
+ */
+static const char *pModule = NULL;
+
+/*
+ * The request payload under construction.
+ * 
+ * m_req_len is the number of bytes currently in the payload.
+ */
+static unsigned char m_req[JOBPROTO_MAXFRAME];
+static size_t m_req_len = 0;
+
+/*
+ * Local functions
+ * ---------------
+ */
+
+/* Prototypes */
+static int addString(const char *pstr, int absolute);
+static int submit(const char *pSockPath, char *pResp, size_t respsize);
+
+/*
+ * Append a nul-terminated string to the request payload.
+ * 
+ * If absolute is non-zero and pstr is a relative path, the current
+ * working directory and a slash are prefixed to it.
+ * 
+ * Parameters:
+ * 
+ *   pstr - the string to append
+ * 
+ *   absolute - non-zero to resolve relative paths
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the payload would be too long or
+ *   the working directory could not be determined
+ */
+static int addString(const char *pstr, int absolute) {
+  
+  int status = 1;
+  size_t dlen = 0;
+  size_t slen = 0;
+  char cwd[JOBPROTO_MAXFRAME];
+  
+  /* Initialize buffer */
+  memset(cwd, 0, JOBPROTO_MAXFRAME);
+  
+  /* Check parameter */
+  if (pstr == NULL) {
+    abort();
+  }
+  
+  /* Get the directory prefix for relative paths */
+  if (absolute && (pstr[0] != '/')) {
+    if (getcwd(cwd, JOBPROTO_MAXFRAME) == NULL) {
+      status = 0;
+    }
+    if (status) {
+      dlen = strlen(cwd);
+    }
+  }
+  
+  /* Make sure prefix, slash, string, and nul fit */
+  if (status) {
+    slen = strlen(pstr);
+    if (dlen + slen + 2 > JOBPROTO_MAXFRAME - m_req_len) {
+      status = 0;
+    }
+  }
+  
+  /* Append the prefix and a slash */
+  if (status && (dlen > 0)) {
+    memcpy(m_req + m_req_len, cwd, dlen);
+    m_req_len += dlen;
+    m_req[m_req_len] = (unsigned char) '/';
+    m_req_len++;
+  }
+  
+  /* Append the string with its terminating nul */
+  if (status) {
+    memcpy(m_req + m_req_len, pstr, slen + 1);
+    m_req_len += slen + 1;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Send the request payload to the daemon and wait for the response.
+ * 
+ * The response is written as a nul-terminated string into pResp, which
+ * has respsize bytes.
+ * 
+ * This function handles reporting errors to stderr.
+ * 
+ * Parameters:
+ * 
+ *   pSockPath - path to the daemon socket
+ * 
+ *   pResp - buffer to receive the response
+ * 
+ *   respsize - size of the response buffer
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int submit(const char *pSockPath, char *pResp, size_t respsize) {
+  
+  int status = 1;
+  int fd = -1;
+  size_t rlen = 0;
+  struct sockaddr_un addr;
+  
+  /* Initialize structures */
+  memset(&addr, 0, sizeof(struct sockaddr_un));
+  
+  /* Check parameters */
+  if ((pSockPath == NULL) || (pResp == NULL) || (respsize < 1)) {
+    abort();
+  }
+  
+  /* Make sure the socket path fits in the address */
+  if (strlen(pSockPath) >= sizeof(addr.sun_path)) {
+    status = 0;
+    fprintf(stderr, "%s: Socket path is too long!\n", pModule);
+  }
+  
+  /* Connect to the daemon */
+  if (status) {
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+      status = 0;
+      fprintf(stderr, "%s: Can't create socket!\n", pModule);
+    }
+  }
+  
+  if (status) {
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, pSockPath);
+    if (connect(fd, (struct sockaddr *) &addr,
+                sizeof(struct sockaddr_un))) {
+      status = 0;
+      fprintf(stderr, "%s: Can't connect to daemon at '%s'!\n",
+                pModule, pSockPath);
+    }
+  }
+  
+  /* Send the request and read the response */
+  if (status) {
+    if (!jobproto_write(fd, m_req, m_req_len)) {
+      status = 0;
+      fprintf(stderr, "%s: Failed to send request!\n", pModule);
+    }
+  }
+  
+  if (status) {
+    if (!jobproto_read(fd, (unsigned char *) pResp, respsize, &rlen)) {
+      status = 0;
+      fprintf(stderr, "%s: Failed to read response!\n", pModule);
+    }
+  }
+  
+  /* Close the connection if open */
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Program entrypoint
+ * ------------------
+ */
+
+int main(int argc, char *argv[]) {
+  
+  int status = 1;
+  int x = 0;
+  char *pc = NULL;
+  
+  static char resp[JOBPROTO_MAXFRAME + 1];
+  
+  /* Get module name */
+  pModule = NULL;
+  if ((argc > 0) && (argv != NULL)) {
+    pModule = argv[0];
+  }
+  if (pModule == NULL) {
+    pModule = "lilac_submit";
+  }
+  
+  /* Check argv */
+  if (argc > 0) {
+    if (argv == NULL) {
+      abort();
+    }
+    for(x = 0; x < argc; x++) {
+      if (argv[x] == NULL) {
+        abort();
+      }
+    }
+  }
+  
+  /* Build the request from the program arguments */
+  if ((argc == 3) && (strcmp(argv[2], "--shutdown") == 0)) {
+    if (!addString("shutdown", 0)) {
+      abort();
+    }
+  
+  } else if (argc == 6) {
+    if (!addString("render", 0)) {
+      abort();
+    }
+    for(x = 2; x < 6; x++) {
+      if (!addString(argv[x], 1)) {
+        status = 0;
+        fprintf(stderr, "%s: Path '%s' is too long!\n",
+                  pModule, argv[x]);
+        break;
+      }
+    }
+  
+  } else {
+    status = 0;
+    fprintf(stderr, "%s: Wrong number of arguments!\n", pModule);
+  }
+  
+  /* Submit the request */
+  if (status) {
+    if (!submit(argv[1], resp, sizeof(resp))) {
+      status = 0;
+    }
+  }
+  
+  /* Split the first line of the response from the rest */
+  if (status) {
+    pc = strchr(resp, '\n');
+    if (pc != NULL) {
+      *pc = (char) 0;
+      pc++;
+    } else {
+      pc = resp + strlen(resp);
+    }
+  }
+  
+  /* Report the outcome, printing the timings if successful */
+  if (status) {
+    if (strcmp(resp, "ok") == 0) {
+      fputs(pc, stdout);
+    
+    } else if (strncmp(resp, "error ", 6) == 0) {
+      status = 0;
+      fprintf(stderr, "%s: %s!\n", pModule, resp + 6);
+    
+    } else {
+      status = 0;
+      fprintf(stderr, "%s: Unrecognized response from daemon!\n",
+                pModule);
+    }
+  }
+  
+  /* Invert status and return */
+  if (status) {
+    status = 0;
+  } else {
+    status = 1;
+  }
+  return status;
+}
@@ -0,0 +1,171 @@
+/*
+ * lilac_ttable.c
+ * ==============
+ * 
+ * Shading table tool of Lilac.
+ * 
+ * Syntax
+ * ------
+ * 
+ *   lilac_ttable compile [in] [out]
+ * 
+ * The compile command parses the text shading table [in] and writes it
+ * to [out] as a compiled table file, which lilac_draw loads when the
+ * shading table path has a .ltt extension.  See the lilac_draw manual
+ * in the doc directory for the text table syntax, and ttable.h for the
+ * compiled format.
+ * 
+ * The texture indices of the records are not checked against any
+ * particular set of textures when compiling.  lilac_draw checks them
+ * when it loads the compiled table.
+ * 
+ * Compiled tables can only be loaded on machines with the same byte
+ * order as the machine that compiled them.
+ * 
+ * Compilation
+ * -----------
+ * 
+ * Build this program together with the ttable.c, pixel.c, and gamma.c
+ * modules of Lilac, and link it against libsophistry.
+ */
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ttable.h"
+
+/*
+ * Local data
+ * ----------
+ */
+
+/*
+ * The name of this executable module.
+ * 
+ * This is set at the start of the program entrypoint.  It should be
+ * included in error reports from the program.
+ */
+static const char *pModule = NULL;
+
+/*
+ * Local functions
+ * ---------------
+ */
+
+/* Prototypes */
+static int compileTable(const char *pInPath, const char *pOutPath);
+
+/*
+ * Parse a text shading table and write it as a compiled table.
+ * 
+ * Errors are reported to standard error.
+ * 
+ * Parameters:
+ * 
+ *   pInPath - path to the text table
+ * 
+ *   pOutPath - path to the compiled table to write
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int compileTable(const char *pInPath, const char *pOutPath) {
+  
+  int status = 1;
+  int errcode = 0;
+  int errloc = 0;
+  
+  /* Check parameters */
+  if ((pInPath == NULL) || (pOutPath == NULL)) {
+    abort();
+  }
+  
+  /* Parse the text table, allowing any texture index */
+  if (!ttable_parse(pInPath, &errcode, &errloc, INT_MAX)) {
+    status = 0;
+    fprintf(stderr, "%s: Error reading table file...\n", pModule);
+    if (errloc >= 0) {
+      fprintf(stderr, "%s: Error on line %d...\n", pModule, errloc);
+    }
+    fprintf(stderr, "%s: %s!\n", pModule,
+              ttable_errorString(errcode));
+  }
+  
+  /* Write the compiled table */
+  if (status) {
+    if (!ttable_compile(pOutPath, &errcode)) {
+      status = 0;
+      fprintf(stderr, "%s: Error writing compiled table file...\n",
+                pModule);
+      fprintf(stderr, "%s: %s!\n", pModule,
+                ttable_errorString(errcode));
+    }
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Program entrypoint
+ * ------------------
+ */
+
+int main(int argc, char *argv[]) {
+  
+  int status = 1;
+  int x = 0;
+  
+  /* Get module name */
+  pModule = NULL;
+  if ((argc > 0) && (argv != NULL)) {
+    pModule = argv[0];
+  }
+  if (pModule == NULL) {
+    pModule = "lilac_ttable";
+  }
+  
+  /* Check argv */
+  if (argc > 0) {
+    if (argv == NULL) {
+      abort();
+    }
+    for(x = 0; x < argc; x++) {
+      if (argv[x] == NULL) {
+        abort();
+      }
+    }
+  }
+  
+  /* Run the command */
+  if ((argc >= 2) && (strcmp(argv[1], "compile") == 0)) {
+    if (argc == 4) {
+      status = compileTable(argv[2], argv[3]);
+    } else {
+      status = 0;
+      fprintf(stderr, "%s: Wrong number of arguments!\n", pModule);
+    }
+    
+  } else if (argc >= 2) {
+    status = 0;
+    fprintf(stderr, "%s: Unrecognized command '%s'!\n",
+              pModule, argv[1]);
+    
+  } else {
+    status = 0;
+    fprintf(stderr, "%s: Missing command!\n", pModule);
+  }
+  
+  /* Invert status and return */
+  if (status) {
+    status = 0;
+  } else {
+    status = 1;
+  }
+  return status;
+}
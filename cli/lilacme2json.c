@@ -8,119 +8,1312 @@
  * Syntax
  * ------
  * 
- *   lilacme2json [input]
+ *   lilacme2json [options] [input]
  * 
  * [input] is the path to the Lilac mesh Shastina file to interpret.
+ * Paths with a case-insensitive .lmb extension are loaded as binary
+ * mesh files instead (see lilac_mesh.h).
  * 
  * The JSON conversion is written to standard output.  This JSON
  * representation is used by the Lilac mesh editor.  See the Lilac mesh
  * editor for documentation of the JSON format.
  * 
+ * The options are:
+ * 
+ *   --stream - write each point and triangle as soon as it has been
+ *   interpreted
+ * 
+ *   --batch - convert a list of files; [input] is then the path to the
+ *   list
+ * 
+ *   --threads N - the number of threads for batch conversion, by
+ *   default the number of online processors, at most BATCH_MAXTHREADS
+ * 
+ * With the --stream option, each point and triangle is written as soon
+ * as it has been interpreted, without building a mesh object, so the
+ * triangle list is never held in memory.  The output is the same as
+ * without the option.  However, if the mesh has an error, the part of
+ * the JSON written before the error was found remains in the output,
+ * which is then incomplete.  The exit status is non-zero in that case.
+ * Binary mesh files are mapped into memory, so the option has no effect
+ * on them.
+ * 
+ * Batch conversion
+ * ----------------
+ * 
+ * With the --batch option, [input] is a text file listing the files to
+ * convert, one per line.  Each line has the path to an input file, a
+ * horizontal tab, and the path of the JSON file to write.  Blank lines
+ * are ignored.  A carriage return at the end of a line is ignored.
+ * 
+ * The files are converted on a pool of threads, each taking the next
+ * file from the list as it finishes the previous one.  The --stream
+ * option also applies to every file of the batch.  If a file can't be
+ * converted, its error is reported to standard error together with
+ * the input path, its output file is removed, and the batch goes on
+ * with the rest of the files.  Errors are reported in the order of the
+ * list once all the files are done.
+ * 
+ * At the end of the batch, statistics are written to standard output,
+ * giving the number of files converted and failed, the number of
+ * threads that ran, the total size of the input and output files,
+ * the elapsed time, and the throughput.  If the list can't be read, no
+ * file is converted and no statistics are written.  The exit status is
+ * non-zero if any file failed.
+ * 
  * Compilation
  * -----------
  * 
  * Build this program together with the lilac_mesh.c module of Lilac and
- * Shastina.
+ * Shastina, and with POSIX threads.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "lilac_mesh.h"
 #include "shastina.h"
 
 /*
- * Local data
- * ----------
+ * Constants
+ * ---------
+ */
+
+/*
+ * The size in bytes of the output buffer of an emitter.
+ */
+#define OUT_BUF_SIZE (65536)
+
+/*
+ * The most bytes written by one call to emitRaw(), which is more than
+ * any point or triangle needs.
+ */
+#define OUT_MAX_RAW (256)
+
+/*
+ * The maximum number of threads for batch conversion.
+ */
+#define BATCH_MAXTHREADS (64)
+
+/*
+ * The maximum number of files in a batch.
+ */
+#define BATCH_MAXFILES (16777216L)
+
+/*
+ * Type declarations
+ * -----------------
+ */
+
+/*
+ * State of the JSON output of one conversion.
+ * 
+ * Initialize with emitInit() and release with emitFree().  Each thread
+ * of a batch has its own emitter.
+ */
+typedef struct {
+  
+  /*
+   * The file that the output is written to.
+   */
+  FILE *pOut;
+  
+  /*
+   * Set if a write failed.
+   */
+  int err;
+  
+  /*
+   * The total number of bytes written to pOut so far.
+   */
+  uint64_t total;
+  
+  /*
+   * State of streaming mode.
+   *
+   * points_left is the number of points that have not been written yet.
+   * Triangles received before all points have been written are held in
+   * pPend until the points array can be closed.  pend_count is the
+   * number of held triangles and pend_cap is the capacity of the array
+   * in triangles.  Mesh files that define all points before any
+   * triangles never need this array.
+   */
+  int32_t points_left;
+  uint32_t *pPend;
+  int32_t pend_count;
+  int32_t pend_cap;
+  
+  /*
+   * The output buffer.
+   *
+   * len is the number of bytes in the buffer that have not been
+   * written to pOut yet.
+   */
+  size_t len;
+  char buf[OUT_BUF_SIZE];
+
+} EMITTER;
+
+/*
+ * One file of a batch, with the result of converting it.
+ */
+typedef struct {
+  
+  /*
+   * The line of the list that the file is on.
+   */
+  long list_line;
+  
+  /*
+   * The path to the input file and the path of the output file.
+   *
+   * These point into the buffer holding the list.
+   */
+  const char *pIn;
+  const char *pOut;
+  
+  /*
+   * Non-zero if the file was converted successfully.
+   */
+  int status;
+  
+  /*
+   * The error code and line number of the input file if reading it
+   * failed, or LILAC_MESH_ERR_OK.
+   */
+  int errcode;
+  long line_num;
+  
+  /*
+   * If the output file could not be written, OUT_OPEN if it could not
+   * be opened and OUT_WRITE if a write failed; otherwise zero.
+   */
+  int out_err;
+  
+  /*
+   * The size of the input file and the number of bytes written to the
+   * output file.
+   */
+  uint64_t in_bytes;
+  uint64_t out_bytes;
+
+} BATCHJOB;
+
+/*
+ * Values of the out_err field of BATCHJOB.
+ */
+#define OUT_OPEN  (1)
+#define OUT_WRITE (2)
+
+/*
+ * Local data
+ * ----------
+ */
+
+/*
+ * The name of this executable module.
+ * 
+ * This is set at the start of the program entrypoint.  It should be
+ * included in error reports from the program.
+ */
+static const char *pModule = NULL;
+
+/*
+ * The emitter writing to standard output when a single file is
+ * converted.
+ */
+static EMITTER m_emit;
+
+/*
+ * State of a batch.
+ * 
+ * m_pJobs is the array of m_job_count files.  m_job_next is the index
+ * of the next file that a thread should take, and it is protected by
+ * m_job_lock.  m_stream is non-zero if the files are converted in
+ * streaming mode.
+ */
+static BATCHJOB *m_pJobs = NULL;
+static int32_t m_job_count = 0;
+static int32_t m_job_next = 0;
+static int m_stream = 0;
+static pthread_mutex_t m_job_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Local functions
+ * ---------------
+ */
+
+/* Prototypes */
+static double wallclock(void);
+static int batchThreads(void);
+
+static void emitInit(EMITTER *pe, FILE *pOut);
+static void emitFree(EMITTER *pe);
+static void emitFlush(EMITTER *pe);
+static void emitRaw(EMITTER *pe, const char *pStr, size_t len);
+static void emitDec(EMITTER *pe, int32_t v);
+static void emitHex(EMITTER *pe, uint32_t v);
+static void emitPoint(
+    EMITTER                * pe,
+    int32_t                  i,
+    const LILAC_MESH_POINT * pp);
+static void emitTri(EMITTER *pe, int32_t i, const uint32_t *pt);
+
+static void meshToJSON(EMITTER *pe, const LILAC_MESH *pMesh);
+
+static void sinkDim(
+    void    * pCustom,
+    int32_t   point_count,
+    int32_t   tri_count);
+static void sinkPoint(
+    void                   * pCustom,
+    int32_t                  i,
+    const LILAC_MESH_POINT * pp);
+static void sinkTri(void *pCustom, int32_t i, const uint32_t *pt);
+
+static int convertMesh(
+    EMITTER    * pe,
+    const char * pPath,
+    int          stream,
+    int        * pErrCode,
+    long       * pLine);
+
+static int readList(const char *pPath, char **ppList);
+static void convertJob(EMITTER *pe, BATCHJOB *pj);
+static void *batchThread(void *pArg);
+static int runBatch(const char *pListPath, int stream, int threads);
+
+/*
+ * Read the monotonic wall clock.
+ * 
+ * Return:
+ * 
+ *   the current time in seconds relative to an arbitrary epoch, or
+ *   zero if the clock could not be read
+ */
+static double wallclock(void) {
+  
+  double result = 0.0;
+  struct timespec ts;
+  
+  /* Initialize structures */
+  memset(&ts, 0, sizeof(struct timespec));
+  
+  /* Read the clock */
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+    result = ((double) ts.tv_sec) + (((double) ts.tv_nsec) / 1.0e9);
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * Choose the default number of threads for batch conversion.
+ * 
+ * Return:
+ * 
+ *   the number of online processors, limited to the range one up to and
+ *   including BATCH_MAXTHREADS
+ */
+static int batchThreads(void) {
+  
+  long n = 0;
+  
+  n = sysconf(_SC_NPROCESSORS_ONLN);
+  if (n < 1) {
+    n = 1;
+  } else if (n > BATCH_MAXTHREADS) {
+    n = BATCH_MAXTHREADS;
+  }
+  
+  return (int) n;
+}
+
+/*
+ * Initialize an emitter.
+ * 
+ * Parameters:
+ * 
+ *   pe - the emitter to initialize
+ * 
+ *   pOut - the file to write the output to
+ */
+static void emitInit(EMITTER *pe, FILE *pOut) {
+  
+  /* Check parameters */
+  if ((pe == NULL) || (pOut == NULL)) {
+    abort();
+  }
+  
+  pe->pOut = pOut;
+  pe->err = 0;
+  pe->total = 0;
+  pe->points_left = 0;
+  pe->pPend = NULL;
+  pe->pend_count = 0;
+  pe->pend_cap = 0;
+  pe->len = 0;
+}
+
+/*
+ * Release the memory held by an emitter.
+ * 
+ * The output buffer is NOT flushed.  The emitter may be initialized
+ * again afterwards.
+ * 
+ * Parameters:
+ * 
+ *   pe - the emitter
+ */
+static void emitFree(EMITTER *pe) {
+  
+  /* Check parameters */
+  if (pe == NULL) {
+    abort();
+  }
+  
+  if (pe->pPend != NULL) {
+    free(pe->pPend);
+    pe->pPend = NULL;
+  }
+  pe->pend_count = 0;
+  pe->pend_cap = 0;
+}
+
+/*
+ * Write the contents of the output buffer of an emitter to its file
+ * and empty the buffer.
+ * 
+ * If the write fails, the error flag of the emitter is set.
+ * 
+ * Parameters:
+ * 
+ *   pe - the emitter
+ */
+static void emitFlush(EMITTER *pe) {
+  
+  /* Check parameters */
+  if (pe == NULL) {
+    abort();
+  }
+  
+  if (pe->len > 0) {
+    if (fwrite(pe->buf, 1, pe->len, pe->pOut) != pe->len) {
+      pe->err = 1;
+    }
+    pe->total += (uint64_t) pe->len;
+    pe->len = 0;
+  }
+}
+
+/*
+ * Append bytes to the output buffer of an emitter, flushing it first
+ * if there is not enough room.
+ * 
+ * Parameters:
+ * 
+ *   pe - the emitter
+ * 
+ *   pStr - the bytes to append
+ * 
+ *   len - the number of bytes, at most OUT_MAX_RAW
+ */
+static void emitRaw(EMITTER *pe, const char *pStr, size_t len) {
+  
+  /* Check parameters */
+  if ((pe == NULL) || (pStr == NULL) || (len > OUT_MAX_RAW)) {
+    abort();
+  }
+  
+  if (pe->len + len > OUT_BUF_SIZE) {
+    emitFlush(pe);
+  }
+  memcpy(pe->buf + pe->len, pStr, len);
+  pe->len += len;
+}
+
+/*
+ * Append a non-negative integer in decimal to the output buffer of an
+ * emitter.
+ * 
+ * Parameters:
+ * 
+ *   pe - the emitter
+ * 
+ *   v - the integer
+ */
+static void emitDec(EMITTER *pe, int32_t v) {
+  
+  char buf[16];
+  int n = 0;
+  uint32_t u = 0;
+  
+  /* Check parameter */
+  if (v < 0) {
+    abort();
+  }
+  
+  /* Write digits from the end of the buffer */
+  u = (uint32_t) v;
+  do {
+    n++;
+    buf[sizeof(buf) - n] = (char) ('0' + (u % 10));
+    u /= 10;
+  } while (u > 0);
+  
+  emitRaw(pe, buf + sizeof(buf) - n, (size_t) n);
+}
+
+/*
+ * Append an integer in lowercase hexadecimal to the output buffer of
+ * an emitter.
+ * 
+ * Parameters:
+ * 
+ *   pe - the emitter
+ * 
+ *   v - the integer
+ */
+static void emitHex(EMITTER *pe, uint32_t v) {
+  
+  static const char *pDigits = "0123456789abcdef";
+  
+  char buf[16];
+  int n = 0;
+  
+  /* Write digits from the end of the buffer */
+  do {
+    n++;
+    buf[sizeof(buf) - n] = pDigits[v & 0xf];
+    v >>= 4;
+  } while (v > 0);
+  
+  emitRaw(pe, buf + sizeof(buf) - n, (size_t) n);
+}
+
+/*
+ * Append a point of the JSON points array to the output buffer of an
+ * emitter, including the separator before it.
+ * 
+ * Parameters:
+ * 
+ *   pe - the emitter
+ * 
+ *   i - the index of the point
+ * 
+ *   pp - the point
+ */
+static void emitPoint(
+    EMITTER                * pe,
+    int32_t                  i,
+    const LILAC_MESH_POINT * pp) {
+  
+  /* Check parameters */
+  if ((i < 0) || (pp == NULL)) {
+    abort();
+  }
+  
+  /* If not the first point, print a comma, then print line break from
+   * previous line and indent */
+  if (i > 0) {
+    emitRaw(pe, ",\n    {\"uid\": \"", 15);
+  } else {
+    emitRaw(pe, "\n    {\"uid\": \"", 14);
+  }
+  
+  /* Print point parameters */
+  emitHex(pe, ((uint32_t) i) + 1);
+  emitRaw(pe, "\", \"nrm\": \"", 11);
+  emitDec(pe, (int32_t) (pp->normd));
+  emitRaw(pe, ",", 1);
+  emitDec(pe, (int32_t) (pp->norma));
+  emitRaw(pe, "\", \"loc\": \"", 11);
+  emitDec(pe, (int32_t) (pp->x));
+  emitRaw(pe, ",", 1);
+  emitDec(pe, (int32_t) (pp->y));
+  emitRaw(pe, "\"}", 2);
+}
+
+/*
+ * Append a triangle of the JSON triangle array to the output buffer of
+ * an emitter, including the separator before it.
+ * 
+ * Parameters:
+ * 
+ *   pe - the emitter
+ * 
+ *   i - the index of the triangle
+ * 
+ *   pt - the three vertex indices of the triangle
+ */
+static void emitTri(EMITTER *pe, int32_t i, const uint32_t *pt) {
+  
+  /* Check parameters */
+  if ((i < 0) || (pt == NULL)) {
+    abort();
+  }
+  
+  /* If not the first triangle, print a comma, then print line break
+   * from previous line and indent */
+  if (i > 0) {
+    emitRaw(pe, ",\n    [\"", 8);
+  } else {
+    emitRaw(pe, "\n    [\"", 7);
+  }
+  
+  /* Print triangle array */
+  emitHex(pe, pt[0] + 1);
+  emitRaw(pe, "\", \"", 4);
+  emitHex(pe, pt[1] + 1);
+  emitRaw(pe, "\", \"", 4);
+  emitHex(pe, pt[2] + 1);
+  emitRaw(pe, "\"]", 2);
+}
+
+/*
+ * Given a Lilac mesh object, print out a JSON representation with an
+ * emitter.
+ * 
+ * The output is buffered, so emitFlush() must be called afterwards.
+ * 
+ * Parameters:
+ * 
+ *   pe - the emitter
+ * 
+ *   pMesh - the mesh object
+ */
+static void meshToJSON(EMITTER *pe, const LILAC_MESH *pMesh) {
+  
+  int32_t i = 0;
+  
+  /* Check parameter */
+  if (pMesh == NULL) {
+    abort();
+  }
+  
+  /* Print start of JSON object and points array */
+  emitRaw(pe, "{\n  \"points\": [", 15);
+  
+  /* Print each point */
+  for(i = 0; i < pMesh->point_count; i++) {
+    emitPoint(pe, i, &((pMesh->pPoints)[i]));
+  }
+  
+  /* Finish points array and begin triangle array */
+  emitRaw(pe, "\n  ],\n  \"tris\": [", 17);
+  
+  /* Print each triangle */
+  for(i = 0; i < pMesh->tri_count; i++) {
+    emitTri(pe, i, &((pMesh->pTris)[((size_t) i) * 3]));
+  }
+  
+  /* Finish triangle array and JSON object */
+  emitRaw(pe, "\n  ]\n}\n", 7);
+}
+
+/*
+ * Mesh sink function receiving the dimensions in streaming mode.
+ * 
+ * This prints the start of the JSON object and the points array.  If
+ * there are no points, the points array is finished right away.
+ * 
+ * Parameters:
+ * 
+ *   pCustom - the emitter
+ * 
+ *   point_count - the number of points
+ * 
+ *   tri_count - the number of triangles
+ */
+static void sinkDim(
+    void    * pCustom,
+    int32_t   point_count,
+    int32_t   tri_count) {
+  
+  EMITTER *pe = NULL;
+  
+  /* Ignore parameters */
+  (void) tri_count;
+  
+  /* Get the emitter */
+  pe = (EMITTER *) pCustom;
+  if (pe == NULL) {
+    abort();
+  }
+  
+  pe->points_left = point_count;
+  
+  emitRaw(pe, "{\n  \"points\": [", 15);
+  if (pe->points_left < 1) {
+    emitRaw(pe, "\n  ],\n  \"tris\": [", 17);
+  }
+}
+
+/*
+ * Mesh sink function receiving a point in streaming mode.
+ * 
+ * This prints the point.  After the last point, the points array is
+ * finished, the triangle array is begun, and any triangles that were
+ * held until then are printed.
+ * 
+ * Parameters:
+ * 
+ *   pCustom - the emitter
+ * 
+ *   i - the index of the point
+ * 
+ *   pp - the point
+ */
+static void sinkPoint(
+    void                   * pCustom,
+    int32_t                  i,
+    const LILAC_MESH_POINT * pp) {
+  
+  int32_t j = 0;
+  EMITTER *pe = NULL;
+  
+  /* Get the emitter */
+  pe = (EMITTER *) pCustom;
+  if (pe == NULL) {
+    abort();
+  }
+  
+  /* Check state */
+  if (pe->points_left < 1) {
+    abort();
+  }
+  
+  /* Print the point */
+  emitPoint(pe, i, pp);
+  (pe->points_left)--;
+  
+  /* After the last point, finish the points array and print the held
+   * triangles */
+  if (pe->points_left < 1) {
+    emitRaw(pe, "\n  ],\n  \"tris\": [", 17);
+    for(j = 0; j < pe->pend_count; j++) {
+      emitTri(pe, j, &((pe->pPend)[((size_t) j) * 3]));
+    }
+    pe->pend_count = 0;
+  }
+}
+
+/*
+ * Mesh sink function receiving a triangle in streaming mode.
+ * 
+ * The triangle is printed right away if all the points have been
+ * printed.  Otherwise, it is held until after the last point.
+ * 
+ * Parameters:
+ * 
+ *   pCustom - the emitter
+ * 
+ *   i - the index of the triangle
+ * 
+ *   pt - the three vertex indices of the triangle
+ */
+static void sinkTri(void *pCustom, int32_t i, const uint32_t *pt) {
+  
+  EMITTER *pe = NULL;
+  
+  /* Get the emitter */
+  pe = (EMITTER *) pCustom;
+  if (pe == NULL) {
+    abort();
+  }
+  
+  /* Check parameters */
+  if ((i < 0) || (pt == NULL)) {
+    abort();
+  }
+  
+  if (pe->points_left < 1) {
+    /* Print the triangle */
+    emitTri(pe, i, pt);
+  
+  } else {
+    /* Hold the triangle, growing the array if necessary */
+    if (pe->pend_count >= pe->pend_cap) {
+      if (pe->pend_cap < 1) {
+        pe->pend_cap = 1024;
+      } else if (pe->pend_cap <= LILAC_MESH_MAX_TRIS) {
+        pe->pend_cap *= 2;
+      } else {
+        abort();
+      }
+      
+      pe->pPend = (uint32_t *) realloc(
+                    pe->pPend,
+                    ((size_t) pe->pend_cap) * 3 * sizeof(uint32_t));
+      if (pe->pPend == NULL) {
+        abort();
+      }
+    }
+    
+    memcpy(&((pe->pPend)[((size_t) pe->pend_count) * 3]), pt,
+            3 * sizeof(uint32_t));
+    (pe->pend_count)++;
+  }
+}
+
+/*
+ * Convert a mesh file to JSON with an emitter.
+ * 
+ * Paths with a case-insensitive .lmb extension are loaded as binary
+ * mesh files.  Other files are read as Shastina mesh files, in
+ * streaming mode if stream is non-zero.
+ * 
+ * The output is buffered, so emitFlush() must be called afterwards.
+ * Nothing is reported to standard error.
+ * 
+ * Parameters:
+ * 
+ *   pe - the emitter
+ * 
+ *   pPath - path to the mesh file
+ * 
+ *   stream - non-zero for streaming mode
+ * 
+ *   pErrCode - pointer to variable to receive the error code
+ * 
+ *   pLine - pointer to variable to receive the line number of an error,
+ *   or zero
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the mesh file could not be read
  */
+static int convertMesh(
+    EMITTER    * pe,
+    const char * pPath,
+    int          stream,
+    int        * pErrCode,
+    long       * pLine) {
+  
+  int status = 1;
+  size_t slen = 0;
+  LILAC_MESH *pMesh = NULL;
+  LILAC_MESH_SINK sink;
+  
+  /* Initialize structures */
+  memset(&sink, 0, sizeof(LILAC_MESH_SINK));
+  
+  /* Check parameters */
+  if ((pe == NULL) || (pPath == NULL) ||
+      (pErrCode == NULL) || (pLine == NULL)) {
+    abort();
+  }
+  
+  *pErrCode = LILAC_MESH_ERR_OK;
+  *pLine = 0;
+  
+  /* Binary mesh files are loaded directly */
+  slen = strlen(pPath);
+  if ((slen >= 4) && (pPath[slen - 4] == '.') &&
+      ((pPath[slen - 3] == 'l') || (pPath[slen - 3] == 'L')) &&
+      ((pPath[slen - 2] == 'm') || (pPath[slen - 2] == 'M')) &&
+      ((pPath[slen - 1] == 'b') || (pPath[slen - 1] == 'B'))) {
+    pMesh = lilac_mesh_load(pPath, pErrCode);
+    if (pMesh == NULL) {
+      status = 0;
+    }
+  
+  /* Otherwise, in streaming mode, print the JSON representation while
+   * the input file is read */
+  } else if (stream) {
+    sink.pCustom = pe;
+    sink.fDim = &sinkDim;
+    sink.fPoint = &sinkPoint;
+    sink.fTri = &sinkTri;
+    
+    if (lilac_mesh_stream(pPath, &sink, pErrCode, pLine)) {
+      emitRaw(pe, "\n  ]\n}\n", 7);
+    } else {
+      status = 0;
+    }
+  
+  /* Otherwise, read the input file and build the mesh
+   * representation */
+  } else {
+    pMesh = lilac_mesh_read(pPath, pErrCode, pLine);
+    if (pMesh == NULL) {
+      status = 0;
+    }
+  }
+  
+  /* Print a JSON representation of the mesh */
+  if (status && (pMesh != NULL)) {
+    meshToJSON(pe, pMesh);
+  }
+  
+  /* Release the mesh object if allocated */
+  lilac_mesh_free(pMesh);
+  pMesh = NULL;
+  
+  /* Return status */
+  return status;
+}
 
 /*
- * The name of this executable module.
+ * Read the list of files of a batch and set up the batch.
  * 
- * This is set at the start of the program entrypoint.  It should be
- * included in error reports from the program.
+ * The list is read into a dynamically allocated buffer, which the
+ * paths of the batch point into.  *ppList receives the buffer, which
+ * must be freed by the caller even if the function fails.  m_pJobs and
+ * m_job_count are set up with all the files of the list.
+ * 
+ * Errors are reported to standard error.
+ * 
+ * Parameters:
+ * 
+ *   pPath - the path to the list
+ * 
+ *   ppList - receives the buffer holding the list
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
  */
-static const char *pModule = NULL;
+static int readList(const char *pPath, char **ppList) {
+  
+  int status = 1;
+  FILE *pf = NULL;
+  char *pBuf = NULL;
+  char *pc = NULL;
+  char *pEnd = NULL;
+  char *pLineEnd = NULL;
+  char *pTab = NULL;
+  size_t buf_cap = 0;
+  size_t buf_len = 0;
+  size_t rc = 0;
+  long line_num = 0;
+  int32_t cap = 0;
+  
+  /* Check parameters */
+  if ((pPath == NULL) || (ppList == NULL)) {
+    abort();
+  }
+  *ppList = NULL;
+  
+  /* Open the list */
+  pf = fopen(pPath, "rb");
+  if (pf == NULL) {
+    status = 0;
+    fprintf(stderr, "%s: Can't open list file!\n", pModule);
+  }
+  
+  /* Read the whole list, leaving room for a terminating nul */
+  while (status) {
+    if (buf_len + 1 >= buf_cap) {
+      if (buf_cap < 1) {
+        buf_cap = 65536;
+      } else if (buf_cap <= SIZE_MAX / 2) {
+        buf_cap *= 2;
+      } else {
+        abort();
+      }
+      
+      pBuf = (char *) realloc(pBuf, buf_cap);
+      if (pBuf == NULL) {
+        abort();
+      }
+      *ppList = pBuf;
+    }
+    
+    rc = fread(pBuf + buf_len, 1, buf_cap - buf_len - 1, pf);
+    buf_len += rc;
+    if (rc < 1) {
+      if (ferror(pf)) {
+        status = 0;
+        fprintf(stderr, "%s: Error reading list file!\n", pModule);
+      }
+      break;
+    }
+  }
+  
+  if (pf != NULL) {
+    fclose(pf);
+    pf = NULL;
+  }
+  
+  /* Split the list into lines and each line into its two paths */
+  if (status && (pBuf != NULL)) {
+    pBuf[buf_len] = (char) 0;
+    pEnd = pBuf + buf_len;
+    
+    for(pc = pBuf; pc < pEnd; pc = pLineEnd + 1) {
+      /* Find the end of the line and terminate it, dropping any
+       * carriage return */
+      line_num++;
+      pLineEnd = strchr(pc, '\n');
+      if (pLineEnd == NULL) {
+        pLineEnd = pEnd;
+      }
+      *pLineEnd = (char) 0;
+      if ((pLineEnd > pc) && (pLineEnd[-1] == '\r')) {
+        pLineEnd[-1] = (char) 0;
+      }
+      
+      /* Skip blank lines */
+      if (*pc == 0) {
+        continue;
+      }
+      
+      /* Split the line at the tab */
+      pTab = strchr(pc, '\t');
+      if ((pTab == NULL) || (pTab == pc) || (pTab[1] == 0)) {
+        status = 0;
+        fprintf(stderr, "%s: [list line %ld] Expecting two paths!\n",
+                  pModule, line_num);
+        break;
+      }
+      *pTab = (char) 0;
+      
+      /* Grow the file array if necessary */
+      if (m_job_count >= cap) {
+        if (cap < 1) {
+          cap = 1024;
+        } else if (cap < BATCH_MAXFILES) {
+          cap *= 2;
+        } else {
+          status = 0;
+          fprintf(stderr, "%s: Too many files in list!\n", pModule);
+          break;
+        }
+        
+        m_pJobs = (BATCHJOB *) realloc(
+                    m_pJobs, ((size_t) cap) * sizeof(BATCHJOB));
+        if (m_pJobs == NULL) {
+          abort();
+        }
+      }
+      
+      /* Add the file */
+      memset(&(m_pJobs[m_job_count]), 0, sizeof(BATCHJOB));
+      m_pJobs[m_job_count].list_line = line_num;
+      m_pJobs[m_job_count].pIn = pc;
+      m_pJobs[m_job_count].pOut = pTab + 1;
+      m_job_count++;
+    }
+  }
+  
+  /* Return status */
+  return status;
+}
 
 /*
- * Local functions
- * ---------------
+ * Convert one file of a batch.
+ * 
+ * The result is stored in the job structure.  Nothing is reported to
+ * standard error.  The output file is removed if the conversion fails.
+ * 
+ * Parameters:
+ * 
+ *   pe - the emitter of the calling thread
+ * 
+ *   pj - the job
  */
-
-/* Prototypes */
-static void meshToJSON(const LILAC_MESH *pMesh);
+static void convertJob(EMITTER *pe, BATCHJOB *pj) {
+  
+  FILE *pOut = NULL;
+  struct stat st;
+  
+  /* Initialize structures */
+  memset(&st, 0, sizeof(struct stat));
+  
+  /* Check parameters */
+  if ((pe == NULL) || (pj == NULL)) {
+    abort();
+  }
+  
+  pj->status = 1;
+  pj->errcode = LILAC_MESH_ERR_OK;
+  pj->line_num = 0;
+  pj->out_err = 0;
+  pj->in_bytes = 0;
+  pj->out_bytes = 0;
+  
+  /* Open the output file */
+  pOut = fopen(pj->pOut, "wb");
+  if (pOut == NULL) {
+    pj->status = 0;
+    pj->out_err = OUT_OPEN;
+  }
+  
+  /* Convert the input file */
+  if (pj->status) {
+    emitInit(pe, pOut);
+    if (!convertMesh(pe, pj->pIn, m_stream,
+                      &(pj->errcode), &(pj->line_num))) {
+      pj->status = 0;
+    }
+    emitFlush(pe);
+    emitFree(pe);
+    
+    if (pe->err) {
+      pj->status = 0;
+      pj->out_err = OUT_WRITE;
+    }
+    pj->out_bytes = pe->total;
+  }
+  
+  /* Close the output file and remove it if the conversion failed */
+  if (pOut != NULL) {
+    if (fclose(pOut)) {
+      if (pj->status) {
+        pj->status = 0;
+        pj->out_err = OUT_WRITE;
+      }
+    }
+    pOut = NULL;
+    
+    if (!(pj->status)) {
+      remove(pj->pOut);
+    }
+  }
+  
+  /* Get the size of the input file */
+  if (pj->status) {
+    if (stat(pj->pIn, &st) == 0) {
+      pj->in_bytes = (uint64_t) st.st_size;
+    }
+  }
+}
 
 /*
- * Given a Lilac mesh object, print out a JSON representation to
- * standard output.
+ * Thread function of a batch.
+ * 
+ * The thread takes files from the batch until there are none left.
  * 
  * Parameters:
  * 
- *   pMesh - the mesh object
+ *   pArg - the emitter of the thread
+ * 
+ * Return:
+ * 
+ *   NULL
  */
-static void meshToJSON(const LILAC_MESH *pMesh) {
+static void *batchThread(void *pArg) {
   
+  EMITTER *pe = NULL;
   int32_t i = 0;
-  const LILAC_MESH_POINT *pp = NULL;
-  const uint16_t *pt = NULL;
   
-  /* Check parameter */
-  if (pMesh == NULL) {
+  /* Get the emitter */
+  pe = (EMITTER *) pArg;
+  if (pe == NULL) {
     abort();
   }
   
-  /* Print start of JSON object and points array */
-  printf("{\n  \"points\": [");
-  
-  /* Print each point */
-  for(i = 0; i < pMesh->point_count; i++) {
-    /* Get reference to current point object */
-    pp = &((pMesh->pPoints)[i]);
-    
-    /* If not the first point, print a comma */
-    if (i > 0) {
-      printf(",");
+  for(;;) {
+    /* Take the next file */
+    if (pthread_mutex_lock(&m_job_lock)) {
+      abort();
+    }
+    i = m_job_next;
+    if (i < m_job_count) {
+      m_job_next++;
+    }
+    if (pthread_mutex_unlock(&m_job_lock)) {
+      abort();
     }
     
-    /* Print line break from previous line and indent */
-    printf("\n    ");
+    /* Stop if there are no files left */
+    if (i >= m_job_count) {
+      break;
+    }
     
-    /* Print point parameters */
-    printf("{\"uid\": \"%lx\", \"nrm\": \"%d,%d\", \"loc\": \"%d,%d\"}",
-              (long) (i + 1),
-              (int) (pp->normd),
-              (int) (pp->norma),
-              (int) (pp->x),
-              (int) (pp->y));
+    /* Convert the file */
+    convertJob(pe, &(m_pJobs[i]));
   }
   
-  /* Finish points array and begin triangle array */
-  printf("\n  ],\n  \"tris\": [");
+  return NULL;
+}
+
+/*
+ * Convert a batch of files.
+ * 
+ * Errors and statistics are reported.
+ * 
+ * Parameters:
+ * 
+ *   pListPath - the path to the list of files
+ * 
+ *   stream - non-zero for streaming mode
+ * 
+ *   threads - the number of threads, in range one up to and including
+ *   BATCH_MAXTHREADS
+ * 
+ * Return:
+ * 
+ *   non-zero if all the files were converted, zero if any failed
+ */
+static int runBatch(const char *pListPath, int stream, int threads) {
   
-  /* Print each triangle */
-  for(i = 0; i < pMesh->tri_count; i++) {
-    /* Get reference to first vertex of current triangle */
-    pt = &((pMesh->pTris)[i * 3]);
+  int status = 1;
+  int i = 0;
+  int ran = 0;
+  int32_t j = 0;
+  int32_t failed = 0;
+  char *pList = NULL;
+  double t = 0.0;
+  uint64_t in_bytes = 0;
+  uint64_t out_bytes = 0;
+  BATCHJOB *pj = NULL;
+  EMITTER *pEmit = NULL;
+  pthread_t tid[BATCH_MAXTHREADS];
+  int started[BATCH_MAXTHREADS];
+  
+  /* Initialize arrays */
+  memset(tid, 0, sizeof(tid));
+  memset(started, 0, sizeof(started));
+  
+  /* Check parameters */
+  if ((pListPath == NULL) ||
+      (threads < 1) || (threads > BATCH_MAXTHREADS)) {
+    abort();
+  }
+  
+  /* Read the list */
+  if (!readList(pListPath, &pList)) {
+    status = 0;
+  }
+  
+  /* No point in more threads than files */
+  if (status) {
+    if (threads > m_job_count) {
+      threads = (int) m_job_count;
+    }
+    if (threads < 1) {
+      threads = 1;
+    }
+  }
+  
+  /* Allocate an emitter for each thread */
+  if (status) {
+    pEmit = (EMITTER *) calloc((size_t) threads, sizeof(EMITTER));
+    if (pEmit == NULL) {
+      abort();
+    }
+  }
+  
+  /* Start the other threads, and then convert files on this thread
+   * too */
+  if (status) {
+    t = wallclock();
+    m_job_next = 0;
+    m_stream = stream;
+    
+    for(i = 1; i < threads; i++) {
+      if (pthread_create(&(tid[i]), NULL,
+                          &batchThread, &(pEmit[i])) == 0) {
+        started[i] = 1;
+      }
+    }
     
-    /* If not the first triangle, print a comma */
-    if (i > 0) {
-      printf(",");
+    batchThread(&(pEmit[0]));
+    
+    ran = 1;
+    for(i = 1; i < threads; i++) {
+      if (started[i]) {
+        pthread_join(tid[i], NULL);
+        ran++;
+      }
     }
     
-    /* Print line break from previous line and indent */
-    printf("\n    ");
+    t = wallclock() - t;
+  }
+  
+  /* Report the failed files in the order of the list and add up the
+   * sizes of the converted files */
+  if (status) {
+    for(j = 0; j < m_job_count; j++) {
+      pj = &(m_pJobs[j]);
+      
+      if (pj->status) {
+        in_bytes += pj->in_bytes;
+        out_bytes += pj->out_bytes;
+        continue;
+      }
+      
+      failed++;
+      if (pj->out_err == OUT_OPEN) {
+        fprintf(stderr, "%s: %s: Can't open output file!\n",
+                  pModule, pj->pIn);
+      
+      } else if (pj->errcode == LILAC_MESH_ERR_TRAIL) {
+        fprintf(stderr, "%s: %s: Failed to consume input after |;\n",
+                  pModule, pj->pIn);
+      
+      } else if (pj->errcode != LILAC_MESH_ERR_OK) {
+        if (pj->line_num > 0) {
+          fprintf(stderr, "%s: %s: [line %ld] %s!\n",
+                    pModule, pj->pIn, pj->line_num,
+                    lilac_mesh_errstr(pj->errcode));
+        } else {
+          fprintf(stderr, "%s: %s: %s!\n",
+                    pModule, pj->pIn,
+                    lilac_mesh_errstr(pj->errcode));
+        }
+      
+      } else {
+        fprintf(stderr, "%s: %s: Error writing output!\n",
+                  pModule, pj->pIn);
+      }
+    }
     
-    /* Print triangle array */
-    printf("[\"%lx\", \"%lx\", \"%lx\"]",
-              ((long) pt[0]) + 1,
-              ((long) pt[1]) + 1,
-              ((long) pt[2]) + 1);
+    if (failed > 0) {
+      status = 0;
+    }
   }
   
-  /* Finish triangle array and JSON object */
-  printf("\n  ]\n}\n");
+  /* Print the statistics, but only if the list was read and the files
+   * were converted */
+  if (ran > 0) {
+    printf("files:      %ld converted, %ld failed, %d %s\n",
+            (long) (m_job_count - failed), (long) failed, ran,
+            (ran == 1) ? "thread" : "threads");
+    printf("input:      %.1f MB\n", ((double) in_bytes) / 1.0e6);
+    printf("output:     %.1f MB\n", ((double) out_bytes) / 1.0e6);
+    printf("time:       %.3f s\n", t);
+    if (t > 0.0) {
+      printf("throughput: %.1f files/s, %.1f MB/s input, "
+              "%.1f MB/s output\n",
+              ((double) m_job_count) / t,
+              ((double) in_bytes) / (t * 1.0e6),
+              ((double) out_bytes) / (t * 1.0e6));
+    }
+  }
+  
+  /* Release everything */
+  if (pEmit != NULL) {
+    free(pEmit);
+    pEmit = NULL;
+  }
+  
+  if (m_pJobs != NULL) {
+    free(m_pJobs);
+    m_pJobs = NULL;
+  }
+  m_job_count = 0;
+  
+  if (pList != NULL) {
+    free(pList);
+    pList = NULL;
+  }
+  
+  /* Return status */
+  return status;
 }
 
 /*
@@ -132,14 +1325,14 @@ int main(int argc, char *argv[]) {
   
   int status = 1;
   int x = 0;
+  int argi = 0;
   int errcode = 0;
+  int stream = 0;
+  int batch = 0;
+  int threads = 0;
   long line_num = 0;
   const char *pPath = NULL;
   
-  FILE *pIn = NULL;
-  SNSOURCE *pSrc = NULL;
-  LILAC_MESH *pMesh = NULL;
-  
   /* Get module name */
   pModule = NULL;
   if ((argc > 0) && (argv != NULL)) {
@@ -161,37 +1354,63 @@ int main(int argc, char *argv[]) {
     }
   }
   
+  /* Parse options */
+  for(argi = 1; status && (argi < argc); argi++) {
+    if (strncmp(argv[argi], "--", 2) != 0) {
+      break;
+    }
+    
+    if (strcmp(argv[argi], "--stream") == 0) {
+      stream = 1;
+    
+    } else if (strcmp(argv[argi], "--batch") == 0) {
+      batch = 1;
+    
+    } else if ((strcmp(argv[argi], "--threads") == 0) &&
+                (argi + 1 < argc)) {
+      argi++;
+      threads = atoi(argv[argi]);
+      if ((threads < 1) || (threads > BATCH_MAXTHREADS)) {
+        fprintf(stderr, "%s: Invalid thread count!\n", pModule);
+        status = 0;
+      }
+    
+    } else {
+      fprintf(stderr, "%s: Unrecognized option '%s'!\n",
+                pModule, argv[argi]);
+      status = 0;
+    }
+  }
+  
   /* Check number of parameters */
-  if (argc != 2) {
+  if (status && (argc - argi != 1)) {
     status = 0;
     fprintf(stderr, "%s: Wrong number of arguments!\n", pModule);
   }
   
   /* Get the program arguments */
   if (status) {
-    pPath = argv[1];
+    pPath = argv[argi];
   }
   
-  /* Open the input file as a Shastina source and assign ownership of
-   * the file handle to the Shastina source object */
-  if (status) {
-    pIn = fopen(pPath, "rb");
-    if (pIn != NULL) {
-      pSrc = snsource_file(pIn, 1);
-      pIn = NULL;
-      
-    } else {
+  /* Convert a batch of files */
+  if (status && batch) {
+    if (threads < 1) {
+      threads = batchThreads();
+    }
+    if (!runBatch(pPath, stream, threads)) {
       status = 0;
-      fprintf(stderr, "%s: Can't open input file!\n", pModule);
     }
-  }
-
-  /* Parse the input file and build the mesh representation */
-  if (status) {
-    pMesh = lilac_mesh_new(pSrc, &errcode, &line_num);
-    if (pMesh == NULL) {
+  
+  /* Otherwise, convert a single file to standard output */
+  } else if (status) {
+    emitInit(&m_emit, stdout);
+    if (!convertMesh(&m_emit, pPath, stream, &errcode, &line_num)) {
       status = 0;
-      if (line_num > 0) {
+      if (errcode == LILAC_MESH_ERR_TRAIL) {
+        fprintf(stderr, "%s: Failed to consume input after |;\n",
+                  pModule);
+      } else if (line_num > 0) {
         fprintf(stderr, "%s: [line %ld] %s!\n",
                   pModule, line_num, lilac_mesh_errstr(errcode));
       } else {
@@ -199,31 +1418,18 @@ int main(int argc, char *argv[]) {
                   pModule, lilac_mesh_errstr(errcode));
       }
     }
-  }
-  
-  /* Consume the rest of input, making sure nothing remains in file */
-  if (status) {
-    if (snsource_consume(pSrc) <= 0) {
-      status = 0;
-      fprintf(stderr, "%s: Failed to consume input after |;\n", 
-                pModule);
+    
+    /* Write the rest of the output */
+    emitFlush(&m_emit);
+    emitFree(&m_emit);
+    if (status) {
+      if (m_emit.err || fflush(stdout)) {
+        status = 0;
+        fprintf(stderr, "%s: Error writing output!\n", pModule);
+      }
     }
   }
   
-  /* Print a JSON representation of the mesh */
-  if (status) {
-    meshToJSON(pMesh);
-  }
-  
-  /* Release the mesh object if allocated */
-  lilac_mesh_free(pMesh);
-  pMesh = NULL;
-  
-  /* Release the Shastina source if allocated, as well as any file
-   * handle owned by the source */
-  snsource_free(pSrc);
-  pSrc = NULL;
-  
   /* Invert status and return */
   if (status) {
     status = 0;
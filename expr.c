@@ -0,0 +1,1811 @@
+/*
+ * expr.c
+ * 
+ * Implementation of expr.h
+ * 
+ * See the header for further information.
+ */
+
+#include "expr.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Constants
+ * =========
+ */
+
+/*
+ * The number of pixels that each instruction is run across at a time.
+ */
+#define EXPR_LANES (32)
+
+/*
+ * The maximum number of arguments of a function.
+ */
+#define EXPR_MAXARG (4)
+
+/*
+ * The maximum length in characters of a decimal number.
+ */
+#define EXPR_MAXNUM (63)
+
+/*
+ * The registers holding the predefined variables.  Temporaries and
+ * defined variables start at EXPR_REG_FIRST, and constants are placed
+ * after all of those when compilation is finished.
+ */
+#define EXPR_REG_X     (0)
+#define EXPR_REG_Y     (1)
+#define EXPR_REG_W     (2)
+#define EXPR_REG_H     (3)
+#define EXPR_REG_FIRST (4)
+
+/*
+ * Opcodes.
+ * 
+ * The destination register receives the result.  The source operands
+ * are in the order they are written in the expression, except that
+ * EXPR_OP_SEL has the condition first.
+ */
+#define EXPR_OP_ADD   (0)
+#define EXPR_OP_SUB   (1)
+#define EXPR_OP_MUL   (2)
+#define EXPR_OP_DIV   (3)
+#define EXPR_OP_MOD   (4)
+#define EXPR_OP_NEG   (5)
+#define EXPR_OP_NOT   (6)
+#define EXPR_OP_BNOT  (7)
+#define EXPR_OP_BAND  (8)
+#define EXPR_OP_BOR   (9)
+#define EXPR_OP_BXOR  (10)
+#define EXPR_OP_SHL   (11)
+#define EXPR_OP_SHR   (12)
+#define EXPR_OP_LT    (13)
+#define EXPR_OP_LE    (14)
+#define EXPR_OP_GT    (15)
+#define EXPR_OP_GE    (16)
+#define EXPR_OP_EQ    (17)
+#define EXPR_OP_NE    (18)
+#define EXPR_OP_LAND  (19)
+#define EXPR_OP_LOR   (20)
+#define EXPR_OP_SEL   (21)
+#define EXPR_OP_ABS   (22)
+#define EXPR_OP_FLOOR (23)
+#define EXPR_OP_CEIL  (24)
+#define EXPR_OP_SQRT  (25)
+#define EXPR_OP_SIN   (26)
+#define EXPR_OP_COS   (27)
+#define EXPR_OP_ATAN2 (28)
+#define EXPR_OP_POW   (29)
+#define EXPR_OP_MIN   (30)
+#define EXPR_OP_MAX   (31)
+#define EXPR_OP_CLAMP (32)
+#define EXPR_OP_MIX   (33)
+#define EXPR_OP_HASH  (34)
+#define EXPR_OP_NOISE (35)
+#define EXPR_OP_ARGB  (36)
+
+/*
+ * Token kinds.
+ * 
+ * Single-character tokens are represented by the character itself.
+ */
+#define EXPR_T_END  (256)
+#define EXPR_T_NUM  (257)
+#define EXPR_T_NAME (258)
+#define EXPR_T_SHL  (259)
+#define EXPR_T_SHR  (260)
+#define EXPR_T_LE   (261)
+#define EXPR_T_GE   (262)
+#define EXPR_T_EQ   (263)
+#define EXPR_T_NE   (264)
+#define EXPR_T_LAND (265)
+#define EXPR_T_LOR  (266)
+
+/*
+ * The number of built-in functions and binary operators.
+ */
+#define EXPR_FNCOUNT (15)
+#define EXPR_BINCOUNT (18)
+
+/*
+ * The maximum nesting depth of expressions.
+ */
+#define EXPR_MAXDEPTH (64)
+
+/*
+ * Pi, for the predefined constant.
+ */
+#define EXPR_PI (3.14159265358979323846)
+
+/*
+ * Type declarations
+ * =================
+ */
+
+/*
+ * A bytecode instruction.
+ * 
+ * While compiling, negative source operands refer to constants, with
+ * -1 being the first constant.  They are relocated to registers once
+ * the number of registers is known.  Unused source operands are zero.
+ */
+typedef struct {
+  
+  /*
+   * One of the EXPR_OP_ constants.
+   */
+  int16_t op;
+  
+  /*
+   * The destination register.
+   */
+  int16_t d;
+  
+  /*
+   * The source operands.
+   */
+  int16_t s[EXPR_MAXARG];
+  
+} EXPRINS;
+
+/*
+ * A compiled expression shader.
+ */
+typedef struct {
+  
+  /*
+   * The number of registers other than constants.  The constants are in
+   * the registers that follow.
+   */
+  int nreg;
+  
+  /*
+   * The constants.
+   */
+  int nconst;
+  double konst[EXPR_MAXREG];
+  
+  /*
+   * The register holding the final value.
+   */
+  int result;
+  
+  /*
+   * The instructions.
+   */
+  int ncode;
+  EXPRINS code[EXPR_MAXCODE];
+  
+} EXPR;
+
+/*
+ * An operand during compilation.
+ * 
+ * If konst is non-zero, the operand is the constant v.  Otherwise, it
+ * is in register reg, and temp is non-zero if that register is a
+ * temporary that must be released once the operand is used.
+ */
+typedef struct {
+  int konst;
+  double v;
+  int reg;
+  int temp;
+} EXPROPD;
+
+/*
+ * A built-in function.
+ */
+typedef struct {
+  const char *pName;
+  int argc;
+  int op;
+} EXPRFN;
+
+/*
+ * A binary operator.
+ */
+typedef struct {
+  int tok;
+  int prec;
+  int op;
+} EXPRBIN;
+
+/*
+ * Compiler state.
+ */
+typedef struct {
+  
+  /*
+   * The source text, and a pointer to the character after the current
+   * token.
+   */
+  const char *pSrc;
+  const char *pc;
+  
+  /*
+   * The current token, its one-indexed position in the source, and its
+   * value if it is a number or a name.
+   */
+  int tok;
+  int tpos;
+  double tval;
+  char tname[EXPR_MAXNAME + 1];
+  
+  /*
+   * The expression being compiled.
+   */
+  EXPR *pe;
+  
+  /*
+   * The next free register, and the highest number of registers used
+   * so far.  Temporaries are allocated and released in stack order.
+   */
+  int top;
+  int maxreg;
+  
+  /*
+   * The defined variables.
+   */
+  int nvar;
+  char vname[EXPR_MAXVAR][EXPR_MAXNAME + 1];
+  EXPROPD var[EXPR_MAXVAR];
+  
+  /*
+   * The current nesting depth of expressions.
+   */
+  int depth;
+  
+  /*
+   * The first error, and its position.
+   */
+  int err;
+  int epos;
+  
+} EXPRC;
+
+/*
+ * Local data
+ * ==========
+ */
+
+/*
+ * The built-in functions.
+ */
+static const EXPRFN m_fn[EXPR_FNCOUNT] = {
+  {"abs",   1, EXPR_OP_ABS},
+  {"floor", 1, EXPR_OP_FLOOR},
+  {"ceil",  1, EXPR_OP_CEIL},
+  {"sqrt",  1, EXPR_OP_SQRT},
+  {"sin",   1, EXPR_OP_SIN},
+  {"cos",   1, EXPR_OP_COS},
+  {"atan2", 2, EXPR_OP_ATAN2},
+  {"pow",   2, EXPR_OP_POW},
+  {"min",   2, EXPR_OP_MIN},
+  {"max",   2, EXPR_OP_MAX},
+  {"clamp", 3, EXPR_OP_CLAMP},
+  {"mix",   3, EXPR_OP_MIX},
+  {"hash",  3, EXPR_OP_HASH},
+  {"noise", 3, EXPR_OP_NOISE},
+  {"argb",  4, EXPR_OP_ARGB}
+};
+
+/*
+ * The binary operators, with their precedence, where higher binds more
+ * tightly.
+ */
+static const EXPRBIN m_bin[EXPR_BINCOUNT] = {
+  {EXPR_T_LOR,   1, EXPR_OP_LOR},
+  {EXPR_T_LAND,  2, EXPR_OP_LAND},
+  {'|',          3, EXPR_OP_BOR},
+  {'^',          4, EXPR_OP_BXOR},
+  {'&',          5, EXPR_OP_BAND},
+  {EXPR_T_EQ,    6, EXPR_OP_EQ},
+  {EXPR_T_NE,    6, EXPR_OP_NE},
+  {'<',          7, EXPR_OP_LT},
+  {EXPR_T_LE,    7, EXPR_OP_LE},
+  {'>',          7, EXPR_OP_GT},
+  {EXPR_T_GE,    7, EXPR_OP_GE},
+  {EXPR_T_SHL,   8, EXPR_OP_SHL},
+  {EXPR_T_SHR,   8, EXPR_OP_SHR},
+  {'+',          9, EXPR_OP_ADD},
+  {'-',          9, EXPR_OP_SUB},
+  {'*',         10, EXPR_OP_MUL},
+  {'/',         10, EXPR_OP_DIV},
+  {'%',         10, EXPR_OP_MOD}
+};
+
+/*
+ * The compiled expression shaders.
+ * 
+ * m_expr_count is the number of shaders that have been added.
+ */
+static EXPR *m_expr[EXPR_MAXCOUNT];
+static int m_expr_count = 0;
+
+/*
+ * Local functions
+ * ===============
+ */
+
+/* Prototypes */
+static int64_t expr_int(double v);
+static uint32_t expr_hash(uint32_t x, uint32_t y, uint32_t seed);
+static double expr_noise(double x, double y, double seed);
+static uint32_t expr_chan(double v);
+static void expr_step(
+    const EXPRINS *pi,
+    double (*r)[EXPR_LANES],
+    int n);
+
+static int expr_fail(EXPRC *pc, int code);
+static int expr_next(EXPRC *pc);
+static int expr_peek(const EXPRC *pc);
+static int expr_isassign(const EXPRC *pc);
+static int expr_src(EXPRC *pc, const EXPROPD *po);
+static int expr_op(EXPRC *pc, int op, EXPROPD *pArg, int argc,
+                    EXPROPD *pr);
+static int expr_binop(int tok, int *pop);
+static int expr_primary(EXPRC *pc, EXPROPD *pr);
+static int expr_unary(EXPRC *pc, EXPROPD *pr);
+static int expr_binary(EXPRC *pc, int minprec, EXPROPD *pr);
+static int expr_expr(EXPRC *pc, EXPROPD *pr);
+static int expr_define(EXPRC *pc);
+static int expr_compile(EXPRC *pc);
+
+/*
+ * Round a value down to a 64-bit integer.
+ * 
+ * Values that are not finite or out of range become zero.
+ * 
+ * Parameters:
+ * 
+ *   v - the value
+ * 
+ * Return:
+ * 
+ *   the integer
+ */
+static int64_t expr_int(double v) {
+  if (!((v > -9.2e18) && (v < 9.2e18))) {
+    return 0;
+  }
+  return (int64_t) floor(v);
+}
+
+/*
+ * Hash integer lattice coordinates and a seed.
+ * 
+ * This is the same hash that the native texture module uses.
+ * 
+ * Parameters:
+ * 
+ *   x - the X coordinate
+ * 
+ *   y - the Y coordinate
+ * 
+ *   seed - the seed
+ * 
+ * Return:
+ * 
+ *   the hashed value
+ */
+static uint32_t expr_hash(uint32_t x, uint32_t y, uint32_t seed) {
+  
+  uint32_t h = 0;
+  
+  h = seed ^ UINT32_C(0x9e3779b9);
+  h ^= x * UINT32_C(0x85ebca6b);
+  h = (h << 13) | (h >> 19);
+  h = (h * UINT32_C(5)) + UINT32_C(0xe6546b64);
+  h ^= y * UINT32_C(0xc2b2ae35);
+  h = (h << 13) | (h >> 19);
+  h = (h * UINT32_C(5)) + UINT32_C(0xe6546b64);
+  
+  h ^= h >> 16;
+  h *= UINT32_C(0x85ebca6b);
+  h ^= h >> 13;
+  h *= UINT32_C(0xc2b2ae35);
+  h ^= h >> 16;
+  
+  return h;
+}
+
+/*
+ * Smooth value noise with one lattice cell per unit.
+ * 
+ * Parameters:
+ * 
+ *   x - the X coordinate
+ * 
+ *   y - the Y coordinate
+ * 
+ *   seed - the seed
+ * 
+ * Return:
+ * 
+ *   the noise value in range [0.0, 1.0)
+ */
+static double expr_noise(double x, double y, double seed) {
+  
+  double fx = 0.0;
+  double fy = 0.0;
+  double tx = 0.0;
+  double ty = 0.0;
+  double top = 0.0;
+  double bottom = 0.0;
+  uint32_t ix = 0;
+  uint32_t iy = 0;
+  uint32_t s = 0;
+  
+  fx = floor(x);
+  fy = floor(y);
+  tx = x - fx;
+  ty = y - fy;
+  
+  /* Coordinates that are not finite have no cell, so treat them as
+   * lattice points */
+  if (!((tx >= 0.0) && (tx < 1.0))) {
+    tx = 0.0;
+  }
+  if (!((ty >= 0.0) && (ty < 1.0))) {
+    ty = 0.0;
+  }
+  
+  tx = tx * tx * (3.0 - (2.0 * tx));
+  ty = ty * ty * (3.0 - (2.0 * ty));
+  
+  ix = (uint32_t) expr_int(fx);
+  iy = (uint32_t) expr_int(fy);
+  s = (uint32_t) expr_int(seed);
+  
+  top = (double) (expr_hash(ix, iy, s) & 0xffff);
+  top += tx * (((double) (expr_hash(ix + 1, iy, s) & 0xffff)) - top);
+  
+  bottom = (double) (expr_hash(ix, iy + 1, s) & 0xffff);
+  bottom += tx * (((double) (expr_hash(ix + 1, iy + 1, s) & 0xffff)) -
+                    bottom);
+  
+  return (top + (ty * (bottom - top))) / 65536.0;
+}
+
+/*
+ * Convert a value to a channel value for argb().
+ * 
+ * Parameters:
+ * 
+ *   v - the value
+ * 
+ * Return:
+ * 
+ *   the value rounded down and clamped to range 0 to 255
+ */
+static uint32_t expr_chan(double v) {
+  if (!(v > 0.0)) {
+    return 0;
+  } else if (v >= 255.0) {
+    return 255;
+  }
+  return (uint32_t) v;
+}
+
+/*
+ * Run one instruction across a batch of pixels.
+ * 
+ * r is the register file, and n is the number of pixels in the batch,
+ * which is in range one up to and including EXPR_LANES.  The
+ * destination register may be the same as a source register.
+ * 
+ * Parameters:
+ * 
+ *   pi - the instruction
+ * 
+ *   r - the register file
+ * 
+ *   n - the number of pixels
+ */
+static void expr_step(
+    const EXPRINS *pi,
+    double (*r)[EXPR_LANES],
+    int n) {
+  
+  int i = 0;
+  int64_t k = 0;
+  double *pd = NULL;
+  const double *pa = NULL;
+  const double *pb = NULL;
+  const double *pc = NULL;
+  const double *pe = NULL;
+  
+  pd = r[pi->d];
+  pa = r[pi->s[0]];
+  pb = r[pi->s[1]];
+  pc = r[pi->s[2]];
+  pe = r[pi->s[3]];
+  
+  switch (pi->op) {
+    case EXPR_OP_ADD:
+      for(i = 0; i < n; i++) {
+        pd[i] = pa[i] + pb[i];
+      }
+      break;
+    
+    case EXPR_OP_SUB:
+      for(i = 0; i < n; i++) {
+        pd[i] = pa[i] - pb[i];
+      }
+      break;
+    
+    case EXPR_OP_MUL:
+      for(i = 0; i < n; i++) {
+        pd[i] = pa[i] * pb[i];
+      }
+      break;
+    
+    case EXPR_OP_DIV:
+      for(i = 0; i < n; i++) {
+        pd[i] = (pb[i] != 0.0) ? (pa[i] / pb[i]) : 0.0;
+      }
+      break;
+    
+    case EXPR_OP_MOD:
+      for(i = 0; i < n; i++) {
+        pd[i] = (pb[i] != 0.0) ?
+                  (pa[i] - (floor(pa[i] / pb[i]) * pb[i])) : 0.0;
+      }
+      break;
+    
+    case EXPR_OP_NEG:
+      for(i = 0; i < n; i++) {
+        pd[i] = -pa[i];
+      }
+      break;
+    
+    case EXPR_OP_NOT:
+      for(i = 0; i < n; i++) {
+        pd[i] = (pa[i] == 0.0) ? 1.0 : 0.0;
+      }
+      break;
+    
+    case EXPR_OP_BNOT:
+      for(i = 0; i < n; i++) {
+        pd[i] = (double) (~expr_int(pa[i]));
+      }
+      break;
+    
+    case EXPR_OP_BAND:
+      for(i = 0; i < n; i++) {
+        pd[i] = (double) (expr_int(pa[i]) & expr_int(pb[i]));
+      }
+      break;
+    
+    case EXPR_OP_BOR:
+      for(i = 0; i < n; i++) {
+        pd[i] = (double) (expr_int(pa[i]) | expr_int(pb[i]));
+      }
+      break;
+    
+    case EXPR_OP_BXOR:
+      for(i = 0; i < n; i++) {
+        pd[i] = (double) (expr_int(pa[i]) ^ expr_int(pb[i]));
+      }
+      break;
+    
+    case EXPR_OP_SHL:
+      for(i = 0; i < n; i++) {
+        k = expr_int(pb[i]);
+        pd[i] = ((k >= 0) && (k < 64)) ?
+                  (double) ((int64_t)
+                    (((uint64_t) expr_int(pa[i])) << k)) : 0.0;
+      }
+      break;
+    
+    case EXPR_OP_SHR:
+      for(i = 0; i < n; i++) {
+        k = expr_int(pb[i]);
+        pd[i] = ((k >= 0) && (k < 64)) ?
+                  (double) ((int64_t)
+                    (((uint64_t) expr_int(pa[i])) >> k)) : 0.0;
+      }
+      break;
+    
+    case EXPR_OP_LT:
+      for(i = 0; i < n; i++) {
+        pd[i] = (pa[i] < pb[i]) ? 1.0 : 0.0;
+      }
+      break;
+    
+    case EXPR_OP_LE:
+      for(i = 0; i < n; i++) {
+        pd[i] = (pa[i] <= pb[i]) ? 1.0 : 0.0;
+      }
+      break;
+    
+    case EXPR_OP_GT:
+      for(i = 0; i < n; i++) {
+        pd[i] = (pa[i] > pb[i]) ? 1.0 : 0.0;
+      }
+      break;
+    
+    case EXPR_OP_GE:
+      for(i = 0; i < n; i++) {
+        pd[i] = (pa[i] >= pb[i]) ? 1.0 : 0.0;
+      }
+      break;
+    
+    case EXPR_OP_EQ:
+      for(i = 0; i < n; i++) {
+        pd[i] = (pa[i] == pb[i]) ? 1.0 : 0.0;
+      }
+      break;
+    
+    case EXPR_OP_NE:
+      for(i = 0; i < n; i++) {
+        pd[i] = (pa[i] != pb[i]) ? 1.0 : 0.0;
+      }
+      break;
+    
+    case EXPR_OP_LAND:
+      for(i = 0; i < n; i++) {
+        pd[i] = ((pa[i] != 0.0) && (pb[i] != 0.0)) ? 1.0 : 0.0;
+      }
+      break;
+    
+    case EXPR_OP_LOR:
+      for(i = 0; i < n; i++) {
+        pd[i] = ((pa[i] != 0.0) || (pb[i] != 0.0)) ? 1.0 : 0.0;
+      }
+      break;
+    
+    case EXPR_OP_SEL:
+      for(i = 0; i < n; i++) {
+        pd[i] = (pa[i] != 0.0) ? pb[i] : pc[i];
+      }
+      break;
+    
+    case EXPR_OP_ABS:
+      for(i = 0; i < n; i++) {
+        pd[i] = fabs(pa[i]);
+      }
+      break;
+    
+    case EXPR_OP_FLOOR:
+      for(i = 0; i < n; i++) {
+        pd[i] = floor(pa[i]);
+      }
+      break;
+    
+    case EXPR_OP_CEIL:
+      for(i = 0; i < n; i++) {
+        pd[i] = ceil(pa[i]);
+      }
+      break;
+    
+    case EXPR_OP_SQRT:
+      for(i = 0; i < n; i++) {
+        pd[i] = (pa[i] > 0.0) ? sqrt(pa[i]) : 0.0;
+      }
+      break;
+    
+    case EXPR_OP_SIN:
+      for(i = 0; i < n; i++) {
+        pd[i] = sin(pa[i]);
+      }
+      break;
+    
+    case EXPR_OP_COS:
+      for(i = 0; i < n; i++) {
+        pd[i] = cos(pa[i]);
+      }
+      break;
+    
+    case EXPR_OP_ATAN2:
+      for(i = 0; i < n; i++) {
+        pd[i] = atan2(pa[i], pb[i]);
+      }
+      break;
+    
+    case EXPR_OP_POW:
+      for(i = 0; i < n; i++) {
+        pd[i] = pow(pa[i], pb[i]);
+      }
+      break;
+    
+    case EXPR_OP_MIN:
+      for(i = 0; i < n; i++) {
+        pd[i] = (pb[i] < pa[i]) ? pb[i] : pa[i];
+      }
+      break;
+    
+    case EXPR_OP_MAX:
+      for(i = 0; i < n; i++) {
+        pd[i] = (pb[i] > pa[i]) ? pb[i] : pa[i];
+      }
+      break;
+    
+    case EXPR_OP_CLAMP:
+      for(i = 0; i < n; i++) {
+        if (pa[i] < pb[i]) {
+          pd[i] = pb[i];
+        } else if (pa[i] > pc[i]) {
+          pd[i] = pc[i];
+        } else {
+          pd[i] = pa[i];
+        }
+      }
+      break;
+    
+    case EXPR_OP_MIX:
+      for(i = 0; i < n; i++) {
+        pd[i] = pa[i] + ((pb[i] - pa[i]) * pc[i]);
+      }
+      break;
+    
+    case EXPR_OP_HASH:
+      for(i = 0; i < n; i++) {
+        pd[i] = ((double) expr_hash(
+                  (uint32_t) expr_int(pa[i]),
+                  (uint32_t) expr_int(pb[i]),
+                  (uint32_t) expr_int(pc[i]))) / 4294967296.0;
+      }
+      break;
+    
+    case EXPR_OP_NOISE:
+      for(i = 0; i < n; i++) {
+        pd[i] = expr_noise(pa[i], pb[i], pc[i]);
+      }
+      break;
+    
+    case EXPR_OP_ARGB:
+      for(i = 0; i < n; i++) {
+        pd[i] = (double) ((expr_chan(pa[i]) << 24) |
+                          (expr_chan(pb[i]) << 16) |
+                          (expr_chan(pc[i]) << 8) |
+                          expr_chan(pe[i]));
+      }
+      break;
+    
+    default:
+      abort();
+  }
+}
+
+/*
+ * Record a compilation error at the current token.
+ * 
+ * Only the first error is kept.
+ * 
+ * Parameters:
+ * 
+ *   pc - the compiler state
+ * 
+ *   code - the EXPR_ERR_ code
+ * 
+ * Return:
+ * 
+ *   zero, so that callers can return the result as a failed status
+ */
+static int expr_fail(EXPRC *pc, int code) {
+  if (pc->err == EXPR_ERR_NONE) {
+    pc->err = code;
+    pc->epos = pc->tpos;
+  }
+  return 0;
+}
+
+/*
+ * Read the next token into the compiler state.
+ * 
+ * Parameters:
+ * 
+ *   pc - the compiler state
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int expr_next(EXPRC *pc) {
+  
+  int status = 1;
+  int len = 0;
+  int digits = 0;
+  int c = 0;
+  const char *p = NULL;
+  char buf[EXPR_MAXNUM + 1];
+  
+  /* Skip whitespace */
+  p = pc->pc;
+  while ((*p == ' ') || (*p == '\t') || (*p == '\r') || (*p == '\n')) {
+    p++;
+  }
+  pc->tpos = (int) (p - pc->pSrc) + 1;
+  pc->tval = 0.0;
+  
+  if (*p == 0) {
+    /* End of source */
+    pc->tok = EXPR_T_END;
+  
+  } else if ((p[0] == '0') && ((p[1] == 'x') || (p[1] == 'X'))) {
+    /* Hexadecimal integer */
+    pc->tok = EXPR_T_NUM;
+    for(p += 2; ; p++) {
+      if ((*p >= '0') && (*p <= '9')) {
+        c = *p - '0';
+      } else if ((*p >= 'a') && (*p <= 'f')) {
+        c = *p - 'a' + 10;
+      } else if ((*p >= 'A') && (*p <= 'F')) {
+        c = *p - 'A' + 10;
+      } else {
+        break;
+      }
+      pc->tval = (pc->tval * 16.0) + ((double) c);
+      digits++;
+    }
+    if (digits < 1) {
+      status = 0;
+    }
+  
+  } else if (((*p >= '0') && (*p <= '9')) ||
+              ((*p == '.') && (p[1] >= '0') && (p[1] <= '9'))) {
+    /* Decimal number, which is scanned here and then converted */
+    pc->tok = EXPR_T_NUM;
+    while (((p[len] >= '0') && (p[len] <= '9')) || (p[len] == '.')) {
+      if (p[len] == '.') {
+        digits++;
+      }
+      len++;
+    }
+    if ((p[len] == 'e') || (p[len] == 'E')) {
+      len++;
+      if ((p[len] == '+') || (p[len] == '-')) {
+        len++;
+      }
+      if ((p[len] < '0') || (p[len] > '9')) {
+        status = 0;
+      }
+      while ((p[len] >= '0') && (p[len] <= '9')) {
+        len++;
+      }
+    }
+    if (digits > 1) {
+      status = 0;
+    }
+    if (status && (len > EXPR_MAXNUM)) {
+      status = 0;
+    }
+    if (status) {
+      memcpy(buf, p, (size_t) len);
+      buf[len] = 0;
+      pc->tval = strtod(buf, NULL);
+    }
+    p += len;
+  
+  } else if (((*p >= 'A') && (*p <= 'Z')) ||
+              ((*p >= 'a') && (*p <= 'z')) ||
+              (*p == '_')) {
+    /* Name */
+    pc->tok = EXPR_T_NAME;
+    while (((p[len] >= 'A') && (p[len] <= 'Z')) ||
+            ((p[len] >= 'a') && (p[len] <= 'z')) ||
+            ((p[len] >= '0') && (p[len] <= '9')) ||
+            (p[len] == '_')) {
+      len++;
+    }
+    if (len > EXPR_MAXNAME) {
+      return expr_fail(pc, EXPR_ERR_LONG);
+    }
+    memcpy(pc->tname, p, (size_t) len);
+    pc->tname[len] = 0;
+    p += len;
+  
+  } else {
+    /* Operator or punctuation */
+    c = (((int) p[0]) << 8) | ((int) p[1]);
+    if (c == (('<' << 8) | '<')) {
+      pc->tok = EXPR_T_SHL;
+    } else if (c == (('>' << 8) | '>')) {
+      pc->tok = EXPR_T_SHR;
+    } else if (c == (('<' << 8) | '=')) {
+      pc->tok = EXPR_T_LE;
+    } else if (c == (('>' << 8) | '=')) {
+      pc->tok = EXPR_T_GE;
+    } else if (c == (('=' << 8) | '=')) {
+      pc->tok = EXPR_T_EQ;
+    } else if (c == (('!' << 8) | '=')) {
+      pc->tok = EXPR_T_NE;
+    } else if (c == (('&' << 8) | '&')) {
+      pc->tok = EXPR_T_LAND;
+    } else if (c == (('|' << 8) | '|')) {
+      pc->tok = EXPR_T_LOR;
+    } else {
+      pc->tok = 0;
+    }
+    
+    if (pc->tok != 0) {
+      p += 2;
+    } else if (strchr("+-*/%&|^~!<>?:(),=;", *p) != NULL) {
+      pc->tok = (int) *p;
+      p++;
+    } else {
+      status = 0;
+    }
+  }
+  
+  /* Numbers may not run straight into names */
+  if (status && (pc->tok == EXPR_T_NUM)) {
+    if (((*p >= 'A') && (*p <= 'Z')) ||
+        ((*p >= 'a') && (*p <= 'z')) ||
+        ((*p >= '0') && (*p <= '9')) ||
+        (*p == '_') || (*p == '.')) {
+      status = 0;
+    }
+  }
+  
+  if (!status) {
+    return expr_fail(pc, EXPR_ERR_SYNTAX);
+  }
+  
+  pc->pc = p;
+  return status;
+}
+
+/*
+ * Get the first character after the current token that is not
+ * whitespace.
+ * 
+ * Parameters:
+ * 
+ *   pc - the compiler state
+ * 
+ * Return:
+ * 
+ *   the character, or zero at the end of the source
+ */
+static int expr_peek(const EXPRC *pc) {
+  
+  const char *p = NULL;
+  
+  p = pc->pc;
+  while ((*p == ' ') || (*p == '\t') || (*p == '\r') || (*p == '\n')) {
+    p++;
+  }
+  
+  return (int) *p;
+}
+
+/*
+ * Check whether the current token starts a variable definition.
+ * 
+ * This is the case if it is a name followed by = but not by ==.
+ * 
+ * Parameters:
+ * 
+ *   pc - the compiler state
+ * 
+ * Return:
+ * 
+ *   non-zero if a definition follows, zero otherwise
+ */
+static int expr_isassign(const EXPRC *pc) {
+  
+  const char *p = NULL;
+  
+  if ((pc->tok != EXPR_T_NAME) || (expr_peek(pc) != '=')) {
+    return 0;
+  }
+  
+  p = strchr(pc->pc, '=');
+  return (p[1] != '=') ? 1 : 0;
+}
+
+/*
+ * Get the source operand encoding of an operand.
+ * 
+ * Constants are added to the constant table if they are not already
+ * there, and encoded as negative numbers.
+ * 
+ * Parameters:
+ * 
+ *   pc - the compiler state
+ * 
+ *   po - the operand
+ * 
+ * Return:
+ * 
+ *   the encoded operand, or zero if the constant table is full, in
+ *   which case an error has been recorded
+ */
+static int expr_src(EXPRC *pc, const EXPROPD *po) {
+  
+  int i = 0;
+  EXPR *pe = pc->pe;
+  
+  if (!(po->konst)) {
+    return po->reg;
+  }
+  
+  for(i = 0; i < pe->nconst; i++) {
+    if (memcmp(&(pe->konst[i]), &(po->v), sizeof(double)) == 0) {
+      return -(i + 1);
+    }
+  }
+  
+  if (pe->nconst >= EXPR_MAXREG) {
+    return expr_fail(pc, EXPR_ERR_LONG);
+  }
+  
+  pe->konst[pe->nconst] = po->v;
+  pe->nconst++;
+  return -(pe->nconst);
+}
+
+/*
+ * Apply an operation to operands.
+ * 
+ * If all the operands are constants, the operation is done now and the
+ * result is a constant.  Otherwise, temporary operands are released, an
+ * instruction is emitted, and the result is a new temporary.
+ * 
+ * Parameters:
+ * 
+ *   pc - the compiler state
+ * 
+ *   op - the EXPR_OP_ opcode
+ * 
+ *   pArg - the operands
+ * 
+ *   argc - the number of operands
+ * 
+ *   pr - receives the result
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int expr_op(EXPRC *pc, int op, EXPROPD *pArg, int argc,
+                    EXPROPD *pr) {
+  
+  int i = 0;
+  int all = 1;
+  EXPRINS ins;
+  double r[EXPR_MAXARG + 1][EXPR_LANES];
+  
+  memset(&ins, 0, sizeof(EXPRINS));
+  ins.op = (int16_t) op;
+  
+  for(i = 0; i < argc; i++) {
+    if (!(pArg[i].konst)) {
+      all = 0;
+    }
+  }
+  
+  /* Fold constants by running the instruction on a single lane */
+  if (all) {
+    for(i = 0; i < argc; i++) {
+      r[i + 1][0] = pArg[i].v;
+      ins.s[i] = (int16_t) (i + 1);
+    }
+    expr_step(&ins, r, 1);
+    
+    memset(pr, 0, sizeof(EXPROPD));
+    pr->konst = 1;
+    pr->v = r[0][0];
+    return 1;
+  }
+  
+  /* Encode the operands */
+  for(i = 0; i < argc; i++) {
+    ins.s[i] = (int16_t) expr_src(pc, &(pArg[i]));
+  }
+  if (pc->err != EXPR_ERR_NONE) {
+    return 0;
+  }
+  
+  /* Release temporaries in reverse order */
+  for(i = argc - 1; i >= 0; i--) {
+    if (pArg[i].temp) {
+      if (pArg[i].reg != pc->top - 1) {
+        abort();
+      }
+      pc->top--;
+    }
+  }
+  
+  /* Allocate the result register */
+  if (pc->top >= EXPR_MAXREG) {
+    return expr_fail(pc, EXPR_ERR_LONG);
+  }
+  ins.d = (int16_t) pc->top;
+  pc->top++;
+  if (pc->top > pc->maxreg) {
+    pc->maxreg = pc->top;
+  }
+  
+  /* Emit the instruction */
+  if (pc->pe->ncode >= EXPR_MAXCODE) {
+    return expr_fail(pc, EXPR_ERR_LONG);
+  }
+  pc->pe->code[pc->pe->ncode] = ins;
+  pc->pe->ncode++;
+  
+  memset(pr, 0, sizeof(EXPROPD));
+  pr->reg = ins.d;
+  pr->temp = 1;
+  return 1;
+}
+
+/*
+ * Get the precedence and opcode of a binary operator token.
+ * 
+ * Parameters:
+ * 
+ *   tok - the token
+ * 
+ *   pop - receives the EXPR_OP_ opcode
+ * 
+ * Return:
+ * 
+ *   the precedence, where higher binds more tightly, or zero if the
+ *   token is not a binary operator
+ */
+static int expr_binop(int tok, int *pop) {
+  
+  int i = 0;
+  
+  for(i = 0; i < EXPR_BINCOUNT; i++) {
+    if (m_bin[i].tok == tok) {
+      *pop = m_bin[i].op;
+      return m_bin[i].prec;
+    }
+  }
+  
+  return 0;
+}
+
+/*
+ * Compile a primary expression, which is a number, a variable, a
+ * function call, or an expression in parentheses.
+ * 
+ * Parameters:
+ * 
+ *   pc - the compiler state
+ * 
+ *   pr - receives the result
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int expr_primary(EXPRC *pc, EXPROPD *pr) {
+  
+  int status = 1;
+  int i = 0;
+  int fn = 0;
+  int argc = 0;
+  int pos = 0;
+  EXPROPD arg[EXPR_MAXARG];
+  
+  memset(pr, 0, sizeof(EXPROPD));
+  memset(arg, 0, sizeof(arg));
+  
+  if (pc->tok == EXPR_T_NUM) {
+    /* Number */
+    pr->konst = 1;
+    pr->v = pc->tval;
+    status = expr_next(pc);
+  
+  } else if (pc->tok == '(') {
+    /* Parenthesized expression */
+    status = expr_next(pc);
+    if (status) {
+      status = expr_expr(pc, pr);
+    }
+    if (status && (pc->tok != ')')) {
+      status = expr_fail(pc, EXPR_ERR_SYNTAX);
+    }
+    if (status) {
+      status = expr_next(pc);
+    }
+  
+  } else if ((pc->tok == EXPR_T_NAME) && (expr_peek(pc) == '(')) {
+    /* Function call */
+    pos = pc->tpos;
+    for(fn = 0; fn < EXPR_FNCOUNT; fn++) {
+      if (strcmp(m_fn[fn].pName, pc->tname) == 0) {
+        break;
+      }
+    }
+    if (fn >= EXPR_FNCOUNT) {
+      status = expr_fail(pc, EXPR_ERR_FUNC);
+    }
+    
+    if (status) {
+      status = expr_next(pc);
+    }
+    if (status) {
+      status = expr_next(pc);
+    }
+    
+    while (status && (pc->tok != ')')) {
+      if (argc > 0) {
+        if (pc->tok != ',') {
+          status = expr_fail(pc, EXPR_ERR_SYNTAX);
+        } else {
+          status = expr_next(pc);
+        }
+      }
+      if (status && (argc >= m_fn[fn].argc)) {
+        status = expr_fail(pc, EXPR_ERR_ARGS);
+      }
+      if (status) {
+        status = expr_expr(pc, &(arg[argc]));
+      }
+      if (status) {
+        argc++;
+      }
+    }
+    
+    if (status && (argc != m_fn[fn].argc)) {
+      pc->tpos = pos;
+      status = expr_fail(pc, EXPR_ERR_ARGS);
+    }
+    if (status) {
+      status = expr_next(pc);
+    }
+    if (status) {
+      status = expr_op(pc, m_fn[fn].op, arg, argc, pr);
+    }
+  
+  } else if (pc->tok == EXPR_T_NAME) {
+    /* Variable */
+    for(i = 0; i < pc->nvar; i++) {
+      if (strcmp(pc->vname[i], pc->tname) == 0) {
+        break;
+      }
+    }
+    
+    if (i < pc->nvar) {
+      *pr = pc->var[i];
+      pr->temp = 0;
+    } else if (strcmp(pc->tname, "x") == 0) {
+      pr->reg = EXPR_REG_X;
+    } else if (strcmp(pc->tname, "y") == 0) {
+      pr->reg = EXPR_REG_Y;
+    } else if (strcmp(pc->tname, "w") == 0) {
+      pr->reg = EXPR_REG_W;
+    } else if (strcmp(pc->tname, "h") == 0) {
+      pr->reg = EXPR_REG_H;
+    } else if (strcmp(pc->tname, "pi") == 0) {
+      pr->konst = 1;
+      pr->v = EXPR_PI;
+    } else {
+      status = expr_fail(pc, EXPR_ERR_NAME);
+    }
+    
+    if (status) {
+      status = expr_next(pc);
+    }
+  
+  } else {
+    status = expr_fail(pc, EXPR_ERR_SYNTAX);
+  }
+  
+  return status;
+}
+
+/*
+ * Compile a unary expression.
+ * 
+ * Parameters:
+ * 
+ *   pc - the compiler state
+ * 
+ *   pr - receives the result
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int expr_unary(EXPRC *pc, EXPROPD *pr) {
+  
+  int status = 1;
+  int op = -1;
+  EXPROPD a;
+  
+  memset(&a, 0, sizeof(EXPROPD));
+  
+  if (pc->tok == '-') {
+    op = EXPR_OP_NEG;
+  } else if (pc->tok == '!') {
+    op = EXPR_OP_NOT;
+  } else if (pc->tok == '~') {
+    op = EXPR_OP_BNOT;
+  } else if (pc->tok != '+') {
+    return expr_primary(pc, pr);
+  }
+  
+  status = expr_next(pc);
+  if (status) {
+    status = expr_unary(pc, &a);
+  }
+  
+  if (status) {
+    if (op < 0) {
+      *pr = a;
+    } else {
+      status = expr_op(pc, op, &a, 1, pr);
+    }
+  }
+  
+  return status;
+}
+
+/*
+ * Compile a sequence of binary operators that bind at least as tightly
+ * as a given precedence.
+ * 
+ * Operators of equal precedence associate to the left.
+ * 
+ * Parameters:
+ * 
+ *   pc - the compiler state
+ * 
+ *   minprec - the lowest precedence to handle
+ * 
+ *   pr - receives the result
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int expr_binary(EXPRC *pc, int minprec, EXPROPD *pr) {
+  
+  int status = 1;
+  int prec = 0;
+  int op = 0;
+  EXPROPD arg[2];
+  
+  memset(arg, 0, sizeof(arg));
+  
+  status = expr_unary(pc, &(arg[0]));
+  
+  while (status) {
+    prec = expr_binop(pc->tok, &op);
+    if ((prec < 1) || (prec < minprec)) {
+      break;
+    }
+    
+    status = expr_next(pc);
+    if (status) {
+      status = expr_binary(pc, prec + 1, &(arg[1]));
+    }
+    if (status) {
+      status = expr_op(pc, op, arg, 2, &(arg[0]));
+    }
+  }
+  
+  if (status) {
+    *pr = arg[0];
+  }
+  
+  return status;
+}
+
+/*
+ * Compile an expression, including the conditional operator.
+ * 
+ * Parameters:
+ * 
+ *   pc - the compiler state
+ * 
+ *   pr - receives the result
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int expr_expr(EXPRC *pc, EXPROPD *pr) {
+  
+  int status = 1;
+  EXPROPD arg[3];
+  
+  memset(arg, 0, sizeof(arg));
+  
+  /* Limit recursion */
+  if (pc->depth >= EXPR_MAXDEPTH) {
+    return expr_fail(pc, EXPR_ERR_LONG);
+  }
+  pc->depth++;
+  
+  status = expr_binary(pc, 1, &(arg[0]));
+  
+  if (status && (pc->tok == '?')) {
+    status = expr_next(pc);
+    if (status) {
+      status = expr_expr(pc, &(arg[1]));
+    }
+    if (status && (pc->tok != ':')) {
+      status = expr_fail(pc, EXPR_ERR_SYNTAX);
+    }
+    if (status) {
+      status = expr_next(pc);
+    }
+    if (status) {
+      status = expr_expr(pc, &(arg[2]));
+    }
+    if (status) {
+      status = expr_op(pc, EXPR_OP_SEL, arg, 3, &(arg[0]));
+    }
+  }
+  
+  if (status) {
+    *pr = arg[0];
+  }
+  
+  pc->depth--;
+  return status;
+}
+
+/*
+ * Compile a variable definition.
+ * 
+ * The current token must be the name of the variable, as checked by
+ * expr_isassign().  The value of the variable keeps the register it
+ * was computed in, so temporaries must not be in use.
+ * 
+ * Parameters:
+ * 
+ *   pc - the compiler state
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int expr_define(EXPRC *pc) {
+  
+  int status = 1;
+  int i = 0;
+  EXPROPD v;
+  
+  memset(&v, 0, sizeof(EXPROPD));
+  
+  /* Check the name */
+  for(i = 0; i < pc->nvar; i++) {
+    if (strcmp(pc->vname[i], pc->tname) == 0) {
+      status = expr_fail(pc, EXPR_ERR_REDEF);
+      break;
+    }
+  }
+  if (status && ((strcmp(pc->tname, "x") == 0) ||
+                  (strcmp(pc->tname, "y") == 0) ||
+                  (strcmp(pc->tname, "w") == 0) ||
+                  (strcmp(pc->tname, "h") == 0) ||
+                  (strcmp(pc->tname, "pi") == 0))) {
+    status = expr_fail(pc, EXPR_ERR_REDEF);
+  }
+  if (status && (pc->nvar >= EXPR_MAXVAR)) {
+    status = expr_fail(pc, EXPR_ERR_LONG);
+  }
+  if (status) {
+    strcpy(pc->vname[pc->nvar], pc->tname);
+  }
+  
+  /* Skip the name and the = sign, then compile the value */
+  if (status) {
+    status = expr_next(pc);
+  }
+  if (status) {
+    status = expr_next(pc);
+  }
+  if (status) {
+    status = expr_expr(pc, &v);
+  }
+  if (status && (pc->tok != ';')) {
+    status = expr_fail(pc, EXPR_ERR_SYNTAX);
+  }
+  if (status) {
+    status = expr_next(pc);
+  }
+  
+  /* The register of a temporary value now belongs to the variable */
+  if (status) {
+    v.temp = 0;
+    pc->var[pc->nvar] = v;
+    pc->nvar++;
+  }
+  
+  return status;
+}
+
+/*
+ * Compile a whole expression shader.
+ * 
+ * The compiler state must be initialized with the source and an empty
+ * expression.  The registers of the expression are relocated so that
+ * the constants follow all the other registers.
+ * 
+ * Parameters:
+ * 
+ *   pc - the compiler state
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int expr_compile(EXPRC *pc) {
+  
+  int status = 1;
+  int i = 0;
+  int j = 0;
+  EXPR *pe = pc->pe;
+  EXPROPD v;
+  
+  memset(&v, 0, sizeof(EXPROPD));
+  
+  /* Read the first token */
+  status = expr_next(pc);
+  
+  /* Compile the variable definitions */
+  while (status && expr_isassign(pc)) {
+    status = expr_define(pc);
+  }
+  
+  /* Compile the final expression, with an optional semicolon */
+  if (status) {
+    status = expr_expr(pc, &v);
+  }
+  if (status && (pc->tok == ';')) {
+    status = expr_next(pc);
+  }
+  if (status && (pc->tok != EXPR_T_END)) {
+    status = expr_fail(pc, EXPR_ERR_SYNTAX);
+  }
+  
+  /* Get the register of the result */
+  if (status) {
+    pe->result = expr_src(pc, &v);
+    if (pc->err != EXPR_ERR_NONE) {
+      status = 0;
+    }
+  }
+  
+  /* Relocate the constants after the other registers */
+  if (status) {
+    pe->nreg = pc->maxreg;
+    if (pe->nreg + pe->nconst > EXPR_MAXREG) {
+      pc->tpos = 0;
+      status = expr_fail(pc, EXPR_ERR_LONG);
+    }
+  }
+  
+  if (status) {
+    for(i = 0; i < pe->ncode; i++) {
+      for(j = 0; j < EXPR_MAXARG; j++) {
+        if (pe->code[i].s[j] < 0) {
+          pe->code[i].s[j] = (int16_t)
+                              (pe->nreg - pe->code[i].s[j] - 1);
+        }
+      }
+    }
+    if (pe->result < 0) {
+      pe->result = pe->nreg - pe->result - 1;
+    }
+  }
+  
+  return status;
+}
+
+/*
+ * Public function implementations
+ * ===============================
+ * 
+ * See the header for specifications.
+ */
+
+/*
+ * expr_errorString function.
+ */
+const char *expr_errorString(int code) {
+  
+  const char *pResult = NULL;
+  
+  switch (code) {
+    case EXPR_ERR_NONE:
+      pResult = "No error";
+      break;
+    
+    case EXPR_ERR_SYNTAX:
+      pResult = "Syntax error";
+      break;
+    
+    case EXPR_ERR_NAME:
+      pResult = "Unknown variable";
+      break;
+    
+    case EXPR_ERR_FUNC:
+      pResult = "Unknown function";
+      break;
+    
+    case EXPR_ERR_ARGS:
+      pResult = "Wrong number of function arguments";
+      break;
+    
+    case EXPR_ERR_REDEF:
+      pResult = "Variable defined more than once";
+      break;
+    
+    case EXPR_ERR_LONG:
+      pResult = "Expression is too complex";
+      break;
+    
+    case EXPR_ERR_FULL:
+      pResult = "Too many expression shaders";
+      break;
+    
+    default:
+      pResult = "Unknown error";
+  }
+  
+  return pResult;
+}
+
+/*
+ * expr_add function.
+ */
+int expr_add(const char *pSrc, int *perr, int *ppos) {
+  
+  int status = 1;
+  EXPRC *pc = NULL;
+  EXPR *pe = NULL;
+  
+  /* Check parameters */
+  if ((pSrc == NULL) || (perr == NULL) || (ppos == NULL)) {
+    abort();
+  }
+  
+  /* Reset error indicators */
+  *perr = EXPR_ERR_NONE;
+  *ppos = 0;
+  
+  /* Make sure there is room */
+  if (m_expr_count >= EXPR_MAXCOUNT) {
+    status = 0;
+    *perr = EXPR_ERR_FULL;
+  }
+  
+  /* Allocate the expression and the compiler state */
+  if (status) {
+    pe = (EXPR *) calloc(1, sizeof(EXPR));
+    pc = (EXPRC *) calloc(1, sizeof(EXPRC));
+    if ((pe == NULL) || (pc == NULL)) {
+      abort();
+    }
+    
+    pc->pSrc = pSrc;
+    pc->pc = pSrc;
+    pc->pe = pe;
+    pc->top = EXPR_REG_FIRST;
+    pc->maxreg = EXPR_REG_FIRST;
+    pc->err = EXPR_ERR_NONE;
+  }
+  
+  /* Compile */
+  if (status) {
+    if (!expr_compile(pc)) {
+      status = 0;
+      *perr = pc->err;
+      *ppos = pc->epos;
+    }
+  }
+  
+  /* Add the expression */
+  if (status) {
+    m_expr[m_expr_count] = pe;
+    m_expr_count++;
+    pe = NULL;
+  }
+  
+  /* Free the compiler state and the expression if it was not added */
+  free(pc);
+  pc = NULL;
+  
+  free(pe);
+  pe = NULL;
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * expr_count function.
+ */
+int expr_count(void) {
+  return m_expr_count;
+}
+
+/*
+ * expr_span function.
+ */
+void expr_span(
+    int        eidx,
+    int32_t    x,
+    int32_t    y,
+    int32_t    count,
+    int32_t    width,
+    int32_t    height,
+    uint32_t * pOut) {
+  
+  int i = 0;
+  int n = 0;
+  int32_t base = 0;
+  const EXPR *pe = NULL;
+  const EXPRINS *pi = NULL;
+  const EXPRINS *pend = NULL;
+  const double *pv = NULL;
+  double r[EXPR_MAXREG][EXPR_LANES];
+  
+  /* Check parameters */
+  if ((eidx < 1) || (eidx > m_expr_count) || (pOut == NULL)) {
+    abort();
+  }
+  if ((width < 1) || (height < 1) || (count < 0)) {
+    abort();
+  }
+  if ((x < 0) || (y < 0) || (y >= height) || (x > width - count)) {
+    abort();
+  }
+  pe = m_expr[eidx - 1];
+  pend = &(pe->code[pe->ncode]);
+  
+  /* Fill in the registers that are the same for the whole span */
+  for(i = 0; i < EXPR_LANES; i++) {
+    r[EXPR_REG_Y][i] = (double) y;
+    r[EXPR_REG_W][i] = (double) width;
+    r[EXPR_REG_H][i] = (double) height;
+  }
+  for(n = 0; n < pe->nconst; n++) {
+    for(i = 0; i < EXPR_LANES; i++) {
+      r[pe->nreg + n][i] = pe->konst[n];
+    }
+  }
+  
+  /* Run the program across each batch of pixels */
+  for(base = 0; base < count; base += EXPR_LANES) {
+    n = (int) (count - base);
+    if (n > EXPR_LANES) {
+      n = EXPR_LANES;
+    }
+    
+    for(i = 0; i < n; i++) {
+      r[EXPR_REG_X][i] = (double) (x + base + i);
+    }
+    
+    for(pi = pe->code; pi < pend; pi++) {
+      expr_step(pi, r, n);
+    }
+    
+    pv = r[pe->result];
+    for(i = 0; i < n; i++) {
+      pOut[base + i] = (uint32_t) expr_int(pv[i]);
+    }
+  }
+}
+
+/*
+ * expr_pixel function.
+ */
+uint32_t expr_pixel(
+    int     eidx,
+    int32_t x,
+    int32_t y,
+    int32_t width,
+    int32_t height) {
+  
+  uint32_t result = 0;
+  
+  expr_span(eidx, x, y, 1, width, height, &result);
+  return result;
+}
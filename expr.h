@@ -0,0 +1,236 @@
+#ifndef EXPR_H_INCLUDED
+#define EXPR_H_INCLUDED
+
+/*
+ * expr.h
+ * 
+ * Expression shader module of Lilac.
+ * 
+ * This module compiles procedural textures written as small arithmetic
+ * expressions into a register bytecode, which is run by an interpreter
+ * in C.  This avoids the overhead of calling into Lua for the simple
+ * shaders that only compute a value from the coordinates.
+ * 
+ * An expression shader is a sequence of zero or more variable
+ * definitions of the form:
+ * 
+ *   name = expression;
+ * 
+ * followed by a final expression, which may optionally be followed by
+ * a semicolon.  The value of the final expression is the packed ARGB
+ * pixel, with premultiplied alpha, the same as returned by Lua
+ * shaders.
+ * 
+ * All values are double-precision floating point.  The predefined
+ * variables are x and y, the coordinates of the pixel, w and h, the
+ * dimensions of the output image, and the constant pi.  Numbers may be
+ * decimal, with optional fraction and exponent, or hexadecimal
+ * integers with a 0x prefix.
+ * 
+ * The operators are the same as in C, with the same precedence:
+ * 
+ *   ?:  ||  &&  |  ^  &  ==  !=  <  <=  >  >=  <<  >>  +  -  *  /  %
+ * 
+ * and the unary operators - + ! ~
+ * 
+ * Comparisons and logical operators give one for true and zero for
+ * false, and any non-zero value counts as true.  Both sides of && ||
+ * and ?: are always evaluated, since expressions have no side effects.
+ * / and % give zero when dividing by zero, and % takes the sign of the
+ * divisor, as in Lua.  The bitwise operators first round their operands
+ * down to 64-bit integers, and >> is a logical shift.  Shift counts
+ * outside of range 0 to 63 give zero.
+ * 
+ * The functions are:
+ * 
+ *   abs(v) floor(v) ceil(v) sqrt(v) sin(v) cos(v)
+ *   atan2(y, x) pow(a, b) min(a, b) max(a, b)
+ *   clamp(v, lo, hi) - v limited to range lo to hi
+ *   mix(a, b, t) - linear interpolation a + (b - a) * t
+ *   hash(x, y, seed) - random value in range [0.0, 1.0) for each
+ *                      integer lattice point
+ *   noise(x, y, seed) - smooth value noise in range [0.0, 1.0) with
+ *                       one lattice cell per unit
+ *   argb(a, r, g, b) - packs four channels, each rounded down and
+ *                      clamped to range 0 to 255, into a pixel
+ * 
+ * The final value is rounded down and its lowest 32 bits are the
+ * pixel.  Values that are not finite become zero.
+ * 
+ * Subexpressions with constant operands are folded when the shader is
+ * compiled.  The interpreter evaluates each instruction across a whole
+ * batch of pixels in a span before moving on to the next instruction,
+ * so the cost of decoding instructions is shared by the batch.
+ * 
+ * Compiled shaders are read-only, so expr_span() and expr_pixel() may
+ * be called from any number of threads at once.  Expression shaders
+ * never depend on the order they are queried in.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Error codes.
+ * 
+ * Don't forget to update expr_errorString()!
+ */
+#define EXPR_ERR_NONE   (0)   /* No error */
+#define EXPR_ERR_SYNTAX (1)   /* Syntax error */
+#define EXPR_ERR_NAME   (2)   /* Unknown variable */
+#define EXPR_ERR_FUNC   (3)   /* Unknown function */
+#define EXPR_ERR_ARGS   (4)   /* Wrong number of function arguments */
+#define EXPR_ERR_REDEF  (5)   /* Variable defined more than once */
+#define EXPR_ERR_LONG   (6)   /* Expression is too complex */
+#define EXPR_ERR_FULL   (7)   /* Too many expression shaders */
+
+/*
+ * The maximum number of expression shaders that can be added.
+ */
+#define EXPR_MAXCOUNT (1024)
+
+/*
+ * The maximum number of registers of a compiled expression, including
+ * the predefined variables, temporaries, and constants.
+ */
+#define EXPR_MAXREG (128)
+
+/*
+ * The maximum number of instructions of a compiled expression.
+ */
+#define EXPR_MAXCODE (1024)
+
+/*
+ * The maximum number of variables that an expression may define.
+ */
+#define EXPR_MAXVAR (32)
+
+/*
+ * The maximum length in characters of a variable name.
+ */
+#define EXPR_MAXNAME (31)
+
+/*
+ * Given an expression shader error code, return an error message.
+ * 
+ * The error message begins with a capital letter but does not have any
+ * punctuation or line break at the end.
+ * 
+ * If zero is passed, "No error" is returned.  If an unknown error code
+ * is passed, "Unknown error" is returned.
+ * 
+ * Parameters:
+ * 
+ *   code - the error code to look up
+ * 
+ * Return:
+ * 
+ *   an error message for the code
+ */
+const char *expr_errorString(int code);
+
+/*
+ * Compile and add an expression shader.
+ * 
+ * pSrc is the source text of the shader, in the syntax described at
+ * the top of this header.
+ * 
+ * perr points to a variable to receive an error code, which is one of
+ * the constants EXPR_ERR_.  EXPR_ERR_NONE is written if successful.
+ * ppos points to a variable to receive the one-indexed character
+ * position in pSrc where the error was found, or zero if there is no
+ * position for the error.
+ * 
+ * Shaders are numbered starting at one, in the order they are added.
+ * The number of the new shader is the same as expr_count() after the
+ * call.
+ * 
+ * Parameters:
+ * 
+ *   pSrc - the source text
+ * 
+ *   perr - pointer to a variable to receive an error code
+ * 
+ *   ppos - pointer to a variable to receive the error position
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+int expr_add(const char *pSrc, int *perr, int *ppos);
+
+/*
+ * Return the number of expression shaders that have been added.
+ * 
+ * Return:
+ * 
+ *   the number of expression shaders
+ */
+int expr_count(void);
+
+/*
+ * Evaluate a span of pixels of an expression shader.
+ * 
+ * eidx is the one-indexed shader number.  It must be in range one up
+ * to and including expr_count().
+ * 
+ * The pixels from (x, y) up to but excluding (x + count, y) are
+ * written to pOut, which must have room for count pixels.  width and
+ * height are the dimensions of the output image, which must be greater
+ * than zero, and the whole span must be within the image.  count may
+ * be zero, in which case nothing is written.
+ * 
+ * Parameters:
+ * 
+ *   eidx - the shader
+ * 
+ *   x - the X coordinate of the first pixel
+ * 
+ *   y - the Y coordinate of the span
+ * 
+ *   count - the number of pixels
+ * 
+ *   width - the width of the output image
+ * 
+ *   height - the height of the output image
+ * 
+ *   pOut - receives the ARGB pixels
+ */
+void expr_span(
+    int        eidx,
+    int32_t    x,
+    int32_t    y,
+    int32_t    count,
+    int32_t    width,
+    int32_t    height,
+    uint32_t * pOut);
+
+/*
+ * Get a single pixel of an expression shader.
+ * 
+ * This is the same as expr_span() with a count of one.
+ * 
+ * Parameters:
+ * 
+ *   eidx - the shader
+ * 
+ *   x - the X coordinate
+ * 
+ *   y - the Y coordinate
+ * 
+ *   width - the width of the output image
+ * 
+ *   height - the height of the output image
+ * 
+ * Return:
+ * 
+ *   the ARGB value of the shader at the given coordinate
+ */
+uint32_t expr_pixel(
+    int     eidx,
+    int32_t x,
+    int32_t y,
+    int32_t width,
+    int32_t height);
+
+#endif
@@ -0,0 +1,441 @@
+/*
+ * jobproto.c
+ * 
+ * Implementation of jobproto.h
+ * 
+ * See the header for further information.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "jobproto.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <poll.h>
+#include <unistd.h>
+
+/*
+ * Local functions
+ * ===============
+ */
+
+/* Function prototypes */
+static int64_t clockMillis(void);
+static int deadlineOf(int32_t timeout, int64_t *pDeadline);
+static int waitFd(int fd, short events, int64_t deadline);
+static int readFull(
+    int             fd,
+    unsigned char * pBuf,
+    size_t          len,
+    int64_t         deadline);
+static int writeFull(
+          int             fd,
+    const unsigned char * pBuf,
+          size_t          len,
+          int64_t         deadline);
+
+/*
+ * Read the monotonic clock in milliseconds.
+ * 
+ * Return:
+ * 
+ *   the current time in milliseconds relative to an arbitrary epoch,
+ *   or zero if the clock could not be read
+ */
+static int64_t clockMillis(void) {
+  
+  int64_t result = 0;
+  struct timespec ts;
+  
+  /* Initialize structures */
+  memset(&ts, 0, sizeof(struct timespec));
+  
+  /* Read the clock */
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+    result = (((int64_t) ts.tv_sec) * 1000) +
+                (((int64_t) ts.tv_nsec) / 1000000);
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * Convert a timeout into a deadline.
+ * 
+ * Parameters:
+ * 
+ *   timeout - the number of milliseconds from now, or negative for no
+ *   limit
+ * 
+ *   pDeadline - receives the deadline on the clock of clockMillis(),
+ *   or -1 if there is no limit
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the clock could not be read
+ */
+static int deadlineOf(int32_t timeout, int64_t *pDeadline) {
+  
+  int64_t now = 0;
+  
+  /* Check parameters */
+  if (pDeadline == NULL) {
+    abort();
+  }
+  
+  /* No limit */
+  if (timeout < 0) {
+    *pDeadline = -1;
+    return 1;
+  }
+  
+  /* Limit relative to the current time */
+  now = clockMillis();
+  if (now <= 0) {
+    return 0;
+  }
+  *pDeadline = now + timeout;
+  return 1;
+}
+
+/*
+ * Wait until a file descriptor is ready or a deadline passes.
+ * 
+ * Interrupted waits are restarted with the time that remains.
+ * 
+ * Parameters:
+ * 
+ *   fd - the file descriptor
+ * 
+ *   events - POLLIN to wait for input or POLLOUT to wait for room for
+ *   output
+ * 
+ *   deadline - the deadline on the clock of clockMillis(), or negative
+ *   for no limit
+ * 
+ * Return:
+ * 
+ *   non-zero if the file descriptor is ready, zero if the deadline
+ *   passed or there was an error
+ */
+static int waitFd(int fd, short events, int64_t deadline) {
+  
+  int result = -1;
+  int rc = 0;
+  int ms = -1;
+  int64_t left = 0;
+  struct pollfd pfd;
+  
+  /* Initialize structures */
+  memset(&pfd, 0, sizeof(struct pollfd));
+  
+  /* Poll until ready, out of time, or failed */
+  while (result < 0) {
+    if (deadline >= 0) {
+      left = deadline - clockMillis();
+      if (left <= 0) {
+        result = 0;
+        break;
+      }
+      ms = (left > 60000) ? 60000 : ((int) left);
+    }
+    
+    pfd.fd = fd;
+    pfd.events = events;
+    pfd.revents = 0;
+    
+    rc = poll(&pfd, 1, ms);
+    if (rc > 0) {
+      result = 1;
+    } else if ((rc < 0) && (errno != EINTR)) {
+      result = 0;
+    }
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * Read exactly len bytes from a file descriptor.
+ * 
+ * Interrupted reads are restarted.  Reaching end of file before all
+ * the bytes have been read is an error.  If the file descriptor is
+ * non-blocking, reads that would block wait for more input.
+ * 
+ * If there is a deadline, each read first waits for input until the
+ * deadline, so that all the bytes must arrive before it.
+ * 
+ * Parameters:
+ * 
+ *   fd - the file descriptor to read from
+ * 
+ *   pBuf - the buffer to receive the bytes
+ * 
+ *   len - the number of bytes to read
+ * 
+ *   deadline - the deadline on the clock of clockMillis(), or negative
+ *   for no limit
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int readFull(
+    int             fd,
+    unsigned char * pBuf,
+    size_t          len,
+    int64_t         deadline) {
+  
+  int status = 1;
+  ssize_t rc = 0;
+  
+  /* Check parameters */
+  if ((pBuf == NULL) && (len > 0)) {
+    abort();
+  }
+  
+  /* Read until all bytes have been received */
+  while (status && (len > 0)) {
+    if (deadline >= 0) {
+      if (!waitFd(fd, POLLIN, deadline)) {
+        /* Out of time */
+        status = 0;
+        break;
+      }
+    }
+    
+    rc = read(fd, pBuf, len);
+    if (rc > 0) {
+      pBuf += rc;
+      len -= (size_t) rc;
+    
+    } else if ((rc < 0) && (errno == EINTR)) {
+      /* Interrupted, so try again */
+      continue;
+    
+    } else if ((rc < 0) &&
+                ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+      /* Nothing to read yet, so wait for input */
+      if (!waitFd(fd, POLLIN, deadline)) {
+        status = 0;
+      }
+    
+    } else {
+      /* End of file or I/O error */
+      status = 0;
+    }
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Write exactly len bytes to a file descriptor.
+ * 
+ * Interrupted writes are restarted.  If the file descriptor is
+ * non-blocking, writes that would block wait for room for output.
+ * 
+ * If there is a deadline, each write first waits for room for output
+ * until the deadline.  The file descriptor should then be non-blocking,
+ * or else a single write may block past the deadline.
+ * 
+ * Parameters:
+ * 
+ *   fd - the file descriptor to write to
+ * 
+ *   pBuf - the bytes to write
+ * 
+ *   len - the number of bytes to write
+ * 
+ *   deadline - the deadline on the clock of clockMillis(), or negative
+ *   for no limit
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int writeFull(
+          int             fd,
+    const unsigned char * pBuf,
+          size_t          len,
+          int64_t         deadline) {
+  
+  int status = 1;
+  ssize_t rc = 0;
+  
+  /* Check parameters */
+  if ((pBuf == NULL) && (len > 0)) {
+    abort();
+  }
+  
+  /* Write until all bytes have been sent */
+  while (status && (len > 0)) {
+    if (deadline >= 0) {
+      if (!waitFd(fd, POLLOUT, deadline)) {
+        /* Out of time */
+        status = 0;
+        break;
+      }
+    }
+    
+    rc = write(fd, pBuf, len);
+    if (rc > 0) {
+      pBuf += rc;
+      len -= (size_t) rc;
+    
+    } else if ((rc < 0) && (errno == EINTR)) {
+      /* Interrupted, so try again */
+      continue;
+    
+    } else if ((rc < 0) &&
+                ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+      /* No room for output yet, so wait for it */
+      if (!waitFd(fd, POLLOUT, deadline)) {
+        status = 0;
+      }
+    
+    } else {
+      /* I/O error */
+      status = 0;
+    }
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Public function implementations
+ * ===============================
+ * 
+ * See the header for specifications.
+ */
+
+/*
+ * jobproto_read function.
+ */
+int jobproto_read(int fd, unsigned char *pBuf, size_t bufsize,
+                  size_t *pLen) {
+  return jobproto_read_timed(fd, pBuf, bufsize, pLen, -1);
+}
+
+/*
+ * jobproto_read_timed function.
+ */
+int jobproto_read_timed(
+    int             fd,
+    unsigned char * pBuf,
+    size_t          bufsize,
+    size_t        * pLen,
+    int32_t         timeout) {
+  
+  int status = 1;
+  int64_t deadline = -1;
+  unsigned char hdr[4];
+  uint32_t len = 0;
+  
+  /* Check parameters */
+  if ((pBuf == NULL) || (pLen == NULL) ||
+      (bufsize < 1) || (bufsize > JOBPROTO_MAXFRAME + 1)) {
+    abort();
+  }
+  
+  /* The whole frame must arrive within the timeout */
+  if (!deadlineOf(timeout, &deadline)) {
+    status = 0;
+  }
+  
+  /* Read the big-endian length */
+  if (status) {
+    if (!readFull(fd, hdr, 4, deadline)) {
+      status = 0;
+    }
+  }
+  
+  if (status) {
+    len = (((uint32_t) hdr[0]) << 24) |
+          (((uint32_t) hdr[1]) << 16) |
+          (((uint32_t) hdr[2]) <<  8) |
+           ((uint32_t) hdr[3]);
+    
+    /* Payload and terminating nul must fit in the buffer */
+    if (len >= bufsize) {
+      status = 0;
+    }
+  }
+  
+  /* Read the payload and terminate it */
+  if (status) {
+    if (!readFull(fd, pBuf, (size_t) len, deadline)) {
+      status = 0;
+    }
+  }
+  
+  if (status) {
+    pBuf[len] = (unsigned char) 0;
+    *pLen = (size_t) len;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * jobproto_write function.
+ */
+int jobproto_write(int fd, const unsigned char *pBuf, size_t len) {
+  return jobproto_write_timed(fd, pBuf, len, -1);
+}
+
+/*
+ * jobproto_write_timed function.
+ */
+int jobproto_write_timed(
+          int             fd,
+    const unsigned char * pBuf,
+          size_t          len,
+          int32_t         timeout) {
+  
+  int status = 1;
+  int64_t deadline = -1;
+  unsigned char hdr[4];
+  
+  /* Check parameters */
+  if (((pBuf == NULL) && (len > 0)) || (len > JOBPROTO_MAXFRAME)) {
+    abort();
+  }
+  
+  /* The whole frame must be sent within the timeout */
+  if (!deadlineOf(timeout, &deadline)) {
+    status = 0;
+  }
+  
+  /* Encode the big-endian length */
+  hdr[0] = (unsigned char) ((len >> 24) & 0xff);
+  hdr[1] = (unsigned char) ((len >> 16) & 0xff);
+  hdr[2] = (unsigned char) ((len >>  8) & 0xff);
+  hdr[3] = (unsigned char) ( len        & 0xff);
+  
+  /* Write the length and then the payload */
+  if (status) {
+    if (!writeFull(fd, hdr, 4, deadline)) {
+      status = 0;
+    }
+  }
+  
+  if (status) {
+    if (!writeFull(fd, pBuf, len, deadline)) {
+      status = 0;
+    }
+  }
+  
+  /* Return status */
+  return status;
+}
@@ -0,0 +1,147 @@
+#ifndef JOBPROTO_H_INCLUDED
+#define JOBPROTO_H_INCLUDED
+
+/*
+ * jobproto.h
+ * 
+ * Render job protocol module of Lilac.
+ * 
+ * This module handles the framing used between the lilac_draw daemon
+ * mode and the lilac_submit client.  Each frame is a four-byte unsigned
+ * big-endian length followed by that many bytes of payload.  See the
+ * lilac_draw manual in the doc directory for the payload contents.
+ * 
+ * This module requires POSIX file descriptors.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The maximum number of payload bytes in a single frame.
+ */
+#define JOBPROTO_MAXFRAME (16384)
+
+/*
+ * Read a frame from a file descriptor.
+ * 
+ * fd is the file descriptor to read from, which is normally a connected
+ * socket.
+ * 
+ * pBuf points to a buffer of bufsize bytes that receives the payload.
+ * A nul byte is always written after the payload, so the buffer must
+ * be at least one byte larger than the longest payload that should be
+ * accepted.  bufsize must be in range 1 to JOBPROTO_MAXFRAME + 1.
+ * 
+ * pLen receives the length of the payload, not including the nul byte
+ * that is appended.
+ * 
+ * The read fails if the connection is closed before the whole frame is
+ * received, if there is an I/O error, or if the declared payload
+ * length does not fit in the buffer.
+ * 
+ * Parameters:
+ * 
+ *   fd - the file descriptor to read from
+ * 
+ *   pBuf - the buffer to receive the payload
+ * 
+ *   bufsize - the size of the buffer in bytes
+ * 
+ *   pLen - pointer to variable to receive the payload length
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+int jobproto_read(int fd, unsigned char *pBuf, size_t bufsize,
+                  size_t *pLen);
+
+/*
+ * Read a frame from a file descriptor within a time limit.
+ * 
+ * This is the same as jobproto_read(), except that the read also fails
+ * if the whole frame has not been received within timeout milliseconds
+ * of the call.  The limit applies to the frame as a whole, so a peer
+ * can't keep the read going by sending a few bytes at a time.  If
+ * timeout is negative, there is no limit.
+ * 
+ * The file descriptor may be blocking or non-blocking.
+ * 
+ * Parameters:
+ * 
+ *   fd - the file descriptor to read from
+ * 
+ *   pBuf - the buffer to receive the payload
+ * 
+ *   bufsize - the size of the buffer in bytes
+ * 
+ *   pLen - pointer to variable to receive the payload length
+ * 
+ *   timeout - the time limit in milliseconds, or negative for none
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error or out of time
+ */
+int jobproto_read_timed(
+    int             fd,
+    unsigned char * pBuf,
+    size_t          bufsize,
+    size_t        * pLen,
+    int32_t         timeout);
+
+/*
+ * Write a frame to a file descriptor.
+ * 
+ * fd is the file descriptor to write to, which is normally a connected
+ * socket.
+ * 
+ * pBuf points to len bytes of payload.  len must be in range zero to
+ * JOBPROTO_MAXFRAME.  pBuf may be NULL only if len is zero.
+ * 
+ * Parameters:
+ * 
+ *   fd - the file descriptor to write to
+ * 
+ *   pBuf - the payload
+ * 
+ *   len - the number of bytes in the payload
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+int jobproto_write(int fd, const unsigned char *pBuf, size_t len);
+
+/*
+ * Write a frame to a file descriptor within a time limit.
+ * 
+ * This is the same as jobproto_write(), except that the write also
+ * fails if the whole frame has not been sent within timeout
+ * milliseconds of the call.  If timeout is negative, there is no limit.
+ * 
+ * The file descriptor should be non-blocking, since otherwise a single
+ * write to a peer that is not reading may block past the limit.
+ * 
+ * Parameters:
+ * 
+ *   fd - the file descriptor to write to
+ * 
+ *   pBuf - the payload
+ * 
+ *   len - the number of bytes in the payload
+ * 
+ *   timeout - the time limit in milliseconds, or negative for none
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error or out of time
+ */
+int jobproto_write_timed(
+          int             fd,
+    const unsigned char * pBuf,
+          size_t          len,
+          int32_t         timeout);
+
+#endif
@@ -7,12 +7,21 @@
  * See the header for further information.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "lilac_mesh.h"
 
+#include <errno.h>
 #include <limits.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 /*
  * Constants
  * ---------
@@ -23,13 +32,31 @@
  */
 #define MAX_SN_STACK (16)
 
+/*
+ * The maximum value of a numeric literal in the mesh file.
+ * 
+ * This must be at least LILAC_MESH_MAX_C, LILAC_MESH_MAX_POINTS, and
+ * LILAC_MESH_MAX_TRIS, so that coordinates, point indices, and counts
+ * can all be expressed.
+ */
+#define MAX_NUMBER (INT32_C(1048576))
+
+/*
+ * The value of an empty slot in the edge hash set.
+ * 
+ * Edge keys have the "from" point index in the upper 32 bits and the
+ * "to" point index in the lower 32 bits, so no valid key has all bits
+ * set.
+ */
+#define EDGE_EMPTY (UINT64_MAX)
+
 /*
  * Type declarations
  * -----------------
  */
 
 /*
- * Structure storing usage bitmaps.
+ * Structure storing usage tracking for points and directed edges.
  * 
  * Initialize with usage_map_init().  Reset with usage_map_reset()
  * before the structure goes out of scope to avoid a memory leak.
@@ -55,24 +82,28 @@ typedef struct {
   uint32_t *pPointUse;
   
   /*
-   * Pointer to a 2D bitmap that keeps track of which directed edges
+   * Pointer to a hash set that keeps track of which directed edges
    * have been used within triangles.
    * 
-   * The total length **IN BITS** of this bitmap is the total number of
-   * points squared, rounded up to the nearest 32-bit boundary.  The
-   * most significant bit of the first unsigned 32-bit integer is the
-   * first bit in the 2D bitmap.
-   * 
    * A directed edge of a triangle going from a point with index i1 to
-   * a point with index i2 corresponds to a bit in this bitmap having
-   * the zero-based offset ((i1 * point_count) + i2).  Bits that are
-   * zero mean the corresponding directed edge has not yet been used in
-   * a triangle, while bits that are one mean the corresponding directed
-   * edge has been used in a triangle already.
-   *  
-   * This pointer is only NULL if the point count is zero.
+   * a point with index i2 is stored as the key (i1 << 32) | i2.  Empty
+   * slots hold EDGE_EMPTY.  Collisions are resolved with linear
+   * probing.
+   * 
+   * The number of slots is edge_cap, which is a power of two that is
+   * at least twice the number of directed edges in all the triangles,
+   * so the set never fills up and memory use is linear in the number
+   * of triangles.  The pointer is NULL only if the triangle count is
+   * zero.
    */
-  uint32_t *pEdgeUse;
+  uint64_t *pEdgeUse;
+  
+  /*
+   * The number of slots in the edge hash set, and the base-2 logarithm
+   * of that number.
+   */
+  int32_t edge_cap;
+  int edge_bits;
   
   /*
    * The total number of points tracked by this usage map.
@@ -81,6 +112,35 @@ typedef struct {
   
 } USAGE_MAP;
 
+/*
+ * Structure tracking what has been passed to a mesh sink.
+ * 
+ * A mesh that falls back from the fast path to Shastina is interpreted
+ * again from the start, and both paths perform the same operations in
+ * the same order up to the point where the fast path stopped.  The
+ * counts in this structure make sure that the sink receives each point
+ * and triangle exactly once.
+ */
+typedef struct {
+  
+  /*
+   * The sink to pass the mesh to.
+   */
+  const LILAC_MESH_SINK *pSink;
+  
+  /*
+   * Non-zero if the dimensions have been passed to the sink.
+   */
+  int dim_sent;
+  
+  /*
+   * The number of points and triangles passed to the sink so far.
+   */
+  int32_t points_sent;
+  int32_t tris_sent;
+  
+} MESH_STREAM;
+
 /*
  * Local functions
  * ---------------
@@ -89,7 +149,10 @@ typedef struct {
 /* Prototypes */
 static void usage_map_init(USAGE_MAP *pM);
 static void usage_map_reset(USAGE_MAP *pM);
-static void usage_map_dim(USAGE_MAP *pM, int32_t point_count);
+static void usage_map_dim(
+    USAGE_MAP * pM,
+    int32_t     point_count,
+    int32_t     tri_count);
 static void usage_map_point(USAGE_MAP *pM, int32_t i);
 static int usage_map_edge(USAGE_MAP *pM, int32_t i1, int32_t i2);
 static int usage_map_orphan(USAGE_MAP *pM);
@@ -97,21 +160,22 @@ static int usage_map_orphan(USAGE_MAP *pM);
 static int32_t parseNumber(const char *pstr);
 
 static int op_p(
-    uint16_t     normd,
-    uint16_t     norma,
-    uint16_t     x,
-    uint16_t     y,
+    int32_t      normd,
+    int32_t      norma,
+    int32_t      x,
+    int32_t      y,
     LILAC_MESH * pM,
     int32_t    * pPtsWritten,
     int        * pErrCode);
 
 static int op_t(
-    uint16_t     v1,
-    uint16_t     v2,
-    uint16_t     v3,
+    int32_t      v1,
+    int32_t      v2,
+    int32_t      v3,
     LILAC_MESH * pM,
     int32_t      ptsWritten,
     int32_t    * pTriWritten,
+    uint32_t   * pLast,
     USAGE_MAP  * pUm,
     int        * pErrCode);
 
@@ -123,6 +187,55 @@ static int readHeader(
     int      * pErrCode,
     long     * pLine);
 
+static uint32_t binChecksum(const uint32_t *pHeader);
+static uint64_t binSize(uint32_t point_count, uint32_t tri_count);
+
+static LILAC_MESH *newMesh(
+    int32_t point_count,
+    int32_t tri_count,
+    int     with_tris);
+
+static void streamDim(MESH_STREAM *pStream, const LILAC_MESH *pM);
+static void streamPoint(
+    MESH_STREAM      * pStream,
+    const LILAC_MESH * pM,
+    int32_t            points_written);
+static void streamTri(
+    MESH_STREAM    * pStream,
+    int32_t          tris_written,
+    const uint32_t * pLast);
+
+static const char *fastSpace(
+    const char * pc,
+    const char * pEnd,
+    int          lines);
+static const char *fastToken(const char *pc, const char *pEnd);
+static int32_t fastNumber(const char *pc, const char *pEnd);
+static LILAC_MESH *fastParse(
+    const char        * pBuf,
+          size_t        len,
+          MESH_STREAM * pStream);
+
+static LILAC_MESH *snParse(
+    SNSOURCE    * pIn,
+    MESH_STREAM * pStream,
+    int         * pErrCode,
+    long        * pLine);
+static LILAC_MESH *bufParse(
+    const char        * pBuf,
+          size_t        len,
+          MESH_STREAM * pStream,
+          int         * pErrCode,
+          long        * pLine);
+
+static int readText(
+    const char  *  pPath,
+    const char  ** ppText,
+          size_t * pSize,
+          int    * pMapped,
+          int    * pErrCode);
+static void freeText(const char *pText, size_t size, int mapped);
+
 /*
  * Initialize a usage map structure.
  * 
@@ -153,6 +266,8 @@ static void usage_map_init(USAGE_MAP *pM) {
   /* Initialize */
   pM->pPointUse = NULL;
   pM->pEdgeUse = NULL;
+  pM->edge_cap = 0;
+  pM->edge_bits = 0;
   pM->point_count = 0;
 }
 
@@ -187,35 +302,46 @@ static void usage_map_reset(USAGE_MAP *pM) {
     free(pM->pEdgeUse);
     pM->pEdgeUse = NULL;
   }
+  pM->edge_cap = 0;
+  pM->edge_bits = 0;
   
   /* Reset point count to zero */
   pM->point_count = 0;
 }
 
 /*
- * Prepare a usage map structure for use with a given number of points.
+ * Prepare a usage map structure for use with a given number of points
+ * and triangles.
  * 
  * The given usage map structure must already have been initialized with
  * usage_map_init().  This function will automatically call the function
  * usage_map_reset() before updating the structure.
  * 
- * point_count must be in range [0, LILAC_MESH_MAX_POINTS].  All bits in
- * the bitmaps are initialized to clear.
+ * point_count must be in range [0, LILAC_MESH_MAX_POINTS] and tri_count
+ * must be in range [0, LILAC_MESH_MAX_TRIS].  All bits in the point
+ * bitmap are initialized to clear and the edge hash set starts out
+ * empty.
  * 
  * Parameters:
  * 
  *   pM - the initialized usage map structure to dimension
  * 
  *   point_count - the number of points to track
+ * 
+ *   tri_count - the number of triangles whose edges will be tracked
  */
-static void usage_map_dim(USAGE_MAP *pM, int32_t point_count) {
+static void usage_map_dim(
+    USAGE_MAP * pM,
+    int32_t     point_count,
+    int32_t     tri_count) {
   
   int32_t count = 0;
-  int32_t mcount = 0;
+  int32_t i = 0;
 
   /* Check parameters */
   if ((pM == NULL) ||
-        (point_count < 0) || (point_count > LILAC_MESH_MAX_POINTS)) {
+        (point_count < 0) || (point_count > LILAC_MESH_MAX_POINTS) ||
+        (tri_count < 0) || (tri_count > LILAC_MESH_MAX_TRIS)) {
     abort();
   }
   
@@ -237,21 +363,31 @@ static void usage_map_dim(USAGE_MAP *pM, int32_t point_count) {
       abort();
     }
     
-    /* Compute number of 32-bit blocks needed for edge usage bitmap */
-    mcount = point_count * point_count;
-    count = mcount / 32;
-    if (mcount % 32) {
-      count++;
+    /* Write the point count */
+    pM->point_count = point_count;
+  }
+  
+  /* Only allocate the edge hash set if at least one triangle */
+  if (tri_count > 0) {
+    
+    /* Find the smallest power of two that is at least twice the number
+     * of directed edges, which is three times the triangle count */
+    pM->edge_bits = 1;
+    pM->edge_cap = 2;
+    while (pM->edge_cap < tri_count * 6) {
+      (pM->edge_bits)++;
+      pM->edge_cap *= 2;
     }
     
-    /* Allocate and zero out edge-use bitmap */
-    pM->pEdgeUse = (uint32_t *) calloc(count, sizeof(uint32_t));
+    /* Allocate the hash set and mark every slot empty */
+    pM->pEdgeUse = (uint64_t *) malloc(
+                      ((size_t) pM->edge_cap) * sizeof(uint64_t));
     if (pM->pEdgeUse == NULL) {
       abort();
     }
-    
-    /* Write the point count */
-    pM->point_count = point_count;
+    for(i = 0; i < pM->edge_cap; i++) {
+      (pM->pEdgeUse)[i] = EDGE_EMPTY;
+    }
   }
 }
 
@@ -302,6 +438,9 @@ static void usage_map_point(USAGE_MAP *pM, int32_t i) {
  * i2 is significant because the edges are directed.  A fault occurs if
  * i1 and i2 are equal.
  * 
+ * No more than three times the tri_count value established by the call
+ * to usage_map_dim() may be marked, or a fault occurs.
+ * 
  * If the directed edge has not been marked for use yet, it is marked
  * for use and a non-zero value is returned.  If the directed edge has
  * already been marked for use, a zero value is returned.
@@ -322,36 +461,42 @@ static int usage_map_edge(USAGE_MAP *pM, int32_t i1, int32_t i2) {
   
   int status = 1;
   
-  int32_t ix = 0;
-  int32_t offs = 0;
-  int shift = 0;
-  uint32_t mask = 0;
+  uint64_t key = 0;
+  int32_t slot = 0;
+  int32_t probes = 0;
 
   /* Check parameters */
   if ((pM == NULL) ||
       (i1 < 0) || (i1 >= pM->point_count) ||
-      (i2 < 0) || (i2 >= pM->point_count)) {
+      (i2 < 0) || (i2 >= pM->point_count) ||
+      (i1 == i2) || (pM->pEdgeUse == NULL)) {
     abort();
   }
 
-  /* Compute the 1D index of the bit */
-  ix = (i1 * pM->point_count) + i2;
-  
-  /* Compute offset and shift of the corresponding bit */
-  offs = ix / 32;
-  shift = (int) (31 - (ix % 32));
-  
-  /* Compute mask */
-  mask = (uint32_t) (UINT32_C(1) << shift);
-  
-  /* Check whether bit is set or not */
-  if ((pM->pEdgeUse)[offs] & mask) {
-    /* Already set, so fail */
-    status = 0;
+  /* Compute the key of the edge and its home slot with a
+   * multiplicative hash */
+  key = (((uint64_t) i1) << 32) | ((uint64_t) i2);
+  slot = (int32_t) ((key * UINT64_C(0x9e3779b97f4a7c15)) >>
+                      (64 - pM->edge_bits));
+  
+  /* Probe until the key or an empty slot is found */
+  while ((pM->pEdgeUse)[slot] != EDGE_EMPTY) {
+    if ((pM->pEdgeUse)[slot] == key) {
+      /* Already used, so fail */
+      status = 0;
+      break;
+    }
     
-  } else {
-    /* Not already set, so set it */
-    (pM->pEdgeUse)[offs] |= mask;
+    probes++;
+    if (probes >= pM->edge_cap) {
+      abort();
+    }
+    slot = (slot + 1) & (pM->edge_cap - 1);
+  }
+  
+  /* If not already used, mark it */
+  if (status) {
+    (pM->pEdgeUse)[slot] = key;
   }
   
   /* Return status */
@@ -429,7 +574,7 @@ static int usage_map_orphan(USAGE_MAP *pM) {
 /*
  * Parse a numeric entity string from the Shastina file.
  * 
- * If successful, return value is an integer in [0, LILAC_MESH_MAX_C].
+ * If successful, return value is an integer in [0, MAX_NUMBER].
  * Otherwise, return value is -1.
  * 
  * Parameters:
@@ -474,7 +619,7 @@ static int32_t parseNumber(const char *pstr) {
       result = (result * 10) + c;
       
       /* Check for overflow */
-      if (result > LILAC_MESH_MAX_C) {
+      if (result > MAX_NUMBER) {
         result = -1;
         break;
       }
@@ -489,9 +634,10 @@ static int32_t parseNumber(const char *pstr) {
  * Perform the point operation.
  * 
  * normd, norma, x, and y are the parameters passed to this function
- * from the interpreter stack.  All must be in [0, LILAC_MESH_MAX_C] or
- * a fault occurs.  This function will perform further checks if needed
- * and report them as errors.
+ * from the interpreter stack.  All must be in [0, MAX_NUMBER] or a
+ * fault occurs.  Values above LILAC_MESH_MAX_C are reported as errors.
+ * This function will perform further checks if needed and report them
+ * as errors.
  * 
  * pM is the mesh object to update, pPtsWritten must point to a variable
  * that keeps track of how many points have been written into the mesh
@@ -523,10 +669,10 @@ static int32_t parseNumber(const char *pstr) {
  *   non-zero if successful, zero if error
  */
 static int op_p(
-    uint16_t     normd,
-    uint16_t     norma,
-    uint16_t     x,
-    uint16_t     y,
+    int32_t      normd,
+    int32_t      norma,
+    int32_t      x,
+    int32_t      y,
     LILAC_MESH * pM,
     int32_t    * pPtsWritten,
     int        * pErrCode) {
@@ -535,17 +681,24 @@ static int op_p(
   LILAC_MESH_POINT *pLMP = NULL;
   
   /* Check parameters */
-  if ((normd > LILAC_MESH_MAX_C) ||
-      (norma > LILAC_MESH_MAX_C) ||
-      (x > LILAC_MESH_MAX_C) ||
-      (y > LILAC_MESH_MAX_C) ||
+  if ((normd < 0) || (normd > MAX_NUMBER) ||
+      (norma < 0) || (norma > MAX_NUMBER) ||
+      (x < 0) || (x > MAX_NUMBER) ||
+      (y < 0) || (y > MAX_NUMBER) ||
       (pM == NULL) || (pPtsWritten == NULL) ||
       (pErrCode == NULL)) {
     abort();
   }
   
+  /* All point parameters must be in coordinate range */
+  if ((normd > LILAC_MESH_MAX_C) || (norma > LILAC_MESH_MAX_C) ||
+      (x > LILAC_MESH_MAX_C) || (y > LILAC_MESH_MAX_C)) {
+    status = 0;
+    *pErrCode = LILAC_MESH_ERR_PTPARM;
+  }
+  
   /* If normd is zero, norma must also be zero */
-  if (normd == 0) {
+  if (status && (normd == 0)) {
     if (norma != 0) {
       status = 0;
       *pErrCode = LILAC_MESH_ERR_NORMDA;
@@ -568,10 +721,10 @@ static int op_p(
    * and increment the written point count */
   if (status) {
     pLMP = &((pM->pPoints)[*pPtsWritten]);
-    pLMP->normd = normd;
-    pLMP->norma = norma;
-    pLMP->x = x;
-    pLMP->y = y;
+    pLMP->normd = (uint16_t) normd;
+    pLMP->norma = (uint16_t) norma;
+    pLMP->x = (uint16_t) x;
+    pLMP->y = (uint16_t) y;
     (*pPtsWritten)++;
   }
   
@@ -583,8 +736,8 @@ static int op_p(
  * Perform the triangle operation.
  * 
  * v1, v2, and v3 are the parameters passed to this function from the
- * interpreter stack.  All must be in the range [0, LILAC_MESH_MAX_C] or
- * a fault occurs.  This function will perform further checks if needed
+ * interpreter stack.  All must be in the range [0, MAX_NUMBER] or a
+ * fault occurs.  This function will perform further checks if needed
  * and report them as errors.
  * 
  * pM is the mesh object to update, pTriWritten must point to a variable
@@ -592,6 +745,12 @@ static int op_p(
  * mesh object so far, and pUm is a pointer to the usage map structure
  * to update.
  * 
+ * pLast points to three elements that hold the vertices of the previous
+ * triangle, if any, and receive the vertices of this triangle if it is
+ * successful.  The triangle list of the mesh object may be NULL when
+ * the mesh is being streamed, in which case triangles are only written
+ * to pLast.
+ * 
  * pErrCode must point to a variable to receive an error code if there
  * is a failure.  Note that this function does not have a way of setting
  * the line number of an error, so the caller is expected to do that in
@@ -616,6 +775,8 @@ static int op_p(
  *   pTriWritten - pointer to variable tracking number of triangles
  *   written
  * 
+ *   pLast - the vertices of the previous triangle
+ * 
  *   pUm - pointer to the usage map structure
  * 
  *   pErrCode - pointer to variable to receive error code
@@ -625,12 +786,13 @@ static int op_p(
  *   non-zero if successful, zero if error
  */
 static int op_t(
-    uint16_t     v1,
-    uint16_t     v2,
-    uint16_t     v3,
+    int32_t      v1,
+    int32_t      v2,
+    int32_t      v3,
     LILAC_MESH * pM,
     int32_t      ptsWritten,
     int32_t    * pTriWritten,
+    uint32_t   * pLast,
     USAGE_MAP  * pUm,
     int        * pErrCode) {
   
@@ -640,7 +802,7 @@ static int op_t(
   LILAC_MESH_POINT *pB = NULL;
   LILAC_MESH_POINT *pC = NULL;
   
-  uint16_t *pt = NULL;
+  uint32_t *pt = NULL;
   
   double v1x = 0.0;
   double v1y = 0.0;
@@ -651,11 +813,11 @@ static int op_t(
   double k = 0.0;
 
   /* Check parameters */
-  if ((v1 > LILAC_MESH_MAX_C) ||
-      (v2 > LILAC_MESH_MAX_C) ||
-      (v3 > LILAC_MESH_MAX_C) ||
+  if ((v1 < 0) || (v1 > MAX_NUMBER) ||
+      (v2 < 0) || (v2 > MAX_NUMBER) ||
+      (v3 < 0) || (v3 > MAX_NUMBER) ||
       (ptsWritten < 0) || (ptsWritten > LILAC_MESH_MAX_POINTS) ||
-      (pM == NULL) || (pTriWritten == NULL) ||
+      (pM == NULL) || (pTriWritten == NULL) || (pLast == NULL) ||
       (pUm == NULL) || (pErrCode == NULL)) {
     abort();
   }
@@ -717,16 +879,12 @@ static int op_t(
   /* If this is not the first triangle, check that this triangle is
    * properly sorted relative to the previous triangle */
   if (status && (*pTriWritten > 0)) {
-    /* Get reference to previous triangle vertices */
-    pt = &((pM->pTris)[(*pTriWritten - 1) * 3]);
-    
-    /* Check ordering */
-    if (pt[0] > v1) {
+    if (pLast[0] > (uint32_t) v1) {
       status = 0;
       *pErrCode = LILAC_MESH_ERR_TRSORT;
     
-    } else if (pt[0] == v1) {
-      if (pt[1] >= v2) {
+    } else if (pLast[0] == (uint32_t) v1) {
+      if (pLast[1] >= (uint32_t) v2) {
         status = 0;
         *pErrCode = LILAC_MESH_ERR_TRSORT;
       }
@@ -769,13 +927,21 @@ static int op_t(
     usage_map_point(pUm, v3);
   }
 
-  /* Finally, add the triangle to the triangle list and updated the
-   * triangles written count */
+  /* Finally, add the triangle to the triangle list if there is one,
+   * remember it as the previous triangle, and update the triangles
+   * written count */
   if (status) {
-    pt = &((pM->pTris)[(*pTriWritten) * 3]);
-    pt[0] = v1;
-    pt[1] = v2;
-    pt[2] = v3;
+    pLast[0] = (uint32_t) v1;
+    pLast[1] = (uint32_t) v2;
+    pLast[2] = (uint32_t) v3;
+    
+    if (pM->pTris != NULL) {
+      pt = &((pM->pTris)[((size_t) *pTriWritten) * 3]);
+      pt[0] = pLast[0];
+      pt[1] = pLast[1];
+      pt[2] = pLast[2];
+    }
+    
     (*pTriWritten)++;
   }
   
@@ -1014,117 +1180,727 @@ static int readHeader(
 }
 
 /*
- * Public function implementations
- * -------------------------------
+ * Compute the checksum of a binary mesh header.
  * 
- * See the header for specifications
+ * This is the 32-bit FNV-1a hash of the bytes of every header word
+ * except the last, which is where the checksum is stored.
+ * 
+ * Parameters:
+ * 
+ *   pHeader - the header words
+ * 
+ * Return:
+ * 
+ *   the checksum
  */
+static uint32_t binChecksum(const uint32_t *pHeader) {
+  
+  const unsigned char *pc = NULL;
+  size_t i = 0;
+  uint32_t h = UINT32_C(2166136261);
+  
+  /* Check parameter */
+  if (pHeader == NULL) {
+    abort();
+  }
+  
+  pc = (const unsigned char *) pHeader;
+  for(i = 0; i < (LILAC_MESH_BIN_HEADER - 1) * sizeof(uint32_t); i++) {
+    h ^= (uint32_t) pc[i];
+    h *= UINT32_C(16777619);
+  }
+  
+  return h;
+}
 
 /*
- * lilac_mesh_new function.
+ * Compute the total size in bytes of a binary mesh file with the given
+ * number of points and triangles.
+ * 
+ * Parameters:
+ * 
+ *   point_count - the number of points
+ * 
+ *   tri_count - the number of triangles
+ * 
+ * Return:
+ * 
+ *   the size of the file in bytes
  */
-LILAC_MESH *lilac_mesh_new(SNSOURCE *pIn, int *pErrCode, long *pLine) {
+static uint64_t binSize(uint32_t point_count, uint32_t tri_count) {
+  return (((uint64_t) LILAC_MESH_BIN_HEADER) * sizeof(uint32_t)) +
+          (((uint64_t) point_count) * sizeof(LILAC_MESH_POINT)) +
+          (((uint64_t) tri_count) * 3 * sizeof(uint32_t));
+}
+
+/*
+ * Allocate a mesh object with the given number of points and
+ * triangles.
+ * 
+ * The point and triangle arrays are allocated and cleared to zero.
+ * Both counts must already have been checked against the limits.
+ * 
+ * If with_tris is zero, the triangle list is not allocated even though
+ * the triangle count is set.  Such a mesh may only be used internally
+ * while streaming.
+ * 
+ * Parameters:
+ * 
+ *   point_count - the number of points
+ * 
+ *   tri_count - the number of triangles
+ * 
+ *   with_tris - non-zero to allocate the triangle list
+ * 
+ * Return:
+ * 
+ *   the new mesh object
+ */
+static LILAC_MESH *newMesh(
+    int32_t point_count,
+    int32_t tri_count,
+    int     with_tris) {
   
-  int status = 1;
-  int i_dummy = 0;
-  long l_dummy = 0;
+  LILAC_MESH *pM = NULL;
   
-  int32_t i = 0;
+  /* Check parameters */
+  if ((point_count < 0) || (point_count > LILAC_MESH_MAX_POINTS) ||
+      (tri_count < 0) || (tri_count > LILAC_MESH_MAX_TRIS)) {
+    abort();
+  }
   
-  int32_t point_count = 0;
-  int32_t tri_count = 0;
+  /* Allocate and clear the structure memory */
+  pM = (LILAC_MESH *) malloc(sizeof(LILAC_MESH));
+  if (pM == NULL) {
+    abort();
+  }
+  memset(pM, 0, sizeof(LILAC_MESH));
   
-  int32_t points_written = 0;
-  int32_t tris_written = 0;
+  /* Write the point and triangle counts in and initialize pointers to
+   * NULL */
+  pM->point_count = point_count;
+  pM->tri_count = tri_count;
   
-  uint16_t st[MAX_SN_STACK];
-  int st_count = 0;
+  pM->pPoints = NULL;
+  pM->pTris = NULL;
+  pM->pMap = NULL;
+  pM->map_size = 0;
   
-  SNPARSER *pSn = NULL;
-  LILAC_MESH *pM = NULL;
+  /* Allocate non-empty arrays and clear to zero */
+  if (point_count > 0) {
+    pM->pPoints = (LILAC_MESH_POINT *) calloc(
+                                          point_count,
+                                          sizeof(LILAC_MESH_POINT));
+    if (pM->pPoints == NULL) {
+      abort();
+    }
+  }
   
-  SNENTITY ent;
-  USAGE_MAP um;
+  if ((tri_count > 0) && with_tris) {
+    pM->pTris = (uint32_t *) calloc(
+                                ((size_t) tri_count) * 3,
+                                sizeof(uint32_t));
+    if (pM->pTris == NULL) {
+      abort();
+    }
+  }
   
-  /* Initialize structures and arrays */
-  memset(&ent, 0, sizeof(SNENTITY));
-  memset(st, 0, MAX_SN_STACK * sizeof(uint16_t));
-  usage_map_init(&um);
+  return pM;
+}
+
+/*
+ * Pass the dimensions of a mesh to the sink of a stream.
+ * 
+ * Nothing happens if pStream is NULL or the dimensions have already
+ * been passed.
+ * 
+ * Parameters:
+ * 
+ *   pStream - the stream, or NULL
+ * 
+ *   pM - the mesh being interpreted
+ */
+static void streamDim(MESH_STREAM *pStream, const LILAC_MESH *pM) {
   
-  /* Check required parameter */
-  if (pIn == NULL) {
+  /* Check parameters */
+  if (pM == NULL) {
     abort();
   }
+  
+  if ((pStream != NULL) && (!(pStream->dim_sent))) {
+    pStream->dim_sent = 1;
+    if (pStream->pSink->fDim != NULL) {
+      pStream->pSink->fDim(
+        pStream->pSink->pCustom, pM->point_count, pM->tri_count);
+    }
+  }
+}
 
-  /* If optional parameter(s) not provided, redirect to dummy vars */
-  if (pErrCode == NULL) {
-    pErrCode = &i_dummy;
+/*
+ * Pass the last point written to a mesh to the sink of a stream.
+ * 
+ * Nothing happens if pStream is NULL or the point has already been
+ * passed.
+ * 
+ * Parameters:
+ * 
+ *   pStream - the stream, or NULL
+ * 
+ *   pM - the mesh being interpreted
+ * 
+ *   points_written - the number of points written so far
+ */
+static void streamPoint(
+    MESH_STREAM      * pStream,
+    const LILAC_MESH * pM,
+    int32_t            points_written) {
+  
+  /* Check parameters */
+  if ((pM == NULL) || (points_written < 1) ||
+      (points_written > pM->point_count)) {
+    abort();
   }
-  if (pLine == NULL) {
-    pLine = &l_dummy;
+  
+  if ((pStream != NULL) && (points_written > pStream->points_sent)) {
+    pStream->points_sent = points_written;
+    if (pStream->pSink->fPoint != NULL) {
+      pStream->pSink->fPoint(
+        pStream->pSink->pCustom,
+        points_written - 1,
+        &((pM->pPoints)[points_written - 1]));
+    }
   }
+}
+
+/*
+ * Pass the last triangle written to a mesh to the sink of a stream.
+ * 
+ * Nothing happens if pStream is NULL or the triangle has already been
+ * passed.
+ * 
+ * Parameters:
+ * 
+ *   pStream - the stream, or NULL
+ * 
+ *   tris_written - the number of triangles written so far
+ * 
+ *   pLast - the vertices of the last triangle written
+ */
+static void streamTri(
+    MESH_STREAM    * pStream,
+    int32_t          tris_written,
+    const uint32_t * pLast) {
   
-  /* Reset error and line codes */
-  *pErrCode = LILAC_MESH_ERR_OK;
-  *pLine = 0;
+  /* Check parameters */
+  if ((tris_written < 1) || (pLast == NULL)) {
+    abort();
+  }
   
-  /* Allocate a Shastina parser */
-  pSn = snparser_alloc();
-
-  /* Begin by reading the header and getting dimension information */
-  if (!readHeader(
-        pSn, pIn, &point_count, &tri_count, pErrCode, pLine)) {
-    status = 0;
+  if ((pStream != NULL) && (tris_written > pStream->tris_sent)) {
+    pStream->tris_sent = tris_written;
+    if (pStream->pSink->fTri != NULL) {
+      pStream->pSink->fTri(
+        pStream->pSink->pCustom, tris_written - 1, pLast);
+    }
   }
+}
 
-  /* Prepare the usage map using the point count */
-  if (status) {
-    usage_map_dim(&um, point_count);
+/*
+ * Skip over whitespace in a buffer for the fast path.
+ * 
+ * Spaces and horizontal tabs are skipped.  Line feeds are also skipped
+ * if lines is non-zero.  Carriage returns are never skipped, so that
+ * files with them go through Shastina.
+ * 
+ * Parameters:
+ * 
+ *   pc - the current position
+ * 
+ *   pEnd - the end of the buffer
+ * 
+ *   lines - non-zero to also skip line feeds
+ * 
+ * Return:
+ * 
+ *   the first position that is not skipped, which may be pEnd
+ */
+static const char *fastSpace(
+    const char * pc,
+    const char * pEnd,
+    int          lines) {
+  
+  /* Check parameters */
+  if ((pc == NULL) || (pEnd == NULL) || (pc > pEnd)) {
+    abort();
   }
-
-  /* Allocate the Lilac mesh structure */
-  if (status) {
-    /* Allocate and clear the structure memory */
-    pM = (LILAC_MESH *) malloc(sizeof(LILAC_MESH));
-    if (pM == NULL) {
-      abort();
-    }
-    memset(pM, 0, sizeof(LILAC_MESH));
-    
-    /* Write the point and triangle counts in and initialize pointers to
-     * NULL */
-    pM->point_count = point_count;
-    pM->tri_count = tri_count;
-    
-    pM->pPoints = NULL;
-    pM->pTris = NULL;
-    
-    /* Allocate non-empty arrays and clear to zero */
-    if (point_count > 0) {
-      pM->pPoints = (LILAC_MESH_POINT *) calloc(
-                                            point_count,
-                                            sizeof(LILAC_MESH_POINT));
-      if (pM->pPoints == NULL) {
-        abort();
-      }
-    }
-    
-    if (tri_count > 0) {
-      pM->pTris = (uint16_t *) calloc(
-                                  (tri_count * 3),
-                                  sizeof(uint16_t));
-      if (pM->pTris == NULL) {
-        abort();
-      }
+  
+  for( ; pc < pEnd; pc++) {
+    if ((*pc != ' ') && (*pc != '\t') && ((!lines) || (*pc != '\n'))) {
+      break;
     }
   }
+  
+  return pc;
+}
 
-  /* Interpret the Shastina mesh file */
-  if (status) {
-    /* Go through tokens until EOF or error */
-    for(snparser_read(pSn, &ent, pIn);
-        ent.status > 0;
-        snparser_read(pSn, &ent, pIn)) {
+/*
+ * Find the end of a token in a buffer for the fast path.
+ * 
+ * Tokens on the fast path are made only of ASCII digits, lowercase
+ * letters, and hyphens.  Any other character ends the token, and the
+ * caller decides whether that character is allowed there.
+ * 
+ * Parameters:
+ * 
+ *   pc - the start of the token
+ * 
+ *   pEnd - the end of the buffer
+ * 
+ * Return:
+ * 
+ *   the position just after the token, which equals pc if the token is
+ *   empty
+ */
+static const char *fastToken(const char *pc, const char *pEnd) {
+  
+  /* Check parameters */
+  if ((pc == NULL) || (pEnd == NULL) || (pc > pEnd)) {
+    abort();
+  }
+  
+  for( ; pc < pEnd; pc++) {
+    if (((*pc < '0') || (*pc > '9')) &&
+        ((*pc < 'a') || (*pc > 'z')) &&
+        (*pc != '-')) {
+      break;
+    }
+  }
+  
+  return pc;
+}
+
+/*
+ * Parse a token as a numeric literal for the fast path.
+ * 
+ * This follows parseNumber(), except that the token is given as a range
+ * of the buffer instead of a nul-terminated string.
+ * 
+ * Parameters:
+ * 
+ *   pc - the start of the token
+ * 
+ *   pEnd - the end of the token
+ * 
+ * Return:
+ * 
+ *   the parsed numeric value in [0, MAX_NUMBER], or -1
+ */
+static int32_t fastNumber(const char *pc, const char *pEnd) {
+  
+  int32_t result = 0;
+  
+  /* Check parameters */
+  if ((pc == NULL) || (pEnd == NULL) || (pc > pEnd)) {
+    abort();
+  }
+  
+  /* Make sure at least one character */
+  if (pc >= pEnd) {
+    result = -1;
+  }
+  
+  /* Parse the decimal digits, checking for overflow */
+  for( ; (result >= 0) && (pc < pEnd); pc++) {
+    if ((*pc < '0') || (*pc > '9')) {
+      result = -1;
+    } else {
+      result = (result * 10) + (int32_t) (*pc - '0');
+      if (result > MAX_NUMBER) {
+        result = -1;
+      }
+    }
+  }
+  
+  return result;
+}
+
+/*
+ * Interpret a Lilac mesh file held in a buffer without Shastina.
+ * 
+ * Mesh files are almost always written by tools, so they use a small
+ * subset of Shastina: the two header metacommands, unsigned decimal
+ * literals, the p and t operations, and the |; marker, separated by
+ * spaces, tabs, and line feeds.  This function recognizes that subset
+ * directly and runs the same operations and checks as
+ * lilac_mesh_new().
+ * 
+ * NULL is returned if the buffer contains anything outside the subset,
+ * such as comments, carriage returns, or other entity types, and also
+ * if the mesh has any error at all.  The caller must then interpret the
+ * buffer with Shastina, which either succeeds or reports the error with
+ * the proper error code and line number.  Nothing after the |; marker
+ * may be present except whitespace.
+ * 
+ * If pStream is not NULL, the mesh is passed to its sink while it is
+ * interpreted, and the returned mesh has no triangle list.  When NULL
+ * is returned, the sink may have already received part of the mesh.
+ * 
+ * Parameters:
+ * 
+ *   pBuf - the buffer
+ * 
+ *   len - the length of the buffer in bytes
+ * 
+ *   pStream - the stream, or NULL
+ * 
+ * Return:
+ * 
+ *   a new Lilac mesh object, or NULL if the buffer must be interpreted
+ *   with Shastina
+ */
+static LILAC_MESH *fastParse(
+    const char        * pBuf,
+          size_t        len,
+          MESH_STREAM * pStream) {
+  
+  int status = 1;
+  int errcode = 0;
+  
+  const char *pc = NULL;
+  const char *pt = NULL;
+  const char *pEnd = NULL;
+  
+  int32_t i = 0;
+  
+  int32_t point_count = 0;
+  int32_t tri_count = 0;
+  
+  int32_t points_written = 0;
+  int32_t tris_written = 0;
+  
+  int32_t st[MAX_SN_STACK];
+  int st_count = 0;
+  
+  uint32_t last[3];
+  
+  LILAC_MESH *pM = NULL;
+  USAGE_MAP um;
+  
+  /* Initialize structures and arrays */
+  memset(st, 0, MAX_SN_STACK * sizeof(int32_t));
+  memset(last, 0, 3 * sizeof(uint32_t));
+  usage_map_init(&um);
+  
+  /* Check parameters */
+  if ((pBuf == NULL) && (len > 0)) {
+    abort();
+  }
+  
+  /* An empty buffer always has an error */
+  if (len < 1) {
+    status = 0;
+  }
+  
+  if (status) {
+    pc = pBuf;
+    pEnd = pBuf + len;
+  }
+  
+  /* Read the %lilac-mesh; signature */
+  if (status) {
+    pc = fastSpace(pc, pEnd, 1);
+    if ((pc >= pEnd) || (*pc != '%')) {
+      status = 0;
+    }
+  }
+  
+  if (status) {
+    pt = fastToken(pc + 1, pEnd);
+    if ((pt - (pc + 1) != 10) ||
+        (memcmp(pc + 1, "lilac-mesh", 10) != 0)) {
+      status = 0;
+    }
+  }
+  
+  if (status) {
+    pc = fastSpace(pt, pEnd, 0);
+    if ((pc >= pEnd) || (*pc != ';')) {
+      status = 0;
+    }
+  }
+  
+  /* Read the %dim metacommand */
+  if (status) {
+    pc = fastSpace(pc + 1, pEnd, 1);
+    if ((pc >= pEnd) || (*pc != '%')) {
+      status = 0;
+    }
+  }
+  
+  if (status) {
+    pt = fastToken(pc + 1, pEnd);
+    if ((pt - (pc + 1) != 3) || (memcmp(pc + 1, "dim", 3) != 0)) {
+      status = 0;
+    }
+  }
+  
+  if (status) {
+    pc = fastSpace(pt, pEnd, 0);
+    if (pc <= pt) {
+      status = 0;
+    }
+  }
+  
+  if (status) {
+    pt = fastToken(pc, pEnd);
+    point_count = fastNumber(pc, pt);
+    if ((point_count < 0) || (point_count > LILAC_MESH_MAX_POINTS)) {
+      status = 0;
+    }
+  }
+  
+  if (status) {
+    pc = fastSpace(pt, pEnd, 0);
+    if (pc <= pt) {
+      status = 0;
+    }
+  }
+  
+  if (status) {
+    pt = fastToken(pc, pEnd);
+    tri_count = fastNumber(pc, pt);
+    if ((tri_count < 0) || (tri_count > LILAC_MESH_MAX_TRIS)) {
+      status = 0;
+    }
+  }
+  
+  if (status) {
+    pc = fastSpace(pt, pEnd, 0);
+    if ((pc >= pEnd) || (*pc != ';')) {
+      status = 0;
+    }
+  }
+  
+  /* Prepare the usage map and allocate the mesh */
+  if (status) {
+    pc++;
+    usage_map_dim(&um, point_count, tri_count);
+    pM = newMesh(point_count, tri_count, (pStream == NULL));
+    streamDim(pStream, pM);
+  }
+  
+  /* Interpret tokens until the |; marker; every token must be followed
+   * by whitespace */
+  while (status) {
+    pc = fastSpace(pc, pEnd, 1);
+    if (pc >= pEnd) {
+      status = 0;
+      break;
+    }
+    
+    /* Check for the |; marker, which may only be followed by
+     * whitespace */
+    if (*pc == '|') {
+      if ((pEnd - pc < 2) || (pc[1] != ';')) {
+        status = 0;
+      }
+      if (status) {
+        pc = fastSpace(pc + 2, pEnd, 1);
+        if (pc < pEnd) {
+          status = 0;
+        }
+      }
+      break;
+    }
+    
+    /* Get the token */
+    pt = fastToken(pc, pEnd);
+    if ((pt <= pc) || (pt >= pEnd) ||
+        ((*pt != ' ') && (*pt != '\t') && (*pt != '\n'))) {
+      status = 0;
+      break;
+    }
+    
+    if ((*pc >= '0') && (*pc <= '9')) {
+      /* Numeric literal, which is pushed on the interpreter stack */
+      i = fastNumber(pc, pt);
+      if ((i < 0) || (st_count >= MAX_SN_STACK)) {
+        status = 0;
+      } else {
+        st[st_count] = i;
+        st_count++;
+      }
+      
+    } else if ((pt - pc == 1) && (*pc == 'p')) {
+      /* Point operation */
+      if (st_count < 4) {
+        status = 0;
+      } else if (!op_p(
+                    st[st_count - 4],
+                    st[st_count - 3],
+                    st[st_count - 2],
+                    st[st_count - 1],
+                    pM,
+                    &points_written,
+                    &errcode)) {
+        status = 0;
+      } else {
+        st_count -= 4;
+        streamPoint(pStream, pM, points_written);
+      }
+      
+    } else if ((pt - pc == 1) && (*pc == 't')) {
+      /* Triangle operation */
+      if (st_count < 3) {
+        status = 0;
+      } else if (!op_t(
+                    st[st_count - 3],
+                    st[st_count - 2],
+                    st[st_count - 1],
+                    pM,
+                    points_written,
+                    &tris_written,
+                    last,
+                    &um,
+                    &errcode)) {
+        status = 0;
+      } else {
+        st_count -= 3;
+        streamTri(pStream, tris_written, last);
+      }
+      
+    } else {
+      /* Anything else goes through Shastina */
+      status = 0;
+    }
+    
+    pc = pt;
+  }
+  
+  /* Make sure that stack is empty, that everything has been written,
+   * and that there are no orphan points */
+  if (status) {
+    if ((st_count > 0) ||
+        (points_written != point_count) ||
+        (tris_written != tri_count) ||
+        usage_map_orphan(&um)) {
+      status = 0;
+    }
+  }
+  
+  /* Reset usage map to release any memory */
+  usage_map_reset(&um);
+  
+  /* If failure and mesh allocated, release it */
+  if (!status) {
+    lilac_mesh_free(pM);
+    pM = NULL;
+  }
+  
+  /* Return mesh pointer or NULL */
+  return pM;
+}
+
+/*
+ * Interpret a Lilac mesh file from a Shastina source.
+ * 
+ * This implements lilac_mesh_new(), which calls it with a NULL stream.
+ * If pStream is not NULL, the mesh is passed to its sink while it is
+ * interpreted, and the returned mesh has no triangle list.
+ * 
+ * Parameters:
+ * 
+ *   pIn - the Shastina source to read the Lilac mesh file from
+ * 
+ *   pStream - the stream, or NULL
+ * 
+ *   pErrCode - pointer to variable to receive the error code status of
+ *   the operation, or NULL
+ * 
+ *   pLine - pointer to variable to receive a line number, or NULL
+ * 
+ * Return:
+ * 
+ *   a new Lilac mesh object or NULL if failure
+ */
+static LILAC_MESH *snParse(
+    SNSOURCE    * pIn,
+    MESH_STREAM * pStream,
+    int         * pErrCode,
+    long        * pLine) {
+  
+  int status = 1;
+  int i_dummy = 0;
+  long l_dummy = 0;
+  
+  int32_t i = 0;
+  
+  int32_t point_count = 0;
+  int32_t tri_count = 0;
+  
+  int32_t points_written = 0;
+  int32_t tris_written = 0;
+  
+  int32_t st[MAX_SN_STACK];
+  int st_count = 0;
+  
+  uint32_t last[3];
+  
+  SNPARSER *pSn = NULL;
+  LILAC_MESH *pM = NULL;
+  
+  SNENTITY ent;
+  USAGE_MAP um;
+  
+  /* Initialize structures and arrays */
+  memset(&ent, 0, sizeof(SNENTITY));
+  memset(st, 0, MAX_SN_STACK * sizeof(int32_t));
+  memset(last, 0, 3 * sizeof(uint32_t));
+  usage_map_init(&um);
+  
+  /* Check required parameter */
+  if (pIn == NULL) {
+    abort();
+  }
+
+  /* If optional parameter(s) not provided, redirect to dummy vars */
+  if (pErrCode == NULL) {
+    pErrCode = &i_dummy;
+  }
+  if (pLine == NULL) {
+    pLine = &l_dummy;
+  }
+  
+  /* Reset error and line codes */
+  *pErrCode = LILAC_MESH_ERR_OK;
+  *pLine = 0;
+  
+  /* Allocate a Shastina parser */
+  pSn = snparser_alloc();
+
+  /* Begin by reading the header and getting dimension information */
+  if (!readHeader(
+        pSn, pIn, &point_count, &tri_count, pErrCode, pLine)) {
+    status = 0;
+  }
+
+  /* Prepare the usage map using the point and triangle counts */
+  if (status) {
+    usage_map_dim(&um, point_count, tri_count);
+  }
+
+  /* Allocate the Lilac mesh structure */
+  if (status) {
+    pM = newMesh(point_count, tri_count, (pStream == NULL));
+    streamDim(pStream, pM);
+  }
+
+  /* Interpret the Shastina mesh file */
+  if (status) {
+    /* Go through tokens until EOF or error */
+    for(snparser_read(pSn, &ent, pIn);
+        ent.status > 0;
+        snparser_read(pSn, &ent, pIn)) {
 
       /* We read an entity (after the header), so handle the specific
        * type of entity */
@@ -1146,7 +1922,7 @@ LILAC_MESH *lilac_mesh_new(SNSOURCE *pIn, int *pErrCode, long *pLine) {
         
         /* Push the numeric value on the interpreter stack */
         if (status) {
-          st[st_count] = (uint16_t) i;
+          st[st_count] = i;
           st_count++;
         }
       
@@ -1179,6 +1955,7 @@ LILAC_MESH *lilac_mesh_new(SNSOURCE *pIn, int *pErrCode, long *pLine) {
           /* Clear operation parameters from stack */
           if (status) {
             st_count -= 4;
+            streamPoint(pStream, pM, points_written);
           }
           
         } else if (strcmp(ent.pKey, "t") == 0) {
@@ -1199,6 +1976,7 @@ LILAC_MESH *lilac_mesh_new(SNSOURCE *pIn, int *pErrCode, long *pLine) {
                     pM,
                     points_written,
                     &tris_written,
+                    last,
                     &um,
                     pErrCode)) {
               status = 0;
@@ -1209,6 +1987,7 @@ LILAC_MESH *lilac_mesh_new(SNSOURCE *pIn, int *pErrCode, long *pLine) {
           /* Clear operation parameters from stack */
           if (status) {
             st_count -= 3;
+            streamTri(pStream, tris_written, last);
           }
           
         } else {
@@ -1230,66 +2009,748 @@ LILAC_MESH *lilac_mesh_new(SNSOURCE *pIn, int *pErrCode, long *pLine) {
         break;
       }
     }
- 
-    /* If parsing error encountered, report it */
-    if (status && (ent.status < 0)) {
+ 
+    /* If parsing error encountered, report it */
+    if (status && (ent.status < 0)) {
+      status = 0;
+      *pErrCode = ent.status;
+      *pLine = snparser_count(pSn);
+    }
+    
+    /* If we got here successfully, we read the EOF token, so make sure
+     * that stack is empty and everything has been written */
+    if (status && (st_count > 0)) {
+      status = 0;
+      *pErrCode = LILAC_MESH_ERR_REM;
+      *pLine = 0;
+    }
+    
+    if (status && (points_written != point_count)) {
+      status = 0;
+      *pErrCode = LILAC_MESH_ERR_PUNDEF;
+      *pLine = 0;
+    }
+    
+    if (status && (tris_written != tri_count)) {
+      status = 0;
+      *pErrCode = LILAC_MESH_ERR_TUNDEF;
+      *pLine = 0;
+    }
+    
+    /* Check for orphan points */
+    if (status && usage_map_orphan(&um)) {
+      status = 0;
+      *pErrCode = LILAC_MESH_ERR_ORPHAN;
+      *pLine = 0;
+    }
+  }
+
+  /* Reset usage map to release any memory */
+  usage_map_reset(&um);
+  
+  /* Free parser if allocated */
+  snparser_free(pSn);
+  pSn = NULL;
+  
+  /* If failure and mesh allocated, release it */
+  if (!status) {
+    lilac_mesh_free(pM);
+    pM = NULL;
+  }
+  
+  /* If failure, make sure line count is valid else set to zero */
+  if (!status) {
+    if ((*pLine < 1) || (*pLine >= LONG_MAX)) {
+      *pLine = 0;
+    }
+  }
+  
+  /* Return mesh pointer or NULL */
+  return pM;
+}
+
+/*
+ * Interpret a Lilac mesh file that is held in memory.
+ * 
+ * This implements lilac_mesh_parse(), which calls it with a NULL
+ * stream.  If pStream is not NULL, the mesh is passed to its sink while
+ * it is interpreted, and the returned mesh has no triangle list.
+ * 
+ * Parameters:
+ * 
+ *   pBuf - the contents of the mesh file
+ * 
+ *   len - the size of the contents in bytes
+ * 
+ *   pStream - the stream, or NULL
+ * 
+ *   pErrCode - pointer to variable to receive the error code status of
+ *   the operation, or NULL
+ * 
+ *   pLine - pointer to variable to receive a line number, or NULL
+ * 
+ * Return:
+ * 
+ *   a new Lilac mesh object or NULL if failure
+ */
+static LILAC_MESH *bufParse(
+    const char        * pBuf,
+          size_t        len,
+          MESH_STREAM * pStream,
+          int         * pErrCode,
+          long        * pLine) {
+  
+  int status = 1;
+  int i_dummy = 0;
+  long l_dummy = 0;
+  
+  FILE *pf = NULL;
+  SNSOURCE *pSrc = NULL;
+  LILAC_MESH *pM = NULL;
+  
+  /* Check parameters */
+  if ((pBuf == NULL) && (len > 0)) {
+    abort();
+  }
+  
+  /* If optional parameter(s) not provided, redirect to dummy vars */
+  if (pErrCode == NULL) {
+    pErrCode = &i_dummy;
+  }
+  if (pLine == NULL) {
+    pLine = &l_dummy;
+  }
+  
+  /* Reset error and line codes */
+  *pErrCode = LILAC_MESH_ERR_OK;
+  *pLine = 0;
+  
+  /* Try the fast path first */
+  pM = fastParse(pBuf, len, pStream);
+  
+  /* If the fast path failed, open the buffer as a file, using an empty
+   * temporary file for an empty buffer, since memory streams can't be
+   * empty */
+  if (pM == NULL) {
+    if (len > 0) {
+      pf = fmemopen((void *) pBuf, len, "r");
+    } else {
+      pf = tmpfile();
+    }
+    if (pf == NULL) {
+      status = 0;
+      *pErrCode = LILAC_MESH_ERR_IO;
+    }
+    
+    /* Interpret the file with Shastina */
+    if (status) {
+      pSrc = snsource_file(pf, 1);
+      pf = NULL;
+      
+      pM = snParse(pSrc, pStream, pErrCode, pLine);
+      if (pM == NULL) {
+        status = 0;
+      }
+    }
+    
+    /* Consume the rest of input, making sure nothing remains */
+    if (status) {
+      if (snsource_consume(pSrc) <= 0) {
+        status = 0;
+        *pErrCode = LILAC_MESH_ERR_TRAIL;
+        *pLine = 0;
+      }
+    }
+    
+    /* Release the source, and the mesh if there was an error */
+    snsource_free(pSrc);
+    pSrc = NULL;
+    
+    if (!status) {
+      lilac_mesh_free(pM);
+      pM = NULL;
+    }
+  }
+  
+  /* Return mesh pointer or NULL */
+  return pM;
+}
+
+/*
+ * Read a whole text file into memory.
+ * 
+ * pPath is the path to the file.  If successful, *ppText receives a
+ * pointer to the contents of the file and *pSize receives the size of
+ * the contents in bytes.  The contents are NOT nul-terminated, and the
+ * pointer may be NULL if the file is empty.
+ * 
+ * Regular files are mapped into memory, so the contents are not
+ * copied.  Other files, such as pipes, and files that can't be mapped
+ * are read into a dynamically allocated buffer.  *pMapped receives
+ * non-zero if the file was mapped.  The contents must be released with
+ * freeText().
+ * 
+ * pErrCode points to the variable to receive the error code if the
+ * function fails.  It may not be NULL.
+ * 
+ * Parameters:
+ * 
+ *   pPath - the path to the file
+ * 
+ *   ppText - receives the contents of the file
+ * 
+ *   pSize - receives the size of the contents
+ * 
+ *   pMapped - receives whether the file was mapped
+ * 
+ *   pErrCode - pointer to the error status return
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int readText(
+    const char  *  pPath,
+    const char  ** ppText,
+          size_t * pSize,
+          int    * pMapped,
+          int    * pErrCode) {
+  
+  int status = 1;
+  int fd = -1;
+  void *pm = MAP_FAILED;
+  char *pBuf = NULL;
+  size_t buf_cap = 0;
+  size_t buf_len = 0;
+  ssize_t rc = 0;
+  struct stat st;
+  
+  /* Initialize structures */
+  memset(&st, 0, sizeof(struct stat));
+  
+  /* Check parameters */
+  if ((pPath == NULL) || (ppText == NULL) || (pSize == NULL) ||
+      (pMapped == NULL) || (pErrCode == NULL)) {
+    abort();
+  }
+  
+  /* Reset results */
+  *ppText = NULL;
+  *pSize = 0;
+  *pMapped = 0;
+  
+  /* Open the file and get its type and size */
+  fd = open(pPath, O_RDONLY);
+  if (fd < 0) {
+    status = 0;
+    *pErrCode = LILAC_MESH_ERR_OPEN;
+  }
+  
+  if (status) {
+    if (fstat(fd, &st)) {
+      status = 0;
+      *pErrCode = LILAC_MESH_ERR_IO;
+    }
+  }
+  
+  /* Map non-empty regular files that fit in memory */
+  if (status && S_ISREG(st.st_mode) && (st.st_size > 0) &&
+      ((uint64_t) st.st_size <= (uint64_t) SIZE_MAX)) {
+    pm = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (pm != MAP_FAILED) {
+      *ppText = (const char *) pm;
+      *pSize = (size_t) st.st_size;
+      *pMapped = 1;
+    }
+  }
+  
+  /* Otherwise, read the whole file into a buffer */
+  while (status && (!(*pMapped))) {
+    
+    /* Grow the buffer if it is full */
+    if (buf_len >= buf_cap) {
+      if (buf_cap < 1) {
+        buf_cap = 65536;
+      } else if (buf_cap <= SIZE_MAX / 2) {
+        buf_cap *= 2;
+      } else {
+        abort();
+      }
+      
+      pBuf = (char *) realloc(pBuf, buf_cap);
+      if (pBuf == NULL) {
+        abort();
+      }
+    }
+    
+    /* Read as much as fits */
+    rc = read(fd, pBuf + buf_len, buf_cap - buf_len);
+    if (rc > 0) {
+      buf_len += (size_t) rc;
+      
+    } else if (rc == 0) {
+      /* End of file */
+      *ppText = pBuf;
+      *pSize = buf_len;
+      break;
+      
+    } else if (errno != EINTR) {
+      status = 0;
+      *pErrCode = LILAC_MESH_ERR_IO;
+    }
+  }
+  
+  /* Release the buffer if error */
+  if ((!status) && (pBuf != NULL)) {
+    free(pBuf);
+    pBuf = NULL;
+  }
+  
+  /* Close the file if open; the mapping stays valid after closing */
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Release the contents of a file read with readText().
+ * 
+ * Parameters:
+ * 
+ *   pText - the contents of the file, or NULL
+ * 
+ *   size - the size of the contents
+ * 
+ *   mapped - non-zero if the file was mapped
+ */
+static void freeText(const char *pText, size_t size, int mapped) {
+  if (pText != NULL) {
+    if (mapped) {
+      munmap((void *) pText, size);
+    } else {
+      free((void *) pText);
+    }
+  }
+}
+
+/*
+ * Public function implementations
+ * -------------------------------
+ * 
+ * See the header for specifications
+ */
+
+/*
+ * lilac_mesh_new function.
+ */
+LILAC_MESH *lilac_mesh_new(SNSOURCE *pIn, int *pErrCode, long *pLine) {
+  return snParse(pIn, NULL, pErrCode, pLine);
+}
+
+/*
+ * lilac_mesh_parse function.
+ */
+LILAC_MESH *lilac_mesh_parse(
+    const char   * pBuf,
+          size_t   len,
+          int    * pErrCode,
+          long   * pLine) {
+  return bufParse(pBuf, len, NULL, pErrCode, pLine);
+}
+
+/*
+ * lilac_mesh_read function.
+ */
+LILAC_MESH *lilac_mesh_read(
+    const char * pPath,
+          int  * pErrCode,
+          long * pLine) {
+  
+  int status = 1;
+  int i_dummy = 0;
+  long l_dummy = 0;
+  
+  const char *pText = NULL;
+  size_t text_size = 0;
+  int mapped = 0;
+  
+  LILAC_MESH *pM = NULL;
+  
+  /* Check parameters */
+  if (pPath == NULL) {
+    abort();
+  }
+  
+  /* If optional parameter(s) not provided, redirect to dummy vars */
+  if (pErrCode == NULL) {
+    pErrCode = &i_dummy;
+  }
+  if (pLine == NULL) {
+    pLine = &l_dummy;
+  }
+  
+  /* Reset error and line codes */
+  *pErrCode = LILAC_MESH_ERR_OK;
+  *pLine = 0;
+  
+  /* Read the whole file */
+  if (!readText(pPath, &pText, &text_size, &mapped, pErrCode)) {
+    status = 0;
+  }
+  
+  /* Interpret the contents */
+  if (status) {
+    pM = lilac_mesh_parse(pText, text_size, pErrCode, pLine);
+  }
+  
+  /* Release the contents */
+  freeText(pText, text_size, mapped);
+  pText = NULL;
+  
+  /* Return mesh pointer or NULL */
+  return pM;
+}
+
+/*
+ * lilac_mesh_stream function.
+ */
+int lilac_mesh_stream(
+    const char            * pPath,
+    const LILAC_MESH_SINK * pSink,
+          int             * pErrCode,
+          long            * pLine) {
+  
+  int status = 1;
+  int i_dummy = 0;
+  long l_dummy = 0;
+  
+  const char *pText = NULL;
+  size_t text_size = 0;
+  int mapped = 0;
+  
+  LILAC_MESH *pM = NULL;
+  MESH_STREAM ms;
+  
+  /* Initialize structures */
+  memset(&ms, 0, sizeof(MESH_STREAM));
+  
+  /* Check parameters */
+  if ((pPath == NULL) || (pSink == NULL)) {
+    abort();
+  }
+  
+  /* If optional parameter(s) not provided, redirect to dummy vars */
+  if (pErrCode == NULL) {
+    pErrCode = &i_dummy;
+  }
+  if (pLine == NULL) {
+    pLine = &l_dummy;
+  }
+  
+  /* Reset error and line codes */
+  *pErrCode = LILAC_MESH_ERR_OK;
+  *pLine = 0;
+  
+  /* Read the whole file */
+  if (!readText(pPath, &pText, &text_size, &mapped, pErrCode)) {
+    status = 0;
+  }
+  
+  /* Interpret the contents, passing them to the sink */
+  if (status) {
+    ms.pSink = pSink;
+    ms.dim_sent = 0;
+    ms.points_sent = 0;
+    ms.tris_sent = 0;
+    
+    pM = bufParse(pText, text_size, &ms, pErrCode, pLine);
+    if (pM == NULL) {
+      status = 0;
+    }
+  }
+  
+  /* Release the mesh and the contents */
+  lilac_mesh_free(pM);
+  pM = NULL;
+  
+  freeText(pText, text_size, mapped);
+  pText = NULL;
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * lilac_mesh_load function.
+ */
+LILAC_MESH *lilac_mesh_load(const char *pPath, int *pErrCode) {
+  
+  int status = 1;
+  int i_dummy = 0;
+  int fd = -1;
+  void *pm = MAP_FAILED;
+  size_t msize = 0;
+  const uint32_t *ph = NULL;
+  const uint32_t *pt = NULL;
+  uint32_t point_count = 0;
+  uint32_t tri_count = 0;
+  size_t i = 0;
+  LILAC_MESH *pM = NULL;
+  struct stat st;
+  
+  /* Initialize structures */
+  memset(&st, 0, sizeof(struct stat));
+  
+  /* Check parameters */
+  if (pPath == NULL) {
+    abort();
+  }
+  
+  /* Points must be stored without padding */
+  if (sizeof(LILAC_MESH_POINT) != 4 * sizeof(uint16_t)) {
+    abort();
+  }
+  
+  /* If optional parameter not provided, redirect to dummy var */
+  if (pErrCode == NULL) {
+    pErrCode = &i_dummy;
+  }
+  *pErrCode = LILAC_MESH_ERR_OK;
+  
+  /* Open the file and get its size */
+  fd = open(pPath, O_RDONLY);
+  if (fd < 0) {
+    status = 0;
+    *pErrCode = LILAC_MESH_ERR_OPEN;
+  }
+  
+  if (status) {
+    if (fstat(fd, &st)) {
       status = 0;
-      *pErrCode = ent.status;
-      *pLine = snparser_count(pSn);
+      *pErrCode = LILAC_MESH_ERR_IO;
     }
-    
-    /* If we got here successfully, we read the EOF token, so make sure
-     * that stack is empty and everything has been written */
-    if (status && (st_count > 0)) {
+  }
+  
+  if (status) {
+    if ((st.st_size <
+            (off_t) (LILAC_MESH_BIN_HEADER * sizeof(uint32_t))) ||
+        ((uint64_t) st.st_size > UINT32_MAX)) {
       status = 0;
-      *pErrCode = LILAC_MESH_ERR_REM;
-      *pLine = 0;
+      *pErrCode = LILAC_MESH_ERR_BIN;
+    } else {
+      msize = (size_t) st.st_size;
     }
-    
-    if (status && (points_written != point_count)) {
+  }
+  
+  /* Map the whole file privately, so that the arrays can be written
+   * without changing the file; the mapping stays valid after the file
+   * is closed */
+  if (status) {
+    pm = mmap(NULL, msize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (pm == MAP_FAILED) {
       status = 0;
-      *pErrCode = LILAC_MESH_ERR_PUNDEF;
-      *pLine = 0;
+      *pErrCode = LILAC_MESH_ERR_IO;
     }
-    
-    if (status && (tris_written != tri_count)) {
+  }
+  
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+  
+  /* Check the magic value, the byte order, the version, and the
+   * checksum */
+  if (status) {
+    ph = (const uint32_t *) pm;
+    if (ph[0] != LILAC_MESH_BIN_MAGIC) {
       status = 0;
-      *pErrCode = LILAC_MESH_ERR_TUNDEF;
-      *pLine = 0;
+      if (ph[0] == ((LILAC_MESH_BIN_MAGIC >> 24) |
+                    ((LILAC_MESH_BIN_MAGIC >> 8) & UINT32_C(0xff00)) |
+                    ((LILAC_MESH_BIN_MAGIC << 8) & UINT32_C(0xff0000)) |
+                    (LILAC_MESH_BIN_MAGIC << 24))) {
+        *pErrCode = LILAC_MESH_ERR_BYTE;
+      } else {
+        *pErrCode = LILAC_MESH_ERR_BIN;
+      }
     }
-    
-    /* Check for orphan points */
-    if (status && usage_map_orphan(&um)) {
+  }
+  
+  if (status) {
+    if ((ph[1] != LILAC_MESH_BIN_VERSION) ||
+        (ph[LILAC_MESH_BIN_HEADER - 1] != binChecksum(ph))) {
       status = 0;
-      *pErrCode = LILAC_MESH_ERR_ORPHAN;
-      *pLine = 0;
+      *pErrCode = LILAC_MESH_ERR_BIN;
     }
   }
-
-  /* Reset usage map to release any memory */
-  usage_map_reset(&um);
   
-  /* Free parser if allocated */
-  snparser_free(pSn);
-  pSn = NULL;
+  /* Check the counts against the limits and the size of the file; a
+   * mesh with points must also have triangles, or the points would be
+   * orphans */
+  if (status) {
+    point_count = ph[2];
+    tri_count = ph[3];
+    if ((point_count > LILAC_MESH_MAX_POINTS) ||
+        (tri_count > LILAC_MESH_MAX_TRIS) ||
+        ((point_count > 0) && (tri_count < 1)) ||
+        ((uint64_t) ph[4] != binSize(point_count, tri_count)) ||
+        ((uint64_t) msize != binSize(point_count, tri_count))) {
+      status = 0;
+      *pErrCode = LILAC_MESH_ERR_BIN;
+    }
+  }
   
-  /* If failure and mesh allocated, release it */
-  if (!status) {
-    lilac_mesh_free(pM);
-    pM = NULL;
+  /* Every vertex index must refer to a point, so that the triangle list
+   * can be used safely */
+  if (status) {
+    pt = (const uint32_t *) (((const unsigned char *) pm) +
+            (LILAC_MESH_BIN_HEADER * sizeof(uint32_t)) +
+            (((size_t) point_count) * sizeof(LILAC_MESH_POINT)));
+    for(i = 0; i < ((size_t) tri_count) * 3; i++) {
+      if (pt[i] >= point_count) {
+        status = 0;
+        *pErrCode = LILAC_MESH_ERR_BIN;
+        break;
+      }
+    }
   }
   
-  /* If failure, make sure line count is valid else set to zero */
-  if (!status) {
-    if ((*pLine < 1) || (*pLine >= LONG_MAX)) {
-      *pLine = 0;
+  /* Allocate the mesh structure with its arrays pointing into the
+   * mapping */
+  if (status) {
+    pM = (LILAC_MESH *) malloc(sizeof(LILAC_MESH));
+    if (pM == NULL) {
+      abort();
+    }
+    memset(pM, 0, sizeof(LILAC_MESH));
+    
+    pM->point_count = (int32_t) point_count;
+    pM->tri_count = (int32_t) tri_count;
+    
+    pM->pPoints = NULL;
+    pM->pTris = NULL;
+    if (point_count > 0) {
+      pM->pPoints = (LILAC_MESH_POINT *) (((unsigned char *) pm) +
+                      (LILAC_MESH_BIN_HEADER * sizeof(uint32_t)));
+    }
+    if (tri_count > 0) {
+      pM->pTris = (uint32_t *) pt;
     }
+    
+    pM->pMap = pm;
+    pM->map_size = msize;
+  }
+  
+  /* Unmap the file if there was an error */
+  if ((!status) && (pm != MAP_FAILED)) {
+    munmap(pm, msize);
+    pm = MAP_FAILED;
   }
   
   /* Return mesh pointer or NULL */
   return pM;
 }
 
+/*
+ * lilac_mesh_save function.
+ */
+int lilac_mesh_save(
+    const LILAC_MESH * pLm,
+    const char       * pPath,
+          int        * pErrCode) {
+  
+  int status = 1;
+  int i_dummy = 0;
+  FILE *pf = NULL;
+  uint32_t hdr[LILAC_MESH_BIN_HEADER];
+  
+  /* Initialize buffers */
+  memset(hdr, 0, sizeof(hdr));
+  
+  /* Check parameters */
+  if ((pLm == NULL) || (pPath == NULL)) {
+    abort();
+  }
+  if ((pLm->point_count < 0) ||
+      (pLm->point_count > LILAC_MESH_MAX_POINTS) ||
+      (pLm->tri_count < 0) ||
+      (pLm->tri_count > LILAC_MESH_MAX_TRIS) ||
+      ((pLm->point_count > 0) && (pLm->pPoints == NULL)) ||
+      ((pLm->tri_count > 0) && (pLm->pTris == NULL))) {
+    abort();
+  }
+  
+  /* Points must be stored without padding */
+  if (sizeof(LILAC_MESH_POINT) != 4 * sizeof(uint16_t)) {
+    abort();
+  }
+  
+  /* If optional parameter not provided, redirect to dummy var */
+  if (pErrCode == NULL) {
+    pErrCode = &i_dummy;
+  }
+  *pErrCode = LILAC_MESH_ERR_OK;
+  
+  /* Fill in the header */
+  hdr[0] = LILAC_MESH_BIN_MAGIC;
+  hdr[1] = LILAC_MESH_BIN_VERSION;
+  hdr[2] = (uint32_t) pLm->point_count;
+  hdr[3] = (uint32_t) pLm->tri_count;
+  hdr[4] = (uint32_t) binSize(hdr[2], hdr[3]);
+  hdr[LILAC_MESH_BIN_HEADER - 1] = binChecksum(hdr);
+  
+  /* Open the file for writing */
+  pf = fopen(pPath, "wb");
+  if (pf == NULL) {
+    status = 0;
+    *pErrCode = LILAC_MESH_ERR_OPEN;
+  }
+  
+  /* Write the header, the points, and the triangles */
+  if (status) {
+    if (fwrite(hdr, sizeof(uint32_t), LILAC_MESH_BIN_HEADER, pf) !=
+          LILAC_MESH_BIN_HEADER) {
+      status = 0;
+      *pErrCode = LILAC_MESH_ERR_IO;
+    }
+  }
+  
+  if (status && (pLm->point_count > 0)) {
+    if (fwrite(pLm->pPoints, sizeof(LILAC_MESH_POINT),
+                (size_t) pLm->point_count, pf) !=
+          (size_t) pLm->point_count) {
+      status = 0;
+      *pErrCode = LILAC_MESH_ERR_IO;
+    }
+  }
+  
+  if (status && (pLm->tri_count > 0)) {
+    if (fwrite(pLm->pTris, sizeof(uint32_t),
+                ((size_t) pLm->tri_count) * 3, pf) !=
+          ((size_t) pLm->tri_count) * 3) {
+      status = 0;
+      *pErrCode = LILAC_MESH_ERR_IO;
+    }
+  }
+  
+  /* Close the file */
+  if (pf != NULL) {
+    if (fclose(pf)) {
+      if (status) {
+        status = 0;
+        *pErrCode = LILAC_MESH_ERR_IO;
+      }
+    }
+    pf = NULL;
+  }
+  
+  /* Return status */
+  return status;
+}
+
 /*
  * lilac_mesh_free function.
  */
@@ -1297,6 +2758,15 @@ void lilac_mesh_free(LILAC_MESH *pLm) {
   
   /* Only proceed if non-NULL value passed */
   if (pLm != NULL) {
+    
+    /* Release the mapping if the arrays point into one */
+    if (pLm->pMap != NULL) {
+      munmap(pLm->pMap, pLm->map_size);
+      pLm->pMap = NULL;
+      pLm->map_size = 0;
+      pLm->pPoints = NULL;
+      pLm->pTris = NULL;
+    }
   
     /* Free the arrays if allocated */
     if (pLm->pPoints != NULL) {
@@ -1428,6 +2898,35 @@ const char *lilac_mesh_errstr(int code) {
       pResult = "Same directed triangle edge used more than once";
       break;
     
+    case LILAC_MESH_ERR_TROVER:
+      pResult =
+        "More triangles defined than were declared in dimensions";
+      break;
+    
+    case LILAC_MESH_ERR_PTPARM:
+      pResult = "Point parameter is out of coordinate range";
+      break;
+    
+    case LILAC_MESH_ERR_OPEN:
+      pResult = "Can't open mesh file";
+      break;
+    
+    case LILAC_MESH_ERR_IO:
+      pResult = "I/O error on mesh file";
+      break;
+    
+    case LILAC_MESH_ERR_BIN:
+      pResult = "Not a valid binary mesh file";
+      break;
+    
+    case LILAC_MESH_ERR_BYTE:
+      pResult = "Binary mesh file has the wrong byte order";
+      break;
+    
+    case LILAC_MESH_ERR_TRAIL:
+      pResult = "Input remains after the |; marker";
+      break;
+    
     default:
       if (code < 0) {
         pResult = snerror_str(code);
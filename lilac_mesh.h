@@ -7,7 +7,38 @@
  * 
  * Lilac module for parsing a Shastina mesh file into memory.
  * 
+ * Meshes can also be saved to and loaded from a binary mesh file with
+ * lilac_mesh_save() and lilac_mesh_load().  A binary mesh file holds
+ * the point and triangle arrays exactly as they are laid out in memory,
+ * so loading one maps the file into memory instead of parsing it, and
+ * large meshes load in about the time it takes to page them in.
+ * 
+ * All values in a binary mesh file are in the byte order of the machine
+ * that saved it:
+ * 
+ *   (1) A header of LILAC_MESH_BIN_HEADER 32-bit unsigned integers,
+ *       which are the magic value LILAC_MESH_BIN_MAGIC, the format
+ *       version LILAC_MESH_BIN_VERSION, the point count, the triangle
+ *       count, the total size of the file in bytes, reserved words that
+ *       are zero, and in the last word an FNV-1a checksum of the bytes
+ *       of all the other header words.
+ * 
+ *   (2) The points, each of which is four 16-bit unsigned integers in
+ *       the order of the fields of LILAC_MESH_POINT.
+ * 
+ *   (3) The triangle list, each element of which is a 32-bit unsigned
+ *       integer, three elements per triangle.
+ * 
+ * Files saved on a machine with a different byte order are rejected.
+ * The header is validated and each vertex index is checked against the
+ * point count when a binary mesh is loaded, but the other rules of the
+ * mesh format are not checked again.  Binary mesh files should only be
+ * saved from meshes that were read with lilac_mesh_new() or
+ * lilac_mesh_read(), and they should not be modified afterwards.
+ * 
  * This module must be compiled together with the Shastina library.
+ * Loading binary mesh files requires mmap(), so this module also
+ * requires a POSIX platform.
  */
 
 /*
@@ -61,6 +92,12 @@
 #define LILAC_MESH_ERR_TRSORT (24)  /* Invalid triangle sorting */
 #define LILAC_MESH_ERR_DUPEDG (25)  /* Duplicated directed edge */
 #define LILAC_MESH_ERR_TROVER (26)  /* Too many triangles defined */
+#define LILAC_MESH_ERR_PTPARM (27)  /* Point parameter out of range */
+#define LILAC_MESH_ERR_OPEN   (28)  /* Can't open file */
+#define LILAC_MESH_ERR_IO     (29)  /* I/O error */
+#define LILAC_MESH_ERR_BIN    (30)  /* Not a valid binary mesh */
+#define LILAC_MESH_ERR_BYTE   (31)  /* Wrong byte order */
+#define LILAC_MESH_ERR_TRAIL  (32)  /* Input remains after |; */
 
 /*
  * Constants
@@ -77,21 +114,31 @@
 /*
  * The maximum number of points that may be in a mesh.
  * 
- * This must be in unsigned 16-bit range.  It must also not exceed the
- * value of LILAC_MESH_MAX_C.
+ * This must not exceed 2^20, which is the largest numeric literal
+ * allowed in a mesh file.
  * 
- * To check for unique edges, a bitmap is constructed that has as many
- * bits as this constant value squared, so be careful not to set this
- * too high.
+ * Unique edges are checked with a hash set that is sized by the number
+ * of triangles, so this limit does not affect memory use.
  */
-#define LILAC_MESH_MAX_POINTS (1024)
+#define LILAC_MESH_MAX_POINTS (1048576L)
 
 /*
  * The maximum number of triangles that may be in a mesh.
  * 
- * It must not exceed the value of LILAC_MESH_MAX_C.
+ * This must not exceed 2^20, which is the largest numeric literal
+ * allowed in a mesh file.
+ */
+#define LILAC_MESH_MAX_TRIS (1048576L)
+
+/*
+ * Constants of the binary mesh format.
+ * 
+ * The header size is in 32-bit words.  See the top of this header for
+ * the layout of the file.
  */
-#define LILAC_MESH_MAX_TRIS (1024)
+#define LILAC_MESH_BIN_MAGIC   UINT32_C(0x4c4d5348)
+#define LILAC_MESH_BIN_VERSION (1)
+#define LILAC_MESH_BIN_HEADER  (8)
 
 /*
  * Type declarations
@@ -179,8 +226,9 @@ typedef struct {
    * If point_count is zero, then this pointer must be NULL.  Otherwise,
    * this pointer must be non-NULL.
    * 
-   * If non-NULL, the memory indicated by this pointer is dynamically
-   * allocated and owned by the mesh structure.
+   * If non-NULL, the memory indicated by this pointer is owned by the
+   * mesh structure.  It is either dynamically allocated or part of the
+   * mapping of a binary mesh file; see pMap.
    * 
    * Each point in this array must be referenced from at least one
    * triangle in the triangle list.
@@ -202,8 +250,9 @@ typedef struct {
    * If tri_count is zero, then this pointer must be NULL.  Otherwise,
    * this pointer must be non-NULL.
    * 
-   * If non-NULL, the memory indicated by this pointer is dynamically
-   * allocated and owned by the mesh structure.
+   * If non-NULL, the memory indicated by this pointer is owned by the
+   * mesh structure.  It is either dynamically allocated or part of the
+   * mapping of a binary mesh file; see pMap.
    * 
    * Within each triangle, all three vertices must be to different
    * points, and the first vertex must be the vertex with the lowest
@@ -224,7 +273,7 @@ typedef struct {
    * two triangles are allowed to have the same directed edge, there is
    * no need to reference the third vertex during sorting.
    */
-  uint16_t *pTris;
+  uint32_t *pTris;
   
   /*
    * The total number of point structures in the pPoints array.
@@ -244,8 +293,59 @@ typedef struct {
    */
   int32_t tri_count;
   
+  /*
+   * The mapping of the binary mesh file that the arrays point into.
+   * 
+   * This is NULL unless the mesh was loaded with lilac_mesh_load(), in
+   * which case the arrays are not separately allocated, and map_size is
+   * the size of the mapping in bytes.  The mapping is private, so
+   * changes to the arrays are not written back to the file.
+   */
+  void *pMap;
+  size_t map_size;
+  
 } LILAC_MESH;
 
+/*
+ * Structure receiving a Lilac mesh while it is interpreted.
+ * 
+ * See lilac_mesh_stream().  Any of the function pointers may be NULL if
+ * the client does not need that part of the mesh.
+ */
+typedef struct {
+  
+  /*
+   * Custom data passed to each of the functions.
+   */
+  void *pCustom;
+  
+  /*
+   * Receive the point and triangle counts declared in the header.
+   * 
+   * This is called once, before any points or triangles.
+   */
+  void (*fDim)(void *pCustom, int32_t point_count, int32_t tri_count);
+  
+  /*
+   * Receive a point.
+   * 
+   * i is the index of the point.  Points are received in order of their
+   * indices.  The point structure is only valid during the call.
+   */
+  void (*fPoint)(void *pCustom, int32_t i, const LILAC_MESH_POINT *pp);
+  
+  /*
+   * Receive a triangle.
+   * 
+   * i is the index of the triangle, and pt points to its three vertex
+   * indices.  Triangles are received in order of their indices, after
+   * all the points that they reference.  The vertex indices are only
+   * valid during the call.
+   */
+  void (*fTri)(void *pCustom, int32_t i, const uint32_t *pt);
+  
+} LILAC_MESH_SINK;
+
 /*
  * Public functions
  * ----------------
@@ -306,10 +406,180 @@ typedef struct {
  */
 LILAC_MESH *lilac_mesh_new(SNSOURCE *pIn, int *pErrCode, long *pLine);
 
+/*
+ * Interpret a Lilac mesh file that is held in memory.
+ * 
+ * pBuf points to the contents of the mesh file and len is their size
+ * in bytes.  The contents do not need to be nul-terminated, and pBuf
+ * may be NULL if len is zero.  The buffer remains owned by the caller.
+ * 
+ * Unlike lilac_mesh_new(), this function also checks that nothing but
+ * whitespace follows the |; marker, and reports LILAC_MESH_ERR_TRAIL
+ * otherwise.
+ * 
+ * Most mesh files only use a small subset of Shastina, which this
+ * function recognizes directly from the buffer.  Anything outside that
+ * subset, such as comments or carriage returns, and any mesh that has
+ * an error, is interpreted with lilac_mesh_new() instead.  Apart from
+ * the check for trailing input, the results, including error codes and
+ * line numbers, are always the same as interpreting the buffer with
+ * lilac_mesh_new().
+ * 
+ * pErrCode and pLine work the same way as for lilac_mesh_new().  The
+ * error code may also be LILAC_MESH_ERR_IO if the buffer couldn't be
+ * opened as a stream for Shastina.
+ * 
+ * Parameters:
+ * 
+ *   pBuf - the contents of the mesh file
+ * 
+ *   len - the size of the contents in bytes
+ * 
+ *   pErrCode - pointer to variable to receive the error code status of
+ *   the operation, or NULL
+ * 
+ *   pLine - pointer to variable to receive a line number, or NULL
+ * 
+ * Return:
+ * 
+ *   a new Lilac mesh object or NULL if failure
+ */
+LILAC_MESH *lilac_mesh_parse(
+    const char   * pBuf,
+          size_t   len,
+          int    * pErrCode,
+          long   * pLine);
+
+/*
+ * Read a Lilac mesh file from a path.
+ * 
+ * The whole file is read into memory, mapping it if it is a regular
+ * file, and then interpreted with lilac_mesh_parse().  This is the
+ * fastest way to read a Shastina mesh file.
+ * 
+ * pErrCode and pLine work the same way as for lilac_mesh_parse().  The
+ * error code may also be LILAC_MESH_ERR_OPEN if the file can't be
+ * opened, or LILAC_MESH_ERR_IO if it can't be read.
+ * 
+ * Parameters:
+ * 
+ *   pPath - path to the mesh file
+ * 
+ *   pErrCode - pointer to variable to receive the error code status of
+ *   the operation, or NULL
+ * 
+ *   pLine - pointer to variable to receive a line number, or NULL
+ * 
+ * Return:
+ * 
+ *   a new Lilac mesh object or NULL if failure
+ */
+LILAC_MESH *lilac_mesh_read(
+    const char * pPath,
+          int  * pErrCode,
+          long * pLine);
+
+/*
+ * Read a Lilac mesh file from a path and pass it to a sink while it is
+ * interpreted.
+ * 
+ * This works like lilac_mesh_read(), except that no mesh object is
+ * returned.  Instead, the dimensions, the points, and the triangles are
+ * passed to the functions of pSink in the order they appear in the
+ * file.  Only the points are kept in memory while interpreting, since
+ * triangles are checked against them; the triangle list is not kept.
+ * 
+ * Each part of the mesh is passed to the sink as soon as it has been
+ * checked, so the sink receives part of the mesh before errors later in
+ * the file are found.  If this function fails, the client must discard
+ * whatever the sink received.
+ * 
+ * pErrCode and pLine work the same way as for lilac_mesh_read().
+ * 
+ * Parameters:
+ * 
+ *   pPath - path to the mesh file
+ * 
+ *   pSink - the sink to pass the mesh to
+ * 
+ *   pErrCode - pointer to variable to receive the error code status of
+ *   the operation, or NULL
+ * 
+ *   pLine - pointer to variable to receive a line number, or NULL
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if failure
+ */
+int lilac_mesh_stream(
+    const char            * pPath,
+    const LILAC_MESH_SINK * pSink,
+          int             * pErrCode,
+          long            * pLine);
+
+/*
+ * Load a Lilac mesh object from a binary mesh file.
+ * 
+ * pPath is the path to the binary mesh file, which is mapped into
+ * memory.  See the top of this header for the format.  The mapping is
+ * released by lilac_mesh_free().
+ * 
+ * pErrCode, if not NULL, points to a variable to receive the error code
+ * status upon return.  If the function is successful, a value of
+ * LILAC_MESH_ERR_OK (zero) will be written into the variable.
+ * Otherwise, the value is LILAC_MESH_ERR_OPEN, LILAC_MESH_ERR_IO,
+ * LILAC_MESH_ERR_BIN, or LILAC_MESH_ERR_BYTE.
+ * 
+ * Parameters:
+ * 
+ *   pPath - path to the binary mesh file
+ * 
+ *   pErrCode - pointer to variable to receive the error code status of
+ *   the operation, or NULL
+ * 
+ * Return:
+ * 
+ *   a new Lilac mesh object or NULL if failure
+ */
+LILAC_MESH *lilac_mesh_load(const char *pPath, int *pErrCode);
+
+/*
+ * Save a Lilac mesh object to a binary mesh file.
+ * 
+ * pPath is the path of the file to write, which is overwritten if it
+ * already exists.  See the top of this header for the format.  The mesh
+ * object should have been read with lilac_mesh_new(),
+ * lilac_mesh_read(), or lilac_mesh_load(), so that it follows all the
+ * rules of the mesh format.
+ * 
+ * pErrCode, if not NULL, points to a variable to receive the error code
+ * status upon return.  If the function is successful, a value of
+ * LILAC_MESH_ERR_OK (zero) will be written into the variable.
+ * Otherwise, the value is LILAC_MESH_ERR_OPEN or LILAC_MESH_ERR_IO.
+ * 
+ * Parameters:
+ * 
+ *   pLm - the mesh object to save
+ * 
+ *   pPath - path to the binary mesh file to write
+ * 
+ *   pErrCode - pointer to variable to receive the error code status of
+ *   the operation, or NULL
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+int lilac_mesh_save(
+    const LILAC_MESH * pLm,
+    const char       * pPath,
+          int        * pErrCode);
+
 /*
  * Free an allocated Lilac mesh object.
  * 
- * If NULL is passed, the call is ignored.
+ * If NULL is passed, the call is ignored.  If the mesh was loaded from
+ * a binary mesh file, the mapping of the file is released.
  * 
  * Parameters:
  * 
@@ -0,0 +1,187 @@
+#ifndef LILAC_PLUGIN_H_INCLUDED
+#define LILAC_PLUGIN_H_INCLUDED
+
+/*
+ * lilac_plugin.h
+ * 
+ * Application binary interface for Lilac shader plugins.
+ * 
+ * A shader plugin is a shared object that provides procedural textures
+ * as compiled C code.  This header is the only part of Lilac that a
+ * plugin needs; it does not link against anything in Lilac.
+ * 
+ * A plugin exports one function with C linkage named
+ * lilac_plugin_query, which has the type LILAC_PLUGIN_QUERY_FN.  Lilac
+ * calls it with the name of a shader and the ABI version of the host.
+ * The plugin returns a pointer to a static LILAC_PLUGIN_SHADER
+ * structure describing the shader, or NULL if it does not have a shader
+ * with that name or does not support the host version.  The returned
+ * structure must remain valid until the plugin is unloaded.
+ * 
+ * The life cycle of a shader is:
+ * 
+ *   (1) fInit is called once, before anything else, and may create
+ *       shared data that is passed to the other functions.
+ * 
+ *   (2) fThreadInit is called to create a context for each thread
+ *       that will evaluate the shader.  Each context is only ever used
+ *       by one thread at a time, but different contexts may be used at
+ *       the same time on different threads.
+ * 
+ *   (3) fSpan is called any number of times with a context to evaluate
+ *       spans of pixels.
+ * 
+ *   (4) fThreadFree is called for each context when it is no longer
+ *       needed.
+ * 
+ *   (5) fTeardown is called once, after everything else.
+ * 
+ * Any of the function pointers except fSpan may be NULL if the shader
+ * has nothing to do at that point.  fInit and fTeardown are only ever
+ * called from one thread.
+ * 
+ * Pixels are packed ARGB values with premultiplied alpha, the same as
+ * the values returned by Lua shaders.
+ * 
+ * A minimal plugin looks like this:
+ * 
+ *   #include <string.h>
+ *   #include "lilac_plugin.h"
+ * 
+ *   static int stripes(void *pCtx, int32_t x, int32_t y,
+ *                       int32_t count, int32_t width, int32_t height,
+ *                       uint32_t *pOut) {
+ *     int32_t i = 0;
+ *     for(i = 0; i < count; i++) {
+ *       pOut[i] = (((x + i) / 4) & 1) ? 0xff000000 : 0;
+ *     }
+ *     return 1;
+ *   }
+ * 
+ *   static const LILAC_PLUGIN_SHADER m_stripes = {
+ *     LILAC_PLUGIN_ABI_VERSION, LILAC_PLUGIN_PURE, 8, 1,
+ *     NULL, NULL, NULL, NULL, &stripes
+ *   };
+ * 
+ *   const LILAC_PLUGIN_SHADER *lilac_plugin_query(
+ *       const char *pName, uint32_t version) {
+ *     if ((version == LILAC_PLUGIN_ABI_VERSION) &&
+ *         (strcmp(pName, "stripes") == 0)) {
+ *       return &m_stripes;
+ *     }
+ *     return NULL;
+ *   }
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The version of the ABI described by this header.
+ * 
+ * This is incremented whenever the structures or the calling
+ * conventions change in an incompatible way.
+ */
+#define LILAC_PLUGIN_ABI_VERSION (1)
+
+/*
+ * The name of the query function that plugins export.
+ */
+#define LILAC_PLUGIN_QUERY_NAME "lilac_plugin_query"
+
+/*
+ * Shader flags.
+ * 
+ * LILAC_PLUGIN_RANDOM means that the shader does not depend on the
+ * order in which spans are requested.  Without this flag, spans on each
+ * context are requested in left-to-right and then top-to-bottom order
+ * without overlapping, starting over at the top-left corner for each
+ * new image.
+ * 
+ * LILAC_PLUGIN_PURE means that the shader only depends on the
+ * coordinates modulo the period given in the shader structure, and not
+ * on the image dimensions or any state kept between calls.  Lilac may
+ * then evaluate one period at startup and use it like an image texture.
+ * Pure shaders are also random-access.
+ */
+#define LILAC_PLUGIN_RANDOM (UINT32_C(0x1))
+#define LILAC_PLUGIN_PURE   (UINT32_C(0x2))
+
+/*
+ * Description of a shader provided by a plugin.
+ */
+typedef struct {
+  
+  /*
+   * Must be LILAC_PLUGIN_ABI_VERSION.
+   */
+  uint32_t version;
+  
+  /*
+   * Combination of the LILAC_PLUGIN flags.
+   */
+  uint32_t flags;
+  
+  /*
+   * The period of a pure shader, each in range one up to and including
+   * 2048.  Ignored if the shader is not pure.
+   */
+  int32_t period_w;
+  int32_t period_h;
+  
+  /*
+   * Initialize the shader.
+   *
+   * *ppShared may be set to shared data, which is passed to the other
+   * functions.  It starts out as NULL.  Return non-zero if successful,
+   * zero if the shader can't be used.
+   */
+  int (*fInit)(void **ppShared);
+  
+  /*
+   * Release the shared data.
+   */
+  void (*fTeardown)(void *pShared);
+  
+  /*
+   * Create a context for one thread.
+   *
+   * Return the context, which may be any non-NULL pointer, or NULL if
+   * the context could not be created.  If this function pointer is
+   * NULL, every context is the shared data pointer.
+   */
+  void *(*fThreadInit)(void *pShared);
+  
+  /*
+   * Release a context created by fThreadInit.
+   */
+  void (*fThreadFree)(void *pCtx);
+  
+  /*
+   * Evaluate a span of pixels.
+   *
+   * Write the pixels from (x, y) up to but excluding (x + count, y) to
+   * pOut.  width and height are the dimensions of the output image, and
+   * the whole span is always inside the image.  count is at least one.
+   *
+   * Return non-zero if successful, zero if the shader failed.
+   */
+  int (*fSpan)(
+      void     * pCtx,
+      int32_t    x,
+      int32_t    y,
+      int32_t    count,
+      int32_t    width,
+      int32_t    height,
+      uint32_t * pOut);
+  
+} LILAC_PLUGIN_SHADER;
+
+/*
+ * The type of the lilac_plugin_query function.
+ */
+typedef const LILAC_PLUGIN_SHADER *(*LILAC_PLUGIN_QUERY_FN)(
+    const char * pName,
+    uint32_t     version);
+
+#endif
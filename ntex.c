@@ -0,0 +1,1022 @@
+/*
+ * ntex.c
+ * 
+ * Implementation of ntex.h
+ * 
+ * See the header for further information.
+ */
+
+#include "ntex.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Constants
+ * =========
+ */
+
+/*
+ * Native texture kinds.
+ */
+#define NTEX_GRADIENT (0)
+#define NTEX_NOISE    (1)
+#define NTEX_PERLIN   (2)
+#define NTEX_GRAIN    (3)
+#define NTEX_HATCH    (4)
+#define NTEX_DITHER   (5)
+#define NTEX_SIMPLEX  (6)
+
+/*
+ * The number of native texture kinds.
+ */
+#define NTEX_KINDS (7)
+
+/*
+ * Pi, for converting degrees.
+ */
+#define NTEX_PI (3.14159265358979323846)
+
+/*
+ * The skewing and unskewing factors of the simplex lattice, which are
+ * (sqrt(3) - 1) / 2 and (3 - sqrt(3)) / 6.
+ */
+#define NTEX_SKEW   (0.36602540378443864676)
+#define NTEX_UNSKEW (0.21132486540518711775)
+
+/*
+ * The factor that scales simplex noise to approximately plus or minus
+ * one.
+ */
+#define NTEX_SIMPLEX_SCALE (99.0)
+
+/*
+ * Type declarations
+ * =================
+ */
+
+/*
+ * Definition of a native texture kind.
+ */
+typedef struct {
+  
+  /*
+   * The name used to select the kind.
+   */
+  const char *pName;
+  
+  /*
+   * The number of parameters.
+   */
+  int pcount;
+  
+  /*
+   * The default value, the minimum value, and the maximum value of each
+   * parameter.
+   */
+  double def[NTEX_MAXPARAM];
+  double lo[NTEX_MAXPARAM];
+  double hi[NTEX_MAXPARAM];
+  
+  /*
+   * Bit i is set if parameter i must be an integer.
+   */
+  int whole;
+  
+} NTEXDEF;
+
+/*
+ * An added native texture.
+ */
+typedef struct {
+  
+  /*
+   * One of the NTEX_ kind constants.
+   */
+  int kind;
+  
+  /*
+   * Values derived from the parameters when the texture is added.
+   *
+   * For gradient, dx and dy are the direction and a0 and a1 the alpha
+   * range.  For the noise textures, inv is one over the scale.  The
+   * integer parameters of the other textures are kept in seed, s, t,
+   * and dir.
+   */
+  double dx;
+  double dy;
+  double a0;
+  double a1;
+  double inv;
+  uint32_t seed;
+  int32_t s;
+  int32_t t;
+  int dir;
+  
+} NTEX;
+
+/*
+ * Local data
+ * ==========
+ */
+
+/*
+ * The native texture kinds, indexed by kind constant.
+ */
+static const NTEXDEF m_def[NTEX_KINDS] = {
+  {"gradient", 3, {0.0, 0.0, 255.0, 0.0},
+                  {-360.0, 0.0, 0.0, 0.0},
+                  {360.0, 255.0, 255.0, 0.0}, 0},
+  {"noise",    2, {16.0, 0.0, 0.0, 0.0},
+                  {1.0, 0.0, 0.0, 0.0},
+                  {4096.0, 4294967295.0, 0.0, 0.0}, 2},
+  {"perlin",   2, {16.0, 0.0, 0.0, 0.0},
+                  {1.0, 0.0, 0.0, 0.0},
+                  {4096.0, 4294967295.0, 0.0, 0.0}, 2},
+  {"grain",    2, {64.0, 0.0, 0.0, 0.0},
+                  {0.0, 0.0, 0.0, 0.0},
+                  {255.0, 4294967295.0, 0.0, 0.0}, 3},
+  {"hatch",    3, {8.0, 1.0, 0.0, 0.0},
+                  {1.0, 0.0, 0.0, 0.0},
+                  {(double) NTEX_MAXPERIOD, (double) NTEX_MAXPERIOD,
+                    3.0, 0.0}, 7},
+  {"dither",   1, {128.0, 0.0, 0.0, 0.0},
+                  {0.0, 0.0, 0.0, 0.0},
+                  {255.0, 0.0, 0.0, 0.0}, 1},
+  {"simplex",  2, {16.0, 0.0, 0.0, 0.0},
+                  {1.0, 0.0, 0.0, 0.0},
+                  {4096.0, 4294967295.0, 0.0, 0.0}, 2}
+};
+
+/*
+ * Unit gradient directions of the gradient noise textures, selected by
+ * the low three bits of a lattice hash.
+ */
+static const double m_gx[8] = {
+  1.0, 0.70710678118654752, 0.0, -0.70710678118654752,
+  -1.0, -0.70710678118654752, 0.0, 0.70710678118654752
+};
+static const double m_gy[8] = {
+  0.0, 0.70710678118654752, 1.0, 0.70710678118654752,
+  0.0, -0.70710678118654752, -1.0, -0.70710678118654752
+};
+
+/*
+ * The 8 by 8 Bayer matrix for ordered dithering.
+ */
+static const unsigned char m_bayer[8][8] = {
+  { 0, 32,  8, 40,  2, 34, 10, 42},
+  {48, 16, 56, 24, 50, 18, 58, 26},
+  {12, 44,  4, 36, 14, 46,  6, 38},
+  {60, 28, 52, 20, 62, 30, 54, 22},
+  { 3, 35, 11, 43,  1, 33,  9, 41},
+  {51, 19, 59, 27, 49, 17, 57, 25},
+  {15, 47,  7, 39, 13, 45,  5, 37},
+  {63, 31, 55, 23, 61, 29, 53, 21}
+};
+
+/*
+ * The added native textures.
+ * 
+ * m_ntex_count is the number of textures that have been added.
+ */
+static NTEX m_ntex[NTEX_MAXCOUNT];
+static int m_ntex_count = 0;
+
+/*
+ * Local functions
+ * ===============
+ */
+
+/* Prototypes */
+static int ntex_kind(const char *pName);
+static int ntex_parse(const char *pParam, double *pv, int *perr);
+static uint32_t ntex_hash(uint32_t x, uint32_t y, uint32_t seed);
+static uint32_t ntex_ink(double a);
+static double ntex_smooth(double t);
+static void ntex_gradient(const NTEX *pt, int32_t x, int32_t y,
+                            int32_t count, int32_t width,
+                            int32_t height, uint32_t *pOut);
+static void ntex_noise(const NTEX *pt, int32_t x, int32_t y,
+                        int32_t count, uint32_t *pOut);
+static void ntex_perlin(const NTEX *pt, int32_t x, int32_t y,
+                          int32_t count, uint32_t *pOut);
+static void ntex_grain(const NTEX *pt, int32_t x, int32_t y,
+                        int32_t count, uint32_t *pOut);
+static void ntex_hatch(const NTEX *pt, int32_t x, int32_t y,
+                        int32_t count, uint32_t *pOut);
+static void ntex_dither(const NTEX *pt, int32_t x, int32_t y,
+                          int32_t count, uint32_t *pOut);
+static void ntex_simplex(const NTEX *pt, int32_t x, int32_t y,
+                          int32_t count, uint32_t *pOut);
+
+/*
+ * Find the kind of native texture with a given name.
+ * 
+ * Parameters:
+ * 
+ *   pName - the name
+ * 
+ * Return:
+ * 
+ *   the NTEX_ kind constant, or -1 if there is no such kind
+ */
+static int ntex_kind(const char *pName) {
+  
+  int i = 0;
+  
+  /* Check parameter */
+  if (pName == NULL) {
+    abort();
+  }
+  
+  /* Search the definitions */
+  for(i = 0; i < NTEX_KINDS; i++) {
+    if (strcmp(m_def[i].pName, pName) == 0) {
+      return i;
+    }
+  }
+  
+  return -1;
+}
+
+/*
+ * Parse a parameter list.
+ * 
+ * The parameters are written to pv, which must have room for
+ * NTEX_MAXPARAM values.  Each parameter must be a decimal number with
+ * an optional leading minus sign and an optional fractional part.
+ * 
+ * Parameters:
+ * 
+ *   pParam - the parameter list
+ * 
+ *   pv - receives the parameter values
+ * 
+ *   perr - receives an error code if the function fails
+ * 
+ * Return:
+ * 
+ *   the number of parameters, or -1 if error
+ */
+static int ntex_parse(const char *pParam, double *pv, int *perr) {
+  
+  int count = 0;
+  int digits = 0;
+  const char *pc = NULL;
+  const char *pStart = NULL;
+  char buf[32];
+  
+  /* Initialize buffer */
+  memset(buf, 0, sizeof(buf));
+  
+  /* Check parameters */
+  if ((pParam == NULL) || (pv == NULL) || (perr == NULL)) {
+    abort();
+  }
+  
+  /* Empty list has no parameters */
+  if (*pParam == 0) {
+    return 0;
+  }
+  
+  /* Parse each comma-separated number */
+  pc = pParam;
+  while (1) {
+    
+    /* Check the syntax of the number and find its end */
+    pStart = pc;
+    digits = 0;
+    if (*pc == '-') {
+      pc++;
+    }
+    for( ; (*pc >= '0') && (*pc <= '9'); pc++) {
+      digits++;
+    }
+    if (*pc == '.') {
+      pc++;
+      for( ; (*pc >= '0') && (*pc <= '9'); pc++) {
+        digits++;
+      }
+    }
+    if ((digits < 1) || ((*pc != ',') && (*pc != 0)) ||
+        ((size_t) (pc - pStart) >= sizeof(buf))) {
+      *perr = NTEX_ERR_SYNTAX;
+      return -1;
+    }
+    
+    /* Make sure there is room */
+    if (count >= NTEX_MAXPARAM) {
+      *perr = NTEX_ERR_PCOUNT;
+      return -1;
+    }
+    
+    /* Convert the number */
+    memcpy(buf, pStart, (size_t) (pc - pStart));
+    buf[pc - pStart] = 0;
+    pv[count] = strtod(buf, NULL);
+    count++;
+    
+    /* Move to the next number, if there is one */
+    if (*pc == 0) {
+      break;
+    }
+    pc++;
+  }
+  
+  return count;
+}
+
+/*
+ * Hash a lattice coordinate to a pseudo-random value.
+ * 
+ * Parameters:
+ * 
+ *   x - the X coordinate
+ * 
+ *   y - the Y coordinate
+ * 
+ *   seed - the seed
+ * 
+ * Return:
+ * 
+ *   the hashed value
+ */
+static uint32_t ntex_hash(uint32_t x, uint32_t y, uint32_t seed) {
+  
+  uint32_t h = 0;
+  
+  h = seed ^ UINT32_C(0x9e3779b9);
+  h ^= x * UINT32_C(0x85ebca6b);
+  h = (h << 13) | (h >> 19);
+  h = (h * UINT32_C(5)) + UINT32_C(0xe6546b64);
+  h ^= y * UINT32_C(0xc2b2ae35);
+  h = (h << 13) | (h >> 19);
+  h = (h * UINT32_C(5)) + UINT32_C(0xe6546b64);
+  
+  h ^= h >> 16;
+  h *= UINT32_C(0x85ebca6b);
+  h ^= h >> 13;
+  h *= UINT32_C(0xc2b2ae35);
+  h ^= h >> 16;
+  
+  return h;
+}
+
+/*
+ * Convert an ink coverage into a packed ARGB pixel.
+ * 
+ * The coverage is clamped to range 0.0 to 255.0 and rounded.
+ * 
+ * Parameters:
+ * 
+ *   a - the coverage
+ * 
+ * Return:
+ * 
+ *   the premultiplied black pixel with that alpha
+ */
+static uint32_t ntex_ink(double a) {
+  
+  if (!(a > 0.0)) {
+    a = 0.0;
+  } else if (a > 255.0) {
+    a = 255.0;
+  }
+  
+  return ((uint32_t) (a + 0.5)) << 24;
+}
+
+/*
+ * The smoothstep curve used to interpolate noise lattices.
+ * 
+ * Parameters:
+ * 
+ *   t - a value in range 0.0 to 1.0
+ * 
+ * Return:
+ * 
+ *   the smoothed value
+ */
+static double ntex_smooth(double t) {
+  return t * t * (3.0 - (2.0 * t));
+}
+
+/*
+ * Generate a span of a gradient texture.
+ * 
+ * The parameters are the same as for ntex_span(), except that the
+ * texture is given directly.
+ */
+static void ntex_gradient(const NTEX *pt, int32_t x, int32_t y,
+                            int32_t count, int32_t width,
+                            int32_t height, uint32_t *pOut) {
+  
+  int32_t i = 0;
+  int j = 0;
+  double pmin = 0.0;
+  double pmax = 0.0;
+  double scale = 0.0;
+  double base = 0.0;
+  double step = 0.0;
+  double range = 0.0;
+  
+  /* Project the centers of the corner pixels onto the direction */
+  for(j = 0; j < 4; j++) {
+    base = (((j & 1) ? (((double) width) - 0.5) : 0.5) * pt->dx) +
+            (((j >> 1) ? (((double) height) - 0.5) : 0.5) * pt->dy);
+    if ((j == 0) || (base < pmin)) {
+      pmin = base;
+    }
+    if ((j == 0) || (base > pmax)) {
+      pmax = base;
+    }
+  }
+  
+  /* Scale the projection so it runs from zero to one over the image */
+  if (pmax > pmin) {
+    scale = 1.0 / (pmax - pmin);
+  }
+  
+  /* Hoist the scanline terms, so each pixel is a multiply-add; the
+   * result only depends on the X coordinate and not on where the span
+   * starts, so spans match single pixels exactly */
+  range = pt->a1 - pt->a0;
+  base = (((0.5 * pt->dx) + ((((double) y) + 0.5) * pt->dy) - pmin) *
+          scale * range) + pt->a0;
+  step = pt->dx * scale * range;
+  
+  for(i = 0; i < count; i++) {
+    pOut[i] = ntex_ink(base + (((double) (x + i)) * step));
+  }
+}
+
+/*
+ * Generate a span of a value noise texture.
+ * 
+ * The parameters are the same as for ntex_span(), except that the
+ * texture is given directly and the image dimensions are not needed.
+ */
+static void ntex_noise(const NTEX *pt, int32_t x, int32_t y,
+                        int32_t count, uint32_t *pOut) {
+  
+  int32_t i = 0;
+  double fx = 0.0;
+  double fy = 0.0;
+  double ty = 0.0;
+  double tx = 0.0;
+  double left = 0.0;
+  double right = 0.0;
+  uint32_t iy = 0;
+  uint32_t ix = 0;
+  uint32_t cell = 0;
+  int have_cell = 0;
+  
+  /* The vertical position is the same for the whole span */
+  fy = (((double) y) + 0.5) * pt->inv;
+  iy = (uint32_t) floor(fy);
+  ty = ntex_smooth(fy - floor(fy));
+  
+  for(i = 0; i < count; i++) {
+    fx = (((double) (x + i)) + 0.5) * pt->inv;
+    ix = (uint32_t) floor(fx);
+    
+    /* Blend the lattice columns vertically only when entering a new
+     * cell */
+    if ((!have_cell) || (ix != cell)) {
+      cell = ix;
+      have_cell = 1;
+      left = (double) (ntex_hash(ix, iy, pt->seed) & 0xffff);
+      left += ty * (((double) (ntex_hash(ix, iy + 1, pt->seed) &
+                      0xffff)) - left);
+      right = (double) (ntex_hash(ix + 1, iy, pt->seed) & 0xffff);
+      right += ty * (((double) (ntex_hash(ix + 1, iy + 1, pt->seed) &
+                        0xffff)) - right);
+    }
+    
+    tx = ntex_smooth(fx - floor(fx));
+    pOut[i] = ntex_ink((left + (tx * (right - left))) *
+                        (255.0 / 65535.0));
+  }
+}
+
+/*
+ * Generate a span of a Perlin noise texture.
+ * 
+ * The parameters are the same as for ntex_span(), except that the
+ * texture is given directly and the image dimensions are not needed.
+ */
+static void ntex_perlin(const NTEX *pt, int32_t x, int32_t y,
+                          int32_t count, uint32_t *pOut) {
+  
+  int32_t i = 0;
+  int j = 0;
+  double fx = 0.0;
+  double fy = 0.0;
+  double rx = 0.0;
+  double ry = 0.0;
+  double tx = 0.0;
+  double ty = 0.0;
+  double n0 = 0.0;
+  double n1 = 0.0;
+  double d[4];
+  uint32_t iy = 0;
+  uint32_t ix = 0;
+  uint32_t cell = 0;
+  int have_cell = 0;
+  int g[4];
+  
+  /* Initialize arrays */
+  memset(d, 0, sizeof(d));
+  memset(g, 0, sizeof(g));
+  
+  /* The vertical position is the same for the whole span */
+  fy = (((double) y) + 0.5) * pt->inv;
+  iy = (uint32_t) floor(fy);
+  ry = fy - floor(fy);
+  ty = ntex_smooth(ry);
+  
+  for(i = 0; i < count; i++) {
+    fx = (((double) (x + i)) + 0.5) * pt->inv;
+    ix = (uint32_t) floor(fx);
+    rx = fx - floor(fx);
+    
+    /* Look up the corner gradients only when entering a new cell */
+    if ((!have_cell) || (ix != cell)) {
+      cell = ix;
+      have_cell = 1;
+      for(j = 0; j < 4; j++) {
+        g[j] = (int) (ntex_hash(ix + (uint32_t) (j & 1),
+                                iy + (uint32_t) (j >> 1),
+                                pt->seed) & 7);
+      }
+    }
+    
+    /* Dot each corner gradient with the offset from that corner */
+    for(j = 0; j < 4; j++) {
+      d[j] = (m_gx[g[j]] * (rx - (double) (j & 1))) +
+              (m_gy[g[j]] * (ry - (double) (j >> 1)));
+    }
+    
+    tx = ntex_smooth(rx);
+    n0 = d[0] + (tx * (d[1] - d[0]));
+    n1 = d[2] + (tx * (d[3] - d[2]));
+    n0 = n0 + (ty * (n1 - n0));
+    
+    /* The noise is within plus or minus the square root of one half */
+    pOut[i] = ntex_ink(((n0 * 1.41421356237309505) + 1.0) * 127.5);
+  }
+}
+
+/*
+ * Generate a span of a paper grain texture.
+ * 
+ * The parameters are the same as for ntex_span(), except that the
+ * texture is given directly and the image dimensions are not needed.
+ */
+static void ntex_grain(const NTEX *pt, int32_t x, int32_t y,
+                        int32_t count, uint32_t *pOut) {
+  
+  int32_t i = 0;
+  uint32_t a = 0;
+  
+  for(i = 0; i < count; i++) {
+    a = ntex_hash((uint32_t) (x + i), (uint32_t) y, pt->seed) & 0xff;
+    a = ((a * (uint32_t) pt->s) + 127) / 255;
+    pOut[i] = a << 24;
+  }
+}
+
+/*
+ * Generate a span of a hatching texture.
+ * 
+ * The parameters are the same as for ntex_span(), except that the
+ * texture is given directly and the image dimensions are not needed.
+ */
+static void ntex_hatch(const NTEX *pt, int32_t x, int32_t y,
+                        int32_t count, uint32_t *pOut) {
+  
+  int32_t i = 0;
+  int32_t m = 0;
+  uint32_t ink = 0;
+  
+  /* Horizontal lines are the same across the whole span */
+  if (pt->dir == 0) {
+    ink = ((y % pt->s) < pt->t) ? UINT32_C(0xff000000) : 0;
+    for(i = 0; i < count; i++) {
+      pOut[i] = ink;
+    }
+    return;
+  }
+  
+  /* Otherwise, find the phase of the first pixel within the spacing
+   * and then step it along the span */
+  if (pt->dir == 1) {
+    m = x % pt->s;
+  } else if (pt->dir == 2) {
+    m = (x + (y % pt->s)) % pt->s;
+  } else {
+    m = (x + pt->s - (y % pt->s)) % pt->s;
+  }
+  
+  for(i = 0; i < count; i++) {
+    pOut[i] = (m < pt->t) ? UINT32_C(0xff000000) : 0;
+    m++;
+    if (m >= pt->s) {
+      m = 0;
+    }
+  }
+}
+
+/*
+ * Generate a span of an ordered dither texture.
+ * 
+ * The parameters are the same as for ntex_span(), except that the
+ * texture is given directly and the image dimensions are not needed.
+ */
+static void ntex_dither(const NTEX *pt, int32_t x, int32_t y,
+                          int32_t count, uint32_t *pOut) {
+  
+  int32_t i = 0;
+  const unsigned char *pRow = NULL;
+  
+  pRow = m_bayer[y & 7];
+  for(i = 0; i < count; i++) {
+    pOut[i] = ((((int32_t) pRow[(x + i) & 7]) * 4) + 2 < pt->t) ?
+                UINT32_C(0xff000000) : 0;
+  }
+}
+
+/*
+ * Generate a span of a simplex noise texture.
+ * 
+ * The parameters are the same as for ntex_span(), except that the
+ * texture is given directly and the image dimensions are not needed.
+ */
+static void ntex_simplex(const NTEX *pt, int32_t x, int32_t y,
+                          int32_t count, uint32_t *pOut) {
+  
+  int32_t i = 0;
+  int j = 0;
+  int c = 0;
+  double fx = 0.0;
+  double fy = 0.0;
+  double sk = 0.0;
+  double un = 0.0;
+  double a = 0.0;
+  double n = 0.0;
+  double cx = 0.0;
+  double cy = 0.0;
+  double ox[3];
+  double oy[3];
+  uint32_t ix = 0;
+  uint32_t iy = 0;
+  uint32_t cell_x = 0;
+  uint32_t cell_y = 0;
+  int have_cell = 0;
+  int g[4];
+  int k[3];
+  
+  /* Initialize arrays */
+  memset(ox, 0, sizeof(ox));
+  memset(oy, 0, sizeof(oy));
+  memset(g, 0, sizeof(g));
+  memset(k, 0, sizeof(k));
+  
+  /* The vertical position is the same for the whole span */
+  fy = (((double) y) + 0.5) * pt->inv;
+  
+  /* The first and last corners of each simplex are always the origin
+   * and the far corner of its skewed cell */
+  k[0] = 0;
+  k[2] = 3;
+  
+  for(i = 0; i < count; i++) {
+    fx = (((double) (x + i)) + 0.5) * pt->inv;
+    
+    /* Skew the position to find its cell, then unskew the cell origin
+     * to get the offset from it */
+    sk = (fx + fy) * NTEX_SKEW;
+    cx = floor(fx + sk);
+    cy = floor(fy + sk);
+    ix = (uint32_t) cx;
+    iy = (uint32_t) cy;
+    un = (cx + cy) * NTEX_UNSKEW;
+    ox[0] = fx - cx + un;
+    oy[0] = fy - cy + un;
+    
+    /* Look up the corner gradients only when entering a new cell */
+    if ((!have_cell) || (ix != cell_x) || (iy != cell_y)) {
+      cell_x = ix;
+      cell_y = iy;
+      have_cell = 1;
+      for(j = 0; j < 4; j++) {
+        g[j] = (int) (ntex_hash(ix + (uint32_t) (j & 1),
+                                iy + (uint32_t) (j >> 1),
+                                pt->seed) & 7);
+      }
+    }
+    
+    /* The cell is split along its diagonal into two triangles; pick
+     * the middle corner of the triangle the position is in */
+    if (ox[0] > oy[0]) {
+      k[1] = 1;
+      ox[1] = ox[0] - 1.0 + NTEX_UNSKEW;
+      oy[1] = oy[0] + NTEX_UNSKEW;
+    } else {
+      k[1] = 2;
+      ox[1] = ox[0] + NTEX_UNSKEW;
+      oy[1] = oy[0] - 1.0 + NTEX_UNSKEW;
+    }
+    ox[2] = ox[0] - 1.0 + (2.0 * NTEX_UNSKEW);
+    oy[2] = oy[0] - 1.0 + (2.0 * NTEX_UNSKEW);
+    
+    /* Sum the radially attenuated contribution of each corner */
+    n = 0.0;
+    for(j = 0; j < 3; j++) {
+      a = 0.5 - (ox[j] * ox[j]) - (oy[j] * oy[j]);
+      if (a > 0.0) {
+        c = g[k[j]];
+        a *= a;
+        n += a * a * ((m_gx[c] * ox[j]) + (m_gy[c] * oy[j]));
+      }
+    }
+    
+    /* Scale the noise to approximately plus or minus one */
+    pOut[i] = ntex_ink(((n * NTEX_SIMPLEX_SCALE) + 1.0) * 127.5);
+  }
+}
+
+/*
+ * Public function implementations
+ * ===============================
+ * 
+ * See the header for specifications.
+ */
+
+/*
+ * ntex_errorString function.
+ */
+const char *ntex_errorString(int code) {
+  
+  const char *pResult = NULL;
+  
+  switch (code) {
+    case NTEX_ERR_NONE:
+      pResult = "No error";
+      break;
+    
+    case NTEX_ERR_NAME:
+      pResult = "Unknown native texture";
+      break;
+    
+    case NTEX_ERR_SYNTAX:
+      pResult = "Native texture parameters must be decimal numbers "
+                "separated by commas";
+      break;
+    
+    case NTEX_ERR_PCOUNT:
+      pResult = "Too many native texture parameters";
+      break;
+    
+    case NTEX_ERR_RANGE:
+      pResult = "Native texture parameter out of range";
+      break;
+    
+    case NTEX_ERR_FULL:
+      pResult = "Too many native textures";
+      break;
+    
+    default:
+      pResult = "Unknown error";
+  }
+  
+  return pResult;
+}
+
+/*
+ * ntex_known function.
+ */
+int ntex_known(const char *pName) {
+  return (ntex_kind(pName) >= 0) ? 1 : 0;
+}
+
+/*
+ * ntex_add function.
+ */
+int ntex_add(const char *pName, const char *pParam, int *perr) {
+  
+  int status = 1;
+  int kind = 0;
+  int count = 0;
+  int i = 0;
+  double a = 0.0;
+  double v[NTEX_MAXPARAM];
+  NTEX *pt = NULL;
+  
+  /* Initialize array */
+  memset(v, 0, sizeof(v));
+  
+  /* Check parameters */
+  if ((pName == NULL) || (pParam == NULL) || (perr == NULL)) {
+    abort();
+  }
+  
+  /* Reset error indicator */
+  *perr = NTEX_ERR_NONE;
+  
+  /* Find the kind */
+  kind = ntex_kind(pName);
+  if (kind < 0) {
+    status = 0;
+    *perr = NTEX_ERR_NAME;
+  }
+  
+  /* Make sure there is room */
+  if (status && (m_ntex_count >= NTEX_MAXCOUNT)) {
+    status = 0;
+    *perr = NTEX_ERR_FULL;
+  }
+  
+  /* Parse the parameters */
+  if (status) {
+    count = ntex_parse(pParam, v, perr);
+    if (count < 0) {
+      status = 0;
+    } else if (count > m_def[kind].pcount) {
+      status = 0;
+      *perr = NTEX_ERR_PCOUNT;
+    }
+  }
+  
+  /* Fill in defaults and check ranges */
+  if (status) {
+    for(i = 0; i < m_def[kind].pcount; i++) {
+      if (i >= count) {
+        v[i] = m_def[kind].def[i];
+      }
+      if ((v[i] < m_def[kind].lo[i]) || (v[i] > m_def[kind].hi[i]) ||
+          (((m_def[kind].whole >> i) & 1) && (v[i] != floor(v[i])))) {
+        status = 0;
+        *perr = NTEX_ERR_RANGE;
+      }
+    }
+  }
+  
+  /* Hatching lines may not be thicker than their spacing */
+  if (status && (kind == NTEX_HATCH) && (v[1] > v[0])) {
+    status = 0;
+    *perr = NTEX_ERR_RANGE;
+  }
+  
+  /* Add the texture and derive its constants */
+  if (status) {
+    pt = &(m_ntex[m_ntex_count]);
+    memset(pt, 0, sizeof(NTEX));
+    pt->kind = kind;
+    
+    if (kind == NTEX_GRADIENT) {
+      a = v[0] * (NTEX_PI / 180.0);
+      pt->dx = cos(a);
+      pt->dy = sin(a);
+      pt->a0 = v[1];
+      pt->a1 = v[2];
+    
+    } else if ((kind == NTEX_NOISE) || (kind == NTEX_PERLIN) ||
+                (kind == NTEX_SIMPLEX)) {
+      pt->inv = 1.0 / v[0];
+      pt->seed = (uint32_t) v[1];
+    
+    } else if (kind == NTEX_GRAIN) {
+      pt->s = (int32_t) v[0];
+      pt->seed = (uint32_t) v[1];
+    
+    } else if (kind == NTEX_HATCH) {
+      pt->s = (int32_t) v[0];
+      pt->t = (int32_t) v[1];
+      pt->dir = (int) v[2];
+    
+    } else if (kind == NTEX_DITHER) {
+      pt->t = (int32_t) v[0];
+    }
+    
+    m_ntex_count++;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * ntex_count function.
+ */
+int ntex_count(void) {
+  return m_ntex_count;
+}
+
+/*
+ * ntex_period function.
+ */
+int ntex_period(int nidx, int32_t *pw, int32_t *ph) {
+  
+  const NTEX *pt = NULL;
+  
+  /* Check parameters */
+  if ((nidx < 1) || (nidx > m_ntex_count) ||
+      (pw == NULL) || (ph == NULL)) {
+    abort();
+  }
+  pt = &(m_ntex[nidx - 1]);
+  
+  /* Only hatching and dithering are periodic */
+  if (pt->kind == NTEX_HATCH) {
+    *pw = (pt->dir == 0) ? 1 : pt->s;
+    *ph = (pt->dir == 1) ? 1 : pt->s;
+    return 1;
+  
+  } else if (pt->kind == NTEX_DITHER) {
+    *pw = 8;
+    *ph = 8;
+    return 1;
+  }
+  
+  return 0;
+}
+
+/*
+ * ntex_span function.
+ */
+void ntex_span(
+    int        nidx,
+    int32_t    x,
+    int32_t    y,
+    int32_t    count,
+    int32_t    width,
+    int32_t    height,
+    uint32_t * pOut) {
+  
+  const NTEX *pt = NULL;
+  
+  /* Check parameters */
+  if ((nidx < 1) || (nidx > m_ntex_count) || (pOut == NULL)) {
+    abort();
+  }
+  if ((width < 1) || (height < 1) || (count < 0)) {
+    abort();
+  }
+  if ((x < 0) || (y < 0) || (y >= height) || (x > width - count)) {
+    abort();
+  }
+  pt = &(m_ntex[nidx - 1]);
+  
+  /* Dispatch to the generator */
+  switch (pt->kind) {
+    case NTEX_GRADIENT:
+      ntex_gradient(pt, x, y, count, width, height, pOut);
+      break;
+    
+    case NTEX_NOISE:
+      ntex_noise(pt, x, y, count, pOut);
+      break;
+    
+    case NTEX_PERLIN:
+      ntex_perlin(pt, x, y, count, pOut);
+      break;
+    
+    case NTEX_GRAIN:
+      ntex_grain(pt, x, y, count, pOut);
+      break;
+    
+    case NTEX_HATCH:
+      ntex_hatch(pt, x, y, count, pOut);
+      break;
+    
+    case NTEX_DITHER:
+      ntex_dither(pt, x, y, count, pOut);
+      break;
+    
+    case NTEX_SIMPLEX:
+      ntex_simplex(pt, x, y, count, pOut);
+      break;
+    
+    default:
+      abort();
+  }
+}
+
+/*
+ * ntex_pixel function.
+ */
+uint32_t ntex_pixel(
+    int     nidx,
+    int32_t x,
+    int32_t y,
+    int32_t width,
+    int32_t height) {
+  
+  uint32_t result = 0;
+  
+  ntex_span(nidx, x, y, 1, width, height, &result);
+  return result;
+}
@@ -0,0 +1,263 @@
+#ifndef NTEX_H_INCLUDED
+#define NTEX_H_INCLUDED
+
+/*
+ * ntex.h
+ * 
+ * Native procedural texture module of Lilac.
+ * 
+ * This module provides a library of common procedural textures that
+ * are implemented in C, so that they do not have to go through the
+ * programmable shader module.  They are selected with the same name()
+ * syntax as programmable shaders, but they may also take a
+ * comma-separated list of numeric parameters between the parentheses.
+ * Trailing parameters may be left out to use their defaults.
+ * 
+ * Every native texture is an ink texture.  Each pixel is black with an
+ * alpha value that is the coverage of the ink, premultiplied, so the
+ * RGB channels are always zero.  Use a shading record tint to give the
+ * ink a color.
+ * 
+ * The textures are:
+ * 
+ *   gradient(angle, a0, a1)
+ * 
+ *     Linear ramp of alpha from a0 to a1 across the output image in
+ *     the direction of angle degrees, where zero goes left to right and
+ *     90 goes top to bottom.  Defaults are 0, 0, 255.
+ * 
+ *   noise(scale, seed)
+ * 
+ *     Smooth value noise with lattice cells of scale pixels.  Defaults
+ *     are 16, 0.
+ * 
+ *   perlin(scale, seed)
+ * 
+ *     Perlin gradient noise with lattice cells of scale pixels.
+ *     Defaults are 16, 0.
+ * 
+ *   simplex(scale, seed)
+ * 
+ *     Simplex gradient noise on a triangular lattice whose cells are
+ *     about scale pixels across.  It has fewer axis-aligned artifacts
+ *     than perlin.  Defaults are 16, 0.
+ * 
+ *   grain(amount, seed)
+ * 
+ *     Paper grain, which is independent random alpha for each pixel in
+ *     range zero up to amount.  Defaults are 64, 0.
+ * 
+ *   hatch(spacing, thickness, dir)
+ * 
+ *     Solid lines of the given thickness every spacing pixels.  dir is
+ *     0 for horizontal lines, 1 for vertical lines, 2 for diagonal
+ *     lines rising to the right, and 3 for diagonal lines falling to
+ *     the right.  Defaults are 8, 1, 0.
+ * 
+ *   dither(level)
+ * 
+ *     Ordered dither with an 8 by 8 Bayer matrix, covering level out
+ *     of 255 of the pixels.  Default is 128.
+ * 
+ * Textures are generated a span of pixels at a time with ntex_span(),
+ * which hoists everything that depends only on the scanline out of the
+ * per-pixel loop.  Textures never depend on the order they are queried
+ * in, and the module is read-only once textures have been added, so
+ * ntex_span() and ntex_pixel() may be called from any number of
+ * threads at once.
+ * 
+ * Some textures repeat with a small period, which ntex_period()
+ * reports, so that they can be rendered once into an image texture.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Error codes.
+ * 
+ * Don't forget to update ntex_errorString()!
+ */
+#define NTEX_ERR_NONE   (0)   /* No error */
+#define NTEX_ERR_NAME   (1)   /* Unknown native texture name */
+#define NTEX_ERR_SYNTAX (2)   /* Parameter list syntax error */
+#define NTEX_ERR_PCOUNT (3)   /* Too many parameters */
+#define NTEX_ERR_RANGE  (4)   /* Parameter out of range */
+#define NTEX_ERR_FULL   (5)   /* Too many native textures */
+
+/*
+ * The maximum number of native textures that can be added.
+ */
+#define NTEX_MAXCOUNT (1024)
+
+/*
+ * The maximum number of parameters of a native texture.
+ */
+#define NTEX_MAXPARAM (4)
+
+/*
+ * The maximum value of each dimension of a period reported by
+ * ntex_period().
+ */
+#define NTEX_MAXPERIOD (2048)
+
+/*
+ * Given a native texture error code, return an error message.
+ * 
+ * The error message begins with a capital letter but does not have any
+ * punctuation or line break at the end.
+ * 
+ * If zero is passed, "No error" is returned.  If an unknown error code
+ * is passed, "Unknown error" is returned.
+ * 
+ * Parameters:
+ * 
+ *   code - the error code to look up
+ * 
+ * Return:
+ * 
+ *   an error message for the code
+ */
+const char *ntex_errorString(int code);
+
+/*
+ * Check whether a name is the name of a native texture.
+ * 
+ * Parameters:
+ * 
+ *   pName - the name to check
+ * 
+ * Return:
+ * 
+ *   non-zero if there is a native texture with this name, zero if not
+ */
+int ntex_known(const char *pName);
+
+/*
+ * Add a native texture.
+ * 
+ * pName is the name of the texture, without parentheses.  pParam is
+ * the text between the parentheses, which is a possibly empty list of
+ * decimal numbers separated by commas.  Whitespace is not allowed.
+ * 
+ * perr points to a variable to receive an error code, which is one of
+ * the constants NTEX_ERR_.  NTEX_ERR_NONE is written if successful.
+ * 
+ * Textures are numbered starting at one, in the order they are added.
+ * The number of the new texture is the same as ntex_count() after the
+ * call.
+ * 
+ * Parameters:
+ * 
+ *   pName - the name of the texture
+ * 
+ *   pParam - the parameter list
+ * 
+ *   perr - pointer to a variable to receive an error code
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+int ntex_add(const char *pName, const char *pParam, int *perr);
+
+/*
+ * Return the number of native textures that have been added.
+ * 
+ * Return:
+ * 
+ *   the number of native textures
+ */
+int ntex_count(void);
+
+/*
+ * Get the period of a native texture.
+ * 
+ * nidx is the one-indexed texture number.  It must be in range one up
+ * to and including ntex_count().
+ * 
+ * If the texture depends only on the coordinates modulo a period of at
+ * most NTEX_MAXPERIOD in each dimension, and not on the output image
+ * dimensions, the period is written to *pw and *ph and non-zero is
+ * returned.  Otherwise, zero is returned.
+ * 
+ * Parameters:
+ * 
+ *   nidx - the texture
+ * 
+ *   pw - receives the width of the period
+ * 
+ *   ph - receives the height of the period
+ * 
+ * Return:
+ * 
+ *   non-zero if the texture is periodic, zero otherwise
+ */
+int ntex_period(int nidx, int32_t *pw, int32_t *ph);
+
+/*
+ * Generate a span of pixels of a native texture.
+ * 
+ * nidx is the one-indexed texture number.  It must be in range one up
+ * to and including ntex_count().
+ * 
+ * The pixels from (x, y) up to but excluding (x + count, y) are
+ * written to pOut, which must have room for count pixels.  width and
+ * height are the dimensions of the output image, which must be greater
+ * than zero, and the whole span must be within the image.  count may
+ * be zero, in which case nothing is written.
+ * 
+ * Parameters:
+ * 
+ *   nidx - the texture
+ * 
+ *   x - the X coordinate of the first pixel
+ * 
+ *   y - the Y coordinate of the span
+ * 
+ *   count - the number of pixels
+ * 
+ *   width - the width of the output image
+ * 
+ *   height - the height of the output image
+ * 
+ *   pOut - receives the ARGB pixels
+ */
+void ntex_span(
+    int        nidx,
+    int32_t    x,
+    int32_t    y,
+    int32_t    count,
+    int32_t    width,
+    int32_t    height,
+    uint32_t * pOut);
+
+/*
+ * Get a single pixel of a native texture.
+ * 
+ * This is the same as ntex_span() with a count of one.
+ * 
+ * Parameters:
+ * 
+ *   nidx - the texture
+ * 
+ *   x - the X coordinate
+ * 
+ *   y - the Y coordinate
+ * 
+ *   width - the width of the output image
+ * 
+ *   height - the height of the output image
+ * 
+ * Return:
+ * 
+ *   the ARGB value of the texture at the given coordinate
+ */
+uint32_t ntex_pixel(
+    int     nidx,
+    int32_t x,
+    int32_t y,
+    int32_t width,
+    int32_t height);
+
+#endif
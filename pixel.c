@@ -0,0 +1,693 @@
+/*
+ * pixel.c
+ * 
+ * Implementation of pixel.h
+ * 
+ * See the header for further information.
+ */
+
+#include "pixel.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gamma.h"
+#include "sophistry.h"
+
+/*
+ * Type declarations
+ * =================
+ */
+
+/*
+ * Stores an HSL color with floating-point channels.
+ * 
+ * This can not be used for grayscale values, which have an undefined
+ * hue.
+ */
+typedef struct {
+  
+  /* The hue, in range [0.0, 360.0) */
+  float h;
+  
+  /* The saturation, in range [0.0, 1.0] */
+  float s;
+  
+  /* The lightness, in range [0.0, 1.0] */
+  float l;
+  
+} HSL;
+
+/*
+ * Stores an RGB color with floating-point channels.
+ */
+typedef struct {
+  
+  /* Red, in range [0.0, 1.0] */
+  float r;
+  
+  /* Green, in range [0.0, 1.0] */
+  float g;
+  
+  /* Blue, in range [0.0, 1.0] */
+  float b;
+  
+} RGB;
+
+/*
+ * A memo cache entry.
+ */
+typedef struct {
+  
+  /* The two inputs, first input in the high 32 bits */
+  uint64_t key;
+  
+  /* The result for the inputs */
+  uint32_t val;
+  
+  /* Non-zero if the entry is filled in */
+  uint32_t valid;
+  
+} MEMO;
+
+/*
+ * Local data
+ * ==========
+ */
+
+/*
+ * The memo caches, indexed by PIXEL_MEMO_ codes.
+ */
+static MEMO m_memo[2][PIXEL_MEMO_SIZE];
+
+/*
+ * Hit and miss counts of each memo cache.
+ */
+static int64_t m_memo_hits[2];
+static int64_t m_memo_misses[2];
+
+/*
+ * Local functions
+ * ===============
+ */
+
+/* Function prototypes */
+static float hslval(float a, float b, float hue);
+static void rgb2hsl(RGB *pRGB, HSL *pHSL);
+static void hsl2rgb(HSL *pHSL, RGB *pRGB);
+static int memo_slot(uint32_t a, uint32_t b);
+
+/*
+ * Get the memo cache slot for a pair of inputs.
+ * 
+ * Parameters:
+ * 
+ *   a - the first input
+ * 
+ *   b - the second input
+ * 
+ * Return:
+ * 
+ *   the slot index, in range zero up to but excluding PIXEL_MEMO_SIZE
+ */
+static int memo_slot(uint32_t a, uint32_t b) {
+  
+  uint32_t h = 0;
+  
+  h = (a * UINT32_C(0x9e3779b1)) ^ (b * UINT32_C(0x85ebca77));
+  h ^= h >> 16;
+  
+  return (int) (h & (PIXEL_MEMO_SIZE - 1));
+}
+
+/*
+ * Auxiliary function for HSL/RGB conversions.
+ * 
+ * See the conversion functions for further information.
+ */
+static float hslval(float a, float b, float hue) {
+  
+  float result = 0.0f;
+  
+  /* Adapted from The Revolutionary Guide to Bitmapped Graphics,
+   * Control-Zed, Wrox Press, 1994, pg. 124 */
+  
+  while (hue >= 360.0f) {
+    hue -= 360.0f;
+  }
+  while (hue < 0.0f) {
+    hue += 360.0f;
+  }
+  
+  if (hue < 60.0f) {
+    result = a + (b - a) * hue / 60.0f;
+  
+  } else if (hue < 180.0f) {
+    result = b;
+  
+  } else if (hue < 240.0f) {
+    result = a + (b - a) * (240.0f - hue) / 60.0f;
+  
+  } else {
+    result = a;
+  }
+  
+  return result;
+}
+
+/*
+ * Convert an RGB color to HSL.
+ * 
+ * pRGB points to the RGB color.  This structure is first adjusted in
+ * the following way.  Any component that is not a finite value is set
+ * to zero.  Then, each component is clamped to range [0.0, 1.0].
+ * 
+ * Note that the RGB channels must be in range [0.0, 1.0] rather than
+ * the integer range [0, 255].
+ * 
+ * Grayscale values may not be provided or a fault occurs.  This is
+ * because the hue is undefined in grayscale cases.  The grayscale check
+ * is done after the RGB values are adjusted as noted above.
+ * 
+ * The HSL result is written to pHSL.
+ * 
+ * Parameters:
+ * 
+ *   pRGB - pointer to the input RGB, which may be adjusted
+ * 
+ *   pHSL - pointer to the output HSL
+ */
+static void rgb2hsl(RGB *pRGB, HSL *pHSL) {
+  
+  float min = 0.0f;
+  float max = 0.0f;
+  float D = 0.0f;
+  
+  /* Check parameters */
+  if ((pRGB == NULL) || (pHSL == NULL)) {
+    abort();
+  }
+  
+  /* Fix non-finite channels */
+  if (!isfinite(pRGB->r)) {
+    pRGB->r = 0.0f;
+  }
+  if (!isfinite(pRGB->g)) {
+    pRGB->g = 0.0f;
+  }
+  if (!isfinite(pRGB->b)) {
+    pRGB->b = 0.0f;
+  }
+  
+  /* Clamp channel values */
+  if (!(pRGB->r >= 0.0f)) {
+    pRGB->r = 0.0f;
+  }
+  if (!(pRGB->g >= 0.0f)) {
+    pRGB->g = 0.0f;
+  }
+  if (!(pRGB->b >= 0.0f)) {
+    pRGB->b = 0.0f;
+  }
+  
+  if (!(pRGB->r <= 1.0f)) {
+    pRGB->r = 1.0f;
+  }
+  if (!(pRGB->g <= 1.0f)) {
+    pRGB->g = 1.0f;
+  }
+  if (!(pRGB->b <= 1.0f)) {
+    pRGB->b = 1.0f;
+  }
+  
+  /* Fault if grayscale */
+  if ((pRGB->r == pRGB->g) && (pRGB->r == pRGB->b)) {
+    abort();
+  }
+  
+  /* Adapted from The Revolutionary Guide to Bitmapped Graphics,
+   * Control-Zed, Wrox Press, 1994, pg. 122-123 */
+  
+  max = pRGB->r;
+  if (pRGB->g > max) {
+    max = pRGB->g;
+  }
+  if (pRGB->b > max) {
+    max = pRGB->b;
+  }
+  
+  min = pRGB->r;
+  if (pRGB->g < min) {
+    min = pRGB->g;
+  }
+  if (pRGB->b < min) {
+    min = pRGB->b;
+  }
+  
+  pHSL->l = (max + min) / 2.0f;
+  assert(max != min);
+  D = max - min;
+  
+  if (pHSL->l <= 0.5f) {
+    pHSL->s = D / (max + min);
+  } else {
+    pHSL->s = D / (2.0f - max - min);
+  }
+  
+  if (pRGB->r == max) {
+    pHSL->h = (pRGB->g - pRGB->b) / D;
+  
+  } else if (pRGB->g == max) {
+    pHSL->h = 2.0f + (pRGB->b - pRGB->r) / D;
+  
+  } else if (pRGB->b == max) {
+    pHSL->h = 4.0f + (pRGB->r - pRGB->g) / D;
+  
+  } else {
+    /* Shouldn't happen */
+    abort();
+  }
+  
+  pHSL->h *= 60.0f;
+  while(pHSL->h >= 360.0f) {
+    pHSL->h -= 360.0f;
+  }
+  while(pHSL->h < 0.0f) {
+    pHSL->h += 360.0f;
+  }
+}
+
+/*
+ * Convert an HSL color to RGB.
+ * 
+ * pHSL points to the HSL color.  This structure is first adjusted in
+ * the following way.  Any component that is not a finite value is set
+ * to zero.  Then, the S and L components are clamped to the range
+ * [0.0, 1.0].  Finally, the H component is adjusted to the degree range
+ * [0.0, 360.0).  The H component adjustment is by successive additions
+ * or subtractions, so do not pass a huge positive or negative value for
+ * H.
+ * 
+ * The RGB result is written to pRGB
+ * 
+ * Parameters:
+ * 
+ *   pHSL - pointer to the input HSL, which may be adjusted
+ * 
+ *   pRGB - pointer to the output RGB
+ */
+static void hsl2rgb(HSL *pHSL, RGB *pRGB) {
+  
+  float m = 0.0f;
+  float n = 0.0f;
+  
+  /* Check parameters */
+  if ((pHSL == NULL) || (pRGB == NULL)) {
+    abort();
+  }
+  
+  /* Fix non-finite channels */
+  if (!isfinite(pHSL->h)) {
+    pHSL->h = 0.0f;
+  }
+  if (!isfinite(pHSL->s)) {
+    pHSL->s = 0.0f;
+  }
+  if (!isfinite(pHSL->l)) {
+    pHSL->l = 0.0f;
+  }
+  
+  /* Clamp S and L values */
+  if (!(pHSL->s >= 0.0f)) {
+    pHSL->s = 0.0f;
+  }
+  if (!(pHSL->l >= 0.0f)) {
+    pHSL->l = 0.0f;
+  }
+  
+  if (!(pHSL->s <= 1.0f)) {
+    pHSL->s = 1.0f;
+  }
+  if (!(pHSL->l <= 1.0f)) {
+    pHSL->l = 1.0f;
+  }
+  
+  /* Adjust H value */
+  while (pHSL->h < 0.0f) {
+    pHSL->h += 360.0f;
+  }
+  while (pHSL->h >= 360.0f) {
+    pHSL->h -= 360.0f;
+  }
+  
+  /* Adapted from The Revolutionary Guide to Bitmapped Graphics,
+   * Control-Zed, Wrox Press, 1994, pg. 124 */
+  if (pHSL->l <= 0.5f) {
+    n = pHSL->l * (1.0f + pHSL->s);
+  } else {
+    n = pHSL->l + pHSL->s - pHSL->l * pHSL->s;
+  }
+  
+  m = 2.0f * pHSL->l - n;
+  
+  if (pHSL->s == 0) {
+    pRGB->r = pHSL->l;
+    pRGB->g = pHSL->l;
+    pRGB->b = pHSL->l;
+  
+  } else {
+    pRGB->r = hslval(m, n, pHSL->h + 120.0f);
+    pRGB->g = hslval(m, n, pHSL->h);
+    pRGB->b = hslval(m, n, pHSL->h - 120.0f);
+  }
+    
+  /* Assert finite */
+  assert(isfinite(pRGB->r));
+  assert(isfinite(pRGB->g));
+  assert(isfinite(pRGB->b));
+    
+  /* Clamp ranges */
+  if (pRGB->r < 0.0f) {
+    pRGB->r = 0.0f;
+  }
+  if (pRGB->g < 0.0f) {
+    pRGB->g = 0.0f;
+  }
+  if (pRGB->b < 0.0f) {
+    pRGB->b = 0.0f;
+  }
+    
+  if (pRGB->r > 1.0f) {
+    pRGB->r = 1.0f;
+  }
+  if (pRGB->g > 1.0f) {
+    pRGB->g = 1.0f;
+  }
+  if (pRGB->b > 1.0f) {
+    pRGB->b = 1.0f;
+  }
+}
+
+/*
+ * Public function implementations
+ * ===============================
+ * 
+ * See the header for specifications.
+ */
+
+/*
+ * pixel_fade function.
+ */
+uint32_t pixel_fade(uint32_t rgb, int rate) {
+  
+  uint32_t result = 0;
+  SPH_ARGB argb;
+  
+  /* Initialize structure */
+  memset(&argb, 0, sizeof(SPH_ARGB));
+  
+  /* Check parameters */
+  if ((rate < 0) || (rate > 255)) {
+    abort();
+  }
+  
+  /* Handle cases */
+  if (rate >= 255) {
+    /* Full shading, so return RGB as-is */
+    result = rgb;
+    
+  } else if (rate < 1) {
+    /* No shading, so return fully transparent */
+    result = 0;
+    
+  } else {
+    /* Partial shading, so first unpack to ARGB */
+    sph_argb_unpack(rgb, &argb);
+    
+    /* Adjust alpha */
+    argb.a = (int) (
+                (((int32_t) argb.a) * ((int32_t) rate)) / 255
+              );
+    
+    /* Pack to get result */
+    result = sph_argb_pack(&argb);
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * pixel_composite function.
+ */
+uint32_t pixel_composite(uint32_t over, uint32_t under) {
+  
+  SPH_ARGB co;
+  SPH_ARGB cu;
+  SPH_ARGB cf;
+  float ao = 0.0f;
+  float au = 0.0f;
+  float af = 0.0f;
+  float mo = 0.0f;
+  float mu = 0.0f;
+  
+  /* Initialize structures */
+  memset(&co, 0, sizeof(SPH_ARGB));
+  memset(&cu, 0, sizeof(SPH_ARGB));
+  memset(&cf, 0, sizeof(SPH_ARGB));
+  
+  /* Unpack colors */
+  sph_argb_unpack(over, &co);
+  sph_argb_unpack(under, &cu);
+  
+  /* Get floating-point alpha values */
+  ao = ((float) co.a) / 255.0f;
+  au = ((float) cu.a) / 255.0f;
+  
+  /* Calculate output alpha */
+  af = ao + (au * (1.0f - ao));
+  if (af * 255.0f < 1.0f) {
+    af = 0.0f;
+  }
+  
+  /* Watch for zero output alpha case */
+  if (af != 0.0f) {
+    
+    /* Non-zero output alpha -- composite each component */
+    cf.a = (int) floor(((double) af) * 255.0);
+    
+    mo = gamma_undo(co.r);
+    mu = gamma_undo(cu.r);
+    cf.r = gamma_correct(((mo * ao) + (mu * au * (1.0f - ao))) / af);
+    
+    mo = gamma_undo(co.g);
+    mu = gamma_undo(cu.g);
+    cf.g = gamma_correct(((mo * ao) + (mu * au * (1.0f - ao))) / af);
+    
+    mo = gamma_undo(co.b);
+    mu = gamma_undo(cu.b);
+    cf.b = gamma_correct(((mo * ao) + (mu * au * (1.0f - ao))) / af);
+    
+  } else {
+    /* Zero output alpha, so final is fully transparent */
+    cf.a = 0;
+    cf.r = 0;
+    cf.g = 0;
+    cf.b = 0;
+  }
+  
+  /* Pack for result */
+  return sph_argb_pack(&cf);
+}
+
+/*
+ * pixel_colorize function.
+ */
+uint32_t pixel_colorize(uint32_t rgb_in, uint32_t rgb_tint) {
+  return pixel_colorize_gray(pixel_gray(rgb_in), rgb_tint);
+}
+
+/*
+ * pixel_gray function.
+ */
+int pixel_gray(uint32_t rgb_in) {
+  
+  SPH_ARGB argb;
+  
+  /* Initialize structures */
+  memset(&argb, 0, sizeof(SPH_ARGB));
+  
+  /* Down-convert input to grayscale */
+  sph_argb_unpack(rgb_in, &argb);
+  sph_argb_downGray(&argb);
+  return argb.r;
+}
+
+/*
+ * pixel_colorize_gray function.
+ */
+uint32_t pixel_colorize_gray(int gray_i, uint32_t rgb_tint) {
+  
+  SPH_ARGB argb;
+  float gray = 0.0f;
+  RGB rgb;
+  HSL hsl;
+  
+  /* Initialize structures */
+  memset(&argb, 0, sizeof(SPH_ARGB));
+  memset(&rgb, 0, sizeof(RGB));
+  memset(&hsl, 0, sizeof(HSL));
+  
+  /* Check parameter */
+  if ((gray_i < 0) || (gray_i > 255)) {
+    abort();
+  }
+  
+  /* Unpack RGB tint */
+  sph_argb_unpack(rgb_tint, &argb);
+ 
+  /* Check if tint is grayscale */
+  if ((argb.r == argb.g) && (argb.r == argb.b)) {
+    /* Grayscale tint, so result is just grayscale input */
+    argb.a = 255;
+    argb.r = gray_i;
+    argb.g = gray_i;
+    argb.b = gray_i;
+  
+  } else {
+    /* Not a grayscale tint, next check if input greyscale is pure white
+     * or black */
+    if (gray_i < 1) {
+      /* Input grayscale pure black, so result is black */
+      argb.a = 255;
+      argb.r = 0;
+      argb.g = 0;
+      argb.b = 0;
+      
+    } else if (gray_i > 254) {
+      /* Input grayscale pure white, so result is white */
+      argb.a = 255;
+      argb.r = 255;
+      argb.g = 255;
+      argb.b = 255;
+      
+    } else {
+      /* General case -- input grayscale not pure white or black and
+       * tint is not grayscale -- compute floating-point values */
+      gray = ((float) gray_i) / 255.0f;
+      
+      rgb.r = ((float) argb.r) / 255.0f;
+      rgb.g = ((float) argb.g) / 255.0f;
+      rgb.b = ((float) argb.b) / 255.0f;
+      
+      /* Convert RGB to HSL */
+      rgb2hsl(&rgb, &hsl);
+      
+      /* Set lightness to grayscale value */
+      hsl.l = gray;
+        
+      /* Convert adjusted HSL back to RGB */
+      hsl2rgb(&hsl, &rgb);
+        
+      /* Convert floating-point RGB to integer */
+      argb.a = 255;
+      argb.r = (int) floor(((double) rgb.r) * 255.0);
+      argb.g = (int) floor(((double) rgb.g) * 255.0);
+      argb.b = (int) floor(((double) rgb.b) * 255.0);
+        
+      if (argb.r < 0) {
+        argb.r = 0;
+      }
+      if (argb.g < 0) {
+        argb.g = 0;
+      }
+      if (argb.b < 0) {
+        argb.b = 0;
+      }
+        
+      if (argb.r > 255) {
+        argb.r = 255;
+      }
+      if (argb.g > 255) {
+        argb.g = 255;
+      }
+      if (argb.b > 255) {
+        argb.b = 255;
+      }
+    }
+  }
+  
+  /* Return packed value */
+  return sph_argb_pack(&argb);
+}
+
+/*
+ * pixel_composite_memo function.
+ */
+uint32_t pixel_composite_memo(uint32_t over, uint32_t under) {
+  
+  uint64_t key = 0;
+  MEMO *pm = NULL;
+  
+  key = (((uint64_t) over) << 32) | ((uint64_t) under);
+  pm = &(m_memo[PIXEL_MEMO_COMPOSITE][memo_slot(over, under)]);
+  
+  if (pm->valid && (pm->key == key)) {
+    (m_memo_hits[PIXEL_MEMO_COMPOSITE])++;
+  } else {
+    (m_memo_misses[PIXEL_MEMO_COMPOSITE])++;
+    pm->key = key;
+    pm->val = pixel_composite(over, under);
+    pm->valid = 1;
+  }
+  
+  return pm->val;
+}
+
+/*
+ * pixel_colorize_memo function.
+ */
+uint32_t pixel_colorize_memo(uint32_t rgb_in, uint32_t rgb_tint) {
+  
+  uint64_t key = 0;
+  MEMO *pm = NULL;
+  
+  key = (((uint64_t) rgb_in) << 32) | ((uint64_t) rgb_tint);
+  pm = &(m_memo[PIXEL_MEMO_COLORIZE][memo_slot(rgb_in, rgb_tint)]);
+  
+  if (pm->valid && (pm->key == key)) {
+    (m_memo_hits[PIXEL_MEMO_COLORIZE])++;
+  } else {
+    (m_memo_misses[PIXEL_MEMO_COLORIZE])++;
+    pm->key = key;
+    pm->val = pixel_colorize(rgb_in, rgb_tint);
+    pm->valid = 1;
+  }
+  
+  return pm->val;
+}
+
+/*
+ * pixel_memo_clear function.
+ */
+void pixel_memo_clear(void) {
+  memset(m_memo, 0, sizeof(m_memo));
+}
+
+/*
+ * pixel_memo_count function.
+ */
+void pixel_memo_count(int cache, int64_t *pHits, int64_t *pMisses) {
+  
+  /* Check parameters */
+  if (((cache != PIXEL_MEMO_COMPOSITE) &&
+        (cache != PIXEL_MEMO_COLORIZE)) ||
+      (pHits == NULL) || (pMisses == NULL)) {
+    abort();
+  }
+  
+  *pHits = m_memo_hits[cache];
+  *pMisses = m_memo_misses[cache];
+}
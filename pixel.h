@@ -0,0 +1,189 @@
+#ifndef PIXEL_H_INCLUDED
+#define PIXEL_H_INCLUDED
+
+/*
+ * pixel.h
+ * 
+ * Pixel operations module of Lilac.
+ * 
+ * These are the per-pixel kernels of the rendering pipeline.  Colors
+ * are 32-bit ARGB values packed in the same format as Sophistry uses,
+ * with non-premultiplied alpha.
+ * 
+ * Textures usually have few distinct colors, so the same inputs reach
+ * the compositing and colorizing kernels over and over.  The memoized
+ * variants of these kernels remember recent results in small
+ * direct-mapped caches.  They always return exactly the same result as
+ * the plain kernels.  The caches are shared by the whole process, so
+ * the memoized variants must not be called from more than one thread.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Memo cache codes for pixel_memo_count().
+ */
+#define PIXEL_MEMO_COMPOSITE (0)
+#define PIXEL_MEMO_COLORIZE  (1)
+
+/*
+ * The number of entries in each memo cache.
+ * 
+ * This must be a power of two.
+ */
+#define PIXEL_MEMO_SIZE (4096)
+
+/*
+ * Apply fading to an RGB value.
+ * 
+ * rgb is the 32-bit ARGB color to fade.
+ * 
+ * rate is a value in range [0, 255].  If 255, then rgb is returned
+ * as-is.  If zero, then a fully transparent pixel is returned.  If in
+ * between, the alpha value in the original RGB value is scaled.
+ * 
+ * Parameters:
+ * 
+ *   rgb - the RGB value to fade
+ * 
+ *   rate - the shading rate
+ * 
+ * Return:
+ * 
+ *   the faded value
+ */
+uint32_t pixel_fade(uint32_t rgb, int rate);
+
+/*
+ * Apply alpha compositing.
+ * 
+ * over is the 32-bit ARGB color that is on top.
+ * 
+ * under is the 32-bit ARGB color that is underneath.
+ * 
+ * The gamma table must be initialized before calling, for example with
+ * gamma_sRGB().
+ * 
+ * Parameters:
+ * 
+ *   over - the over color
+ * 
+ *   under - the under color
+ * 
+ * Return:
+ * 
+ *   the composited result
+ */
+uint32_t pixel_composite(uint32_t over, uint32_t under);
+
+/*
+ * Apply colorization to the given RGB color.
+ * 
+ * rgb_in is the 32-bit ARGB color to colorize.
+ * 
+ * rgb_tint is the 24-bit RGB color to use as a tint.  The eight most
+ * significant bits are ignored.
+ * 
+ * Parameters:
+ * 
+ *   rgb_in - the input RGB
+ * 
+ *   rgb_tint - the tint
+ * 
+ * Return:
+ * 
+ *   the colorized output
+ */
+uint32_t pixel_colorize(uint32_t rgb_in, uint32_t rgb_tint);
+
+/*
+ * Get the grayscale level of a color as used by pixel_colorize().
+ * 
+ * The result of colorization only depends on this level and the tint,
+ * so pixel_colorize() is the same as passing the result of this
+ * function to pixel_colorize_gray().  This allows the 256 possible
+ * results for a tint to be computed ahead of time.
+ * 
+ * Parameters:
+ * 
+ *   rgb_in - the input RGB
+ * 
+ * Return:
+ * 
+ *   the grayscale level, in range [0, 255]
+ */
+int pixel_gray(uint32_t rgb_in);
+
+/*
+ * Apply colorization to a grayscale level.
+ * 
+ * gray_i is the level returned by pixel_gray(), in range [0, 255].
+ * 
+ * Parameters:
+ * 
+ *   gray_i - the grayscale level
+ * 
+ *   rgb_tint - the tint
+ * 
+ * Return:
+ * 
+ *   the colorized output
+ */
+uint32_t pixel_colorize_gray(int gray_i, uint32_t rgb_tint);
+
+/*
+ * Memoized version of pixel_composite().
+ * 
+ * The gamma table must not change while results are cached.  Call
+ * pixel_memo_clear() if it does.
+ * 
+ * Parameters:
+ * 
+ *   over - the over color
+ * 
+ *   under - the under color
+ * 
+ * Return:
+ * 
+ *   the composited result
+ */
+uint32_t pixel_composite_memo(uint32_t over, uint32_t under);
+
+/*
+ * Memoized version of pixel_colorize().
+ * 
+ * Parameters:
+ * 
+ *   rgb_in - the input RGB
+ * 
+ *   rgb_tint - the tint
+ * 
+ * Return:
+ * 
+ *   the colorized output
+ */
+uint32_t pixel_colorize_memo(uint32_t rgb_in, uint32_t rgb_tint);
+
+/*
+ * Empty the memo caches.
+ * 
+ * The hit and miss counts are not affected.
+ */
+void pixel_memo_clear(void);
+
+/*
+ * Get the number of hits and misses of a memo cache since the program
+ * started.
+ * 
+ * Parameters:
+ * 
+ *   cache - PIXEL_MEMO_COMPOSITE or PIXEL_MEMO_COLORIZE
+ * 
+ *   pHits - receives the number of hits
+ * 
+ *   pMisses - receives the number of misses
+ */
+void pixel_memo_count(int cache, int64_t *pHits, int64_t *pMisses);
+
+#endif
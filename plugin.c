@@ -0,0 +1,589 @@
+/*
+ * plugin.c
+ * 
+ * Implementation of plugin.h
+ * 
+ * See the header for further information.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "plugin.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <dlfcn.h>
+
+#include "lilac_plugin.h"
+
+/*
+ * Type declarations
+ * =================
+ */
+
+/*
+ * An open shared object.
+ */
+typedef struct {
+  
+  /*
+   * Dynamic copy of the path the object was opened with.
+   */
+  char *pPath;
+  
+  /*
+   * The handle returned by dlopen().
+   */
+  void *pHandle;
+  
+  /*
+   * The query function of the plugin.
+   */
+  LILAC_PLUGIN_QUERY_FN fQuery;
+  
+} PLIB;
+
+/*
+ * A loaded shader.
+ */
+typedef struct {
+  
+  /*
+   * The description returned by the plugin.
+   */
+  const LILAC_PLUGIN_SHADER *ps;
+  
+  /*
+   * The shared data set by fInit.
+   */
+  void *pShared;
+  
+  /*
+   * The default context.
+   */
+  PLUGIN_CONTEXT *pDefault;
+  
+} PSHADER;
+
+/*
+ * PLUGIN_CONTEXT structure.
+ * 
+ * Prototype given in header.
+ */
+struct PLUGIN_CONTEXT_TAG {
+  
+  /*
+   * The shader this context belongs to.
+   */
+  const PSHADER *pShader;
+  
+  /*
+   * The context returned by fThreadInit.
+   */
+  void *pCtx;
+  
+  /*
+   * One past the end of the most recent span and its Y coordinate, used
+   * for enforcing the scanning order of shaders that are not
+   * random-access.
+   */
+  int32_t last_end;
+  int32_t last_y;
+
+};
+
+/*
+ * Local data
+ * ==========
+ */
+
+/*
+ * The open shared objects.
+ * 
+ * There can't be more objects than shaders, since objects are only
+ * opened when a shader is loaded from them.
+ */
+static PLIB m_lib[PLUGIN_MAXCOUNT];
+static int m_lib_count = 0;
+
+/*
+ * The loaded shaders.
+ */
+static PSHADER m_shader[PLUGIN_MAXCOUNT];
+static int m_shader_count = 0;
+
+/*
+ * Local functions
+ * ===============
+ */
+
+/* Prototypes */
+static PLIB *plugin_lib(const char *pPath, int *perr);
+static PLUGIN_CONTEXT *plugin_ctx(const PSHADER *pShader, int *perr);
+
+/*
+ * Get an open shared object, opening it if necessary.
+ * 
+ * Parameters:
+ * 
+ *   pPath - the path to the shared object
+ * 
+ *   perr - receives an error code if the function fails
+ * 
+ * Return:
+ * 
+ *   the open shared object, or NULL if error
+ */
+static PLIB *plugin_lib(const char *pPath, int *perr) {
+  
+  int status = 1;
+  int i = 0;
+  void *pHandle = NULL;
+  void *pSym = NULL;
+  PLIB *pl = NULL;
+  
+  /* Look for an object that is already open */
+  for(i = 0; i < m_lib_count; i++) {
+    if (strcmp(m_lib[i].pPath, pPath) == 0) {
+      return &(m_lib[i]);
+    }
+  }
+  
+  /* Open the object */
+  pHandle = dlopen(pPath, RTLD_NOW | RTLD_LOCAL);
+  if (pHandle == NULL) {
+    status = 0;
+    *perr = PLUGIN_ERR_OPEN;
+  }
+  
+  /* Find the query function */
+  if (status) {
+    pSym = dlsym(pHandle, LILAC_PLUGIN_QUERY_NAME);
+    if (pSym == NULL) {
+      status = 0;
+      *perr = PLUGIN_ERR_QUERY;
+    }
+  }
+  
+  /* Add to the table */
+  if (status) {
+    pl = &(m_lib[m_lib_count]);
+    pl->pPath = (char *) malloc(strlen(pPath) + 1);
+    if (pl->pPath == NULL) {
+      abort();
+    }
+    strcpy(pl->pPath, pPath);
+    pl->pHandle = pHandle;
+    
+    /* POSIX guarantees that data pointers returned by dlsym() can be
+     * converted to function pointers this way */
+    memcpy(&(pl->fQuery), &pSym, sizeof(void *));
+    
+    m_lib_count++;
+    pHandle = NULL;
+  }
+  
+  /* Close the object if it wasn't added */
+  if (pHandle != NULL) {
+    dlclose(pHandle);
+    pHandle = NULL;
+  }
+  
+  return pl;
+}
+
+/*
+ * Create a context on a loaded shader.
+ * 
+ * Parameters:
+ * 
+ *   pShader - the shader
+ * 
+ *   perr - receives an error code if the function fails
+ * 
+ * Return:
+ * 
+ *   the new context, or NULL if error
+ */
+static PLUGIN_CONTEXT *plugin_ctx(const PSHADER *pShader, int *perr) {
+  
+  PLUGIN_CONTEXT *pc = NULL;
+  
+  /* Allocate the context */
+  pc = (PLUGIN_CONTEXT *) calloc(1, sizeof(PLUGIN_CONTEXT));
+  if (pc == NULL) {
+    abort();
+  }
+  pc->pShader = pShader;
+  pc->last_end = 0;
+  pc->last_y = 0;
+  
+  /* Create the thread context of the shader */
+  if (pShader->ps->fThreadInit != NULL) {
+    pc->pCtx = pShader->ps->fThreadInit(pShader->pShared);
+    if (pc->pCtx == NULL) {
+      free(pc);
+      pc = NULL;
+      *perr = PLUGIN_ERR_CTX;
+    }
+  } else {
+    pc->pCtx = pShader->pShared;
+  }
+  
+  return pc;
+}
+
+/*
+ * Public function implementations
+ * ===============================
+ * 
+ * See the header for specifications.
+ */
+
+/*
+ * plugin_errorString function.
+ */
+const char *plugin_errorString(int code) {
+  
+  const char *pResult = NULL;
+  
+  switch (code) {
+    case PLUGIN_ERR_NONE:
+      pResult = "No error";
+      break;
+    
+    case PLUGIN_ERR_OPEN:
+      pResult = "Failed to open plugin shared object";
+      break;
+    
+    case PLUGIN_ERR_QUERY:
+      pResult = "Plugin does not export " LILAC_PLUGIN_QUERY_NAME;
+      break;
+    
+    case PLUGIN_ERR_NOTFND:
+      pResult = "Plugin does not provide the shader";
+      break;
+    
+    case PLUGIN_ERR_VERSION:
+      pResult = "Plugin shader was built for a different ABI version";
+      break;
+    
+    case PLUGIN_ERR_PERIOD:
+      pResult = "Plugin shader declares an invalid period";
+      break;
+    
+    case PLUGIN_ERR_INIT:
+      pResult = "Plugin shader failed to initialize";
+      break;
+    
+    case PLUGIN_ERR_CTX:
+      pResult = "Failed to create plugin shader context";
+      break;
+    
+    case PLUGIN_ERR_SPAN:
+      pResult = "Plugin shader failed";
+      break;
+    
+    case PLUGIN_ERR_FULL:
+      pResult = "Too many plugin shaders";
+      break;
+    
+    default:
+      pResult = "Unknown error";
+  }
+  
+  return pResult;
+}
+
+/*
+ * plugin_load function.
+ */
+int plugin_load(const char *pPath, const char *pName, int *perr) {
+  
+  int status = 1;
+  int inited = 0;
+  PLIB *pl = NULL;
+  PSHADER *psh = NULL;
+  const LILAC_PLUGIN_SHADER *ps = NULL;
+  
+  /* Check parameters */
+  if ((pPath == NULL) || (pName == NULL) || (perr == NULL)) {
+    abort();
+  }
+  
+  /* Reset error indicator */
+  *perr = PLUGIN_ERR_NONE;
+  
+  /* Make sure there is room */
+  if (m_shader_count >= PLUGIN_MAXCOUNT) {
+    status = 0;
+    *perr = PLUGIN_ERR_FULL;
+  }
+  
+  /* Get the shared object */
+  if (status) {
+    pl = plugin_lib(pPath, perr);
+    if (pl == NULL) {
+      status = 0;
+    }
+  }
+  
+  /* Query the shader */
+  if (status) {
+    ps = pl->fQuery(pName, (uint32_t) LILAC_PLUGIN_ABI_VERSION);
+    if (ps == NULL) {
+      status = 0;
+      *perr = PLUGIN_ERR_NOTFND;
+    }
+  }
+  
+  /* Check the description */
+  if (status) {
+    if ((ps->version != LILAC_PLUGIN_ABI_VERSION) ||
+        (ps->fSpan == NULL)) {
+      status = 0;
+      *perr = PLUGIN_ERR_VERSION;
+    }
+  }
+  
+  if (status && (ps->flags & LILAC_PLUGIN_PURE)) {
+    if ((ps->period_w < 1) || (ps->period_w > PLUGIN_MAXPERIOD) ||
+        (ps->period_h < 1) || (ps->period_h > PLUGIN_MAXPERIOD)) {
+      status = 0;
+      *perr = PLUGIN_ERR_PERIOD;
+    }
+  }
+  
+  /* Initialize the shader */
+  if (status) {
+    psh = &(m_shader[m_shader_count]);
+    memset(psh, 0, sizeof(PSHADER));
+    psh->ps = ps;
+    psh->pShared = NULL;
+    
+    if (ps->fInit != NULL) {
+      if (!(ps->fInit(&(psh->pShared)))) {
+        status = 0;
+        *perr = PLUGIN_ERR_INIT;
+      }
+    }
+    if (status) {
+      inited = 1;
+    }
+  }
+  
+  /* Create the default context */
+  if (status) {
+    psh->pDefault = plugin_ctx(psh, perr);
+    if (psh->pDefault == NULL) {
+      status = 0;
+    }
+  }
+  
+  /* Add the shader, or tear it down if it was initialized but the
+   * default context failed */
+  if (status) {
+    m_shader_count++;
+  
+  } else if (inited) {
+    if (ps->fTeardown != NULL) {
+      ps->fTeardown(psh->pShared);
+    }
+    psh->pShared = NULL;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * plugin_count function.
+ */
+int plugin_count(void) {
+  return m_shader_count;
+}
+
+/*
+ * plugin_pure function.
+ */
+int plugin_pure(int pidx, int32_t *pw, int32_t *ph) {
+  
+  const LILAC_PLUGIN_SHADER *ps = NULL;
+  
+  /* Check parameters */
+  if ((pidx < 1) || (pidx > m_shader_count) ||
+      (pw == NULL) || (ph == NULL)) {
+    abort();
+  }
+  ps = m_shader[pidx - 1].ps;
+  
+  /* Report the period if pure */
+  if (ps->flags & LILAC_PLUGIN_PURE) {
+    *pw = ps->period_w;
+    *ph = ps->period_h;
+    return 1;
+  }
+  
+  return 0;
+}
+
+/*
+ * plugin_rewind function.
+ */
+void plugin_rewind(void) {
+  
+  int i = 0;
+  
+  for(i = 0; i < m_shader_count; i++) {
+    plugin_context_rewind(m_shader[i].pDefault);
+  }
+}
+
+/*
+ * plugin_span function.
+ */
+int plugin_span(
+    int        pidx,
+    int32_t    x,
+    int32_t    y,
+    int32_t    count,
+    int32_t    width,
+    int32_t    height,
+    uint32_t * pOut,
+    int      * perr) {
+  
+  /* Check parameter */
+  if ((pidx < 1) || (pidx > m_shader_count)) {
+    abort();
+  }
+  
+  return plugin_context_span(m_shader[pidx - 1].pDefault,
+                              x, y, count, width, height, pOut, perr);
+}
+
+/*
+ * plugin_context_new function.
+ */
+PLUGIN_CONTEXT *plugin_context_new(int pidx, int *perr) {
+  
+  /* Check parameters */
+  if ((pidx < 1) || (pidx > m_shader_count) || (perr == NULL)) {
+    abort();
+  }
+  
+  /* Reset error indicator */
+  *perr = PLUGIN_ERR_NONE;
+  
+  return plugin_ctx(&(m_shader[pidx - 1]), perr);
+}
+
+/*
+ * plugin_context_free function.
+ */
+void plugin_context_free(PLUGIN_CONTEXT *pc) {
+  if (pc != NULL) {
+    if ((pc->pShader->ps->fThreadInit != NULL) &&
+        (pc->pShader->ps->fThreadFree != NULL)) {
+      pc->pShader->ps->fThreadFree(pc->pCtx);
+    }
+    pc->pCtx = NULL;
+    free(pc);
+  }
+}
+
+/*
+ * plugin_context_rewind function.
+ */
+void plugin_context_rewind(PLUGIN_CONTEXT *pc) {
+  if (pc == NULL) {
+    abort();
+  }
+  pc->last_end = 0;
+  pc->last_y = 0;
+}
+
+/*
+ * plugin_context_span function.
+ */
+int plugin_context_span(
+    PLUGIN_CONTEXT * pc,
+    int32_t          x,
+    int32_t          y,
+    int32_t          count,
+    int32_t          width,
+    int32_t          height,
+    uint32_t       * pOut,
+    int            * perr) {
+  
+  int status = 1;
+  uint32_t flags = 0;
+  
+  /* Check parameters */
+  if ((pc == NULL) || (pOut == NULL) || (perr == NULL)) {
+    abort();
+  }
+  if ((width < 1) || (height < 1) || (count < 0)) {
+    abort();
+  }
+  if ((x < 0) || (y < 0) || (y >= height) || (x > width - count)) {
+    abort();
+  }
+  
+  /* Reset error indicator */
+  *perr = PLUGIN_ERR_NONE;
+  
+  /* Enforce the scanning order unless the shader is random-access;
+   * each span must start at or after the end of the previous one */
+  flags = pc->pShader->ps->flags;
+  if ((y > pc->last_y) || ((y == pc->last_y) && (x >= pc->last_end))) {
+    pc->last_end = x + count;
+    pc->last_y = y;
+  
+  } else if (!(flags & (LILAC_PLUGIN_RANDOM | LILAC_PLUGIN_PURE))) {
+    abort();
+  }
+  
+  /* Evaluate the span */
+  if (count > 0) {
+    if (!(pc->pShader->ps->fSpan(pc->pCtx, x, y, count,
+                                  width, height, pOut))) {
+      status = 0;
+      *perr = PLUGIN_ERR_SPAN;
+    }
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * plugin_close function.
+ */
+void plugin_close(void) {
+  
+  int i = 0;
+  PSHADER *psh = NULL;
+  
+  /* Tear down the shaders in reverse order */
+  for(i = m_shader_count - 1; i >= 0; i--) {
+    psh = &(m_shader[i]);
+    plugin_context_free(psh->pDefault);
+    psh->pDefault = NULL;
+    if (psh->ps->fTeardown != NULL) {
+      psh->ps->fTeardown(psh->pShared);
+    }
+    psh->pShared = NULL;
+    psh->ps = NULL;
+  }
+  m_shader_count = 0;
+  
+  /* Close the shared objects */
+  for(i = 0; i < m_lib_count; i++) {
+    dlclose(m_lib[i].pHandle);
+    m_lib[i].pHandle = NULL;
+    free(m_lib[i].pPath);
+    m_lib[i].pPath = NULL;
+  }
+  m_lib_count = 0;
+}
@@ -0,0 +1,286 @@
+#ifndef PLUGIN_H_INCLUDED
+#define PLUGIN_H_INCLUDED
+
+/*
+ * plugin.h
+ * 
+ * Shader plugin module of Lilac.
+ * 
+ * This module loads procedural texture shaders from shared objects
+ * with dlopen().  See lilac_plugin.h for the interface that plugins
+ * implement.
+ * 
+ * Each loaded shader has a default context, which is created when the
+ * shader is loaded and used by plugin_span().  Further contexts can be
+ * opened with plugin_context_new() for use on other threads.  Each
+ * context remembers its scanning position, and unless the shader
+ * declares LILAC_PLUGIN_RANDOM or LILAC_PLUGIN_PURE, spans on a context
+ * may not start before the start of the previous span in scanning
+ * order.
+ * 
+ * Shared objects are only opened once, no matter how many of their
+ * shaders are loaded, and they stay open until plugin_close().
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Error codes.
+ * 
+ * Don't forget to update plugin_errorString()!
+ */
+#define PLUGIN_ERR_NONE    (0)  /* No error */
+#define PLUGIN_ERR_OPEN    (1)  /* Failed to open shared object */
+#define PLUGIN_ERR_QUERY   (2)  /* No query function in shared object */
+#define PLUGIN_ERR_NOTFND  (3)  /* Shader not found in plugin */
+#define PLUGIN_ERR_VERSION (4)  /* Shader has wrong ABI version */
+#define PLUGIN_ERR_PERIOD  (5)  /* Invalid period of pure shader */
+#define PLUGIN_ERR_INIT    (6)  /* Shader failed to initialize */
+#define PLUGIN_ERR_CTX     (7)  /* Failed to create shader context */
+#define PLUGIN_ERR_SPAN    (8)  /* Shader failed to evaluate span */
+#define PLUGIN_ERR_FULL    (9)  /* Too many plugin shaders */
+
+/*
+ * The maximum number of plugin shaders that can be loaded.
+ */
+#define PLUGIN_MAXCOUNT (256)
+
+/*
+ * The maximum value of each dimension of the period of a pure shader.
+ */
+#define PLUGIN_MAXPERIOD (2048)
+
+/*
+ * Opaque context structure.
+ */
+struct PLUGIN_CONTEXT_TAG;
+typedef struct PLUGIN_CONTEXT_TAG PLUGIN_CONTEXT;
+
+/*
+ * Given a plugin error code, return an error message.
+ * 
+ * The error message begins with a capital letter but does not have any
+ * punctuation or line break at the end.
+ * 
+ * If zero is passed, "No error" is returned.  If an unknown error code
+ * is passed, "Unknown error" is returned.
+ * 
+ * Parameters:
+ * 
+ *   code - the error code to look up
+ * 
+ * Return:
+ * 
+ *   an error message for the code
+ */
+const char *plugin_errorString(int code);
+
+/*
+ * Load a shader from a plugin.
+ * 
+ * pPath is the path to the shared object, which is passed to dlopen().
+ * pName is the name of the shader within the plugin.
+ * 
+ * The shader is looked up with the query function of the plugin and
+ * checked, its fInit function is called, and its default context is
+ * created.  perr points to a variable to receive an error code, which
+ * is one of the constants PLUGIN_ERR_.  PLUGIN_ERR_NONE is written if
+ * successful.
+ * 
+ * Shaders are numbered starting at one, in the order they are loaded.
+ * The number of the new shader is the same as plugin_count() after the
+ * call.
+ * 
+ * Parameters:
+ * 
+ *   pPath - the path to the shared object
+ * 
+ *   pName - the name of the shader
+ * 
+ *   perr - pointer to a variable to receive an error code
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+int plugin_load(const char *pPath, const char *pName, int *perr);
+
+/*
+ * Return the number of plugin shaders that have been loaded.
+ * 
+ * Return:
+ * 
+ *   the number of shaders
+ */
+int plugin_count(void);
+
+/*
+ * Check whether a plugin shader is pure and periodic.
+ * 
+ * pidx is the one-indexed shader number.  It must be in range one up to
+ * and including plugin_count().
+ * 
+ * If the shader declares LILAC_PLUGIN_PURE, its period is written to
+ * *pw and *ph and non-zero is returned.  Otherwise, zero is returned.
+ * 
+ * Parameters:
+ * 
+ *   pidx - the shader
+ * 
+ *   pw - receives the width of the period
+ * 
+ *   ph - receives the height of the period
+ * 
+ * Return:
+ * 
+ *   non-zero if the shader is pure, zero otherwise
+ */
+int plugin_pure(int pidx, int32_t *pw, int32_t *ph);
+
+/*
+ * Reset the scanning order of the default contexts of all shaders.
+ * 
+ * Use this between separate renders.
+ */
+void plugin_rewind(void);
+
+/*
+ * Evaluate a span of a plugin shader using its default context.
+ * 
+ * pidx is the one-indexed shader number.  It must be in range one up to
+ * and including plugin_count().  The other parameters and the return
+ * value are the same as for plugin_context_span().
+ * 
+ * Parameters:
+ * 
+ *   pidx - the shader
+ * 
+ *   x - the X coordinate of the first pixel
+ * 
+ *   y - the Y coordinate of the span
+ * 
+ *   count - the number of pixels
+ * 
+ *   width - the width of the output image
+ * 
+ *   height - the height of the output image
+ * 
+ *   pOut - receives the ARGB pixels
+ * 
+ *   perr - pointer to a variable to receive an error code
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+int plugin_span(
+    int        pidx,
+    int32_t    x,
+    int32_t    y,
+    int32_t    count,
+    int32_t    width,
+    int32_t    height,
+    uint32_t * pOut,
+    int      * perr);
+
+/*
+ * Open a new context on a plugin shader.
+ * 
+ * pidx is the one-indexed shader number.  It must be in range one up to
+ * and including plugin_count().  The scanning position of the new
+ * context starts at the top-left corner.
+ * 
+ * This function may be called from any thread.  All contexts must be
+ * freed with plugin_context_free() before plugin_close() is called.
+ * 
+ * Parameters:
+ * 
+ *   pidx - the shader
+ * 
+ *   perr - pointer to a variable to receive an error code
+ * 
+ * Return:
+ * 
+ *   the new context, or NULL if error
+ */
+PLUGIN_CONTEXT *plugin_context_new(int pidx, int *perr);
+
+/*
+ * Free a context opened with plugin_context_new().
+ * 
+ * If NULL is passed, the call is ignored.
+ * 
+ * Parameters:
+ * 
+ *   pc - the context to free, or NULL
+ */
+void plugin_context_free(PLUGIN_CONTEXT *pc);
+
+/*
+ * Reset the scanning order of a context back to the top-left corner.
+ * 
+ * Parameters:
+ * 
+ *   pc - the context
+ */
+void plugin_context_rewind(PLUGIN_CONTEXT *pc);
+
+/*
+ * Evaluate a span of a plugin shader using a given context.
+ * 
+ * The pixels from (x, y) up to but excluding (x + count, y) are
+ * written to pOut, which must have room for count pixels.  width and
+ * height are the dimensions of the output image, which must be greater
+ * than zero, and the whole span must be within the image.  If count is
+ * zero, nothing is done.
+ * 
+ * Unless the shader is random-access, spans must be requested in the
+ * order given in lilac_plugin.h, so each span must start at or after
+ * the end of the previous span of the context.  A fault occurs
+ * otherwise.
+ * 
+ * If the shader fails, zero is returned and *perr is set to
+ * PLUGIN_ERR_SPAN.  Otherwise, *perr is set to PLUGIN_ERR_NONE.
+ * 
+ * Parameters:
+ * 
+ *   pc - the context
+ * 
+ *   x - the X coordinate of the first pixel
+ * 
+ *   y - the Y coordinate of the span
+ * 
+ *   count - the number of pixels
+ * 
+ *   width - the width of the output image
+ * 
+ *   height - the height of the output image
+ * 
+ *   pOut - receives the ARGB pixels
+ * 
+ *   perr - pointer to a variable to receive an error code
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+int plugin_context_span(
+    PLUGIN_CONTEXT * pc,
+    int32_t          x,
+    int32_t          y,
+    int32_t          count,
+    int32_t          width,
+    int32_t          height,
+    uint32_t       * pOut,
+    int            * perr);
+
+/*
+ * Tear down all plugin shaders and close all shared objects.
+ * 
+ * Default contexts are freed, fTeardown is called for each shader, and
+ * the shared objects are closed.
+ */
+void plugin_close(void);
+
+#endif
@@ -7,7 +7,11 @@
  */
 #include "pshade.h"
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
 
 /* Lua headers */
 #include <lua.h>
@@ -15,28 +19,1360 @@
 #include <lualib.h>
 
 /*
- * Constants
- * =========
+ * Constants
+ * =========
+ */
+
+/*
+ * Number of entries required on the Lua interpreter stack.
+ * 
+ * We need space for a function object, four parameters, and one return
+ * value.
+ */
+#define PSHADE_LSTACK_HEIGHT (6)
+
+/*
+ * Block sizes of the pooled allocator.
+ * 
+ * Blocks of up to PSHADE_POOL_MAX bytes are rounded up to a multiple of
+ * PSHADE_POOL_GRAIN and served from the pool.  Larger blocks go
+ * straight to the system allocator.
+ */
+#define PSHADE_POOL_GRAIN (16)
+#define PSHADE_POOL_MAX (256)
+#define PSHADE_POOL_CLASSES (PSHADE_POOL_MAX / PSHADE_POOL_GRAIN)
+
+/*
+ * The number of bytes in each chunk that pool blocks are carved from,
+ * not counting the chunk header.
+ */
+#define PSHADE_POOL_CHUNK (65536)
+
+/*
+ * Type declarations
+ * =================
+ */
+
+/*
+ * The work of one baking thread.
+ */
+typedef struct {
+  
+  /*
+   * The interpreter, or NULL if the worker should open its own.
+   */
+  lua_State *L;
+  
+  /*
+   * The shader name, the image dimensions, and the pixel buffer.
+   */
+  const char *pShader;
+  int32_t w;
+  int32_t h;
+  uint32_t *pData;
+  
+  /*
+   * The worker bakes rows first, first + step, first + 2 * step, and
+   * so forth.
+   */
+  int32_t first;
+  int32_t step;
+  
+  /*
+   * Receives the error code of the worker.
+   */
+  int err;
+  
+} BAKEJOB;
+
+/*
+ * Header of a chunk of the pooled allocator.
+ * 
+ * The union makes sure that the blocks following the header are
+ * aligned for any type.  Since PSHADE_POOL_GRAIN is a multiple of that
+ * alignment on common platforms, so are all the blocks.
+ */
+typedef union SHADE_CHUNK_TAG {
+  union SHADE_CHUNK_TAG *pNext;
+  long double align_ld;
+  void *align_p;
+  int64_t align_i;
+} SHADE_CHUNK;
+
+/*
+ * The pooled allocator of one interpreter.
+ * 
+ * This is the user data of the lua_Alloc function of the interpreter.
+ */
+typedef struct {
+  
+  /*
+   * Free lists of pool blocks, indexed by size class.  Each free block
+   * begins with a pointer to the next free block of its class.
+   */
+  void *pFree[PSHADE_POOL_CLASSES];
+  
+  /*
+   * All chunks of this allocator, linked through their headers.
+   */
+  SHADE_CHUNK *pChunks;
+  
+  /*
+   * The part of the newest chunk that has not been carved into blocks
+   * yet.
+   */
+  unsigned char *pCarve;
+  size_t left;
+  
+  /*
+   * Memory statistics.
+   */
+  PSHADE_MEMSTATS st;
+  
+} SHADE_HEAP;
+
+/*
+ * The state of one shader on one context.
+ * 
+ * A context has one of these for each shader that has been queried on
+ * it, so that the generator declaration is only looked up once, and so
+ * that generators keep their coroutine from one query to the next.
+ */
+typedef struct {
+  
+  /*
+   * Dynamic copy of the shader name.
+   */
+  char *pName;
+  
+  /*
+   * Non-zero if the shader is declared a generator.
+   */
+  int gen;
+  
+  /*
+   * Registry reference to the coroutine of the current scanline of a
+   * generator, or LUA_NOREF if there is none.
+   */
+  int ref;
+  
+  /*
+   * The scanline of the coroutine, the number of pixels it has yielded
+   * so far, and the most recent pixel it yielded.
+   */
+  int32_t y;
+  int32_t next_x;
+  uint32_t last;
+  
+  /*
+   * The coordinates of the most recent in-order query of the shader,
+   * used for enforcing its scanning order if it is not declared
+   * random-access.
+   */
+  int32_t scan_x;
+  int32_t scan_y;
+  
+} SHADE_GEN;
+
+/*
+ * PSHADE_CONTEXT structure.
+ * 
+ * Prototype given in header.
+ */
+struct PSHADE_CONTEXT_TAG {
+  
+  /*
+   * The interpreter of this context, or NULL if not loaded.
+   */
+  lua_State *L;
+  
+  /*
+   * The scanline of the most recent pixel query, used for collecting
+   * garbage between scanlines in the PSHADE_GC_ROWS mode.
+   */
+  int32_t gc_y;
+  
+  /*
+   * The state of each shader queried on this context.  gen_count
+   * entries are in use out of gen_cap allocated.
+   */
+  SHADE_GEN *pGen;
+  int gen_count;
+  int gen_cap;
+  
+};
+
+/*
+ * Local data
+ * ==========
+ */
+
+/*
+ * The default context, which is used by pshade_pixel().
+ * 
+ * The interpreter is NULL if pshade_load() has not been called yet.
+ * Use pshade_rewind() to reset the scanning order back to the top-left
+ * corner.
+ */
+static PSHADE_CONTEXT m_ctx = {NULL, 0, NULL, 0, 0};
+
+/*
+ * The garbage collector mode, which is one of the PSHADE_GC_
+ * constants.
+ */
+static int m_gcmode = PSHADE_GC_INCREMENTAL;
+
+/*
+ * Dynamic copy of the path of the loaded script, or NULL if not
+ * loaded.
+ * 
+ * Baking threads use this to load their own copies of the script.
+ */
+static char *m_pScriptPath = NULL;
+
+/*
+ * Local functions
+ * ===============
+ */
+
+/* Prototypes */
+static void *shade_pool_get(SHADE_HEAP *ph, int cls);
+static void *shade_alloc(
+    void   * ud,
+    void   * ptr,
+    size_t   osize,
+    size_t   nsize);
+static void shade_heap_free(SHADE_HEAP *ph);
+static int shade_panic(lua_State *L);
+static lua_State *shade_open(const char *pScriptPath, int *perr);
+static void shade_close(lua_State *L);
+static void shade_collect(lua_State *L);
+static void shade_check_name(const char *pShader);
+static uint32_t shade_call(
+          lua_State * L,
+    const char      * pShader,
+          int32_t     x,
+          int32_t     y,
+          int32_t     width,
+          int32_t     height,
+          int       * perr);
+static void *shade_bake_thread(void *pArg);
+static int shade_random(lua_State *L, const char *pShader);
+static int shade_generator(lua_State *L, const char *pShader);
+static SHADE_GEN *shade_slot(PSHADE_CONTEXT *pc, const char *pShader);
+static void shade_slots_free(PSHADE_CONTEXT *pc);
+static void shade_gen_release(lua_State *L, SHADE_GEN *pg);
+static int shade_gen_start(
+          lua_State * L,
+    const char      * pShader,
+          SHADE_GEN * pg,
+          int32_t     y,
+          int32_t     width,
+          int32_t     height,
+          int       * perr);
+static uint32_t shade_gen_next(lua_State *L, lua_State *co, int *perr);
+static int shade_gen_span(
+          lua_State * L,
+    const char      * pShader,
+          SHADE_GEN * pg,
+          int32_t     x,
+          int32_t     y,
+          int32_t     count,
+          int32_t     width,
+          int32_t     height,
+          uint32_t  * pOut,
+          int       * perr);
+static void shade_order(
+          lua_State * L,
+    const char      * pShader,
+          SHADE_GEN * pg,
+          int32_t     x,
+          int32_t     y);
+
+/*
+ * Get a block of a given size class from a pooled allocator.
+ * 
+ * The block is taken from the free list of its class if possible, or
+ * carved out of the newest chunk otherwise.  A new chunk is allocated
+ * when the newest one is used up, and what was left of the old one is
+ * put on the free list of the size class that fits it.
+ * 
+ * Parameters:
+ * 
+ *   ph - the allocator
+ * 
+ *   cls - the size class, where blocks are (cls + 1) times
+ *   PSHADE_POOL_GRAIN bytes
+ * 
+ * Return:
+ * 
+ *   the block, or NULL if out of memory
+ */
+static void *shade_pool_get(SHADE_HEAP *ph, int cls) {
+  
+  void *pBlock = NULL;
+  size_t bsize = 0;
+  SHADE_CHUNK *pChunk = NULL;
+  
+  bsize = ((size_t) (cls + 1)) * PSHADE_POOL_GRAIN;
+  
+  /* Reuse a free block if there is one */
+  if (ph->pFree[cls] != NULL) {
+    pBlock = ph->pFree[cls];
+    memcpy(&(ph->pFree[cls]), pBlock, sizeof(void *));
+    return pBlock;
+  }
+  
+  /* Start a new chunk if the newest one is used up */
+  if (ph->left < bsize) {
+    pChunk = (SHADE_CHUNK *) malloc(
+                sizeof(SHADE_CHUNK) + PSHADE_POOL_CHUNK);
+    if (pChunk == NULL) {
+      return NULL;
+    }
+    (ph->st.sysallocs)++;
+    
+    if (ph->left >= PSHADE_POOL_GRAIN) {
+      memcpy(ph->pCarve,
+              &(ph->pFree[(ph->left / PSHADE_POOL_GRAIN) - 1]),
+              sizeof(void *));
+      ph->pFree[(ph->left / PSHADE_POOL_GRAIN) - 1] = ph->pCarve;
+    }
+    
+    pChunk->pNext = ph->pChunks;
+    ph->pChunks = pChunk;
+    ph->pCarve = (unsigned char *) (pChunk + 1);
+    ph->left = PSHADE_POOL_CHUNK;
+  }
+  
+  /* Carve the block out of the newest chunk */
+  pBlock = ph->pCarve;
+  ph->pCarve += bsize;
+  ph->left -= bsize;
+  
+  return pBlock;
+}
+
+/*
+ * The lua_Alloc function of shader interpreters.
+ * 
+ * ud is the SHADE_HEAP of the interpreter.  Lua always passes the size
+ * of existing blocks in osize, so pool blocks need no header.  Blocks
+ * only move between the pool and the system allocator when a
+ * reallocation crosses PSHADE_POOL_MAX.
+ * 
+ * Parameters:
+ * 
+ *   ud - the allocator
+ * 
+ *   ptr - the existing block, or NULL
+ * 
+ *   osize - the size of the existing block, or a type code if ptr is
+ *   NULL
+ * 
+ *   nsize - the requested size, or zero to free the block
+ * 
+ * Return:
+ * 
+ *   the block, or NULL if the block was freed or out of memory
+ */
+static void *shade_alloc(
+    void   * ud,
+    void   * ptr,
+    size_t   osize,
+    size_t   nsize) {
+  
+  SHADE_HEAP *ph = NULL;
+  void *pNew = NULL;
+  int ocls = -1;
+  int ncls = -1;
+  
+  ph = (SHADE_HEAP *) ud;
+  
+  /* For new blocks, osize is a type code rather than a size */
+  if (ptr == NULL) {
+    osize = 0;
+  }
+  
+  /* Get the size classes of the old and new blocks, or -1 for blocks
+   * that belong to the system allocator */
+  if ((ptr != NULL) && (osize <= PSHADE_POOL_MAX)) {
+    ocls = (int) ((osize + PSHADE_POOL_GRAIN - 1) /
+                    PSHADE_POOL_GRAIN) - 1;
+    if (ocls < 0) {
+      ocls = 0;
+    }
+  }
+  if ((nsize > 0) && (nsize <= PSHADE_POOL_MAX)) {
+    ncls = (int) ((nsize + PSHADE_POOL_GRAIN - 1) /
+                    PSHADE_POOL_GRAIN) - 1;
+  }
+  
+  /* Free the block */
+  if (nsize < 1) {
+    if (ptr != NULL) {
+      if (ocls >= 0) {
+        memcpy(ptr, &(ph->pFree[ocls]), sizeof(void *));
+        ph->pFree[ocls] = ptr;
+      } else {
+        free(ptr);
+      }
+      ph->st.bytes -= (int64_t) osize;
+    }
+    return NULL;
+  }
+  
+  (ph->st.allocs)++;
+  
+  if ((ptr != NULL) && (ocls >= 0) && (ocls == ncls)) {
+    /* Pool block that still fits its class */
+    pNew = ptr;
+  
+  } else if ((ptr != NULL) && (ocls < 0) && (ncls < 0)) {
+    /* System block that stays a system block */
+    pNew = realloc(ptr, nsize);
+    if (pNew == NULL) {
+      return NULL;
+    }
+    (ph->st.sysallocs)++;
+  
+  } else {
+    /* New block, or a block that moves to a different class or between
+     * the pool and the system allocator */
+    if (ncls >= 0) {
+      pNew = shade_pool_get(ph, ncls);
+    } else {
+      pNew = malloc(nsize);
+      if (pNew != NULL) {
+        (ph->st.sysallocs)++;
+      }
+    }
+    if (pNew == NULL) {
+      return NULL;
+    }
+    
+    if (ptr != NULL) {
+      memcpy(pNew, ptr, (osize < nsize) ? osize : nsize);
+      if (ocls >= 0) {
+        memcpy(ptr, &(ph->pFree[ocls]), sizeof(void *));
+        ph->pFree[ocls] = ptr;
+      } else {
+        free(ptr);
+      }
+    }
+  }
+  
+  /* Update the accounting */
+  ph->st.bytes += ((int64_t) nsize) - ((int64_t) osize);
+  if (ph->st.bytes > ph->st.peak) {
+    ph->st.peak = ph->st.bytes;
+  }
+  
+  return pNew;
+}
+
+/*
+ * Release a pooled allocator and all of its chunks.
+ * 
+ * The interpreter using the allocator must already be closed.
+ * 
+ * Parameters:
+ * 
+ *   ph - the allocator, or NULL
+ */
+static void shade_heap_free(SHADE_HEAP *ph) {
+  
+  SHADE_CHUNK *pChunk = NULL;
+  
+  if (ph != NULL) {
+    while (ph->pChunks != NULL) {
+      pChunk = ph->pChunks;
+      ph->pChunks = pChunk->pNext;
+      free(pChunk);
+    }
+    free(ph);
+  }
+}
+
+/*
+ * The panic function of shader interpreters.
+ * 
+ * This is the same as the one that luaL_newstate() installs.  It is
+ * only called for errors outside of a protected call, which are
+ * fatal.
+ * 
+ * Parameters:
+ * 
+ *   L - the interpreter
+ * 
+ * Return:
+ * 
+ *   zero, after which Lua aborts
+ */
+static int shade_panic(lua_State *L) {
+  
+  const char *pMsg = NULL;
+  
+  pMsg = lua_tostring(L, -1);
+  if (pMsg == NULL) {
+    pMsg = "error object is not a string";
+  }
+  fprintf(stderr, "PANIC: unprotected error in call to Lua API (%s)\n",
+            pMsg);
+  
+  return 0;
+}
+
+/*
+ * Open a new Lua interpreter and run a shader script in it.
+ * 
+ * The interpreter has its own pooled allocator, the standard libraries
+ * loaded, the garbage collector mode selected with pshade_gcmode(), and
+ * enough room on its stack for shader calls.  Use shade_close() to
+ * close it.
+ * 
+ * Parameters:
+ * 
+ *   pScriptPath - path to the Lua script to load
+ * 
+ *   perr - the variable to receive an error code
+ * 
+ * Return:
+ * 
+ *   the new interpreter, or NULL if error
+ */
+static lua_State *shade_open(const char *pScriptPath, int *perr) {
+  
+  int status = 1;
+  lua_State *L = NULL;
+  SHADE_HEAP *ph = NULL;
+  
+  /* Check parameters */
+  if ((pScriptPath == NULL) || (perr == NULL)) {
+    abort();
+  }
+  
+  /* Reset error indicator */
+  *perr = PSHADE_ERR_NONE;
+  
+  /* Allocate the pooled allocator */
+  ph = (SHADE_HEAP *) calloc(1, sizeof(SHADE_HEAP));
+  if (ph == NULL) {
+    abort();
+  }
+  
+  /* Allocate new Lua state on the allocator */
+  L = lua_newstate(&shade_alloc, ph);
+  if (L == NULL) {
+    status = 0;
+    *perr = PSHADE_ERR_LALLOC;
+    shade_heap_free(ph);
+    ph = NULL;
+  }
+  
+  /* Install the panic function and load the Lua standard libraries */
+  if (status) {
+    lua_atpanic(L, &shade_panic);
+    luaL_openlibs(L);
+  }
+  
+  /* Switch to the generational collector if selected */
+  if (status && (m_gcmode == PSHADE_GC_GENERATIONAL)) {
+    lua_gc(L, LUA_GCGEN, 0, 0);
+  }
+  
+  /* Load the script file */
+  if (status) {
+    if (luaL_loadfile(L, pScriptPath)) {
+      status = 0;
+      *perr = PSHADE_ERR_LOADSC;
+    }
+  }
+  
+  /* The compiled script file is now a function object on top of the Lua
+   * stack; invoke it so all functions are registered and any startup
+   * code is run */
+  if (status) {
+    if (lua_pcall(L, 0, 0, 0)) {
+      status = 0;
+      *perr = PSHADE_ERR_INITSC;
+    }
+  }
+  
+  /* Make sure we have enough room on the Lua stack */
+  if (status) {
+    if (!lua_checkstack(L, PSHADE_LSTACK_HEIGHT)) {
+      status = 0;
+      *perr = PSHADE_ERR_GROWST;
+    }
+  }
+  
+  /* If collecting only between scanlines, clean up after the startup
+   * code of the script and then stop the collector */
+  if (status && (m_gcmode == PSHADE_GC_ROWS)) {
+    lua_gc(L, LUA_GCCOLLECT);
+    lua_gc(L, LUA_GCSTOP);
+  }
+  
+  /* If there was an error, free the Lua state if allocated */
+  if ((!status) && (L != NULL)) {
+    shade_close(L);
+    L = NULL;
+  }
+  
+  /* Return the interpreter */
+  return L;
+}
+
+/*
+ * Close an interpreter opened with shade_open() and release its
+ * allocator.
+ * 
+ * Parameters:
+ * 
+ *   L - the interpreter
+ */
+static void shade_close(lua_State *L) {
+  
+  void *ud = NULL;
+  
+  lua_getallocf(L, &ud);
+  lua_close(L);
+  shade_heap_free((SHADE_HEAP *) ud);
+}
+
+/*
+ * Run a full garbage collection between scanlines.
+ * 
+ * This is only used in the PSHADE_GC_ROWS mode, where the collector is
+ * otherwise stopped.  The collection is counted in the statistics of
+ * the allocator of the interpreter.
+ * 
+ * Parameters:
+ * 
+ *   L - the interpreter
+ */
+static void shade_collect(lua_State *L) {
+  
+  void *ud = NULL;
+  
+  lua_gc(L, LUA_GCCOLLECT);
+  lua_getallocf(L, &ud);
+  (((SHADE_HEAP *) ud)->st.collections)++;
+}
+
+/*
+ * Check that a shader name is valid, faulting if it is not.
+ * 
+ * The name must be a sequence of one or more ASCII alphanumerics and
+ * underscores, and it may not start with a digit.
+ * 
+ * Parameters:
+ * 
+ *   pShader - the name to check
+ */
+static void shade_check_name(const char *pShader) {
+  
+  const char *pc = NULL;
+  
+  /* Check parameter */
+  if (pShader == NULL) {
+    abort();
+  }
+  
+  /* Check that name is not empty and starts with a letter or an
+   * underscore */
+  if ((*pShader != '_') &&
+        ((*pShader < 'A') || (*pShader > 'Z')) &&
+        ((*pShader < 'a') || (*pShader > 'z'))) {
+    abort();
+  }
+  
+  /* Check that only ASCII alphanumerics and underscore in name */
+  for(pc = pShader; *pc != 0; pc++) {
+    if (((*pc < 'A') || (*pc > 'Z')) &&
+        ((*pc < 'a') || (*pc > 'z')) &&
+        ((*pc < '0') || (*pc > '9')) &&
+        (*pc != '_')) {
+      abort();
+    }
+  }
+}
+
+/*
+ * Call a shader function in a given interpreter.
+ * 
+ * The parameters and return value are the same as for pshade_pixel(),
+ * except that the interpreter is given and the scanning order is not
+ * checked.  The shader name must already have been checked.
+ * 
+ * Parameters:
+ * 
+ *   L - the interpreter
+ * 
+ *   pShader - the name of the programmable shader to invoke
+ * 
+ *   x - the X coordinate
+ * 
+ *   y - the Y coordinate
+ * 
+ *   width - the width of the output image
+ * 
+ *   height - the height of the output image
+ * 
+ *   perr - pointer to a variable to receive an error message
+ * 
+ * Return:
+ * 
+ *   the generated ARGB pixel value packed in a single integer
+ */
+static uint32_t shade_call(
+          lua_State * L,
+    const char      * pShader,
+          int32_t     x,
+          int32_t     y,
+          int32_t     width,
+          int32_t     height,
+          int       * perr) {
+  
+  int status = 1;
+  lua_Integer retval = 0;
+  
+  /* Reset error indicator */
+  *perr = PSHADE_ERR_NONE;
+  
+  /* Fail if interpreter is not loaded */
+  if (L == NULL) {
+    status = 0;
+    *perr = PSHADE_ERR_UNLOAD;
+  }
+  
+  /* Push the Lua function corresponding to the shader name onto the
+   * interpreter stack */
+  if (status) {
+    if (lua_getglobal(L, pShader) != LUA_TFUNCTION) {
+      status = 0;
+      *perr = PSHADE_ERR_NOTFND;
+      lua_settop(L, 0); /* Pop everything off stack */
+    }
+  }
+  
+  /* Push all the arguments onto the interpreter stack */
+  if (status) {
+    lua_pushinteger(L, x);
+    lua_pushinteger(L, y);
+    lua_pushinteger(L, width);
+    lua_pushinteger(L, height);
+  }
+  
+  /* Invoke the shader function, passing four parameters and expecting
+   * one back */
+  if (status) {
+    if (lua_pcall(L, 4, 1, 0)) {
+      status = 0;
+      *perr = PSHADE_ERR_CALL;
+      lua_settop(L, 0); /* Pop everything off stack */
+    }
+  }
+  
+  /* Shader function should have returned exactly one parameter */
+  if (status) {
+    if (lua_gettop(L) != 1) {
+      status = 0;
+      *perr = PSHADE_ERR_RETVAL;
+      lua_settop(L, 0); /* Pop everything off stack */
+    }
+  }
+  
+  /* Shader function should have returned an integer */
+  if (status) {
+    if (!lua_isinteger(L, 1)) {
+      status = 0;
+      *perr = PSHADE_ERR_RTYPE;
+      lua_settop(L, 0); /* Pop everything off stack */
+    }
+  }
+  
+  /* Pop the return value off the stack and store to retval */
+  if (status) {
+    retval = lua_tointegerx(L, 1, NULL);
+    lua_settop(L, 0); /* Pop everything off stack */
+  }
+  
+  /* Check the range of the returned integer */
+  if (status) {
+    if ((retval < 0) || (retval > UINT32_MAX)) {
+      status = 0;
+      *perr = PSHADE_ERR_RRANGE;
+    }
+  }
+  
+  /* If there was an error, set return value to zero */
+  if (!status) {
+    retval = 0;
+  }
+  
+  /* Return the result */
+  return (uint32_t) retval;
+}
+
+/*
+ * Run one baking job.
+ * 
+ * This is the start routine of baking threads, and it is also called
+ * directly for the job that runs on the calling thread.  If the job
+ * has no interpreter, a new one is opened on the loaded script and
+ * closed when the job is done.
+ * 
+ * Parameters:
+ * 
+ *   pArg - pointer to the BAKEJOB
+ * 
+ * Return:
+ * 
+ *   NULL
+ */
+static void *shade_bake_thread(void *pArg) {
+  
+  BAKEJOB *pj = NULL;
+  lua_State *L = NULL;
+  int32_t x = 0;
+  int32_t y = 0;
+  
+  /* Get the job */
+  pj = (BAKEJOB *) pArg;
+  pj->err = PSHADE_ERR_NONE;
+  
+  /* Get an interpreter */
+  L = pj->L;
+  if (L == NULL) {
+    L = shade_open(m_pScriptPath, &(pj->err));
+  }
+  
+  /* Bake the rows of this job */
+  if (L != NULL) {
+    for(y = pj->first; y < pj->h; y += pj->step) {
+      for(x = 0; x < pj->w; x++) {
+        pj->pData[(y * pj->w) + x] = shade_call(
+                                        L, pj->pShader,
+                                        x, y, pj->w, pj->h,
+                                        &(pj->err));
+        if (pj->err != PSHADE_ERR_NONE) {
+          break;
+        }
+      }
+      if (pj->err != PSHADE_ERR_NONE) {
+        break;
+      }
+      if (m_gcmode == PSHADE_GC_ROWS) {
+        shade_collect(L);
+      }
+    }
+  }
+  
+  /* Close the interpreter if this job opened it */
+  if ((L != NULL) && (pj->L == NULL)) {
+    shade_close(L);
+  }
+  
+  return NULL;
+}
+
+/*
+ * Check whether a shader is declared random-access in the lilac_meta
+ * table of a given interpreter.
+ * 
+ * A shader is random-access if its lilac_meta entry has a true
+ * "random" field or a true "pure" field.  The shader name must already
+ * have been checked.
+ * 
+ * Parameters:
+ * 
+ *   L - the interpreter, or NULL
+ * 
+ *   pShader - the name of the shader
+ * 
+ * Return:
+ * 
+ *   non-zero if the shader is random-access, zero otherwise
  */
+static int shade_random(lua_State *L, const char *pShader) {
+  
+  int result = 0;
+  
+  /* Nothing is random-access without an interpreter */
+  if (L == NULL) {
+    return 0;
+  }
+  
+  /* Look for a table entry with a true random or pure field */
+  if (lua_getglobal(L, "lilac_meta") == LUA_TTABLE) {
+    if (lua_getfield(L, -1, pShader) == LUA_TTABLE) {
+      lua_getfield(L, -1, "random");
+      result = lua_toboolean(L, -1);
+      lua_pop(L, 1);
+      
+      if (!result) {
+        lua_getfield(L, -1, "pure");
+        result = lua_toboolean(L, -1);
+        lua_pop(L, 1);
+      }
+      
+      /* Generators are never random-access */
+      if (result) {
+        lua_getfield(L, -1, "generator");
+        if (lua_toboolean(L, -1)) {
+          result = 0;
+        }
+        lua_pop(L, 1);
+      }
+    }
+  }
+  
+  /* Clear the stack */
+  lua_settop(L, 0);
+  
+  /* Return result */
+  return result;
+}
 
 /*
- * Number of entries required on the Lua interpreter stack.
+ * Check whether a shader is declared a generator in the lilac_meta
+ * table of a given interpreter.
  * 
- * We need space for a function object, four parameters, and one return
- * value.
+ * The shader name must already have been checked.
+ * 
+ * Parameters:
+ * 
+ *   L - the interpreter, or NULL
+ * 
+ *   pShader - the name of the shader
+ * 
+ * Return:
+ * 
+ *   non-zero if the shader is a generator, zero otherwise
  */
-#define PSHADE_LSTACK_HEIGHT (6)
+static int shade_generator(lua_State *L, const char *pShader) {
+  
+  int result = 0;
+  
+  /* Nothing is a generator without an interpreter */
+  if (L == NULL) {
+    return 0;
+  }
+  
+  /* Look for a table entry with a true generator field */
+  if (lua_getglobal(L, "lilac_meta") == LUA_TTABLE) {
+    if (lua_getfield(L, -1, pShader) == LUA_TTABLE) {
+      lua_getfield(L, -1, "generator");
+      result = lua_toboolean(L, -1);
+    }
+  }
+  
+  /* Clear the stack */
+  lua_settop(L, 0);
+  
+  /* Return result */
+  return result;
+}
 
 /*
- * Local data
- * ==========
+ * Get the state of a shader on a context, adding it if this is the
+ * first time the shader is queried on the context.
+ * 
+ * The interpreter of the context must be loaded, and the shader name
+ * must already have been checked.
+ * 
+ * Parameters:
+ * 
+ *   pc - the context
+ * 
+ *   pShader - the name of the shader
+ * 
+ * Return:
+ * 
+ *   the state of the shader
+ */
+static SHADE_GEN *shade_slot(PSHADE_CONTEXT *pc, const char *pShader) {
+  
+  int i = 0;
+  int newcap = 0;
+  SHADE_GEN *pg = NULL;
+  
+  /* Look for an existing entry */
+  for(i = 0; i < pc->gen_count; i++) {
+    if (strcmp(pc->pGen[i].pName, pShader) == 0) {
+      return &(pc->pGen[i]);
+    }
+  }
+  
+  /* Grow the array if necessary */
+  if (pc->gen_count >= pc->gen_cap) {
+    newcap = (pc->gen_cap > 0) ? (pc->gen_cap * 2) : 4;
+    pg = (SHADE_GEN *) realloc(pc->pGen,
+                                ((size_t) newcap) * sizeof(SHADE_GEN));
+    if (pg == NULL) {
+      abort();
+    }
+    pc->pGen = pg;
+    pc->gen_cap = newcap;
+  }
+  
+  /* Add the new entry */
+  pg = &(pc->pGen[pc->gen_count]);
+  memset(pg, 0, sizeof(SHADE_GEN));
+  
+  pg->pName = (char *) malloc(strlen(pShader) + 1);
+  if (pg->pName == NULL) {
+    abort();
+  }
+  strcpy(pg->pName, pShader);
+  
+  pg->gen = shade_generator(pc->L, pShader);
+  pg->ref = LUA_NOREF;
+  
+  (pc->gen_count)++;
+  return pg;
+}
+
+/*
+ * Free the shader states of a context.
+ * 
+ * Coroutines are not released, so this may only be used when the
+ * interpreter of the context is being closed.
+ * 
+ * Parameters:
+ * 
+ *   pc - the context
+ */
+static void shade_slots_free(PSHADE_CONTEXT *pc) {
+  
+  int i = 0;
+  
+  for(i = 0; i < pc->gen_count; i++) {
+    free(pc->pGen[i].pName);
+  }
+  free(pc->pGen);
+  
+  pc->pGen = NULL;
+  pc->gen_count = 0;
+  pc->gen_cap = 0;
+}
+
+/*
+ * Release the coroutine of a generator, if it has one.
+ * 
+ * Parameters:
+ * 
+ *   L - the interpreter
+ * 
+ *   pg - the state of the generator
+ */
+static void shade_gen_release(lua_State *L, SHADE_GEN *pg) {
+  if (pg->ref != LUA_NOREF) {
+    luaL_unref(L, LUA_REGISTRYINDEX, pg->ref);
+    pg->ref = LUA_NOREF;
+  }
+}
+
+/*
+ * Start a new scanline of a generator.
+ * 
+ * The generator function is called with the arguments (y, width,
+ * height) and must return a coroutine, which is kept in the registry
+ * of the interpreter.  Any previous coroutine must already be released.
+ * The shader name must already have been checked.
+ * 
+ * Parameters:
+ * 
+ *   L - the interpreter
+ * 
+ *   pShader - the name of the shader
+ * 
+ *   pg - the state of the generator
+ * 
+ *   y - the Y coordinate of the scanline
+ * 
+ *   width - the width of the output image
+ * 
+ *   height - the height of the output image
+ * 
+ *   perr - pointer to a variable to receive an error code
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+static int shade_gen_start(
+          lua_State * L,
+    const char      * pShader,
+          SHADE_GEN * pg,
+          int32_t     y,
+          int32_t     width,
+          int32_t     height,
+          int       * perr) {
+  
+  int status = 1;
+  
+  /* Reset error indicator */
+  *perr = PSHADE_ERR_NONE;
+  
+  /* Push the generator function */
+  if (lua_getglobal(L, pShader) != LUA_TFUNCTION) {
+    status = 0;
+    *perr = PSHADE_ERR_NOTFND;
+  }
+  
+  /* Call it with the scanline, expecting one value back */
+  if (status) {
+    lua_pushinteger(L, y);
+    lua_pushinteger(L, width);
+    lua_pushinteger(L, height);
+    if (lua_pcall(L, 3, 1, 0)) {
+      status = 0;
+      *perr = PSHADE_ERR_CALL;
+    }
+  }
+  
+  /* The value must be a coroutine */
+  if (status) {
+    if (lua_gettop(L) != 1) {
+      status = 0;
+      *perr = PSHADE_ERR_RETVAL;
+    }
+  }
+  if (status) {
+    if (lua_type(L, 1) != LUA_TTHREAD) {
+      status = 0;
+      *perr = PSHADE_ERR_GENRET;
+    }
+  }
+  
+  /* Pop the coroutine into the registry */
+  if (status) {
+    pg->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    pg->y = y;
+    pg->next_x = 0;
+    pg->last = 0;
+  }
+  
+  /* Clear the stack */
+  lua_settop(L, 0);
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Resume the coroutine of a generator to get its next pixel.
+ * 
+ * Parameters:
+ * 
+ *   L - the interpreter
+ * 
+ *   co - the coroutine
+ * 
+ *   perr - pointer to a variable to receive an error code
+ * 
+ * Return:
+ * 
+ *   the generated ARGB pixel value, or zero if error
+ */
+static uint32_t shade_gen_next(lua_State *L, lua_State *co, int *perr) {
+  
+  int rc = 0;
+  int nres = 0;
+  lua_Integer retval = 0;
+  
+  /* Reset error indicator */
+  *perr = PSHADE_ERR_NONE;
+  
+  /* Resume the coroutine, which must yield exactly one integer */
+  rc = lua_resume(co, L, 0, &nres);
+  if (rc == LUA_YIELD) {
+    if (nres != 1) {
+      *perr = PSHADE_ERR_RETVAL;
+    } else if (!lua_isinteger(co, -1)) {
+      *perr = PSHADE_ERR_RTYPE;
+    } else {
+      retval = lua_tointeger(co, -1);
+      if ((retval < 0) || (retval > UINT32_MAX)) {
+        *perr = PSHADE_ERR_RRANGE;
+      }
+    }
+    
+  } else if (rc == LUA_OK) {
+    /* The coroutine returned before the end of the scanline */
+    *perr = PSHADE_ERR_GENEND;
+    
+  } else {
+    /* The coroutine raised an error */
+    *perr = PSHADE_ERR_CALL;
+  }
+  
+  /* Clear the stack of the coroutine */
+  lua_settop(co, 0);
+  
+  /* Return the result */
+  if (*perr != PSHADE_ERR_NONE) {
+    retval = 0;
+  }
+  return (uint32_t) retval;
+}
+
+/*
+ * Generate a span of pixels with a generator.
+ * 
+ * A new scanline is started if the generator does not have a coroutine
+ * for scanline y yet, or if the span begins before the most recent
+ * pixel of the coroutine.  The coroutine is then resumed up to the end
+ * of the span, and pixels before the start of the span are discarded.
+ * If there is an error, the coroutine is released.
+ * 
+ * The other parameters and the return value are the same as for
+ * pshade_context_span().
+ * 
+ * Parameters:
+ * 
+ *   L - the interpreter
+ * 
+ *   pShader - the name of the shader
+ * 
+ *   pg - the state of the generator
+ * 
+ *   x - the X coordinate of the first pixel
+ * 
+ *   y - the Y coordinate of the span
+ * 
+ *   count - the number of pixels
+ * 
+ *   width - the width of the output image
+ * 
+ *   height - the height of the output image
+ * 
+ *   pOut - receives the ARGB pixels
+ * 
+ *   perr - pointer to a variable to receive an error code
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
  */
+static int shade_gen_span(
+          lua_State * L,
+    const char      * pShader,
+          SHADE_GEN * pg,
+          int32_t     x,
+          int32_t     y,
+          int32_t     count,
+          int32_t     width,
+          int32_t     height,
+          uint32_t  * pOut,
+          int       * perr) {
+  
+  int status = 1;
+  int32_t i = 0;
+  lua_State *co = NULL;
+  
+  /* Reset error indicator */
+  *perr = PSHADE_ERR_NONE;
+  
+  /* Start a new scanline if necessary */
+  if ((pg->ref == LUA_NOREF) || (pg->y != y) || (x < pg->next_x - 1)) {
+    shade_gen_release(L, pg);
+    status = shade_gen_start(L, pShader, pg, y, width, height, perr);
+  }
+  
+  /* Get the coroutine, which stays referenced from the registry */
+  if (status) {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, pg->ref);
+    co = lua_tothread(L, -1);
+    lua_settop(L, 0);
+  }
+  
+  /* Resume the coroutine up to each pixel of the span */
+  for(i = 0; status && (i < count); i++) {
+    while (pg->next_x <= x + i) {
+      pg->last = shade_gen_next(L, co, perr);
+      if (*perr != PSHADE_ERR_NONE) {
+        status = 0;
+        break;
+      }
+      (pg->next_x)++;
+    }
+    if (status) {
+      pOut[i] = pg->last;
+    }
+  }
+  
+  /* Release the coroutine if there was an error */
+  if (!status) {
+    shade_gen_release(L, pg);
+  }
+  
+  /* Return status */
+  return status;
+}
 
 /*
- * Pointer to the Lua interpreter state object, or NULL if not
- * initialized yet.
+ * Enforce the scanning order of a shader for a pixel query.
+ * 
+ * Each shader on a context has its own scanning position, so queries
+ * of different shaders may be interleaved freely.  Queries that advance
+ * in left-to-right and then top-to-bottom order move the position of
+ * the shader forward.  A query that goes backwards is only allowed if
+ * the shader is declared random-access in the interpreter, in which
+ * case the position is left alone; otherwise, a fault occurs.
+ * 
+ * The declaration is only looked up when a query goes backwards, so
+ * in-order rendering does not pay for it.
+ * 
+ * Parameters:
+ * 
+ *   L - the interpreter
+ * 
+ *   pShader - the name of the shader, which must already be checked
+ * 
+ *   pg - the state of the shader
+ * 
+ *   x - the X coordinate
+ * 
+ *   y - the Y coordinate
  */
-static lua_State *m_L = NULL;
+static void shade_order(
+          lua_State * L,
+    const char      * pShader,
+          SHADE_GEN * pg,
+          int32_t     x,
+          int32_t     y) {
+  
+  if (y > pg->scan_y) {
+    /* We've advanced a scanline, so update to new position */
+    pg->scan_x = x;
+    pg->scan_y = y;
+  
+  } else if (y == pg->scan_y) {
+    /* Still in same scanline, so next check x */
+    if (x > pg->scan_x) {
+      /* We've advanced within scanline, so update x */
+      pg->scan_x = x;
+    
+    } else if (x != pg->scan_x) {
+      /* We have gone backwards, which is only allowed for
+       * random-access shaders */
+      if (!shade_random(L, pShader)) {
+        abort();
+      }
+    }
+  
+  } else {
+    /* We have gone backwards in scan order, which is only allowed for
+     * random-access shaders */
+    if (!shade_random(L, pShader)) {
+      abort();
+    }
+  }
+}
 
 /*
  * Public function implementations
@@ -93,21 +1429,106 @@ const char *pshade_errorString(int code) {
       pResult = "Shader function must return exactly one value";
       break;
     
-    case PSHADE_ERR_RTYPE:
-      pResult = "Shader function must return an integer";
+    case PSHADE_ERR_RTYPE:
+      pResult = "Shader function must return an integer";
+      break;
+    
+    case PSHADE_ERR_RRANGE:
+      pResult = "Shader function returned integer value out of range";
+      break;
+    
+    case PSHADE_ERR_META:
+      pResult = "Invalid lilac_meta declaration for shader";
+      break;
+    
+    case PSHADE_ERR_THREAD:
+      pResult = "Failed to start baking thread";
+      break;
+    
+    case PSHADE_ERR_GENRET:
+      pResult = "Generator shader must return a coroutine";
+      break;
+    
+    case PSHADE_ERR_GENEND:
+      pResult = "Generator shader ended before end of scanline";
+      break;
+    
+    default:
+      pResult = "Unknown error";
+  }
+  
+  return pResult;
+}
+
+/*
+ * pshade_gcmode function.
+ */
+void pshade_gcmode(int mode) {
+  
+  /* Check state */
+  if (m_ctx.L != NULL) {
+    abort();
+  }
+  
+  /* Check parameter */
+  if ((mode != PSHADE_GC_INCREMENTAL) &&
+      (mode != PSHADE_GC_GENERATIONAL) &&
+      (mode != PSHADE_GC_ROWS)) {
+    abort();
+  }
+  
+  m_gcmode = mode;
+}
+
+/*
+ * pshade_gcname function.
+ */
+const char *pshade_gcname(int mode) {
+  
+  const char *pResult = NULL;
+  
+  switch (mode) {
+    case PSHADE_GC_INCREMENTAL:
+      pResult = "incremental";
+      break;
+    
+    case PSHADE_GC_GENERATIONAL:
+      pResult = "generational";
       break;
     
-    case PSHADE_ERR_RRANGE:
-      pResult = "Shader function returned integer value out of range";
+    case PSHADE_GC_ROWS:
+      pResult = "rows";
       break;
     
     default:
-      pResult = "Unknown error";
+      pResult = "unknown";
   }
   
   return pResult;
 }
 
+/*
+ * pshade_memstats function.
+ */
+int pshade_memstats(PSHADE_MEMSTATS *pms, int *pmode) {
+  
+  /* Check parameters */
+  if ((pms == NULL) || (pmode == NULL)) {
+    abort();
+  }
+  
+  *pmode = m_gcmode;
+  
+  /* Nothing to report if no script is loaded */
+  if (m_ctx.L == NULL) {
+    memset(pms, 0, sizeof(PSHADE_MEMSTATS));
+    return 0;
+  }
+  
+  pshade_context_memstats(&m_ctx, pms);
+  return 1;
+}
+
 /*
  * pshade_load function.
  */
@@ -116,7 +1537,7 @@ int pshade_load(const char *pScriptPath, int *perr) {
   int status = 1;
   
   /* Check state */
-  if (m_L != NULL) {
+  if (m_ctx.L != NULL) {
     abort();
   }
   
@@ -137,52 +1558,21 @@ int pshade_load(const char *pScriptPath, int *perr) {
     *perr = PSHADE_ERR_SMALLI;
   }
   
-  /* Allocate new Lua state */
-  if (status) {
-    m_L = luaL_newstate();
-    if (m_L == NULL) {
-      status = 0;
-      *perr = PSHADE_ERR_LALLOC;
-    }
-  }
-  
-  /* Load the Lua standard libraries */
-  if (status) {
-    luaL_openlibs(m_L);
-  }
-  
-  /* Load the script file */
-  if (status) {
-    if (luaL_loadfile(m_L, pScriptPath)) {
-      status = 0;
-      *perr = PSHADE_ERR_LOADSC;
-    }
-  }
-  
-  /* The compiled script file is now a function object on top of the Lua
-   * stack; invoke it so all functions are registered and any startup
-   * code is run */
+  /* Open the interpreter and run the script */
   if (status) {
-    if (lua_pcall(m_L, 0, 0, 0)) {
+    m_ctx.L = shade_open(pScriptPath, perr);
+    if (m_ctx.L == NULL) {
       status = 0;
-      *perr = PSHADE_ERR_INITSC;
     }
   }
   
-  /* Make sure we have enough room on the Lua stack */
+  /* Remember the script path for baking threads */
   if (status) {
-    if (!lua_checkstack(m_L, PSHADE_LSTACK_HEIGHT)) {
-      status = 0;
-      *perr = PSHADE_ERR_GROWST;
-    }
-  }
-  
-  /* If there was an error, free the Lua state if allocated */
-  if (!status) {
-    if (m_L != NULL) {
-      lua_close(m_L);
-      m_L = NULL;
+    m_pScriptPath = (char *) malloc(strlen(pScriptPath) + 1);
+    if (m_pScriptPath == NULL) {
+      abort();
     }
+    strcpy(m_pScriptPath, pScriptPath);
   }
   
   /* Return status */
@@ -193,10 +1583,22 @@ int pshade_load(const char *pScriptPath, int *perr) {
  * pshade_close function.
  */
 void pshade_close(void) {
-  if (m_L != NULL) {
-    lua_close(m_L);
-    m_L = NULL;
+  if (m_ctx.L != NULL) {
+    shade_close(m_ctx.L);
+    m_ctx.L = NULL;
   }
+  shade_slots_free(&m_ctx);
+  if (m_pScriptPath != NULL) {
+    free(m_pScriptPath);
+    m_pScriptPath = NULL;
+  }
+}
+
+/*
+ * pshade_rewind function.
+ */
+void pshade_rewind(void) {
+  pshade_context_rewind(&m_ctx);
 }
 
 /*
@@ -209,141 +1611,460 @@ uint32_t pshade_pixel(
     int32_t width,
     int32_t height,
     int *perr) {
+  return pshade_context_pixel(
+            &m_ctx, pShader, x, y, width, height, perr);
+}
+
+/*
+ * pshade_defined function.
+ */
+int pshade_defined(const char *pShader) {
   
-  int status = 1;
-  const char *pc = NULL;
-  lua_Integer retval = 0;
+  int result = 0;
   
-  static int32_t s_last_x = 0;
-  static int32_t s_last_y = 0;
+  /* Check shader name */
+  shade_check_name(pShader);
   
-  /* Check parameters */
-  if ((pShader == NULL) || (perr == NULL)) {
-    abort();
+  /* Nothing is defined if no script is loaded */
+  if (m_ctx.L == NULL) {
+    return 0;
   }
-  if ((width < 1) || (height < 1)) {
-    abort();
+  
+  /* Look up the global */
+  if (lua_getglobal(m_ctx.L, pShader) == LUA_TFUNCTION) {
+    result = 1;
   }
-  if ((x < 0) || (x >= width) ||
-      (y < 0) || (y >= height)) {
+  lua_settop(m_ctx.L, 0);
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * pshade_random function.
+ */
+int pshade_random(const char *pShader) {
+  shade_check_name(pShader);
+  return shade_random(m_ctx.L, pShader);
+}
+
+/*
+ * pshade_generator function.
+ */
+int pshade_generator(const char *pShader) {
+  shade_check_name(pShader);
+  return shade_generator(m_ctx.L, pShader);
+}
+
+/*
+ * pshade_span function.
+ */
+int pshade_span(
+    const char     * pShader,
+          int32_t    x,
+          int32_t    y,
+          int32_t    count,
+          int32_t    width,
+          int32_t    height,
+          uint32_t * pOut,
+          int      * perr) {
+  return pshade_context_span(
+          &m_ctx, pShader, x, y, count, width, height, pOut, perr);
+}
+
+/*
+ * pshade_context_new function.
+ */
+PSHADE_CONTEXT *pshade_context_new(int *perr) {
+  
+  int status = 1;
+  PSHADE_CONTEXT *pc = NULL;
+  
+  /* Check parameter */
+  if (perr == NULL) {
     abort();
   }
   
-  /* Enforce proper scanning order and update statistics */
-  if (y > s_last_y) {
-    /* We've advanced a scanline, so update to new position */
-    s_last_x = x;
-    s_last_y = y;
+  /* Reset error indicator */
+  *perr = PSHADE_ERR_NONE;
   
-  } else if (y == s_last_y) {
-    /* Still in same scanline, so next check x */
-    if (x > s_last_x) {
-      /* We've advanced within scanline, so update x */
-      s_last_x = x;
-    
-    } else if (x != s_last_x) {
-      /* We must have gone backwards, which is not allowed */
+  /* Fail if no script is loaded */
+  if (m_pScriptPath == NULL) {
+    status = 0;
+    *perr = PSHADE_ERR_UNLOAD;
+  }
+  
+  /* Allocate the context */
+  if (status) {
+    pc = (PSHADE_CONTEXT *) calloc(1, sizeof(PSHADE_CONTEXT));
+    if (pc == NULL) {
       abort();
     }
+  }
   
-  } else {
-    /* We must have gone backwards in scan order, which is not
-     * allowed */
-    abort();
+  /* Open an interpreter for the context on the loaded script */
+  if (status) {
+    pc->L = shade_open(m_pScriptPath, perr);
+    if (pc->L == NULL) {
+      status = 0;
+    }
   }
   
-  /* Check that name is not empty and starts with a letter or an
-   * underscore */
-  if ((*pShader != '_') &&
-        ((*pShader < 'A') || (*pShader > 'Z')) &&
-        ((*pShader < 'a') || (*pShader > 'z'))) {
-    abort();
+  /* If there was an error, free the context */
+  if ((!status) && (pc != NULL)) {
+    free(pc);
+    pc = NULL;
   }
   
-  /* Check that only ASCII alphanumerics and underscore in name */
-  for(pc = pShader; *pc != 0; pc++) {
-    if (((*pc < 'A') || (*pc > 'Z')) &&
-        ((*pc < 'a') || (*pc > 'z')) &&
-        ((*pc < '0') || (*pc > '9')) &&
-        (*pc != '_')) {
+  /* Return the context */
+  return pc;
+}
+
+/*
+ * pshade_context_free function.
+ */
+void pshade_context_free(PSHADE_CONTEXT *pc) {
+  if (pc != NULL) {
+    if (pc == &m_ctx) {
       abort();
     }
+    if (pc->L != NULL) {
+      shade_close(pc->L);
+      pc->L = NULL;
+    }
+    shade_slots_free(pc);
+    free(pc);
+  }
+}
+
+/*
+ * pshade_context_rewind function.
+ */
+void pshade_context_rewind(PSHADE_CONTEXT *pc) {
+  
+  int i = 0;
+  
+  if (pc == NULL) {
+    abort();
+  }
+  for(i = 0; i < pc->gen_count; i++) {
+    if (pc->L != NULL) {
+      shade_gen_release(pc->L, &(pc->pGen[i]));
+    }
+    pc->pGen[i].scan_x = 0;
+    pc->pGen[i].scan_y = 0;
+  }
+  pc->gc_y = 0;
+}
+
+/*
+ * pshade_context_memstats function.
+ */
+void pshade_context_memstats(PSHADE_CONTEXT *pc, PSHADE_MEMSTATS *pms) {
+  
+  void *ud = NULL;
+  
+  /* Check parameters */
+  if ((pc == NULL) || (pms == NULL)) {
+    abort();
+  }
+  if (pc->L == NULL) {
+    abort();
+  }
+  
+  /* Copy the statistics of the allocator of the interpreter */
+  lua_getallocf(pc->L, &ud);
+  memcpy(pms, &(((SHADE_HEAP *) ud)->st), sizeof(PSHADE_MEMSTATS));
+}
+
+/*
+ * pshade_context_pixel function.
+ */
+uint32_t pshade_context_pixel(
+          PSHADE_CONTEXT * pc,
+    const char           * pShader,
+          int32_t          x,
+          int32_t          y,
+          int32_t          width,
+          int32_t          height,
+          int            * perr) {
+  
+  uint32_t result = 0;
+  
+  /* Query a span of one pixel, which checks the parameters */
+  pshade_context_span(
+      pc, pShader, x, y, 1, width, height, &result, perr);
+  return result;
+}
+
+/*
+ * pshade_context_span function.
+ */
+int pshade_context_span(
+          PSHADE_CONTEXT * pc,
+    const char           * pShader,
+          int32_t          x,
+          int32_t          y,
+          int32_t          count,
+          int32_t          width,
+          int32_t          height,
+          uint32_t       * pOut,
+          int            * perr) {
+  
+  int status = 1;
+  int32_t i = 0;
+  SHADE_GEN *pg = NULL;
+  
+  /* Check parameters */
+  if ((pc == NULL) || (pOut == NULL) || (perr == NULL)) {
+    abort();
+  }
+  if ((width < 1) || (height < 1) || (count < 0)) {
+    abort();
+  }
+  if ((x < 0) || (x > width - count) ||
+      (y < 0) || (y >= height)) {
+    abort();
   }
+  shade_check_name(pShader);
   
   /* Reset error indicator */
   *perr = PSHADE_ERR_NONE;
   
+  /* Nothing to do for an empty span */
+  if (count < 1) {
+    return 1;
+  }
+  
   /* Fail if interpreter is not loaded */
-  if (m_L == NULL) {
+  if (pc->L == NULL) {
     status = 0;
     *perr = PSHADE_ERR_UNLOAD;
   }
   
-  /* Push the Lua function corresponding to the shader name onto the
-   * interpreter stack */
+  /* Get the state of the shader on this context */
   if (status) {
-    if (lua_getglobal(m_L, pShader) != LUA_TFUNCTION) {
-      status = 0;
-      *perr = PSHADE_ERR_NOTFND;
-      lua_settop(m_L, 0); /* Pop everything off stack */
-    }
+    pg = shade_slot(pc, pShader);
   }
   
-  /* Push all the arguments onto the interpreter stack */
+  /* Enforce scanning order unless the shader is random-access, moving
+   * the position of the shader to the last pixel of the span */
   if (status) {
-    lua_pushinteger(m_L, x);
-    lua_pushinteger(m_L, y);
-    lua_pushinteger(m_L, width);
-    lua_pushinteger(m_L, height);
+    shade_order(pc->L, pShader, pg, x, y);
+    if (count > 1) {
+      shade_order(pc->L, pShader, pg, x + count - 1, y);
+    }
   }
   
-  /* Invoke the shader function, passing four parameters and expecting
-   * one back */
-  if (status) {
-    if (lua_pcall(m_L, 4, 1, 0)) {
-      status = 0;
-      *perr = PSHADE_ERR_CALL;
-      lua_settop(m_L, 0); /* Pop everything off stack */
+  /* In the PSHADE_GC_ROWS mode, collect garbage whenever the context
+   * moves to a different scanline */
+  if (status && (m_gcmode == PSHADE_GC_ROWS) && (y != pc->gc_y)) {
+    shade_collect(pc->L);
+    pc->gc_y = y;
+  }
+  
+  /* Resume generators for the whole span, or call other shaders for
+   * each pixel */
+  if (status && pg->gen) {
+    status = shade_gen_span(pc->L, pShader, pg, x, y, count,
+                              width, height, pOut, perr);
+    
+  } else if (status) {
+    for(i = 0; i < count; i++) {
+      pOut[i] = shade_call(
+                  pc->L, pShader, x + i, y, width, height, perr);
+      if (*perr != PSHADE_ERR_NONE) {
+        status = 0;
+        break;
+      }
     }
   }
   
-  /* Shader function should have returned exactly one parameter */
-  if (status) {
-    if (lua_gettop(m_L) != 1) {
-      status = 0;
-      *perr = PSHADE_ERR_RETVAL;
-      lua_settop(m_L, 0); /* Pop everything off stack */
+  /* Return status */
+  return status;
+}
+
+/*
+ * pshade_meta function.
+ */
+int pshade_meta(
+    const char    * pShader,
+          int32_t * pw,
+          int32_t * ph,
+          int     * perr) {
+  
+  int result = 0;
+  int i = 0;
+  lua_Integer v[2];
+  
+  /* Initialize array */
+  memset(v, 0, sizeof(v));
+  
+  /* Check parameters */
+  if ((pw == NULL) || (ph == NULL) || (perr == NULL)) {
+    abort();
+  }
+  shade_check_name(pShader);
+  
+  /* Reset error indicator */
+  *perr = PSHADE_ERR_NONE;
+  
+  /* Nothing is pure if no script is loaded */
+  if (m_ctx.L == NULL) {
+    return 0;
+  }
+  
+  /* Look for a table entry with a true pure field */
+  if (lua_getglobal(m_ctx.L, "lilac_meta") == LUA_TTABLE) {
+    if (lua_getfield(m_ctx.L, -1, pShader) == LUA_TTABLE) {
+      lua_getfield(m_ctx.L, -1, "pure");
+      result = lua_toboolean(m_ctx.L, -1);
+      lua_pop(m_ctx.L, 1);
+      
+      /* Generators can't be pure */
+      if (result) {
+        lua_getfield(m_ctx.L, -1, "generator");
+        if (lua_toboolean(m_ctx.L, -1)) {
+          result = 0;
+          *perr = PSHADE_ERR_META;
+        }
+        lua_pop(m_ctx.L, 1);
+      }
     }
   }
   
-  /* Shader function should have returned an integer */
+  /* If pure, get the period from the entry, which is on top of the
+   * stack */
+  if (result) {
+    if (lua_getfield(m_ctx.L, -1, "period") == LUA_TTABLE) {
+      for(i = 0; i < 2; i++) {
+        lua_geti(m_ctx.L, -1, i + 1);
+        if (lua_isinteger(m_ctx.L, -1)) {
+          v[i] = lua_tointeger(m_ctx.L, -1);
+        }
+        lua_pop(m_ctx.L, 1);
+        
+        if ((v[i] < 1) || (v[i] > PSHADE_MAXPERIOD)) {
+          result = 0;
+          *perr = PSHADE_ERR_META;
+        }
+      }
+    } else {
+      result = 0;
+      *perr = PSHADE_ERR_META;
+    }
+  }
+  
+  /* Clear the stack */
+  lua_settop(m_ctx.L, 0);
+  
+  /* Write the period */
+  if (result) {
+    *pw = (int32_t) v[0];
+    *ph = (int32_t) v[1];
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * pshade_bake function.
+ */
+int pshade_bake(
+    const char     * pShader,
+          int32_t    w,
+          int32_t    h,
+          uint32_t * pData,
+          int        threads,
+          int      * perr) {
+  
+  int status = 1;
+  int i = 0;
+  BAKEJOB job[PSHADE_MAXTHREADS];
+  pthread_t tid[PSHADE_MAXTHREADS];
+  int started[PSHADE_MAXTHREADS];
+  
+  /* Initialize arrays */
+  memset(job, 0, sizeof(job));
+  memset(tid, 0, sizeof(tid));
+  memset(started, 0, sizeof(started));
+  
+  /* Check parameters */
+  if ((w < 1) || (h < 1) || (pData == NULL) || (perr == NULL) ||
+      (threads < 1) || (threads > PSHADE_MAXTHREADS)) {
+    abort();
+  }
+  shade_check_name(pShader);
+  
+  /* Reset error indicator */
+  *perr = PSHADE_ERR_NONE;
+  
+  /* Fail if interpreter is not loaded */
+  if (m_ctx.L == NULL) {
+    status = 0;
+    *perr = PSHADE_ERR_UNLOAD;
+  }
+  
+  /* No point in more workers than rows */
+  if (threads > h) {
+    threads = (int) h;
+  }
+  
+  /* Set up the jobs; the first one uses the loaded interpreter */
   if (status) {
-    if (!lua_isinteger(m_L, 1)) {
-      status = 0;
-      *perr = PSHADE_ERR_RTYPE;
-      lua_settop(m_L, 0); /* Pop everything off stack */
+    for(i = 0; i < threads; i++) {
+      job[i].L = (i == 0) ? m_ctx.L : NULL;
+      job[i].pShader = pShader;
+      job[i].w = w;
+      job[i].h = h;
+      job[i].pData = pData;
+      job[i].first = (int32_t) i;
+      job[i].step = (int32_t) threads;
+      job[i].err = PSHADE_ERR_NONE;
     }
   }
   
-  /* Pop the return value off the stack and store to retval */
+  /* Start the other workers on their own threads */
   if (status) {
-    retval = lua_tointegerx(m_L, 1, NULL);
-    lua_settop(m_L, 0); /* Pop everything off stack */
+    for(i = 1; i < threads; i++) {
+      if (pthread_create(&(tid[i]), NULL,
+                          &shade_bake_thread, &(job[i])) == 0) {
+        started[i] = 1;
+      }
+    }
   }
   
-  /* Check the range of the returned integer */
+  /* Run the first worker on this thread, followed by any workers whose
+   * thread couldn't be started, using the loaded interpreter */
   if (status) {
-    if ((retval < 0) || (retval > UINT32_MAX)) {
-      status = 0;
-      *perr = PSHADE_ERR_RRANGE;
+    shade_bake_thread(&(job[0]));
+    for(i = 1; i < threads; i++) {
+      if (!started[i]) {
+        job[i].L = m_ctx.L;
+        shade_bake_thread(&(job[i]));
+      }
     }
   }
   
-  /* If there was an error, set return value to zero */
-  if (!status) {
-    retval = 0;
+  /* Wait for the other workers */
+  for(i = 1; i < threads; i++) {
+    if (started[i]) {
+      pthread_join(tid[i], NULL);
+    }
   }
   
-  /* Return the result */
-  return (uint32_t) retval;
+  /* Report the first error */
+  if (status) {
+    for(i = 0; i < threads; i++) {
+      if (job[i].err != PSHADE_ERR_NONE) {
+        status = 0;
+        *perr = job[i].err;
+        break;
+      }
+    }
+  }
+  
+  /* Return status */
+  return status;
 }
@@ -5,6 +5,68 @@
  * pshade.h
  * 
  * Programmable shader module of Lilac.
+ * 
+ * Shader scripts may declare that some of their shaders are pure and
+ * periodic, by defining a global table named lilac_meta with an entry
+ * for each such shader.  For example:
+ * 
+ *   lilac_meta = {}
+ *   lilac_meta.sparkle = {period={64, 48}, pure=true}
+ * 
+ * A pure shader returns a value that depends only on (x mod P) and
+ * (y mod Q), where P and Q are the two values of its period, and it
+ * does not depend on the width and height arguments or on any state
+ * kept between calls.  Such a shader can be baked into an image with
+ * pshade_bake() once at startup, and then used like an image texture.
+ * 
+ * Shaders may also declare that they are random-access, meaning that
+ * they do not depend on the order in which pixels are queried:
+ * 
+ *   lilac_meta.wavy = {random=true}
+ * 
+ * Pure shaders are always random-access.  Pixel queries of other
+ * shaders must proceed in scanning order, which is tracked separately
+ * for each shader on each context (see below), so queries of different
+ * shaders may be interleaved.  Random-access shaders may be queried in
+ * any order.
+ * 
+ * Shaders that carry state from one pixel to the next along a scanline
+ * may be declared generators:
+ * 
+ *   lilac_meta.walk = {generator=true}
+ * 
+ * A generator shader is called once at the start of each scanline with
+ * the arguments (y, width, height), and it must return a coroutine.
+ * The coroutine is then resumed without arguments once for each pixel
+ * of the scanline, from left to right starting at X coordinate zero,
+ * and each time it must yield exactly one value, which is the pixel.
+ * State such as a random walk can then be kept in local variables of
+ * the coroutine rather than recomputed for each pixel.  Pixels that are
+ * not queried are still generated and then discarded.  Generator
+ * shaders are never random-access and may not be declared pure.
+ * pshade_span() generates a whole span of a generator in one call.
+ * 
+ * A context is a Lua interpreter running the loaded script together
+ * with its own scanning position for each shader.  pshade_pixel() and
+ * pshade_rewind() use a default context that belongs to pshade_load().
+ * Further contexts may be opened with pshade_context_new(), for
+ * example one for each thread of a renderer; each context may only be
+ * used by one thread at a time, but different contexts may be used
+ * concurrently.
+ * 
+ * Every interpreter has its own pooled allocator.  Small blocks are
+ * carved out of large chunks and recycled through free lists by size,
+ * so the temporary tables and strings that shaders create do not each
+ * go to the system allocator.  The allocator of each interpreter keeps
+ * its own memory accounting, which pshade_memstats() and
+ * pshade_context_memstats() report.  All memory of an interpreter is
+ * returned to the system when the interpreter is closed.
+ * 
+ * The garbage collector of every interpreter runs in the mode selected
+ * with pshade_gcmode() before the script is loaded.  In the
+ * PSHADE_GC_ROWS mode, the collector is stopped and a full collection
+ * is run only when a context moves to a different scanline, so that
+ * collection pauses never happen in the middle of a scanline.
  */
 
 #include <stddef.h>
@@ -27,6 +89,54 @@
 #define PSHADE_ERR_RETVAL (9)   /* Shader didn't return one value */
 #define PSHADE_ERR_RTYPE  (10)  /* Shader returned non-integer */
 #define PSHADE_ERR_RRANGE (11)  /* Shader return value out of range */
+#define PSHADE_ERR_META   (12)  /* Invalid lilac_meta declaration */
+#define PSHADE_ERR_THREAD (13)  /* Failed to start baking thread */
+#define PSHADE_ERR_GENRET (14)  /* Generator didn't return coroutine */
+#define PSHADE_ERR_GENEND (15)  /* Generator ended before end of line */
+
+/*
+ * The maximum number of threads that pshade_bake() will use.
+ */
+#define PSHADE_MAXTHREADS (64)
+
+/*
+ * The maximum value of each dimension of a declared period.
+ */
+#define PSHADE_MAXPERIOD (2048)
+
+/*
+ * Garbage collector modes.
+ */
+#define PSHADE_GC_INCREMENTAL (0)   /* Lua default incremental mode */
+#define PSHADE_GC_GENERATIONAL (1)  /* Lua generational mode */
+#define PSHADE_GC_ROWS (2)          /* Collect only between scanlines */
+
+/*
+ * Memory statistics of an interpreter.
+ */
+typedef struct {
+  
+  /*
+   * The number of bytes currently allocated by the interpreter, and
+   * the highest number of bytes allocated at any time.
+   */
+  int64_t bytes;
+  int64_t peak;
+  
+  /*
+   * The number of allocation requests from the interpreter, and how
+   * many of those had to call the system allocator.
+   */
+  int64_t allocs;
+  int64_t sysallocs;
+  
+  /*
+   * The number of collections run between scanlines in the
+   * PSHADE_GC_ROWS mode.
+   */
+  int64_t collections;
+  
+} PSHADE_MEMSTATS;
 
 /*
  * Given a programmable shader error code, return an error message.
@@ -47,6 +157,54 @@
  */
 const char *pshade_errorString(int code);
 
+/*
+ * Select the garbage collector mode of shader interpreters.
+ * 
+ * mode is one of the PSHADE_GC_ constants.  This may only be called
+ * before pshade_load(); a fault occurs otherwise.  The default mode is
+ * PSHADE_GC_INCREMENTAL.
+ * 
+ * Parameters:
+ * 
+ *   mode - the garbage collector mode
+ */
+void pshade_gcmode(int mode);
+
+/*
+ * Return a short name for a garbage collector mode.
+ * 
+ * The names are "incremental", "generational", and "rows".  An unknown
+ * mode returns "unknown".
+ * 
+ * Parameters:
+ * 
+ *   mode - one of the PSHADE_GC_ constants
+ * 
+ * Return:
+ * 
+ *   the name of the mode
+ */
+const char *pshade_gcname(int mode);
+
+/*
+ * Get the memory statistics of the default context.
+ * 
+ * If no script is loaded, zero is returned and *pms is cleared.
+ * The mode that was selected with pshade_gcmode() is written to *pmode
+ * in either case.
+ * 
+ * Parameters:
+ * 
+ *   pms - receives the statistics
+ * 
+ *   pmode - receives the garbage collector mode
+ * 
+ * Return:
+ * 
+ *   non-zero if a script is loaded, zero otherwise
+ */
+int pshade_memstats(PSHADE_MEMSTATS *pms, int *pmode);
+
 /*
  * Load a Lua script into the programmable shader module.
  * 
@@ -76,6 +234,21 @@ int pshade_load(const char *pScriptPath, int *perr);
  */
 void pshade_close(void);
 
+/*
+ * Opaque context structure.
+ */
+struct PSHADE_CONTEXT_TAG;
+typedef struct PSHADE_CONTEXT_TAG PSHADE_CONTEXT;
+
+/*
+ * Reset the scanning order enforced by pshade_pixel().
+ * 
+ * After this call, pixel queries may begin again from the top-left
+ * corner of the image.  Use this between separate renders that share
+ * the same loaded script.
+ */
+void pshade_rewind(void);
+
 /*
  * Use the programmable shader module to query a specific pixel in a
  * procedurally-generated texture.
@@ -90,10 +263,16 @@ void pshade_close(void);
  * and underscores, and the first character may not be a numeric digit.
  * 
  * x and y are the coordinates of the specific pixel that is being
- * requested.  Requests must be sequenced in left-to-right and then
- * top-to-bottom order, and this is enforced by this function.  It is,
- * however, acceptable to make multiple queries of the same coordinate,
- * and not every pixel coordinate has to be queried.
+ * requested.  Unless the shader is declared random-access, requests
+ * of the shader must be sequenced in left-to-right and then
+ * top-to-bottom order, and this is enforced by this function (see
+ * pshade_rewind() for starting over).  Requests of other shaders do
+ * not affect this order.  It is, however, acceptable to make multiple
+ * queries of the same coordinate, and not every pixel coordinate has
+ * to be queried.
+ * 
+ * This function uses the default context.  See pshade_context_pixel()
+ * for using other contexts.
  * 
  * width and height are the dimensions of the output image.  Both must
  * be greater than zero.  x and y must be greater than or equal to zero
@@ -135,4 +314,330 @@ uint32_t pshade_pixel(
     int32_t height,
     int *perr);
 
+/*
+ * Check whether the loaded script defines a shader function.
+ * 
+ * pShader is the name of the shader, with the same restrictions as for
+ * pshade_pixel().  If no script is loaded, zero is returned.
+ * 
+ * Parameters:
+ * 
+ *   pShader - the name of the shader
+ * 
+ * Return:
+ * 
+ *   non-zero if the script has a global function with this name, zero
+ *   otherwise
+ */
+int pshade_defined(const char *pShader);
+
+/*
+ * Check whether a shader is declared random-access in the lilac_meta
+ * table of the loaded script.
+ * 
+ * pShader is the name of the shader, with the same restrictions as for
+ * pshade_pixel().  A shader is random-access if its entry has a true
+ * "random" field or a true "pure" field, and it does not have a true
+ * "generator" field.  If no script is loaded, zero is returned.
+ * 
+ * Parameters:
+ * 
+ *   pShader - the name of the shader
+ * 
+ * Return:
+ * 
+ *   non-zero if the shader is random-access, zero otherwise
+ */
+int pshade_random(const char *pShader);
+
+/*
+ * Check whether a shader is declared a generator in the lilac_meta
+ * table of the loaded script.
+ * 
+ * pShader is the name of the shader, with the same restrictions as for
+ * pshade_pixel().  A shader is a generator if its entry has a true
+ * "generator" field.  If no script is loaded, zero is returned.
+ * 
+ * Parameters:
+ * 
+ *   pShader - the name of the shader
+ * 
+ * Return:
+ * 
+ *   non-zero if the shader is a generator, zero otherwise
+ */
+int pshade_generator(const char *pShader);
+
+/*
+ * Query a span of pixels of a procedural texture.
+ * 
+ * This is the same as calling pshade_pixel() for each pixel from
+ * (x, y) up to but excluding (x + count, y) in left-to-right order,
+ * except that the results are written to pOut, which must have room
+ * for count pixels.  The whole span must be within the image.  count
+ * may be zero, in which case nothing is done.
+ * 
+ * For generator shaders, the coroutine of the scanline is resumed in a
+ * loop for the whole span.
+ * 
+ * If a query fails, zero is returned, *perr is set to the error code,
+ * and the rest of the span is left alone.  Otherwise, *perr is set to
+ * PSHADE_ERR_NONE.
+ * 
+ * Parameters:
+ * 
+ *   pShader - the name of the programmable shader to invoke
+ * 
+ *   x - the X coordinate of the first pixel
+ * 
+ *   y - the Y coordinate of the span
+ * 
+ *   count - the number of pixels
+ * 
+ *   width - the width of the output image
+ * 
+ *   height - the height of the output image
+ * 
+ *   pOut - receives the ARGB pixels
+ * 
+ *   perr - pointer to a variable to receive an error code
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+int pshade_span(
+    const char     * pShader,
+          int32_t    x,
+          int32_t    y,
+          int32_t    count,
+          int32_t    width,
+          int32_t    height,
+          uint32_t * pOut,
+          int      * perr);
+
+/*
+ * Open a new context on the loaded script.
+ * 
+ * pshade_load() must have been successfully called, or the function
+ * fails with PSHADE_ERR_UNLOAD.  The new context has its own
+ * interpreter, which loads and runs the script again, so the script
+ * must not depend on being run only once.  The scanning position of
+ * every shader starts at the top-left corner.
+ * 
+ * This function may be called from any thread.  All contexts must be
+ * freed with pshade_context_free() before pshade_close() is called.
+ * 
+ * Each context keeps the coroutine of the current scanline of every
+ * generator shader that has been queried on it.
+ * 
+ * Parameters:
+ * 
+ *   perr - pointer to a variable to receive an error code
+ * 
+ * Return:
+ * 
+ *   the new context, or NULL if error
+ */
+PSHADE_CONTEXT *pshade_context_new(int *perr);
+
+/*
+ * Free a context opened with pshade_context_new().
+ * 
+ * If NULL is passed, the call is ignored.
+ * 
+ * Parameters:
+ * 
+ *   pc - the context to free, or NULL
+ */
+void pshade_context_free(PSHADE_CONTEXT *pc);
+
+/*
+ * Reset the scanning order of a context back to the top-left corner.
+ * 
+ * The coroutines of generator shaders on the context are released, so
+ * that the next query of each generator starts a new scanline.
+ * 
+ * Parameters:
+ * 
+ *   pc - the context
+ */
+void pshade_context_rewind(PSHADE_CONTEXT *pc);
+
+/*
+ * Get the memory statistics of a context.
+ * 
+ * Parameters:
+ * 
+ *   pc - the context
+ * 
+ *   pms - receives the statistics
+ */
+void pshade_context_memstats(PSHADE_CONTEXT *pc, PSHADE_MEMSTATS *pms);
+
+/*
+ * Query a pixel of a procedural texture using a given context.
+ * 
+ * This is the same as pshade_pixel(), except that the interpreter and
+ * the scanning order of the given context are used instead of the
+ * default context.
+ * 
+ * Parameters:
+ * 
+ *   pc - the context
+ * 
+ *   pShader - the name of the programmable shader to invoke
+ * 
+ *   x - the X coordinate
+ * 
+ *   y - the Y coordinate
+ * 
+ *   width - the width of the output image
+ * 
+ *   height - the height of the output image
+ * 
+ *   perr - pointer to a variable to receive an error message
+ * 
+ * Return:
+ * 
+ *   the generated ARGB pixel value packed in a single integer; use
+ *   *perr to determine whether zero is a valid return
+ */
+uint32_t pshade_context_pixel(
+          PSHADE_CONTEXT * pc,
+    const char           * pShader,
+          int32_t          x,
+          int32_t          y,
+          int32_t          width,
+          int32_t          height,
+          int            * perr);
+
+/*
+ * Query a span of pixels of a procedural texture using a given context.
+ * 
+ * This is the same as pshade_span(), except that the interpreter and
+ * the scanning order of the given context are used instead of the
+ * default context.
+ * 
+ * Parameters:
+ * 
+ *   pc - the context
+ * 
+ *   pShader - the name of the programmable shader to invoke
+ * 
+ *   x - the X coordinate of the first pixel
+ * 
+ *   y - the Y coordinate of the span
+ * 
+ *   count - the number of pixels
+ * 
+ *   width - the width of the output image
+ * 
+ *   height - the height of the output image
+ * 
+ *   pOut - receives the ARGB pixels
+ * 
+ *   perr - pointer to a variable to receive an error code
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+int pshade_context_span(
+          PSHADE_CONTEXT * pc,
+    const char           * pShader,
+          int32_t          x,
+          int32_t          y,
+          int32_t          count,
+          int32_t          width,
+          int32_t          height,
+          uint32_t       * pOut,
+          int            * perr);
+
+/*
+ * Check whether a shader is declared pure with a period in the
+ * lilac_meta table of the loaded script.
+ * 
+ * pShader is the name of the shader, with the same restrictions as for
+ * pshade_pixel().  If no script is loaded, zero is returned.
+ * 
+ * If the script has a lilac_meta table with an entry for the shader
+ * that has a true "pure" field, then the entry must also have a
+ * "period" field that is an array of two integers, each in range one up
+ * to and including PSHADE_MAXPERIOD.  In that case, the period is
+ * written to *pw and *ph and non-zero is returned.  A pure shader may
+ * not also be declared a generator.
+ * 
+ * Zero is returned if the shader is not declared pure.  If the
+ * declaration is present but invalid, zero is returned and *perr is set
+ * to PSHADE_ERR_META.  Otherwise, *perr is set to PSHADE_ERR_NONE.
+ * 
+ * Parameters:
+ * 
+ *   pShader - the name of the shader
+ * 
+ *   pw - receives the width of the period
+ * 
+ *   ph - receives the height of the period
+ * 
+ *   perr - pointer to a variable to receive an error code
+ * 
+ * Return:
+ * 
+ *   non-zero if the shader is pure and periodic, zero otherwise
+ */
+int pshade_meta(
+    const char    * pShader,
+          int32_t * pw,
+          int32_t * ph,
+          int     * perr);
+
+/*
+ * Bake a pure shader into an image.
+ * 
+ * pShader is the name of the shader, with the same restrictions as for
+ * pshade_pixel().  pshade_load() must have been successfully called.
+ * 
+ * The shader is called once for each pixel with coordinates in range
+ * zero up to but excluding w and h, and with w and h as the image
+ * dimensions.  The results are written to pData, which must have room
+ * for w times h pixels in row-major order.
+ * 
+ * The rows are divided among threads worker threads, which may be from
+ * one up to PSHADE_MAXTHREADS.  The first worker runs on the calling
+ * thread with the interpreter loaded by pshade_load().  Each of the
+ * other workers runs on a new thread with its own interpreter, which
+ * loads and runs the script again, so the top-level code of the script
+ * must be safe to run several times and must set up the same state in
+ * every interpreter.  If a thread can't be started, its rows are
+ * baked on the calling thread after those of the first worker.
+ * 
+ * This does not affect the scanning order of any context.
+ * 
+ * Parameters:
+ * 
+ *   pShader - the name of the shader
+ * 
+ *   w - the width of the image
+ * 
+ *   h - the height of the image
+ * 
+ *   pData - receives the pixels
+ * 
+ *   threads - the number of workers
+ * 
+ *   perr - pointer to a variable to receive an error code
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+int pshade_bake(
+    const char     * pShader,
+          int32_t    w,
+          int32_t    h,
+          uint32_t * pData,
+          int        threads,
+          int      * perr);
+
 #endif
@@ -0,0 +1,876 @@
+/*
+ * splane.c
+ * 
+ * Implementation of splane.h
+ * 
+ * See the header for further information.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "splane.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <png.h>
+
+#include "sophistry.h"
+
+/*
+ * Constants
+ * =========
+ */
+
+/*
+ * The number of slots in the hash table of colors used during the
+ * pass.
+ * 
+ * This must be a power of two that is at least twice SPLANE_MAXCOLORS,
+ * so that probe sequences stay short.
+ */
+#define SPLANE_SLOTS (131072L)
+
+/*
+ * The number of bits in a hash table slot index.
+ */
+#define SPLANE_SLOT_BITS (17)
+
+/*
+ * The number of bytes at the start of a PNG file that hold the
+ * signature and the whole IHDR chunk, not counting its CRC.
+ */
+#define SPLANE_PNG_HEAD (29)
+
+/*
+ * The PNG color type of indexed images.
+ */
+#define SPLANE_PNG_INDEXED (3)
+
+/*
+ * Local data
+ * ==========
+ */
+
+/*
+ * Non-zero if a pass has been started and not closed.
+ */
+static int m_started = 0;
+
+/*
+ * Non-zero if the pass is running on m_tid and hasn't been joined.
+ */
+static int m_running = 0;
+static pthread_t m_tid;
+
+/*
+ * Non-zero once the pass has finished.
+ */
+static int m_done = 0;
+
+/*
+ * The result of the pass.  m_ok is non-zero if the index plane is
+ * available.  Otherwise, m_err is the Sophistry error code if decoding
+ * failed, or zero if the pass gave up.
+ */
+static int m_ok = 0;
+static int m_err = 0;
+
+/*
+ * The path to the shading image.
+ */
+static const char *m_pPath = NULL;
+
+/*
+ * The dimensions of the image.
+ */
+static int32_t m_w = 0;
+static int32_t m_h = 0;
+
+/*
+ * The palette, with the RGB index of each entry, and the hash table
+ * that maps RGB indices to palette entries during the pass.  Empty
+ * slots hold -1.
+ */
+static int32_t *m_pColor = NULL;
+static int32_t m_colors = 0;
+static int32_t *m_pSlot = NULL;
+
+/*
+ * The index plane when it is kept in memory.  m_wide is non-zero if
+ * it has two bytes per pixel, or zero if it has one.
+ */
+static unsigned char *m_pPlane = NULL;
+static int m_wide = 0;
+
+/*
+ * The temporary file that holds a spilled index plane, with two bytes
+ * per pixel, and the next scanline at the file position.
+ */
+static FILE *m_pSpill = NULL;
+static int32_t m_spill_y = 0;
+
+/*
+ * Local functions
+ * ===============
+ */
+
+/* Prototypes */
+static int32_t splane_lookup(int32_t rgb);
+static int splane_widen(size_t count);
+static void splane_release(void);
+static void splane_png_error(png_structp pp, png_const_charp pMsg);
+static void splane_png_warn(png_structp pp, png_const_charp pMsg);
+static int splane_png(void);
+static void splane_pass(void);
+static void *splane_thread(void *pArg);
+
+/*
+ * Find the palette entry of an RGB index, adding it if necessary.
+ * 
+ * Parameters:
+ * 
+ *   rgb - the RGB index
+ * 
+ * Return:
+ * 
+ *   the palette index, or -1 if the palette is full
+ */
+static int32_t splane_lookup(int32_t rgb) {
+  
+  uint32_t h = 0;
+  
+  h = (((uint32_t) rgb) * UINT32_C(0x9e3779b1)) >>
+        (32 - SPLANE_SLOT_BITS);
+  
+  while (m_pSlot[h] >= 0) {
+    if (m_pColor[m_pSlot[h]] == rgb) {
+      return m_pSlot[h];
+    }
+    h = (h + 1) & (SPLANE_SLOTS - 1);
+  }
+  
+  if (m_colors >= SPLANE_MAXCOLORS) {
+    return -1;
+  }
+  
+  m_pColor[m_colors] = rgb;
+  m_pSlot[h] = m_colors;
+  m_colors++;
+  
+  return m_colors - 1;
+}
+
+/*
+ * Change the index plane in memory from one byte to two bytes per
+ * pixel.
+ * 
+ * count is the number of pixels that have been stored so far.
+ * 
+ * Parameters:
+ * 
+ *   count - the number of stored pixels
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if out of memory
+ */
+static int splane_widen(size_t count) {
+  
+  unsigned char *pNew = NULL;
+  uint16_t *p16 = NULL;
+  size_t i = 0;
+  
+  pNew = (unsigned char *) realloc(
+            m_pPlane, ((size_t) m_w) * ((size_t) m_h) * 2);
+  if (pNew == NULL) {
+    return 0;
+  }
+  m_pPlane = pNew;
+  
+  /* Convert from the end, so that no byte is overwritten before it is
+   * read */
+  p16 = (uint16_t *) m_pPlane;
+  for(i = count; i > 0; i--) {
+    p16[i - 1] = (uint16_t) m_pPlane[i - 1];
+  }
+  
+  m_wide = 1;
+  return 1;
+}
+
+/*
+ * Release the index plane and the palette.
+ */
+static void splane_release(void) {
+  
+  free(m_pColor);
+  m_pColor = NULL;
+  m_colors = 0;
+  
+  free(m_pSlot);
+  m_pSlot = NULL;
+  
+  free(m_pPlane);
+  m_pPlane = NULL;
+  m_wide = 0;
+  
+  if (m_pSpill != NULL) {
+    fclose(m_pSpill);
+    m_pSpill = NULL;
+  }
+  m_spill_y = 0;
+}
+
+/*
+ * libpng error handler for splane_png().
+ * 
+ * The message is not printed, because the shading image is read again
+ * through Sophistry when the pass fails, and that reports the error.
+ * 
+ * Parameters:
+ * 
+ *   pp - the libpng read structure
+ * 
+ *   pMsg - the error message
+ */
+static void splane_png_error(png_structp pp, png_const_charp pMsg) {
+  (void) pMsg;
+  png_longjmp(pp, 1);
+}
+
+/*
+ * libpng warning handler for splane_png(), which ignores warnings.
+ * 
+ * Parameters:
+ * 
+ *   pp - the libpng read structure
+ * 
+ *   pMsg - the warning message
+ */
+static void splane_png_warn(png_structp pp, png_const_charp pMsg) {
+  (void) pp;
+  (void) pMsg;
+}
+
+/*
+ * Run the pass over an indexed PNG file.
+ * 
+ * The palette of the file becomes the palette of the pass, padded with
+ * opaque black to the full range of the bit depth, which is what libpng
+ * would expand out-of-range indices to.  Each scanline is unpacked to
+ * one byte per pixel directly into the index plane.
+ * 
+ * The results are stored in the local data, except for m_ok and
+ * m_done.  Everything is released on failure.
+ * 
+ * Return:
+ * 
+ *   non-zero if the index plane is available, zero if not
+ */
+static int splane_png(void) {
+  
+  int status = 1;
+  FILE *fh = NULL;
+  png_structp pp = NULL;
+  png_infop pi = NULL;
+  unsigned char * volatile pBuf = NULL;
+  uint16_t * volatile pRow = NULL;
+  
+  png_uint_32 w = 0;
+  png_uint_32 h = 0;
+  int depth = 0;
+  int ctype = 0;
+  int ilace = 0;
+  png_colorp pPal = NULL;
+  int pal_count = 0;
+  png_bytep pTrans = NULL;
+  int trans_count = 0;
+  png_color_16p pTransColor = NULL;
+  
+  uint32_t argb = 0;
+  int32_t i = 0;
+  int32_t x = 0;
+  int32_t y = 0;
+  unsigned char *pDest = NULL;
+  
+  /* Open the file and set up libpng */
+  fh = fopen(m_pPath, "rb");
+  if (fh == NULL) {
+    status = 0;
+  }
+  
+  if (status) {
+    pp = png_create_read_struct(
+            PNG_LIBPNG_VER_STRING, NULL,
+            &splane_png_error, &splane_png_warn);
+    if (pp == NULL) {
+      abort();
+    }
+    pi = png_create_info_struct(pp);
+    if (pi == NULL) {
+      abort();
+    }
+  }
+  
+  /* libpng returns here on any error, and the pass then gives up so
+   * that Sophistry reports the error */
+  if (status) {
+    if (setjmp(png_jmpbuf(pp))) {
+      status = 0;
+    }
+  }
+  
+  /* Read the header, and check that the image is still indexed and not
+   * interlaced, in case the file changed since splane_indexed() */
+  if (status) {
+    png_init_io(pp, fh);
+    png_read_info(pp, pi);
+    png_get_IHDR(pp, pi, &w, &h, &depth, &ctype, &ilace, NULL, NULL);
+    if ((ctype != PNG_COLOR_TYPE_PALETTE) ||
+        (ilace != PNG_INTERLACE_NONE) ||
+        (w < 1) || (h < 1) ||
+        (w > INT32_MAX) || (h > INT32_MAX)) {
+      status = 0;
+    }
+  }
+  
+  if (status) {
+    if (!png_get_PLTE(pp, pi, &pPal, &pal_count)) {
+      status = 0;
+    }
+  }
+  
+  if (status) {
+    m_w = (int32_t) w;
+    m_h = (int32_t) h;
+    
+    if (!png_get_tRNS(pp, pi, &pTrans, &trans_count, &pTransColor)) {
+      pTrans = NULL;
+      trans_count = 0;
+    }
+    
+    /* Unpack indices below eight bits to one byte each */
+    if (depth < 8) {
+      png_set_packing(pp);
+    }
+    png_read_update_info(pp, pi);
+  }
+  
+  /* Build the palette from the PLTE and tRNS chunks */
+  if (status) {
+    m_colors = ((int32_t) 1) << depth;
+    m_pColor = (int32_t *) malloc(
+                  ((size_t) m_colors) * sizeof(int32_t));
+    if (m_pColor == NULL) {
+      abort();
+    }
+    
+    for(i = 0; i < m_colors; i++) {
+      argb = UINT32_C(0xff000000);
+      if (i < pal_count) {
+        argb = (((uint32_t) pPal[i].red  ) << 16) |
+               (((uint32_t) pPal[i].green) <<  8) |
+                ((uint32_t) pPal[i].blue );
+        if (i < trans_count) {
+          argb |= ((uint32_t) pTrans[i]) << 24;
+        } else {
+          argb |= UINT32_C(0xff000000);
+        }
+      }
+      m_pColor[i] = splane_rgb(argb);
+    }
+  }
+  
+  /* Keep the plane in memory if it fits, otherwise spill it to a
+   * temporary file one scanline at a time */
+  if (status) {
+    m_wide = 0;
+    if (((uint64_t) m_w) * ((uint64_t) m_h) <=
+          (uint64_t) SPLANE_MAXMEM) {
+      m_pPlane = (unsigned char *) malloc(
+                    ((size_t) m_w) * ((size_t) m_h));
+      if (m_pPlane == NULL) {
+        status = 0;
+      }
+    
+    } else {
+      m_pSpill = tmpfile();
+      pBuf = (unsigned char *) malloc((size_t) m_w);
+      pRow = (uint16_t *) malloc(((size_t) m_w) * sizeof(uint16_t));
+      if ((m_pSpill == NULL) || (pBuf == NULL) || (pRow == NULL)) {
+        status = 0;
+      }
+    }
+  }
+  
+  /* Read each scanline of indices */
+  for(y = 0; status && (y < m_h); y++) {
+    if (m_pSpill != NULL) {
+      png_read_row(pp, pBuf, NULL);
+      for(x = 0; x < m_w; x++) {
+        pRow[x] = (uint16_t) pBuf[x];
+      }
+      if (fwrite(pRow, sizeof(uint16_t), (size_t) m_w, m_pSpill) !=
+            (size_t) m_w) {
+        status = 0;
+      }
+    
+    } else {
+      pDest = &(m_pPlane[((size_t) y) * ((size_t) m_w)]);
+      png_read_row(pp, pDest, NULL);
+    }
+  }
+  
+  /* Rewind a spilled plane so it can be read back */
+  if (status && (m_pSpill != NULL)) {
+    if (fflush(m_pSpill) || fseeko(m_pSpill, 0, SEEK_SET)) {
+      status = 0;
+    }
+    m_spill_y = 0;
+  }
+  
+  /* Release everything if the plane isn't available */
+  if (!status) {
+    splane_release();
+  }
+  
+  if (pp != NULL) {
+    png_destroy_read_struct(&pp, &pi, NULL);
+  }
+  if (fh != NULL) {
+    fclose(fh);
+    fh = NULL;
+  }
+  
+  free(pBuf);
+  pBuf = NULL;
+  
+  free(pRow);
+  pRow = NULL;
+  
+  return status;
+}
+
+/*
+ * Run the pass over the shading image.
+ * 
+ * The results are stored in the local data.
+ */
+static void splane_pass(void) {
+  
+  int status = 1;
+  int errcode = 0;
+  SPH_IMAGE_READER *pr = NULL;
+  uint32_t *pScan = NULL;
+  uint16_t *pRow = NULL;
+  
+  int32_t x = 0;
+  int32_t y = 0;
+  int32_t i = 0;
+  int have_last = 0;
+  uint32_t last_px = 0;
+  int32_t last_i = 0;
+  size_t pos = 0;
+  
+  /* Indexed PNG files are read with their own palette */
+  if (splane_indexed(m_pPath)) {
+    m_ok = splane_png();
+    m_done = 1;
+    return;
+  }
+  
+  /* Open the shading image */
+  pr = sph_image_reader_newFromPath(m_pPath, &errcode);
+  if (pr == NULL) {
+    status = 0;
+    m_err = errcode;
+  }
+  
+  if (status) {
+    m_w = sph_image_reader_width(pr);
+    m_h = sph_image_reader_height(pr);
+  }
+  
+  /* Allocate the palette and the hash table */
+  if (status) {
+    m_pColor = (int32_t *) malloc(
+                  ((size_t) SPLANE_MAXCOLORS) * sizeof(int32_t));
+    m_pSlot = (int32_t *) malloc(
+                  ((size_t) SPLANE_SLOTS) * sizeof(int32_t));
+    if ((m_pColor == NULL) || (m_pSlot == NULL)) {
+      abort();
+    }
+    memset(m_pSlot, 0xff, ((size_t) SPLANE_SLOTS) * sizeof(int32_t));
+    m_colors = 0;
+  }
+  
+  /* Keep the plane in memory if it fits, otherwise spill it to a
+   * temporary file one scanline at a time */
+  if (status) {
+    if (((uint64_t) m_w) * ((uint64_t) m_h) * 2 <=
+          (uint64_t) SPLANE_MAXMEM) {
+      m_pPlane = (unsigned char *) malloc(
+                    ((size_t) m_w) * ((size_t) m_h));
+      if (m_pPlane == NULL) {
+        status = 0;
+      }
+    
+    } else {
+      m_pSpill = tmpfile();
+      pRow = (uint16_t *) malloc(((size_t) m_w) * sizeof(uint16_t));
+      if ((m_pSpill == NULL) || (pRow == NULL)) {
+        status = 0;
+      }
+    }
+  }
+  
+  /* Go through each scanline */
+  for(y = 0; status && (y < m_h); y++) {
+    
+    pScan = sph_image_reader_read(pr, &errcode);
+    if (pScan == NULL) {
+      status = 0;
+      m_err = errcode;
+      break;
+    }
+    
+    for(x = 0; x < m_w; x++) {
+      
+      /* Neighbouring pixels usually have the same value */
+      if ((!have_last) || (pScan[x] != last_px)) {
+        last_px = pScan[x];
+        last_i = splane_lookup(splane_rgb(last_px));
+        have_last = 1;
+        if (last_i < 0) {
+          status = 0;
+          break;
+        }
+      }
+      
+      /* Store the palette index, widening the plane when the palette
+       * no longer fits in a byte */
+      if (m_pSpill != NULL) {
+        pRow[x] = (uint16_t) last_i;
+      
+      } else {
+        pos = (((size_t) y) * ((size_t) m_w)) + ((size_t) x);
+        if ((!m_wide) && (last_i > 255)) {
+          if (!splane_widen(pos)) {
+            status = 0;
+            break;
+          }
+        }
+        if (m_wide) {
+          ((uint16_t *) m_pPlane)[pos] = (uint16_t) last_i;
+        } else {
+          m_pPlane[pos] = (unsigned char) last_i;
+        }
+      }
+    }
+    
+    if (status && (m_pSpill != NULL)) {
+      if (fwrite(pRow, sizeof(uint16_t), (size_t) m_w, m_pSpill) !=
+            (size_t) m_w) {
+        status = 0;
+      }
+    }
+  }
+  
+  /* Rewind a spilled plane so it can be read back */
+  if (status && (m_pSpill != NULL)) {
+    if (fflush(m_pSpill) || fseeko(m_pSpill, 0, SEEK_SET)) {
+      status = 0;
+    }
+    m_spill_y = 0;
+  }
+  
+  /* The hash table is only needed during the pass; shrink the palette
+   * to the colors that were used */
+  free(m_pSlot);
+  m_pSlot = NULL;
+  
+  if (status) {
+    i = m_colors;
+    if (i < 1) {
+      i = 1;
+    }
+    m_pColor = (int32_t *) realloc(m_pColor,
+                  ((size_t) i) * sizeof(int32_t));
+    if (m_pColor == NULL) {
+      abort();
+    }
+  }
+  
+  /* Release everything if the plane isn't available */
+  if (!status) {
+    splane_release();
+  }
+  
+  free(pRow);
+  pRow = NULL;
+  
+  sph_image_reader_close(pr);
+  pr = NULL;
+  
+  m_ok = status;
+  m_done = 1;
+}
+
+/*
+ * Thread start routine that runs the pass.
+ * 
+ * Parameters:
+ * 
+ *   pArg - ignored
+ * 
+ * Return:
+ * 
+ *   NULL
+ */
+static void *splane_thread(void *pArg) {
+  (void) pArg;
+  splane_pass();
+  return NULL;
+}
+
+/*
+ * Public function implementations
+ * ===============================
+ * 
+ * See the header for specifications.
+ */
+
+/*
+ * splane_rgb function.
+ */
+int32_t splane_rgb(uint32_t argb) {
+  
+  SPH_ARGB ua;
+  
+  /* Fast path for opaque pixels */
+  if ((argb & UINT32_C(0xff000000)) == UINT32_C(0xff000000)) {
+    return (int32_t) (argb & UINT32_C(0xffffff));
+  }
+  
+  /* Unpack, down-convert to RGB, and pack with zero alpha */
+  memset(&ua, 0, sizeof(SPH_ARGB));
+  sph_argb_unpack(argb, &ua);
+  sph_argb_downRGB(&ua);
+  ua.a = 0;
+  
+  return (int32_t) sph_argb_pack(&ua);
+}
+
+/*
+ * splane_indexed function.
+ */
+int splane_indexed(const char *pPath) {
+  
+  static const unsigned char sig[8] = {
+    0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a
+  };
+  
+  int result = 1;
+  FILE *fh = NULL;
+  unsigned char head[SPLANE_PNG_HEAD];
+  
+  /* Check parameter */
+  if (pPath == NULL) {
+    abort();
+  }
+  
+  /* Read the signature and the IHDR chunk */
+  memset(head, 0, sizeof(head));
+  fh = fopen(pPath, "rb");
+  if (fh == NULL) {
+    result = 0;
+  }
+  
+  if (result) {
+    if (fread(head, 1, SPLANE_PNG_HEAD, fh) != SPLANE_PNG_HEAD) {
+      result = 0;
+    }
+  }
+  
+  if (fh != NULL) {
+    fclose(fh);
+    fh = NULL;
+  }
+  
+  /* IHDR must come first, with the color type at byte 25 and the
+   * interlace method at byte 28 of the file */
+  if (result) {
+    if ((memcmp(head, sig, 8) != 0) ||
+        (memcmp(&(head[12]), "IHDR", 4) != 0) ||
+        (head[25] != SPLANE_PNG_INDEXED) ||
+        (head[28] != 0)) {
+      result = 0;
+    }
+  }
+  
+  return result;
+}
+
+/*
+ * splane_start function.
+ */
+void splane_start(const char *pPath) {
+  
+  /* Check parameters and state */
+  if ((pPath == NULL) || m_started) {
+    abort();
+  }
+  
+  /* Reset the results */
+  m_started = 1;
+  m_done = 0;
+  m_ok = 0;
+  m_err = 0;
+  m_pPath = pPath;
+  m_w = 0;
+  m_h = 0;
+  
+  /* Run the pass on a new thread if possible */
+  if (pthread_create(&m_tid, NULL, &splane_thread, NULL) == 0) {
+    m_running = 1;
+  }
+}
+
+/*
+ * splane_started function.
+ */
+int splane_started(void) {
+  return m_started;
+}
+
+/*
+ * splane_finish function.
+ */
+int splane_finish(int *perr) {
+  
+  /* Check parameters and state */
+  if ((perr == NULL) || (!m_started)) {
+    abort();
+  }
+  
+  /* Wait for the thread, or run the pass here if there is none */
+  if (m_running) {
+    pthread_join(m_tid, NULL);
+    m_running = 0;
+  }
+  if (!m_done) {
+    splane_pass();
+  }
+  
+  *perr = m_err;
+  return m_ok;
+}
+
+/*
+ * splane_size function.
+ */
+void splane_size(int32_t *pw, int32_t *ph) {
+  
+  if ((pw == NULL) || (ph == NULL) || (!m_ok)) {
+    abort();
+  }
+  
+  *pw = m_w;
+  *ph = m_h;
+}
+
+/*
+ * splane_colors function.
+ */
+int32_t splane_colors(void) {
+  
+  if (!m_ok) {
+    abort();
+  }
+  
+  return m_colors;
+}
+
+/*
+ * splane_color function.
+ */
+int32_t splane_color(int32_t i) {
+  
+  if ((!m_ok) || (i < 0) || (i >= m_colors)) {
+    abort();
+  }
+  
+  return m_pColor[i];
+}
+
+/*
+ * splane_row function.
+ */
+int splane_row(int32_t y, uint16_t *pRow) {
+  
+  int status = 1;
+  int32_t x = 0;
+  const unsigned char *pSrc = NULL;
+  
+  /* Check parameters and state */
+  if ((!m_ok) || (y < 0) || (y >= m_h) || (pRow == NULL)) {
+    abort();
+  }
+  
+  if (m_pSpill != NULL) {
+    /* Seek to the scanline unless it is the next one */
+    if (y != m_spill_y) {
+      if (fseeko(m_pSpill,
+            ((off_t) y) * ((off_t) m_w) * ((off_t) sizeof(uint16_t)),
+            SEEK_SET)) {
+        status = 0;
+      }
+    }
+    if (status) {
+      if (fread(pRow, sizeof(uint16_t), (size_t) m_w, m_pSpill) !=
+            (size_t) m_w) {
+        status = 0;
+      }
+    }
+    if (status) {
+      m_spill_y = y + 1;
+    } else {
+      m_spill_y = -1;
+    }
+  
+  } else if (m_wide) {
+    memcpy(pRow,
+            &(((const uint16_t *) m_pPlane)[((size_t) y) * m_w]),
+            ((size_t) m_w) * sizeof(uint16_t));
+  
+  } else {
+    pSrc = &(m_pPlane[((size_t) y) * m_w]);
+    for(x = 0; x < m_w; x++) {
+      pRow[x] = (uint16_t) pSrc[x];
+    }
+  }
+  
+  return status;
+}
+
+/*
+ * splane_close function.
+ */
+void splane_close(void) {
+  
+  int errcode = 0;
+  
+  if (m_started) {
+    splane_finish(&errcode);
+    splane_release();
+    m_started = 0;
+    m_done = 0;
+    m_ok = 0;
+    m_err = 0;
+    m_pPath = NULL;
+  }
+}
@@ -0,0 +1,209 @@
+#ifndef SPLANE_H_INCLUDED
+#define SPLANE_H_INCLUDED
+
+/*
+ * splane.h
+ * 
+ * Shading plane module of Lilac.
+ * 
+ * Shading images usually have only a few hundred distinct colors, but
+ * every pixel of the shading image would otherwise need its RGB index
+ * computed and looked up in the shading table.  This module makes a
+ * first pass over the shading image that collects its distinct RGB
+ * indices into a palette and stores the palette index of every pixel in
+ * an index plane.  The caller then resolves each palette entry to a
+ * shading record once, and the render pass reads palette indices
+ * instead of decoding the shading image.
+ * 
+ * The index plane uses one byte per pixel while there are at most 256
+ * colors and two bytes per pixel otherwise.  Planes larger than
+ * SPLANE_MAXMEM bytes are spilled to a temporary file.  If the image
+ * has more than SPLANE_MAXCOLORS distinct colors, or the plane can't be
+ * stored, the pass gives up and the caller must read the shading image
+ * normally.
+ * 
+ * The pass runs on a separate thread, so it can decode the shading
+ * image while the caller does other work, such as loading textures.
+ * Only one pass may exist at a time.
+ * 
+ * Shading images saved as indexed PNG files are read directly with
+ * libpng instead of through Sophistry.  The palette of the file becomes
+ * the palette of the pass, and its pixel indices are stored as the
+ * index plane without being expanded to ARGB or looked up one by one.
+ * Indexed files always have one byte per pixel and never give up
+ * because of too many colors.  Interlaced files are read through
+ * Sophistry like any other image.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The maximum number of distinct colors in the palette.
+ */
+#define SPLANE_MAXCOLORS (65536L)
+
+/*
+ * The maximum number of bytes of index plane kept in memory.  Larger
+ * planes are spilled to a temporary file.
+ */
+#define SPLANE_MAXMEM (268435456L)
+
+/*
+ * Get the RGB index of a shading pixel.
+ * 
+ * The pixel is down-converted to RGB by compositing it over white, and
+ * packed with a zero alpha channel.  Down-converting an opaque pixel
+ * leaves its channels alone, so opaque pixels are handled without
+ * unpacking.
+ * 
+ * Parameters:
+ * 
+ *   argb - the packed ARGB pixel
+ * 
+ * Return:
+ * 
+ *   the RGB index
+ */
+int32_t splane_rgb(uint32_t argb);
+
+/*
+ * Check whether a shading image is an indexed PNG file that the pass
+ * reads directly.
+ * 
+ * Only the header of the file is read.  Zero is returned if the file
+ * can't be opened or isn't a non-interlaced indexed PNG file.
+ * 
+ * Parameters:
+ * 
+ *   pPath - the path to the shading image
+ * 
+ * Return:
+ * 
+ *   non-zero if the file is a non-interlaced indexed PNG file, zero
+ *   otherwise
+ */
+int splane_indexed(const char *pPath);
+
+/*
+ * Start the pass over a shading image on a new thread.
+ * 
+ * pPath is the path to the shading image, which is opened with the
+ * Sophistry image reader.  The string must remain valid until
+ * splane_finish() is called.
+ * 
+ * A fault occurs if a pass has already been started and not yet
+ * closed with splane_close().
+ * 
+ * If the thread can't be started, the pass is run when splane_finish()
+ * is called instead.
+ * 
+ * Parameters:
+ * 
+ *   pPath - the path to the shading image
+ */
+void splane_start(const char *pPath);
+
+/*
+ * Check whether a pass has been started and not yet closed.
+ * 
+ * Return:
+ * 
+ *   non-zero if a pass has been started, zero otherwise
+ */
+int splane_started(void);
+
+/*
+ * Wait for the pass to finish.
+ * 
+ * A fault occurs if no pass has been started.  This may be called more
+ * than once for the same pass, and always gives the same result.
+ * 
+ * If the shading image could not be decoded, zero is returned and
+ * *perr is set to the Sophistry error code.  If the pass gave up
+ * because of too many colors or because the plane couldn't be stored,
+ * zero is returned and *perr is set to zero.  In both cases, the
+ * caller should read the shading image normally, which will report
+ * the decoding error again.
+ * 
+ * Parameters:
+ * 
+ *   perr - receives the Sophistry error code
+ * 
+ * Return:
+ * 
+ *   non-zero if the index plane is available, zero if not
+ */
+int splane_finish(int *perr);
+
+/*
+ * Get the dimensions of the index plane.
+ * 
+ * The index plane must be available.
+ * 
+ * Parameters:
+ * 
+ *   pw - receives the width
+ * 
+ *   ph - receives the height
+ */
+void splane_size(int32_t *pw, int32_t *ph);
+
+/*
+ * Get the number of colors in the palette.
+ * 
+ * The index plane must be available.
+ * 
+ * Return:
+ * 
+ *   the number of colors, at least one
+ */
+int32_t splane_colors(void);
+
+/*
+ * Get the RGB index of a palette entry.
+ * 
+ * The index plane must be available, and i must be in range zero up to
+ * but excluding splane_colors().
+ * 
+ * Parameters:
+ * 
+ *   i - the palette index
+ * 
+ * Return:
+ * 
+ *   the RGB index of the entry
+ */
+int32_t splane_color(int32_t i);
+
+/*
+ * Read a scanline of the index plane.
+ * 
+ * The index plane must be available, and y must be in range zero up to
+ * but excluding the height.  pRow must have room for a whole scanline,
+ * and receives the palette index of each pixel.
+ * 
+ * Scanlines may be read in any order, but reading them from top to
+ * bottom is fastest for spilled planes.
+ * 
+ * Parameters:
+ * 
+ *   y - the scanline to read
+ * 
+ *   pRow - receives the palette indices
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if the spilled plane couldn't be read
+ */
+int splane_row(int32_t y, uint16_t *pRow);
+
+/*
+ * Release the index plane and the palette.
+ * 
+ * If a pass is running, this waits for it first.  Nothing happens if
+ * no pass has been started.
+ */
+void splane_close(void);
+
+#endif
@@ -0,0 +1,424 @@
+/*
+ * stats.c
+ * 
+ * Implementation of stats.h
+ * 
+ * See the header for further information.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pixel.h"
+#include "pshade.h"
+#include "ttable.h"
+
+/*
+ * Constants
+ * =========
+ */
+
+/*
+ * The number of clock reads used to estimate the cost of one read.
+ */
+#define CALIBRATE_COUNT (1000)
+
+/*
+ * Local data
+ * ==========
+ */
+
+/*
+ * The names of each stage in the report, indexed by stage code.
+ */
+static const char *m_stage_name[STATS_STAGE_COUNT] = {
+  "decode",
+  "ttable",
+  "vtx_png",
+  "vtx_pshade",
+  "fade",
+  "composite1",
+  "composite2",
+  "colorize",
+  "tile",
+  "encode"
+};
+
+/*
+ * Flag indicating whether the module is enabled.
+ */
+static int m_enabled = 0;
+
+/*
+ * The number of renders, and the clock value at the start of the
+ * current render.
+ */
+static long m_renders = 0;
+static double m_render_start = 0.0;
+
+/*
+ * Accumulated seconds for each stage, and accumulated seconds of whole
+ * renders.
+ * 
+ * m_stage_laps counts the stats_lap() calls for each stage.  Each lap
+ * includes the time of one clock read, which is comparable to the time
+ * of a per-pixel stage, so the report subtracts m_clock_cost for each
+ * lap.
+ */
+static double m_stage_sec[STATS_STAGE_COUNT];
+static int64_t m_stage_laps[STATS_STAGE_COUNT];
+static double m_total_sec = 0.0;
+static double m_clock_cost = 0.0;
+
+/*
+ * Pixel counts for each mode.
+ */
+static int64_t m_mode_count[3];
+
+/*
+ * Countdown to the next timed pixel, and the number of pixels that
+ * have been timed.
+ */
+static int m_countdown = 0;
+static int64_t m_sampled = 0;
+
+/*
+ * Per-record pixel counts.
+ * 
+ * m_rcount is the number of shading table records.  m_rec_count has
+ * (m_rcount + 1) * 2 entries.  Each pair holds the shade and pencil
+ * counts for one record, and the last pair is for the default record.
+ */
+static int m_rcount = 0;
+static int64_t *m_rec_count = NULL;
+
+/*
+ * Public function implementations
+ * ===============================
+ * 
+ * See the header for specifications.
+ */
+
+/*
+ * stats_enable function.
+ */
+int stats_enable(int rcount) {
+  
+  int status = 1;
+  int i = 0;
+  double t = 0.0;
+  
+  /* Check parameter */
+  if (rcount < 0) {
+    abort();
+  }
+  
+  /* Release any existing counters */
+  if (m_rec_count != NULL) {
+    free(m_rec_count);
+    m_rec_count = NULL;
+  }
+  m_enabled = 0;
+  
+  /* Allocate new per-record counters */
+  m_rec_count = (int64_t *) calloc(
+                  ((size_t) rcount + 1) * 2, sizeof(int64_t));
+  if (m_rec_count == NULL) {
+    status = 0;
+  }
+  
+  /* Clear everything else */
+  if (status) {
+    m_rcount = rcount;
+    m_renders = 0;
+    m_render_start = 0.0;
+    memset(m_stage_sec, 0, sizeof(m_stage_sec));
+    memset(m_stage_laps, 0, sizeof(m_stage_laps));
+    m_total_sec = 0.0;
+    memset(m_mode_count, 0, sizeof(m_mode_count));
+    m_countdown = 0;
+    m_sampled = 0;
+    m_enabled = 1;
+  }
+  
+  /* Estimate the cost of reading the clock */
+  if (status) {
+    t = stats_clock();
+    for(i = 0; i < CALIBRATE_COUNT; i++) {
+      stats_clock();
+    }
+    m_clock_cost = (stats_clock() - t) /
+                    ((double) (CALIBRATE_COUNT + 1));
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * stats_clock function.
+ */
+double stats_clock(void) {
+  
+  double result = 0.0;
+  struct timespec ts;
+  
+  /* Initialize structures */
+  memset(&ts, 0, sizeof(struct timespec));
+  
+  /* Read the clock */
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+    result = ((double) ts.tv_sec) + (((double) ts.tv_nsec) / 1.0e9);
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * stats_begin function.
+ */
+void stats_begin(void) {
+  if (m_enabled) {
+    m_renders++;
+    m_render_start = stats_clock();
+  }
+}
+
+/*
+ * stats_end function.
+ */
+void stats_end(void) {
+  if (m_enabled) {
+    m_total_sec += stats_clock() - m_render_start;
+  }
+}
+
+/*
+ * stats_pixel function.
+ */
+int stats_pixel(int mode) {
+  
+  int result = 0;
+  
+  /* Check parameter */
+  if ((mode < 0) || (mode > 2)) {
+    abort();
+  }
+  
+  /* Count the pixel and see whether it is time for a sample */
+  if (m_enabled) {
+    (m_mode_count[mode])++;
+    if (m_countdown > 0) {
+      m_countdown--;
+    } else {
+      m_countdown = STATS_INTERVAL - 1;
+      m_sampled++;
+      result = 1;
+    }
+  }
+  
+  /* Return result */
+  return result;
+}
+
+/*
+ * stats_span function.
+ */
+void stats_span(int mode, int32_t count) {
+  
+  int64_t rest = 0;
+  
+  /* Check parameters */
+  if ((mode < 0) || (mode > 2) || (count < 0)) {
+    abort();
+  }
+  
+  /* Count the pixels and advance the sampling countdown exactly as if
+   * each pixel had been passed to stats_pixel() */
+  if (m_enabled && (count > 0)) {
+    m_mode_count[mode] += (int64_t) count;
+    if (count <= m_countdown) {
+      m_countdown -= (int) count;
+    } else {
+      rest = ((int64_t) count) - ((int64_t) m_countdown) - 1;
+      m_sampled += 1 + (rest / STATS_INTERVAL);
+      m_countdown = STATS_INTERVAL - 1 -
+                      ((int) (rest % STATS_INTERVAL));
+    }
+  }
+}
+
+/*
+ * stats_record function.
+ */
+void stats_record(int mode, int rec) {
+  
+  /* Check parameters */
+  if ((mode != STATS_MODE_SHADE) && (mode != STATS_MODE_PENCIL)) {
+    abort();
+  }
+  if ((rec < -1) || (m_enabled && (rec >= m_rcount))) {
+    abort();
+  }
+  
+  /* Use the last pair for the default record */
+  if (rec < 0) {
+    rec = m_rcount;
+  }
+  
+  /* Count the pixel */
+  if (m_enabled) {
+    if (mode == STATS_MODE_SHADE) {
+      (m_rec_count[rec * 2])++;
+    } else {
+      (m_rec_count[rec * 2 + 1])++;
+    }
+  }
+}
+
+/*
+ * stats_lap function.
+ */
+void stats_lap(int stage, double *pt) {
+  
+  double now = 0.0;
+  
+  /* Check parameters */
+  if ((stage < 0) || (stage >= STATS_STAGE_COUNT) || (pt == NULL)) {
+    abort();
+  }
+  
+  /* Add the elapsed time and move the start time forward */
+  if (m_enabled) {
+    now = stats_clock();
+    m_stage_sec[stage] += now - *pt;
+    (m_stage_laps[stage])++;
+    *pt = now;
+  }
+}
+
+/*
+ * stats_report function.
+ */
+void stats_report(FILE *pOut) {
+  
+  int i = 0;
+  int64_t pixels = 0;
+  int64_t hits = 0;
+  int64_t misses = 0;
+  int gcmode = 0;
+  double scale = 0.0;
+  double sec = 0.0;
+  SHADEREC sr;
+  PSHADE_MEMSTATS ms;
+  
+  /* Initialize structures */
+  memset(&sr, 0, sizeof(SHADEREC));
+  memset(&ms, 0, sizeof(PSHADE_MEMSTATS));
+  
+  /* Check parameter */
+  if (pOut == NULL) {
+    abort();
+  }
+  
+  /* Only proceed if enabled */
+  if (m_enabled) {
+    
+    /* Count all pixels */
+    pixels = m_mode_count[0] + m_mode_count[1] + m_mode_count[2];
+    
+    /* Determine how to scale sampled per-pixel times up to the whole
+     * image */
+    if (m_sampled > 0) {
+      scale = ((double) pixels) / ((double) m_sampled);
+    }
+    
+    /* Write the summary */
+    fprintf(pOut, "{\n");
+    fprintf(pOut, "  \"renders\": %ld,\n", m_renders);
+    fprintf(pOut, "  \"pixels\": %lld,\n", (long long) pixels);
+    fprintf(pOut, "  \"sample_interval\": %d,\n", STATS_INTERVAL);
+    fprintf(pOut, "  \"sampled_pixels\": %lld,\n",
+              (long long) m_sampled);
+    
+    /* Write the stage times */
+    fprintf(pOut, "  \"seconds\": {\n");
+    fprintf(pOut, "    \"total\": %.6f,\n", m_total_sec);
+    for(i = 0; i < STATS_STAGE_COUNT; i++) {
+      sec = m_stage_sec[i] -
+              (((double) m_stage_laps[i]) * m_clock_cost);
+      if (sec < 0.0) {
+        sec = 0.0;
+      }
+      if ((i != STATS_DECODE) && (i != STATS_ENCODE)) {
+        sec *= scale;
+      }
+      fprintf(pOut, "    \"%s\": %.6f%s\n",
+                m_stage_name[i], sec,
+                (i < STATS_STAGE_COUNT - 1) ? "," : "");
+    }
+    fprintf(pOut, "  },\n");
+    
+    /* Write the mode counts */
+    fprintf(pOut, "  \"modes\": {\n");
+    fprintf(pOut, "    \"blank\": %lld,\n",
+              (long long) m_mode_count[STATS_MODE_BLANK]);
+    fprintf(pOut, "    \"shade\": %lld,\n",
+              (long long) m_mode_count[STATS_MODE_SHADE]);
+    fprintf(pOut, "    \"pencil\": %lld\n",
+              (long long) m_mode_count[STATS_MODE_PENCIL]);
+    fprintf(pOut, "  },\n");
+    
+    /* Write the memo cache counts */
+    fprintf(pOut, "  \"memo\": {\n");
+    for(i = 0; i < 2; i++) {
+      pixel_memo_count(i, &hits, &misses);
+      fprintf(pOut,
+                "    \"%s\": {\"hits\": %lld, \"misses\": %lld}%s\n",
+                (i == PIXEL_MEMO_COMPOSITE) ? "composite" : "colorize",
+                (long long) hits, (long long) misses,
+                (i < 1) ? "," : "");
+    }
+    fprintf(pOut, "  },\n");
+    
+    /* Write the memory use of the shader interpreter, if loaded */
+    if (pshade_memstats(&ms, &gcmode)) {
+      fprintf(pOut, "  \"lua\": {\n");
+      fprintf(pOut, "    \"gc\": \"%s\",\n", pshade_gcname(gcmode));
+      fprintf(pOut, "    \"bytes\": %lld,\n", (long long) ms.bytes);
+      fprintf(pOut, "    \"peak_bytes\": %lld,\n", (long long) ms.peak);
+      fprintf(pOut, "    \"allocs\": %lld,\n", (long long) ms.allocs);
+      fprintf(pOut, "    \"system_allocs\": %lld,\n",
+                (long long) ms.sysallocs);
+      fprintf(pOut, "    \"collections\": %lld\n",
+                (long long) ms.collections);
+      fprintf(pOut, "  },\n");
+    } else {
+      fprintf(pOut, "  \"lua\": null,\n");
+    }
+    
+    /* Write the per-record counts, with the default record last */
+    fprintf(pOut, "  \"records\": [\n");
+    for(i = 0; i <= m_rcount; i++) {
+      if (i < m_rcount) {
+        ttable_get(i, &sr);
+        fprintf(pOut, "    {\"rgb\": \"%06lx\", ",
+                  (long) (sr.rgbidx & INT32_C(0xffffff)));
+      } else {
+        fprintf(pOut, "    {\"rgb\": null, ");
+      }
+      fprintf(pOut, "\"shade\": %lld, \"pencil\": %lld}%s\n",
+                (long long) m_rec_count[i * 2],
+                (long long) m_rec_count[i * 2 + 1],
+                (i < m_rcount) ? "," : "");
+    }
+    fprintf(pOut, "  ]\n");
+    fprintf(pOut, "}\n");
+  }
+}
@@ -0,0 +1,201 @@
+#ifndef STATS_H_INCLUDED
+#define STATS_H_INCLUDED
+
+/*
+ * stats.h
+ * 
+ * Rendering statistics module of Lilac.
+ * 
+ * This module accumulates timings and pixel counters for the stages of
+ * the rendering pipeline and writes them out as a JSON report.
+ * 
+ * Scanline decoding and encoding are timed exactly, since they happen
+ * only once per scanline.  The per-pixel stages are far too short to
+ * time on every pixel without slowing down the render, so only one
+ * pixel out of every STATS_INTERVAL is timed.  The report extrapolates
+ * the per-pixel stage times from these samples to the whole image.
+ * Pixel counters are always exact.
+ * 
+ * The report also includes the hit and miss counts of the memo caches
+ * of the pixel module, and the memory statistics of the interpreter of
+ * the programmable shader module.
+ * 
+ * The module starts out disabled.  While disabled, stats_pixel() always
+ * returns zero and nothing is recorded, so callers may leave their
+ * instrumentation in place.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Stage codes.
+ * 
+ * Don't forget to update the stage names in stats.c!
+ */
+#define STATS_DECODE      (0)   /* Reading input scanlines */
+#define STATS_TTABLE      (1)   /* Shading table queries */
+#define STATS_VTX_PNG     (2)   /* Image texture queries */
+#define STATS_VTX_PSHADE  (3)   /* Procedural texture queries */
+#define STATS_FADE        (4)   /* Fading by shading or drawing rate */
+#define STATS_COMPOSITE1  (5)   /* Compositing over first texture */
+#define STATS_COMPOSITE2  (6)   /* Compositing over white */
+#define STATS_COLORIZE    (7)   /* Colorizing */
+#define STATS_TILE        (8)   /* Copying from cached tiles */
+#define STATS_ENCODE      (9)   /* Writing output scanlines */
+
+#define STATS_STAGE_COUNT (10)
+
+/*
+ * Pixel mode codes.
+ */
+#define STATS_MODE_BLANK  (0)   /* Masked out, transparent output */
+#define STATS_MODE_SHADE  (1)   /* Shaded, not covered by pencil */
+#define STATS_MODE_PENCIL (2)   /* Covered by pencil */
+
+/*
+ * One pixel out of this many is timed.
+ * 
+ * This is prime so that the sampled pixels do not line up with the
+ * periods of tiled textures or with the image width.
+ */
+#define STATS_INTERVAL (61)
+
+/*
+ * Enable the statistics module and clear all statistics.
+ * 
+ * rcount is the number of records in the shading table, which is used
+ * to size the per-record counters.  The shading table must not change
+ * while statistics are being gathered.
+ * 
+ * This may be called again to start over.
+ * 
+ * Parameters:
+ * 
+ *   rcount - the number of shading table records
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if out of memory
+ */
+int stats_enable(int rcount);
+
+/*
+ * Return the current value of a monotonic clock in seconds.
+ * 
+ * Only differences between return values are meaningful.  Zero is
+ * returned if the clock can't be read.
+ * 
+ * Return:
+ * 
+ *   the clock value in seconds
+ */
+double stats_clock(void);
+
+/*
+ * Record the start of a render.
+ * 
+ * This is counted in the report, and the time until stats_end() is
+ * added to the total render time.  Does nothing if the module is not
+ * enabled.
+ */
+void stats_begin(void);
+
+/*
+ * Record the end of a render started with stats_begin().
+ * 
+ * Does nothing if the module is not enabled.
+ */
+void stats_end(void);
+
+/*
+ * Count a pixel in the given mode and decide whether to time its
+ * stages.
+ * 
+ * mode is one of the STATS_MODE constants.  This should be called once
+ * for each output pixel.
+ * 
+ * If the return value is non-zero, the caller should time each of the
+ * per-pixel stages for this pixel with stats_lap().  Zero is always
+ * returned if the module is not enabled.
+ * 
+ * Parameters:
+ * 
+ *   mode - the mode of the pixel
+ * 
+ * Return:
+ * 
+ *   non-zero if this pixel should be timed, zero otherwise
+ */
+int stats_pixel(int mode);
+
+/*
+ * Count a span of pixels in the given mode without timing any of them.
+ * 
+ * This has the same effect on the counters and on the choice of timed
+ * pixels as calling stats_pixel() count times and ignoring the return
+ * value.  It is meant for spans of BLANK pixels, which have no
+ * per-pixel stages to time.
+ * 
+ * Does nothing if the module is not enabled or count is zero.
+ * 
+ * Parameters:
+ * 
+ *   mode - the mode of the pixels
+ * 
+ *   count - the number of pixels, zero or greater
+ */
+void stats_span(int mode, int32_t count);
+
+/*
+ * Count a shaded or pencil pixel against its shading record.
+ * 
+ * mode is STATS_MODE_SHADE or STATS_MODE_PENCIL.  rec is the record
+ * index returned by ttable_query(), or -1 for the default record.
+ * 
+ * Does nothing if the module is not enabled.
+ * 
+ * Parameters:
+ * 
+ *   mode - the mode of the pixel
+ * 
+ *   rec - the shading record index or -1
+ */
+void stats_record(int mode, int rec);
+
+/*
+ * Add elapsed time to a stage.
+ * 
+ * *pt holds the clock value at the start of the stage.  The time from
+ * there until now is added to the given stage, and *pt is updated to
+ * the current clock value so that it can be passed directly to the
+ * next stage.
+ * 
+ * Time for the per-pixel stages should only be added for pixels that
+ * stats_pixel() selected for timing.  Time for STATS_DECODE and
+ * STATS_ENCODE should be added for every scanline.
+ * 
+ * Does nothing if the module is not enabled.
+ * 
+ * Parameters:
+ * 
+ *   stage - one of the STATS_ stage codes
+ * 
+ *   pt - pointer to the clock value at the start of the stage
+ */
+void stats_lap(int stage, double *pt);
+
+/*
+ * Write the statistics as a JSON object to the given output.
+ * 
+ * Does nothing if the module is not enabled.  The shading table must
+ * still hold the same records as when stats_enable() was called.
+ * 
+ * Parameters:
+ * 
+ *   pOut - the output to write to
+ */
+void stats_report(FILE *pOut);
+
+#endif
@@ -0,0 +1,206 @@
+/*
+ * tcache.c
+ * 
+ * Implementation of tcache.h
+ * 
+ * See the header for further information.
+ */
+
+#include "tcache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Constants
+ * =========
+ */
+
+/*
+ * The number of slots in the hash table of keys.
+ * 
+ * This must be a power of two.
+ */
+#define TCACHE_SLOTS (4096)
+
+/*
+ * The maximum number of keys, which leaves enough free slots to keep
+ * probe sequences short.
+ */
+#define TCACHE_MAX_KEYS (TCACHE_SLOTS / 2)
+
+/*
+ * Type declarations
+ * =================
+ */
+
+/*
+ * A slot in the hash table.
+ */
+typedef struct {
+  
+  /*
+   * Non-zero if this slot is in use.
+   */
+  int used;
+  
+  /*
+   * The key.
+   */
+  int tidx;
+  int rate;
+  uint32_t tint;
+  
+  /*
+   * The tile dimensions.
+   */
+  int32_t w;
+  int32_t h;
+  
+  /*
+   * The tile pixels, or NULL if the tile was refused.
+   */
+  uint32_t *pData;
+  
+} TSLOT;
+
+/*
+ * Local data
+ * ==========
+ */
+
+/*
+ * The hash table.
+ */
+static TSLOT m_slot[TCACHE_SLOTS];
+
+/*
+ * The number of slots in use.
+ */
+static int m_keys = 0;
+
+/*
+ * The number of bytes allocated to tiles.
+ */
+static long m_bytes = 0;
+
+/*
+ * Local functions
+ * ===============
+ */
+
+/*
+ * Hash a key.
+ * 
+ * Parameters:
+ * 
+ *   tidx - the texture index
+ * 
+ *   rate - the fading rate
+ * 
+ *   tint - the tint
+ * 
+ * Return:
+ * 
+ *   the hash, in range zero up to but excluding TCACHE_SLOTS
+ */
+static int tcache_hash(int tidx, int rate, uint32_t tint) {
+  
+  uint32_t h = 0;
+  
+  h = tint;
+  h ^= ((uint32_t) rate) << 24;
+  h ^= ((uint32_t) tidx) * UINT32_C(0x9e3779b1);
+  h ^= h >> 15;
+  h *= UINT32_C(0x85ebca6b);
+  h ^= h >> 13;
+  
+  return (int) (h & (TCACHE_SLOTS - 1));
+}
+
+/*
+ * Public function implementations
+ * ===============================
+ * 
+ * See the header for specifications.
+ */
+
+/*
+ * tcache_get function.
+ */
+uint32_t *tcache_get(int tidx, int rate, uint32_t tint,
+                      int32_t w, int32_t h) {
+  
+  int i = 0;
+  long pixels = 0;
+  TSLOT *ps = NULL;
+  
+  /* Check parameters */
+  if ((w < 1) || (h < 1)) {
+    abort();
+  }
+  
+  /* Find the key or the free slot where it belongs */
+  for(i = tcache_hash(tidx, rate, tint);
+      m_slot[i].used;
+      i = (i + 1) & (TCACHE_SLOTS - 1)) {
+    ps = &(m_slot[i]);
+    if ((ps->tidx == tidx) && (ps->rate == rate) &&
+        (ps->tint == tint)) {
+      if ((ps->w != w) || (ps->h != h)) {
+        abort();
+      }
+      return ps->pData;
+    }
+  }
+  
+  /* Not found -- give up if there is no room for another key */
+  if (m_keys >= TCACHE_MAX_KEYS) {
+    return NULL;
+  }
+  
+  /* Add the key */
+  ps = &(m_slot[i]);
+  memset(ps, 0, sizeof(TSLOT));
+  ps->used = 1;
+  ps->tidx = tidx;
+  ps->rate = rate;
+  ps->tint = tint;
+  ps->w = w;
+  ps->h = h;
+  ps->pData = NULL;
+  m_keys++;
+  
+  /* Allocate the tile if it fits within the limits; otherwise, the
+   * refusal is remembered by leaving pData NULL */
+  if (((long) w) <= TCACHE_MAX_PIXELS / ((long) h)) {
+    pixels = ((long) w) * ((long) h);
+    if (pixels * ((long) sizeof(uint32_t)) <= TCACHE_BUDGET - m_bytes) {
+      ps->pData = (uint32_t *) calloc(
+                    (size_t) pixels, sizeof(uint32_t));
+      if (ps->pData != NULL) {
+        m_bytes += pixels * ((long) sizeof(uint32_t));
+      }
+    }
+  }
+  
+  return ps->pData;
+}
+
+/*
+ * tcache_reset function.
+ */
+void tcache_reset(void) {
+  
+  int i = 0;
+  
+  for(i = 0; i < TCACHE_SLOTS; i++) {
+    if (m_slot[i].used && (m_slot[i].pData != NULL)) {
+      free(m_slot[i].pData);
+    }
+  }
+  
+  memset(m_slot, 0, sizeof(m_slot));
+  m_keys = 0;
+  m_bytes = 0;
+}
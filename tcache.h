@@ -0,0 +1,86 @@
+#ifndef TCACHE_H_INCLUDED
+#define TCACHE_H_INCLUDED
+
+/*
+ * tcache.h
+ * 
+ * Tile cache module of Lilac.
+ * 
+ * When both the texture of a shading record and the paper texture are
+ * tiled image textures, the fully rendered output of the record repeats
+ * with a period of the least common multiple of the texture widths by
+ * the least common multiple of the texture heights.  This module holds
+ * one such period, called a tile, for each combination of texture,
+ * rate, and tint that is rendered, so that repeated pixels are copied
+ * out of the tile instead of going through the whole pipeline again.
+ * 
+ * Tiles are filled lazily by the caller.  Every pixel of a new tile is
+ * zero, which is never a valid rendered pixel since rendered pixels are
+ * always fully opaque.  The caller renders a pixel whenever it finds
+ * zero in the tile and then stores the result there.
+ * 
+ * The total memory used by tiles is limited to TCACHE_BUDGET bytes, and
+ * a single tile may have at most TCACHE_MAX_PIXELS pixels.  Requests
+ * that would go over either limit get no tile and must be rendered
+ * normally.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The maximum number of pixels in a single tile.
+ */
+#define TCACHE_MAX_PIXELS (1048576L)
+
+/*
+ * The maximum total bytes of pixel data in all tiles.
+ */
+#define TCACHE_BUDGET (67108864L)
+
+/*
+ * Get the tile for a given combination of texture, rate, and tint.
+ * 
+ * tidx is the virtual texture index of the texture that is faded, rate
+ * is the rate it is faded by, and tint is the tint of the shading
+ * record, or 0xffffffff if there is none.  The paper texture is the
+ * same for every tile, so it is not part of the key.
+ * 
+ * w and h are the dimensions of the tile, which must be greater than
+ * zero.  They must be the same every time the same key is requested.
+ * 
+ * The pixels of the tile are in row-major order.  The returned pointer
+ * remains valid until tcache_reset() is called.
+ * 
+ * NULL is returned if the tile would be larger than TCACHE_MAX_PIXELS,
+ * if allocating it would exceed TCACHE_BUDGET, if the cache has no
+ * more room for keys, or if memory runs out.  Refusals are remembered,
+ * so requesting the same key again is cheap.
+ * 
+ * Parameters:
+ * 
+ *   tidx - the texture index
+ * 
+ *   rate - the fading rate
+ * 
+ *   tint - the tint
+ * 
+ *   w - the tile width
+ * 
+ *   h - the tile height
+ * 
+ * Return:
+ * 
+ *   the tile pixels, or NULL if there is no tile
+ */
+uint32_t *tcache_get(int tidx, int rate, uint32_t tint,
+                      int32_t w, int32_t h);
+
+/*
+ * Release all tiles.
+ * 
+ * This must be called if the textures or the gamma tables change.
+ */
+void tcache_reset(void);
+
+#endif
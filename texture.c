@@ -40,6 +40,11 @@ typedef struct {
    */
   int32_t height;
   
+  /*
+   * Non-zero if all pixels of the texture have the same value.
+   */
+  int uniform;
+  
 } TEXTURE;
 
 /*
@@ -64,6 +69,7 @@ static TEXTURE m_texture[TEXTURE_MAXCOUNT];
 
 /* Function prototypes */
 static void initTable(void);
+static int isUniform(const uint32_t *pData, int32_t count);
 
 /*
  * Initialize the texture table if no textures have been loaded yet.
@@ -74,6 +80,32 @@ static void initTable(void) {
   }
 }
 
+/*
+ * Check whether all pixels in an array have the same value.
+ * 
+ * Parameters:
+ * 
+ *   pData - the pixels
+ * 
+ *   count - the number of pixels, which must be at least one
+ * 
+ * Return:
+ * 
+ *   non-zero if all pixels are the same as the first, zero otherwise
+ */
+static int isUniform(const uint32_t *pData, int32_t count) {
+  
+  int32_t i = 0;
+  
+  for(i = 1; i < count; i++) {
+    if (pData[i] != pData[0]) {
+      return 0;
+    }
+  }
+  
+  return 1;
+}
+
 /*
  * Public function implementations
  * ===============================
@@ -191,6 +223,11 @@ int texture_load(const char *pPath, int *pError) {
     }
   }
   
+  /* Check whether every pixel is the same as the first */
+  if (status) {
+    pt->uniform = isUniform(pt->pData, w * h);
+  }
+  
   /* If there was an error but the texture was allocated, free it */
   if ((!status) && (pt != NULL)) {
     if (pt->pData != NULL) {
@@ -209,6 +246,39 @@ int texture_load(const char *pPath, int *pError) {
   return status;
 }
 
+/*
+ * texture_add function.
+ */
+int texture_add(uint32_t *pData, int32_t w, int32_t h) {
+  
+  TEXTURE *pt = NULL;
+  
+  /* Check parameters */
+  if ((pData == NULL) ||
+      (w < 1) || (w > TEXTURE_MAXDIM) ||
+      (h < 1) || (h > TEXTURE_MAXDIM)) {
+    abort();
+  }
+  
+  /* Initialize texture table if necessary */
+  initTable();
+  
+  /* Fail if there are too many textures */
+  if (m_texture_count >= TEXTURE_MAXCOUNT) {
+    return 0;
+  }
+  
+  /* Add the texture */
+  m_texture_count++;
+  pt = &(m_texture[m_texture_count - 1]);
+  pt->pData = pData;
+  pt->width = w;
+  pt->height = h;
+  pt->uniform = isUniform(pData, w * h);
+  
+  return 1;
+}
+
 /*
  * texture_count function.
  */
@@ -216,6 +286,45 @@ int texture_count(void) {
   return m_texture_count;
 }
 
+/*
+ * texture_width function.
+ */
+int32_t texture_width(int tidx) {
+  
+  /* Check parameter */
+  if ((tidx < 1) || (tidx > m_texture_count)) {
+    abort();
+  }
+  
+  return m_texture[tidx - 1].width;
+}
+
+/*
+ * texture_height function.
+ */
+int32_t texture_height(int tidx) {
+  
+  /* Check parameter */
+  if ((tidx < 1) || (tidx > m_texture_count)) {
+    abort();
+  }
+  
+  return m_texture[tidx - 1].height;
+}
+
+/*
+ * texture_uniform function.
+ */
+int texture_uniform(int tidx) {
+  
+  /* Check parameter */
+  if ((tidx < 1) || (tidx > m_texture_count)) {
+    abort();
+  }
+  
+  return m_texture[tidx - 1].uniform;
+}
+
 /*
  * texture_pixel function.
  */
@@ -56,6 +56,33 @@
  */
 int texture_load(const char *pPath, int *pError);
 
+/*
+ * Add a texture from pixel data that is already in memory.
+ * 
+ * pData holds w times h ARGB pixels in row-major order, in the same
+ * format that texture_pixel() returns.  It must have been allocated
+ * with malloc().  If the function is successful, the texture module
+ * takes ownership of the data.  Otherwise, the caller still owns it.
+ * 
+ * Each dimension must be in range one up to and including
+ * TEXTURE_MAXDIM.  The function fails if TEXTURE_MAXCOUNT textures
+ * have already been loaded.  If successful, the index of the new
+ * texture is texture_count().
+ * 
+ * Parameters:
+ * 
+ *   pData - the pixel data
+ * 
+ *   w - the width of the texture
+ * 
+ *   h - the height of the texture
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if there are too many textures
+ */
+int texture_add(uint32_t *pData, int32_t w, int32_t h);
+
 /*
  * Retrieve the total count of textures that have been successfully
  * loaded into memory.
@@ -72,6 +99,47 @@ int texture_load(const char *pPath, int *pError);
  */
 int texture_count(void);
 
+/*
+ * Get the dimensions of a loaded texture.
+ * 
+ * tidx is the texture index.  It must be in range one up to and
+ * including texture_count() or a fault occurs.
+ * 
+ * Since textures are tiled, the pixels returned by texture_pixel()
+ * repeat with these periods in the X and Y directions.
+ * 
+ * Parameters:
+ * 
+ *   tidx - the texture index to query
+ * 
+ * Return:
+ * 
+ *   the width or height of the texture in pixels
+ */
+int32_t texture_width(int tidx);
+int32_t texture_height(int tidx);
+
+/*
+ * Check whether a loaded texture is uniform.
+ * 
+ * tidx is the texture index.  It must be in range one up to and
+ * including texture_count() or a fault occurs.
+ * 
+ * A texture is uniform if every one of its pixels has exactly the same
+ * ARGB value, such as a plain paper or a solid fill.  This is
+ * determined when the texture is loaded.  texture_pixel() returns the
+ * same value at every coordinate of a uniform texture.
+ * 
+ * Parameters:
+ * 
+ *   tidx - the texture index to query
+ * 
+ * Return:
+ * 
+ *   non-zero if the texture is uniform, zero otherwise
+ */
+int texture_uniform(int tidx);
+
 /*
  * Get the ARGB pixel value of a given texture at a given coordinate.
  * 
@@ -6,23 +6,39 @@
  * See the header for further information.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "ttable.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pixel.h"
+
 /*
  * Constants
  * =========
  */
 
 /*
- * The maximum number of records in the table.
+ * The maximum number of records in the table, which is one for every
+ * possible RGB index.
+ */
+#define MAX_RECORDS (0x1000000)
+
+/*
+ * The initial capacity in records of the table and of the load buffer.
  */
-#define MAX_RECORDS (1024)
+#define INIT_RECORDS (64)
 
 /*
  * The maximum line length for text files, including termination byte.
@@ -44,13 +60,82 @@
 #define ASCII_LOWER_A (0x61)    /* a */
 #define ASCII_LOWER_F (0x66)    /* f */
 
+/*
+ * Marks an empty hash slot or a record without a tint table in
+ * compiled tables.
+ */
+#define BIN_NONE UINT32_C(0xffffffff)
+
+/*
+ * Type declarations
+ * =================
+ */
+
+/*
+ * A record that has been parsed but not yet added to the table.
+ */
+typedef struct {
+  
+  /*
+   * The shading record.
+   */
+  SHADEREC sr;
+  
+  /*
+   * The order in which the record was parsed, starting at zero.
+   */
+  int32_t ord;
+  
+  /*
+   * The line number the record was parsed from, or -1 if overflow.
+   */
+  int line;
+  
+} LOADREC;
+
 /*
  * Table
  * =====
+ * 
+ * The table is kept sorted by RGB index.  It is dynamically allocated,
+ * and m_table_cap is its capacity in records.
  */
 
+static SHADEREC *m_pTable = NULL;
 static int m_table_count = 0;
-static SHADEREC m_table[MAX_RECORDS];
+static int m_table_cap = 0;
+
+/*
+ * Load buffer
+ * ===========
+ * 
+ * While a text table is parsed, its records are appended to the load
+ * buffer in file order.  When parsing is done, the buffer is sorted
+ * once, checked for duplicates in a single pass, and merged into the
+ * table, so loading takes O(n log n) time rather than inserting each
+ * record in order.
+ */
+
+static LOADREC *m_pLoad = NULL;
+static int m_load_count = 0;
+static int m_load_cap = 0;
+
+/*
+ * Compiled table
+ * ==============
+ * 
+ * When a compiled table is loaded, m_pMap points to the mapped file
+ * and the other variables point to its sections.  m_pMap is NULL
+ * otherwise.
+ */
+
+static const uint32_t *m_pMap = NULL;
+
+static const uint32_t *m_pBinRec = NULL;
+static const uint32_t *m_pBinSlot = NULL;
+static const uint32_t *m_pBinTint = NULL;
+static uint32_t m_bin_count = 0;
+static uint32_t m_bin_mask = 0;
 
 /*
  * Local functions
@@ -58,73 +143,56 @@ static SHADEREC m_table[MAX_RECORDS];
  */
 
 /* Function prototypes */
-static void initTable(void);
-static void shiftRecs(int start);
 static int addRecord(
     int32_t   rgb_index,
     int       tex_index,
     int       shade_rate,
     int       draw_rate,
     int32_t   rgb_tint,
+    int       linenum,
     int     * pError);
+static int cmpLoad(const void *pA, const void *pB);
+static int findDup(void);
+static void mergeLoad(void);
 
-static int readchar(FILE *pf, int *pChar);
-static int is_blank(char *pstr);
-static char *skipSpace(char *pstr, int optional);
-static char *readRGB(char *pstr, int32_t *pRGB);
-static char *readInt(char *pstr, int *pv);
-static int parseLine(char *pstr, int tcount, int *pError);
-
-/*
- * Initialize the shading table, if necessary.
- * 
- * This function clears the table to zero if the count is zero.
- */
-static void initTable(void) {
-  if (m_table_count == 0) {
-    memset(m_table, 0, MAX_RECORDS * sizeof(SHADEREC));
-  }
-}
+static int readText(
+    const char  *  pPath,
+    const char  ** ppText,
+          size_t * pSize,
+          int    * pMapped,
+          int    * pError);
+static void freeText(const char *pText, size_t size, int mapped);
+static int is_blank(const char *pstr, const char *pend);
+static const char *skipSpace(
+    const char * pstr,
+    const char * pend,
+    int          optional);
+static const char *readRGB(
+    const char * pstr,
+    const char * pend,
+    int32_t    * pRGB);
+static const char *readInt(
+    const char * pstr,
+    const char * pend,
+    int        * pv);
+static int parseLine(
+    const char * pstr,
+    const char * pend,
+    int          tcount,
+    int          linenum,
+    int        * pError);
 
-/*
- * Shift records one to the right starting at a given index.
- * 
- * start must be a valid index in the table or a fault occurs.
- * 
- * If start is the last record in the table, the last record is blanked
- * to zero.
- * 
- * Else, records from the second-to-last record in the table down to
- * start are shifted one to the right.  The last record is overwritten
- * in this process.  Finally, the record at start is blanked to zero.
- * 
- * Parameters:
- * 
- *   start - the index to start shifting records
- */
-static void shiftRecs(int start) {
-  
-  int i = 0;
-  
-  /* Check parameters */
-  if ((start < 0) || (start >= m_table_count)) {
-    abort();
-  }
-  
-  /* Shift records */
-  for(i = m_table_count - 2; i >= start; i--) {
-    memcpy(&(m_table[i + 1]), &(m_table[i]), sizeof(SHADEREC));
-  }
-  
-  /* Blank record at start */
-  memset(&(m_table[start]), 0, sizeof(SHADEREC));
-}
+static uint32_t binChecksum(const uint32_t *pHeader);
+static uint32_t binHash(int32_t rgb_index);
+static int cmpTint(const void *pA, const void *pB);
+static void binRecord(uint32_t i, SHADEREC *psr);
+static int binFind(int32_t rgb_index);
 
 /*
- * Add a record to the shading table.
+ * Add a record to the load buffer.
  * 
  * rgb_index is the RGB index value.  A fault occurs if out of range.
- * An error occurs if that RGB index is already in the table.
+ * Duplicate RGB indices are NOT checked here; see findDup().
  * 
  * tex_index is the texture index.  A fault occurs if it is less than
  * one.  The upper bound of the texture index is NOT checked, so the
@@ -138,9 +206,18 @@ static void shiftRecs(int start) {
  * 
  * rgb_tint is the RGB tint.  A fault occurs if out of range.
  * 
+ * linenum is the line number the record was parsed from, or -1 if
+ * overflow.
+ * 
  * pError points to the variable to receive the error code in case of
  * error.  It may not be NULL.
  * 
+ * If the table and the load buffer together already hold MAX_RECORDS,
+ * there must be a duplicate RGB index somewhere, since there are only
+ * MAX_RECORDS different RGB indices.  The error is reported as a
+ * duplicate record, and findDup() will then find an earlier duplicate
+ * if there is one.
+ * 
  * Parameters:
  * 
  *   rgb_index - the RGB index of the record
@@ -153,6 +230,8 @@ static void shiftRecs(int start) {
  * 
  *   rgb_tint - the RGB tint
  * 
+ *   linenum - the line number of the record
+ * 
  *   pError - pointer to the error code variable
  * 
  * Return:
@@ -165,13 +244,12 @@ static int addRecord(
     int       shade_rate,
     int       draw_rate,
     int32_t   rgb_tint,
+    int       linenum,
     int     * pError) {
   
   int status = 1;
-  int lbound = 0;
-  int ubound = 0;
-  int mid = 0;
-  SHADEREC *psr = NULL;
+  int new_cap = 0;
+  LOADREC *plr = NULL;
   
   /* Check parameters */
   if ((rgb_index < 0) || (rgb_index > INT32_C(0xffffff))) {
@@ -193,190 +271,400 @@ static int addRecord(
     abort();
   }
   
-  /* Initialize shading table if necessary */
-  if (status) {
-    initTable();
+  /* If every RGB index is already used, this must be a duplicate */
+  if (m_table_count + m_load_count >= MAX_RECORDS) {
+    *pError = TTABLE_ERR_DUP;
+    status = 0;
   }
   
-  /* Fail if table is full */
-  if (status && (m_table_count >= MAX_RECORDS)) {
-    *pError = TTABLE_ERR_RECS;
-    status = 0;
+  /* Grow the load buffer if necessary */
+  if (status && (m_load_count >= m_load_cap)) {
+    if (m_load_cap < 1) {
+      new_cap = INIT_RECORDS;
+    } else {
+      new_cap = m_load_cap * 2;
+    }
+    
+    m_pLoad = (LOADREC *) realloc(
+                m_pLoad, ((size_t) new_cap) * sizeof(LOADREC));
+    if (m_pLoad == NULL) {
+      abort();
+    }
+    m_load_cap = new_cap;
   }
   
-  /* Check cases */
+  /* Append the record */
   if (status) {
-    if (m_table_count < 1) {
-      /* Table is empty -- insert at start */
-      m_table_count = 1;
-      psr = &(m_table[0]);
+    plr = &(m_pLoad[m_load_count]);
+    memset(plr, 0, sizeof(LOADREC));
     
-    } else if ((m_table[0]).rgbidx > rgb_index) {
-      /* Insert record at start of table */
-      m_table_count++;
-      shiftRecs(0);
-      psr = &(m_table[0]);
-  
-    } else if ((m_table[m_table_count - 1]).rgbidx < rgb_index) {
-      /* Insert record at end of table */
-      m_table_count++;
-      psr = &(m_table[m_table_count - 1]);
-    
-    } else if (((m_table[0]).rgbidx == rgb_index) ||
-               ((m_table[m_table_count - 1]).rgbidx == rgb_index)) {
-      /* New record is duplicate of a boundary index -- fail */
-      *pError = TTABLE_ERR_DUP;
-      status = 0;
-      
+    plr->sr.rgbidx = rgb_index;
+    plr->sr.tidx = tex_index;
+    plr->sr.srate = shade_rate;
+    plr->sr.drate = draw_rate;
+    if (rgb_tint >= 0) {
+      plr->sr.rgbtint = rgb_tint;
     } else {
-      /* Insert record somewhere in middle */
-      assert(m_table_count > 1);
-      
-      /* Set search boundaries to full table */
-      lbound = 0;
-      ubound = m_table_count - 1;
-      
-      /* Zero in on a record */
-      while (ubound > lbound) {
-        
-        /* Choose a record halfway between, but greater than ubound */
-        mid = lbound + ((ubound - lbound) / 2);
-        if (mid <= lbound) {
-          mid = lbound + 1;
-        }
-        
-        /* Compare to mid record */
-        if ((m_table[mid]).rgbidx > rgb_index) {
-          /* Midpoint greater than new record, so new upper bound is
-           * less than that */
-          ubound = mid - 1;
-          
-        } else if ((m_table[mid]).rgbidx < rgb_index) {
-          /* Midpoint less than new record, so new lower bound is
-           * that */
-          lbound = mid;
-          
-        } else if ((m_table[mid]).rgbidx == rgb_index) {
-          /* Duplicate record error */
-          *pError = TTABLE_ERR_DUP;
-          status = 0;
-          break;
-          
-        } else {
-          /* Shouldn't happen */
-          abort();
-        }
+      plr->sr.rgbtint = UINT32_C(0xffffffff);
+    }
+    plr->sr.pTint = NULL;
+    
+    plr->ord = (int32_t) m_load_count;
+    plr->line = linenum;
+    
+    m_load_count++;
+  }
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * Comparison function for sorting the load buffer.
+ * 
+ * Records are sorted by RGB index, and records with the same RGB index
+ * are sorted in the order they were parsed.
+ * 
+ * Parameters:
+ * 
+ *   pA - pointer to the first LOADREC
+ * 
+ *   pB - pointer to the second LOADREC
+ * 
+ * Return:
+ * 
+ *   less than, equal to, or greater than zero as the first record
+ *   sorts before, the same as, or after the second
+ */
+static int cmpLoad(const void *pA, const void *pB) {
+  
+  const LOADREC *pa = NULL;
+  const LOADREC *pb = NULL;
+  
+  if ((pA == NULL) || (pB == NULL)) {
+    abort();
+  }
+  
+  pa = (const LOADREC *) pA;
+  pb = (const LOADREC *) pB;
+  
+  if (pa->sr.rgbidx < pb->sr.rgbidx) {
+    return -1;
+  } else if (pa->sr.rgbidx > pb->sr.rgbidx) {
+    return 1;
+  } else if (pa->ord < pb->ord) {
+    return -1;
+  } else if (pa->ord > pb->ord) {
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * Sort the load buffer and find the first duplicate record.
+ * 
+ * A record is a duplicate if an earlier record in the load buffer or
+ * any record already in the table has the same RGB index.  Of all the
+ * duplicates, the one that was parsed first is returned, which is the
+ * same record that inserting the records one by one in file order
+ * would have failed on.
+ * 
+ * The load buffer is left sorted with cmpLoad().
+ * 
+ * Return:
+ * 
+ *   the index in the sorted load buffer of the first duplicate, or -1
+ *   if there are no duplicates
+ */
+static int findDup(void) {
+  
+  int result = -1;
+  int i = 0;
+  int j = 0;
+  int dup = 0;
+  
+  /* Sort the load buffer */
+  if (m_load_count > 1) {
+    qsort(m_pLoad, (size_t) m_load_count, sizeof(LOADREC), &cmpLoad);
+  }
+  
+  /* Walk the sorted load buffer and the sorted table together */
+  for(i = 0; i < m_load_count; i++) {
+    
+    /* Advance the table to the first record not less than this one */
+    while ((j < m_table_count) &&
+            ((m_pTable[j]).rgbidx < (m_pLoad[i]).sr.rgbidx)) {
+      j++;
+    }
+    
+    /* Check whether this record duplicates the previous one in the
+     * load buffer or one in the table */
+    dup = 0;
+    if (i > 0) {
+      if ((m_pLoad[i - 1]).sr.rgbidx == (m_pLoad[i]).sr.rgbidx) {
+        dup = 1;
       }
-      
-      /* Insert after lbound */
-      if (status) {
-        assert(lbound < m_table_count - 1);
-        m_table_count++;
-        shiftRecs(lbound + 1);
-        psr = &(m_table[lbound + 1]);
+    }
+    if (j < m_table_count) {
+      if ((m_pTable[j]).rgbidx == (m_pLoad[i]).sr.rgbidx) {
+        dup = 1;
+      }
+    }
+    
+    /* Keep the duplicate that was parsed first */
+    if (dup) {
+      if (result < 0) {
+        result = i;
+      } else if ((m_pLoad[i]).ord < (m_pLoad[result]).ord) {
+        result = i;
       }
     }
   }
   
-  /* Write the record */
-  if (status) {
-    psr->rgbidx = rgb_index;
-    psr->tidx = tex_index;
-    psr->srate = shade_rate;
-    psr->drate = draw_rate;
-    if (rgb_tint >= 0) {
-      psr->rgbtint = rgb_tint;
+  /* Return result */
+  return result;
+}
+
+/*
+ * Merge the load buffer into the table and empty the load buffer.
+ * 
+ * The load buffer must already be sorted and checked with findDup(),
+ * and it must not have any duplicates.
+ */
+static void mergeLoad(void) {
+  
+  int new_cap = 0;
+  int i = 0;
+  int j = 0;
+  int k = 0;
+  
+  /* Grow the table if necessary */
+  if (m_table_count + m_load_count > m_table_cap) {
+    new_cap = m_table_cap;
+    if (new_cap < INIT_RECORDS) {
+      new_cap = INIT_RECORDS;
+    }
+    while (new_cap < m_table_count + m_load_count) {
+      new_cap *= 2;
+    }
+    
+    m_pTable = (SHADEREC *) realloc(
+                m_pTable, ((size_t) new_cap) * sizeof(SHADEREC));
+    if (m_pTable == NULL) {
+      abort();
+    }
+    m_table_cap = new_cap;
+  }
+  
+  /* Merge from the end so the table can be merged in place */
+  i = m_table_count - 1;
+  j = m_load_count - 1;
+  k = m_table_count + m_load_count - 1;
+  
+  while (j >= 0) {
+    if ((i >= 0) && ((m_pTable[i]).rgbidx > (m_pLoad[j]).sr.rgbidx)) {
+      memcpy(&(m_pTable[k]), &(m_pTable[i]), sizeof(SHADEREC));
+      i--;
     } else {
-      psr->rgbtint = UINT32_C(0xffffffff);
+      memcpy(&(m_pTable[k]), &((m_pLoad[j]).sr), sizeof(SHADEREC));
+      j--;
     }
+    k--;
   }
   
-  /* Return status */
-  return status;
+  m_table_count += m_load_count;
+  m_load_count = 0;
 }
 
 /*
- * Read a character from an input stream.
+ * Read a whole text file into memory.
  * 
- * pf is the input stream to read from.  Undefined behavior occurs if
- * this is not open for reading.
+ * pPath is the path to the file.  If successful, *ppText receives a
+ * pointer to the contents of the file and *pSize receives the size of
+ * the contents in bytes.  The contents are NOT nul-terminated, and the
+ * pointer may be NULL if the file is empty.
  * 
- * pChar points to the integer to receive the character that was read,
- * or -1 if EOF.
+ * Regular files are mapped into memory, so the contents are not
+ * copied.  Other files, such as pipes, and files that can't be mapped
+ * are read into a dynamically allocated buffer.  *pMapped receives
+ * non-zero if the file was mapped.  The contents must be released with
+ * freeText().
  * 
- * The return value indicates whether reading was successful.  If
- * failure, the state of *pChar is undefined.
+ * pError points to the variable to receive the error code if the
+ * function fails.  It may not be NULL.
  * 
  * Parameters:
  * 
- *   pf - the file to read from
+ *   pPath - the path to the file
+ * 
+ *   ppText - receives the contents of the file
+ * 
+ *   pSize - receives the size of the contents
+ * 
+ *   pMapped - receives whether the file was mapped
  * 
- *   pChar - pointer to variable to receive read character or -1 for EOF
+ *   pError - pointer to the error status return
  * 
  * Return:
  * 
  *   non-zero if successful, zero if error
  */
-static int readchar(FILE *pf, int *pChar) {
+static int readText(
+    const char  *  pPath,
+    const char  ** ppText,
+          size_t * pSize,
+          int    * pMapped,
+          int    * pError) {
   
   int status = 1;
-  int c = 0;
+  int fd = -1;
+  void *pm = MAP_FAILED;
+  char *pBuf = NULL;
+  size_t buf_cap = 0;
+  size_t buf_len = 0;
+  ssize_t rc = 0;
+  struct stat st;
+  
+  /* Initialize structures */
+  memset(&st, 0, sizeof(struct stat));
   
   /* Check parameters */
-  if ((pf == NULL) || (pChar == NULL)) {
+  if ((pPath == NULL) || (ppText == NULL) || (pSize == NULL) ||
+      (pMapped == NULL) || (pError == NULL)) {
     abort();
   }
   
-  /* Get a character */
-  c = getc(pf);
+  /* Reset results */
+  *ppText = NULL;
+  *pSize = 0;
+  *pMapped = 0;
+  
+  /* Open the file and get its type and size */
+  fd = open(pPath, O_RDONLY);
+  if (fd < 0) {
+    status = 0;
+    *pError = TTABLE_ERR_OPEN;
+  }
+  
+  if (status) {
+    if (fstat(fd, &st)) {
+      status = 0;
+      *pError = TTABLE_ERR_IO;
+    }
+  }
   
-  /* Check return */
-  if (c != EOF) {
-    /* Successfully read a character */
-    *pChar = c;
+  /* Map non-empty regular files that fit in memory */
+  if (status && S_ISREG(st.st_mode) && (st.st_size > 0) &&
+      ((uint64_t) st.st_size <= (uint64_t) SIZE_MAX)) {
+    pm = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (pm != MAP_FAILED) {
+      *ppText = (const char *) pm;
+      *pSize = (size_t) st.st_size;
+      *pMapped = 1;
+    }
+  }
   
-  } else {
-    /* Check if error or EOF */
-    if (feof(pf)) {
-      /* EOF */
-      *pChar = -1;
+  /* Otherwise, read the whole file into a buffer */
+  while (status && (!(*pMapped))) {
+    
+    /* Grow the buffer if it is full */
+    if (buf_len >= buf_cap) {
+      if (buf_cap < 1) {
+        buf_cap = 65536;
+      } else if (buf_cap <= SIZE_MAX / 2) {
+        buf_cap *= 2;
+      } else {
+        abort();
+      }
       
-    } else {
-      /* Error */
+      pBuf = (char *) realloc(pBuf, buf_cap);
+      if (pBuf == NULL) {
+        abort();
+      }
+    }
+    
+    /* Read as much as fits */
+    rc = read(fd, pBuf + buf_len, buf_cap - buf_len);
+    if (rc > 0) {
+      buf_len += (size_t) rc;
+      
+    } else if (rc == 0) {
+      /* End of file */
+      *ppText = pBuf;
+      *pSize = buf_len;
+      break;
+      
+    } else if (errno != EINTR) {
       status = 0;
+      *pError = TTABLE_ERR_IO;
     }
   }
   
+  /* Release the buffer if error */
+  if ((!status) && (pBuf != NULL)) {
+    free(pBuf);
+    pBuf = NULL;
+  }
+  
+  /* Close the file if open; the mapping stays valid after closing */
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+  
   /* Return status */
   return status;
 }
 
+/*
+ * Release the contents of a file read with readText().
+ * 
+ * Parameters:
+ * 
+ *   pText - the contents of the file, or NULL
+ * 
+ *   size - the size of the contents
+ * 
+ *   mapped - non-zero if the file was mapped
+ */
+static void freeText(const char *pText, size_t size, int mapped) {
+  if (pText != NULL) {
+    if (mapped) {
+      munmap((void *) pText, size);
+    } else {
+      free((void *) pText);
+    }
+  }
+}
+
 /*
  * Check whether a given string is blank.
  * 
  * This is true only if the string is empty or consists only of spaces
- * and tabs.
+ * and tabs.  The string runs from pstr up to but excluding pend.
  * 
  * Parameters:
  * 
  *   pstr - the string to check
  * 
+ *   pend - the end of the string
+ * 
  * Return:
  * 
  *   non-zero if blank, zero if not
  */
-static int is_blank(char *pstr) {
+static int is_blank(const char *pstr, const char *pend) {
   
   int result = 0;
   
   /* Check parameters */
-  if (pstr == NULL) {
+  if ((pstr == NULL) || (pend < pstr)) {
     abort();
   }
   
   /* Check if blank */
   result = 1;
-  for( ; *pstr != 0; pstr++) {
+  for( ; pstr < pend; pstr++) {
     if ((*pstr != ASCII_SP) && (*pstr != ASCII_HT)) {
       result = 0;
       break;
@@ -389,10 +677,11 @@ static int is_blank(char *pstr) {
 
 /*
  * Skip whitespace at the beginning of the given string, returning a
- * pointer to the first non-whitespace character (or the terminating
- * nul).
+ * pointer to the first non-whitespace character (or the end of the
+ * string).
  * 
- * pstr is the pointer to the string.
+ * pstr is the pointer to the string, and pend is the end of the
+ * string.
  * 
  * optional is non-zero if it is acceptable for there to be no
  * whitespace at the beginning of the string, in which case the return
@@ -405,6 +694,8 @@ static int is_blank(char *pstr) {
  * 
  *   pstr - pointer to the string
  * 
+ *   pend - the end of the string
+ * 
  *   optional - non-zero if whitespace optional, zero if at least one
  *   character of whitespace is required
  * 
@@ -413,21 +704,26 @@ static int is_blank(char *pstr) {
  *   pointer to first non-whitespace, or NULL if required whitespace is
  *   missing
  */
-static char *skipSpace(char *pstr, int optional) {
+static const char *skipSpace(
+    const char * pstr,
+    const char * pend,
+    int          optional) {
   
   /* Check parameters */
-  if (pstr == NULL) {
+  if ((pstr == NULL) || (pend < pstr)) {
     abort();
   }
   
   /* Fail if not optional and first character not whitespace */
-  if ((!optional) && (*pstr != ASCII_SP) && (*pstr != ASCII_HT)) {
+  if ((!optional) && ((pstr >= pend) ||
+        ((*pstr != ASCII_SP) && (*pstr != ASCII_HT)))) {
     pstr = NULL;
   }
   
   /* Advance to first non-whitespace */
   if (pstr != NULL) {
-    for( ; (*pstr == ASCII_SP) || (*pstr == ASCII_HT); pstr++);
+    for( ; (pstr < pend) &&
+            ((*pstr == ASCII_SP) || (*pstr == ASCII_HT)); pstr++);
   }
   
   /* Return result or NULL */
@@ -437,7 +733,7 @@ static char *skipSpace(char *pstr, int optional) {
 /*
  * Read an RGB value from the beginning of the given string.
  * 
- * pstr is the string to read from.
+ * pstr is the string to read from, and pend is the end of the string.
  * 
  * pRGB points to the variable to receive the packed RGB value.
  * 
@@ -451,20 +747,25 @@ static char *skipSpace(char *pstr, int optional) {
  * 
  *   pstr - the string
  * 
+ *   pend - the end of the string
+ * 
  *   pRGB - pointer to variable to receive RGB value
  * 
  * Return:
  * 
  *   pointer to character after RGB value, or NULL if parsing error
  */
-static char *readRGB(char *pstr, int32_t *pRGB) {
+static const char *readRGB(
+    const char * pstr,
+    const char * pend,
+    int32_t    * pRGB) {
   
   int status = 1;
   int32_t v = 0;
   int x = 0;
   
   /* Check parameters */
-  if ((pstr == NULL) || (pRGB == NULL)) {
+  if ((pstr == NULL) || (pend < pstr) || (pRGB == NULL)) {
     abort();
   }
   
@@ -472,7 +773,11 @@ static char *readRGB(char *pstr, int32_t *pRGB) {
   for(x = 0; x < 6; x++) {
     
     /* Check current character */
-    if ((*pstr >= ASCII_ZERO) && (*pstr <= ASCII_NINE)) {
+    if (pstr >= pend) {
+      /* End of string, so error */
+      status = 0;
+      
+    } else if ((*pstr >= ASCII_ZERO) && (*pstr <= ASCII_NINE)) {
       /* Decimal digit */
       v = (v << 4) + (*pstr - ASCII_ZERO);
       
@@ -516,7 +821,7 @@ static char *readRGB(char *pstr, int32_t *pRGB) {
  * Read an unsigned decimal integer from the beginning of the given
  * string.
  * 
- * pstr is the string to read from.
+ * pstr is the string to read from, and pend is the end of the string.
  * 
  * pv points to the variable to receive the decimal value.
  * 
@@ -529,31 +834,37 @@ static char *readRGB(char *pstr, int32_t *pRGB) {
  * 
  *   pstr - the string
  * 
+ *   pend - the end of the string
+ * 
  *   pv - pointer to variable to receive integer value
  * 
  * Return:
  * 
  *   pointer to character after decimal value, or NULL if parsing error
  */
-static char *readInt(char *pstr, int *pv) {
+static const char *readInt(
+    const char * pstr,
+    const char * pend,
+    int        * pv) {
   
   int status = 1;
   int v = 0;
   int d = 0;
   
   /* Check parameters */
-  if ((pstr == NULL) || (pv == NULL)) {
+  if ((pstr == NULL) || (pend < pstr) || (pv == NULL)) {
     abort();
   }
   
   /* Fail if first character is not decimal digit */
-  if ((*pstr < ASCII_ZERO) || (*pstr > ASCII_NINE)) {
+  if ((pstr >= pend) || (*pstr < ASCII_ZERO) || (*pstr > ASCII_NINE)) {
     status = 0;
   }
   
   /* Read decimal digits */
   if (status) {
-    for( ; (*pstr >= ASCII_ZERO) && (*pstr <= ASCII_NINE); pstr++) {
+    for( ; (pstr < pend) &&
+            (*pstr >= ASCII_ZERO) && (*pstr <= ASCII_NINE); pstr++) {
     
       /* Multiply value by ten, watching for overflow */
       if (v <= INT_MAX / 10) {
@@ -600,13 +911,17 @@ static char *readInt(char *pstr, int *pv) {
 /*
  * Parse a line within a text file.
  * 
- * pstr points to the text line.  The line break must NOT be included.
- * The line should be nul-terminated.  The line may be modified by this
- * function by shortening.
+ * pstr points to the text line and pend to the end of the line.  The
+ * line break must NOT be included.  The line is parsed in place and is
+ * not modified.  A comment, which starts at the first # character,
+ * and anything after a nul character are ignored.
  * 
  * tcount is the total number of virtual textures that have been
  * defined.  This is used for range-checking texture indices.
  * 
+ * linenum is the line number of the line, which is stored with the
+ * record that is parsed from it.
+ * 
  * pError points to the variable to receive the error code if the
  * function fails.  It may not be NULL.
  * 
@@ -614,16 +929,27 @@ static char *readInt(char *pstr, int *pv) {
  * 
  *   pstr - pointer to the text line
  * 
+ *   pend - the end of the line
+ * 
+ *   tcount - the total number of virtual textures
+ * 
+ *   linenum - the line number, or -1 if overflow
+ * 
  *   pError - pointer to the error status return
  * 
  * Return:
  * 
  *   non-zero if successful, zero if error
  */
-static int parseLine(char *pstr, int tcount, int *pError) {
+static int parseLine(
+    const char * pstr,
+    const char * pend,
+    int          tcount,
+    int          linenum,
+    int        * pError) {
   
   int status = 1;
-  char *pc = NULL;
+  const char *pc = NULL;
   
   int32_t rgb_index = 0;
   int tex_index = 0;
@@ -632,28 +958,28 @@ static int parseLine(char *pstr, int tcount, int *pError) {
   int32_t rgb_tint = 0;
   
   /* Check parameters */
-  if ((pstr == NULL) || (pError == NULL) || (tcount < 0)) {
+  if ((pstr == NULL) || (pend < pstr) || (pError == NULL) ||
+      (tcount < 0)) {
     abort();
   }
   
-  /* If there is an ampersand in the line, replace it with a nul so that
-   * the comment is stripped out */
-  for(pc = pstr; *pc != 0; pc++) {
-    if (*pc == ASCII_AMP) {
-      *pc = (char) 0;
+  /* If there is a comment or a nul in the line, end the line there */
+  for(pc = pstr; pc < pend; pc++) {
+    if ((*pc == ASCII_AMP) || (*pc == 0)) {
+      pend = pc;
       break;
     }
   }
   
   /* Only proceed if line is not blank, else ignore */
-  if (!is_blank(pstr)) {
+  if (!is_blank(pstr, pend)) {
     
     /* Skip optional whitespace */
-    pstr = skipSpace(pstr, 1);
+    pstr = skipSpace(pstr, pend, 1);
     assert(pstr != NULL);
     
     /* Read RGB index */
-    pstr = readRGB(pstr, &rgb_index);
+    pstr = readRGB(pstr, pend, &rgb_index);
     if (pstr == NULL) {
       *pError = TTABLE_ERR_RGB;
       status = 0;
@@ -661,7 +987,7 @@ static int parseLine(char *pstr, int tcount, int *pError) {
     
     /* Required whitespace */
     if (status) {
-      pstr = skipSpace(pstr, 0);
+      pstr = skipSpace(pstr, pend, 0);
       if (pstr == NULL) {
         *pError = TTABLE_ERR_SP;
         status = 0;
@@ -670,7 +996,7 @@ static int parseLine(char *pstr, int tcount, int *pError) {
     
     /* Read texture index */
     if (status) {
-      pstr = readInt(pstr, &tex_index);
+      pstr = readInt(pstr, pend, &tex_index);
       if (pstr == NULL) {
         *pError = TTABLE_ERR_INT;
         status = 0;
@@ -679,7 +1005,7 @@ static int parseLine(char *pstr, int tcount, int *pError) {
     
     /* Required whitespace */
     if (status) {
-      pstr = skipSpace(pstr, 0);
+      pstr = skipSpace(pstr, pend, 0);
       if (pstr == NULL) {
         *pError = TTABLE_ERR_SP;
         status = 0;
@@ -688,7 +1014,7 @@ static int parseLine(char *pstr, int tcount, int *pError) {
     
     /* Read shading rate */
     if (status) {
-      pstr = readInt(pstr, &shade_rate);
+      pstr = readInt(pstr, pend, &shade_rate);
       if (pstr == NULL) {
         *pError = TTABLE_ERR_INT;
         status = 0;
@@ -697,7 +1023,7 @@ static int parseLine(char *pstr, int tcount, int *pError) {
     
     /* Required whitespace */
     if (status) {
-      pstr = skipSpace(pstr, 0);
+      pstr = skipSpace(pstr, pend, 0);
       if (pstr == NULL) {
         *pError = TTABLE_ERR_SP;
         status = 0;
@@ -706,7 +1032,7 @@ static int parseLine(char *pstr, int tcount, int *pError) {
     
     /* Read drawing rate */
     if (status) {
-      pstr = readInt(pstr, &draw_rate);
+      pstr = readInt(pstr, pend, &draw_rate);
       if (pstr == NULL) {
         *pError = TTABLE_ERR_INT;
         status = 0;
@@ -715,11 +1041,11 @@ static int parseLine(char *pstr, int tcount, int *pError) {
     
     /* Only proceed for RGB tint if present */
     if (status) {
-      if (!is_blank(pstr)) {
+      if (!is_blank(pstr, pend)) {
     
         /* Required whitespace */
         if (status) {
-          pstr = skipSpace(pstr, 0);
+          pstr = skipSpace(pstr, pend, 0);
           if (pstr == NULL) {
             *pError = TTABLE_ERR_SP;
             status = 0;
@@ -728,7 +1054,7 @@ static int parseLine(char *pstr, int tcount, int *pError) {
     
         /* Read RGB tint */
         if (status) {
-          pstr = readRGB(pstr, &rgb_tint);
+          pstr = readRGB(pstr, pend, &rgb_tint);
           if (pstr == NULL) {
             *pError = TTABLE_ERR_RGB;
             status = 0;
@@ -737,13 +1063,13 @@ static int parseLine(char *pstr, int tcount, int *pError) {
     
         /* Skip optional whitespace */
         if (status) {
-          pstr = skipSpace(pstr, 1);
+          pstr = skipSpace(pstr, pend, 1);
           assert(pstr != NULL);
         }
     
         /* Nothing should remain */
         if (status) {
-          if (*pstr != 0) {
+          if (pstr < pend) {
             *pError = TTABLE_ERR_UNX;
             status = 0;
           }
@@ -783,7 +1109,7 @@ static int parseLine(char *pstr, int tcount, int *pError) {
     if (status) {
       if (!addRecord(
             rgb_index, tex_index, shade_rate,
-            draw_rate, rgb_tint, pError)) {
+            draw_rate, rgb_tint, linenum, pError)) {
         status = 0;
       }
     }
@@ -794,42 +1120,189 @@ static int parseLine(char *pstr, int tcount, int *pError) {
 }
 
 /*
- * Public function implementations
- * ===============================
+ * Compute the checksum of the header of a compiled table.
  * 
- * See the header for specifications.
+ * This is the 32-bit FNV-1a hash of the bytes of every header word
+ * except the last, which is where the checksum is stored.
+ * 
+ * Parameters:
+ * 
+ *   pHeader - the header words
+ * 
+ * Return:
+ * 
+ *   the checksum
  */
+static uint32_t binChecksum(const uint32_t *pHeader) {
+  
+  const unsigned char *pc = NULL;
+  size_t i = 0;
+  uint32_t h = UINT32_C(2166136261);
+  
+  pc = (const unsigned char *) pHeader;
+  for(i = 0; i < (TTABLE_BIN_HEADER - 1) * sizeof(uint32_t); i++) {
+    h ^= (uint32_t) pc[i];
+    h *= UINT32_C(16777619);
+  }
+  
+  return h;
+}
 
 /*
- * ttable_errorString function.
+ * Hash an RGB index for the hash index of a compiled table.
+ * 
+ * The slot is the hash masked to the number of slots.  Collisions are
+ * resolved by linear probing.
+ * 
+ * Parameters:
+ * 
+ *   rgb_index - the RGB index
+ * 
+ * Return:
+ * 
+ *   the hash
  */
-const char *ttable_errorString(int code) {
+static uint32_t binHash(int32_t rgb_index) {
   
-  const char *pResult = NULL;
+  uint32_t h = 0;
   
-  switch (code) {
-    
-    case TTABLE_ERR_NONE:
-      pResult = "No error";
-      break;
-    
-    case TTABLE_ERR_OPEN:
-      pResult = "Can't open file";
-      break;
-    
-    case TTABLE_ERR_IO:
-      pResult = "I/O error";
-      break;
-    
-    case TTABLE_ERR_CR:
-      pResult = "Stray CR character without LF";
-      break;
-    
-    case TTABLE_ERR_LONG:
-      pResult = "Text line is too long";
-      break;
-    
-    case TTABLE_ERR_CHAR:
+  h = ((uint32_t) rgb_index) * UINT32_C(0x9e3779b1);
+  return h ^ (h >> 16);
+}
+
+/*
+ * Compare two tints for qsort() and bsearch().
+ * 
+ * Parameters:
+ * 
+ *   pA - pointer to the first uint32_t tint
+ * 
+ *   pB - pointer to the second uint32_t tint
+ * 
+ * Return:
+ * 
+ *   less than, equal to, or greater than zero as the first tint is
+ *   less than, equal to, or greater than the second
+ */
+static int cmpTint(const void *pA, const void *pB) {
+  
+  uint32_t a = 0;
+  uint32_t b = 0;
+  
+  a = *((const uint32_t *) pA);
+  b = *((const uint32_t *) pB);
+  
+  if (a < b) {
+    return -1;
+  } else if (a > b) {
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * Decode a record of the loaded compiled table.
+ * 
+ * i must be less than the number of records.
+ * 
+ * Parameters:
+ * 
+ *   i - the record index
+ * 
+ *   psr - the shading record to fill in
+ */
+static void binRecord(uint32_t i, SHADEREC *psr) {
+  
+  const uint32_t *pr = NULL;
+  
+  pr = &(m_pBinRec[i * TTABLE_BIN_RECORD]);
+  
+  psr->rgbidx = (int32_t) pr[0];
+  psr->tidx = (int) pr[1];
+  psr->srate = (int) (pr[2] & 0xff);
+  psr->drate = (int) ((pr[2] >> 8) & 0xff);
+  psr->rgbtint = pr[3];
+  if (pr[4] != BIN_NONE) {
+    psr->pTint = &(m_pBinTint[((size_t) pr[4]) * 256]);
+  } else {
+    psr->pTint = NULL;
+  }
+}
+
+/*
+ * Find a record of the loaded compiled table through its hash index.
+ * 
+ * Probing stops at the first empty slot.  It also stops after every
+ * slot has been visited, and slots holding record indices that are out
+ * of range are skipped, so a damaged index can not cause a fault.
+ * 
+ * Parameters:
+ * 
+ *   rgb_index - the RGB index to look for
+ * 
+ * Return:
+ * 
+ *   the record index, or -1 if there is no record for the RGB index
+ */
+static int binFind(int32_t rgb_index) {
+  
+  uint32_t h = 0;
+  uint32_t n = 0;
+  uint32_t r = 0;
+  
+  h = binHash(rgb_index) & m_bin_mask;
+  for(n = 0; n <= m_bin_mask; n++) {
+    r = m_pBinSlot[h];
+    if (r == BIN_NONE) {
+      break;
+    }
+    if ((r < m_bin_count) &&
+        (m_pBinRec[r * TTABLE_BIN_RECORD] == (uint32_t) rgb_index)) {
+      return (int) r;
+    }
+    h = (h + 1) & m_bin_mask;
+  }
+  
+  return -1;
+}
+
+/*
+ * Public function implementations
+ * ===============================
+ * 
+ * See the header for specifications.
+ */
+
+/*
+ * ttable_errorString function.
+ */
+const char *ttable_errorString(int code) {
+  
+  const char *pResult = NULL;
+  
+  switch (code) {
+    
+    case TTABLE_ERR_NONE:
+      pResult = "No error";
+      break;
+    
+    case TTABLE_ERR_OPEN:
+      pResult = "Can't open file";
+      break;
+    
+    case TTABLE_ERR_IO:
+      pResult = "I/O error";
+      break;
+    
+    case TTABLE_ERR_CR:
+      pResult = "Stray CR character without LF";
+      break;
+    
+    case TTABLE_ERR_LONG:
+      pResult = "Text line is too long";
+      break;
+    
+    case TTABLE_ERR_CHAR:
       pResult = "Non-ASCII character encountered";
       break;
     
@@ -869,6 +1342,14 @@ const char *ttable_errorString(int code) {
       pResult = "Drawing rate out of range";
       break;
     
+    case TTABLE_ERR_BIN:
+      pResult = "Not a valid compiled table file";
+      break;
+    
+    case TTABLE_ERR_BYTE:
+      pResult = "Compiled table file has the wrong byte order";
+      break;
+    
     default:
       pResult = "Unknown error";
   }
@@ -887,16 +1368,17 @@ int ttable_parse(
   
   int dummy = 0;
   int status = 1;
-  FILE *pf = NULL;
   
-  char buf[IN_MAXLINE];
-  int bufcount = 0;
-  int c = 0;
-  int eoff = 0;
-  int linenum = 0;
+  const char *pText = NULL;
+  size_t text_size = 0;
+  int mapped = 0;
   
-  /* Initialize buffer */
-  memset(buf, 0, IN_MAXLINE);
+  const char *pc = NULL;
+  const char *pe = NULL;
+  const char *pLine = NULL;
+  const char *pLineEnd = NULL;
+  int linenum = 0;
+  int dup = 0;
   
   /* Check parameters */
   if (pPath == NULL) {
@@ -906,6 +1388,11 @@ int ttable_parse(
     abort();
   }
   
+  /* Text tables can't be added to compiled tables */
+  if (m_pMap != NULL) {
+    abort();
+  }
+  
   /* If error pointers are NULL, set to dummy */
   if (pError == NULL) {
     pError = &dummy;
@@ -918,14 +1405,23 @@ int ttable_parse(
   *pError = TTABLE_ERR_NONE;
   *pLineNum = -1;
   
-  /* Open text file for reading */
-  pf = fopen(pPath, "r");
-  if (pf == NULL) {
+  /* Read the whole file */
+  if (!readText(pPath, &pText, &text_size, &mapped, pError)) {
     status = 0;
-    *pError = TTABLE_ERR_OPEN;
   }
   
-  /* Read each line of the file */
+  /* Parse each line of the file in place; there is always at least one
+   * line, and a line break at the end of the file is followed by an
+   * empty line */
+  if (status) {
+    if (pText != NULL) {
+      pc = pText;
+      pe = pText + text_size;
+    } else {
+      pc = "";
+      pe = pc;
+    }
+  }
   while (status) {
     
     /* Increment line number, or set to -1 if overflow */
@@ -937,89 +1433,89 @@ int ttable_parse(
       }
     }
     
-    /* Clear the line buffer */
-    memset(buf, 0, IN_MAXLINE);
-    bufcount = 0;
-    
-    /* Read characters into line buffer */
-    while (status) {
+    /* Scan to the end of the line, checking each character */
+    pLine = pc;
+    pLineEnd = NULL;
+    for( ; pc < pe; pc++) {
       
-      /* Read a character */
-      if (!readchar(pf, &c)) {
-        status = 0;
-        *pError = TTABLE_ERR_IO;
+      /* LF ends the line */
+      if (*pc == ASCII_LF) {
+        pLineEnd = pc;
+        pc++;
+        break;
       }
       
-      /* If character is CR, read next character, which must be LF */
-      if (status && (c == ASCII_CR)) {
-        
-        /* Read next character */
-        if (!readchar(pf, &c)) {
-          status = 0;
-          *pError = TTABLE_ERR_IO;
-        }
-        
-        /* Make sure next character is LF */
-        if (status && (c != ASCII_LF)) {
-          status = 0;
-          *pError = TTABLE_ERR_CR;
-          *pLineNum = linenum;
+      /* CR must be followed by LF, and together they end the line */
+      if (*pc == ASCII_CR) {
+        if ((pc + 1 < pe) && (pc[1] == ASCII_LF)) {
+          pLineEnd = pc;
+          pc += 2;
+          break;
         }
+        status = 0;
+        *pError = TTABLE_ERR_CR;
+        *pLineNum = linenum;
+        break;
       }
       
       /* Check character range */
-      if (status && ((c < -1) || (c > 127))) {
+      if (((unsigned char) *pc) > 127) {
         status = 0;
         *pError = TTABLE_ERR_CHAR;
         *pLineNum = linenum;
-      }
-      
-      /* If we read LF or EOF, we are done */
-      if (status && ((c == ASCII_LF) || (c == -1))) {
         break;
       }
       
-      /* If we got here successfully, we have another character for the
-       * buffer; add it, watching for buffer overflow */
-      if (status) {
-        bufcount++;
-        if (bufcount >= IN_MAXLINE) {
-          status = 0;
-          *pError = TTABLE_ERR_LONG;
-          *pLineNum = linenum;
-        }
-      }
-      
-      if (status) {
-        buf[bufcount - 1] = (char) c;
+      /* Check line length */
+      if (pc - pLine >= IN_MAXLINE - 1) {
+        status = 0;
+        *pError = TTABLE_ERR_LONG;
+        *pLineNum = linenum;
+        break;
       }
     }
     
-    /* If we left the loop because of EOF, set EOF flag */
-    if (status && (c == -1)) {
-      eoff = 1;
-    }
-    
     /* Parse the line */
     if (status) {
-      if (!parseLine(buf, tcount, pError)) {
+      if (!parseLine(pLine, (pLineEnd != NULL) ? pLineEnd : pe,
+                      tcount, linenum, pError)) {
         *pLineNum = linenum;
         status = 0;
       }
     }
     
-    /* If EOF flag set, we are done */
-    if (status && eoff) {
+    /* If there was no line break, this was the last line */
+    if (status && (pLineEnd == NULL)) {
       break;
     }
   }
   
-  /* Close file if open */
-  if (pf != NULL) {
-    fclose(pf);
-    pf = NULL;
+  /* Release the file */
+  freeText(pText, text_size, mapped);
+  pText = NULL;
+  
+  /* Check the parsed records for duplicates; a duplicate always comes
+   * before any error that stopped parsing, so it takes precedence */
+  dup = findDup();
+  if (dup >= 0) {
+    status = 0;
+    *pError = TTABLE_ERR_DUP;
+    *pLineNum = (m_pLoad[dup]).line;
+  }
+  
+  /* Add the records to the table if successful, otherwise discard
+   * them */
+  if (status) {
+    mergeLoad();
+  } else {
+    m_load_count = 0;
   }
   
+  /* Release the load buffer */
+  free(m_pLoad);
+  m_pLoad = NULL;
+  m_load_cap = 0;
+  
   /* Return status */
   return status;
 }
@@ -1027,9 +1523,10 @@ int ttable_parse(
 /*
  * ttable_query function.
  */
-void ttable_query(SHADEREC *psr) {
+int ttable_query(SHADEREC *psr) {
   
   SHADEREC *pt = NULL;
+  int result = -1;
   int32_t rgb_index;
   int lbound = 0;
   int ubound = 0;
@@ -1043,8 +1540,16 @@ void ttable_query(SHADEREC *psr) {
   /* Get index */
   rgb_index = psr->rgbidx;
   
+  /* Compiled tables are searched through their hash index */
+  if (m_pMap != NULL) {
+    result = binFind(rgb_index);
+    if (result >= 0) {
+      binRecord((uint32_t) result, psr);
+    }
+  }
+  
   /* Only proceed with search if table non-empty */
-  if (m_table_count > 0) {
+  if ((m_pMap == NULL) && (m_table_count > 0)) {
     
     /* Set search boundaries */
     lbound = 0;
@@ -1057,21 +1562,21 @@ void ttable_query(SHADEREC *psr) {
       mid = lbound + ((ubound - lbound) / 2);
       
       /* Compare to midpoint */
-      if ((m_table[mid]).rgbidx > rgb_index) {
+      if ((m_pTable[mid]).rgbidx > rgb_index) {
         /* Desired record less than midpoint */
         ubound = mid - 1;
         if (ubound < lbound) {
           ubound = lbound;
         }
         
-      } else if ((m_table[mid]).rgbidx < rgb_index) {
+      } else if ((m_pTable[mid]).rgbidx < rgb_index) {
         /* Desired record greater than midpoint */
         lbound = mid + 1;
         if (lbound > ubound) {
           lbound = ubound;
         }
         
-      } else if ((m_table[mid]).rgbidx == rgb_index) {
+      } else if ((m_pTable[mid]).rgbidx == rgb_index) {
         /* We found the record, so zoom in on that */
         ubound = mid;
         lbound = mid;
@@ -1083,9 +1588,10 @@ void ttable_query(SHADEREC *psr) {
     }
     
     /* Compare to selected record */
-    if ((m_table[lbound]).rgbidx == rgb_index) {
+    if ((m_pTable[lbound]).rgbidx == rgb_index) {
       /* We found the record */
-      pt = &(m_table[lbound]);
+      pt = &(m_pTable[lbound]);
+      result = lbound;
     
     } else {
       /* We didn't find the record */
@@ -1096,11 +1602,387 @@ void ttable_query(SHADEREC *psr) {
   /* Fill in either with record from table or with default */
   if (pt != NULL) {
     memcpy(psr, pt, sizeof(SHADEREC));
-  } else {
+  } else if (result < 0) {
     /* Default record */
     psr->tidx = 1;
     psr->srate = 0;
     psr->drate = 255;
     psr->rgbtint = UINT32_C(0xffffffff);
+    psr->pTint = NULL;
   }
+  
+  /* Return the record index */
+  return result;
+}
+
+/*
+ * ttable_count function.
+ */
+int ttable_count(void) {
+  if (m_pMap != NULL) {
+    return (int) m_bin_count;
+  }
+  return m_table_count;
+}
+
+/*
+ * ttable_get function.
+ */
+void ttable_get(int i, SHADEREC *psr) {
+  
+  /* Check parameters */
+  if ((i < 0) || (i >= ttable_count()) || (psr == NULL)) {
+    abort();
+  }
+  
+  /* Copy the record */
+  if (m_pMap != NULL) {
+    binRecord((uint32_t) i, psr);
+  } else {
+    memcpy(psr, &(m_pTable[i]), sizeof(SHADEREC));
+  }
+}
+
+/*
+ * ttable_compile function.
+ */
+int ttable_compile(const char *pPath, int *pError) {
+  
+  int dummy = 0;
+  int status = 1;
+  int count = 0;
+  int i = 0;
+  FILE *pf = NULL;
+  SHADEREC sr;
+  
+  uint32_t *pTints = NULL;
+  uint32_t *pSlots = NULL;
+  uint32_t *pFound = NULL;
+  uint32_t tints = 0;
+  uint32_t slots = 1;
+  uint32_t max_tidx = 0;
+  uint32_t h = 0;
+  uint32_t j = 0;
+  uint64_t total = 0;
+  
+  uint32_t hdr[TTABLE_BIN_HEADER];
+  uint32_t rec[TTABLE_BIN_RECORD];
+  uint32_t lut[256];
+  
+  /* Initialize structures and buffers */
+  memset(&sr, 0, sizeof(SHADEREC));
+  memset(hdr, 0, sizeof(hdr));
+  memset(rec, 0, sizeof(rec));
+  memset(lut, 0, sizeof(lut));
+  
+  /* Check parameters */
+  if (pPath == NULL) {
+    abort();
+  }
+  
+  /* If error pointer is NULL, set to dummy */
+  if (pError == NULL) {
+    pError = &dummy;
+  }
+  *pError = TTABLE_ERR_NONE;
+  
+  /* Get the record count */
+  count = ttable_count();
+  
+  /* Collect the distinct tints in ascending order, and the greatest
+   * texture index */
+  pTints = (uint32_t *) malloc(((size_t) count + 1) * sizeof(uint32_t));
+  if (pTints == NULL) {
+    abort();
+  }
+  for(i = 0; i < count; i++) {
+    ttable_get(i, &sr);
+    if (sr.rgbtint != UINT32_C(0xffffffff)) {
+      pTints[tints] = sr.rgbtint;
+      tints++;
+    }
+    if ((uint32_t) sr.tidx > max_tidx) {
+      max_tidx = (uint32_t) sr.tidx;
+    }
+  }
+  if (tints > 0) {
+    qsort(pTints, tints, sizeof(uint32_t), &cmpTint);
+    j = 1;
+    for(h = 1; h < tints; h++) {
+      if (pTints[h] != pTints[j - 1]) {
+        pTints[j] = pTints[h];
+        j++;
+      }
+    }
+    tints = j;
+  }
+  
+  /* Build the hash index with at least twice as many slots as
+   * records, so probe sequences stay short */
+  while (((uint64_t) slots) < ((uint64_t) count) * 2) {
+    slots *= 2;
+  }
+  pSlots = (uint32_t *) malloc(((size_t) slots) * sizeof(uint32_t));
+  if (pSlots == NULL) {
+    abort();
+  }
+  for(h = 0; h < slots; h++) {
+    pSlots[h] = BIN_NONE;
+  }
+  for(i = 0; i < count; i++) {
+    ttable_get(i, &sr);
+    h = binHash(sr.rgbidx) & (slots - 1);
+    while (pSlots[h] != BIN_NONE) {
+      h = (h + 1) & (slots - 1);
+    }
+    pSlots[h] = (uint32_t) i;
+  }
+  
+  /* Compute the total size of the file, which must fit in the
+   * header */
+  total = ((uint64_t) TTABLE_BIN_HEADER) +
+          (((uint64_t) count) * TTABLE_BIN_RECORD) +
+          ((uint64_t) slots) +
+          (((uint64_t) tints) * 256);
+  total *= sizeof(uint32_t);
+  if (total > UINT32_MAX) {
+    status = 0;
+    *pError = TTABLE_ERR_RECS;
+  }
+  
+  /* Fill in the header */
+  if (status) {
+    hdr[0] = TTABLE_BIN_MAGIC;
+    hdr[1] = TTABLE_BIN_VERSION;
+    hdr[2] = (uint32_t) count;
+    hdr[3] = slots;
+    hdr[4] = tints;
+    hdr[5] = max_tidx;
+    hdr[6] = (uint32_t) total;
+    hdr[TTABLE_BIN_HEADER - 1] = binChecksum(hdr);
+  }
+  
+  /* Open the file for writing */
+  if (status) {
+    pf = fopen(pPath, "wb");
+    if (pf == NULL) {
+      status = 0;
+      *pError = TTABLE_ERR_OPEN;
+    }
+  }
+  
+  /* Write the header */
+  if (status) {
+    if (fwrite(hdr, sizeof(uint32_t), TTABLE_BIN_HEADER, pf) !=
+          TTABLE_BIN_HEADER) {
+      status = 0;
+      *pError = TTABLE_ERR_IO;
+    }
+  }
+  
+  /* Write the records */
+  for(i = 0; status && (i < count); i++) {
+    ttable_get(i, &sr);
+    rec[0] = (uint32_t) sr.rgbidx;
+    rec[1] = (uint32_t) sr.tidx;
+    rec[2] = ((uint32_t) sr.srate) | (((uint32_t) sr.drate) << 8);
+    rec[3] = sr.rgbtint;
+    rec[4] = BIN_NONE;
+    if (sr.rgbtint != UINT32_C(0xffffffff)) {
+      pFound = (uint32_t *) bsearch(&(sr.rgbtint), pTints, tints,
+                                      sizeof(uint32_t), &cmpTint);
+      assert(pFound != NULL);
+      rec[4] = (uint32_t) (pFound - pTints);
+    }
+    
+    if (fwrite(rec, sizeof(uint32_t), TTABLE_BIN_RECORD, pf) !=
+          TTABLE_BIN_RECORD) {
+      status = 0;
+      *pError = TTABLE_ERR_IO;
+    }
+  }
+  
+  /* Write the hash index */
+  if (status) {
+    if (fwrite(pSlots, sizeof(uint32_t), slots, pf) != slots) {
+      status = 0;
+      *pError = TTABLE_ERR_IO;
+    }
+  }
+  
+  /* Write the tint tables */
+  for(j = 0; status && (j < tints); j++) {
+    for(i = 0; i < 256; i++) {
+      lut[i] = pixel_colorize_gray(i, pTints[j]);
+    }
+    if (fwrite(lut, sizeof(uint32_t), 256, pf) != 256) {
+      status = 0;
+      *pError = TTABLE_ERR_IO;
+    }
+  }
+  
+  /* Close the file */
+  if (pf != NULL) {
+    if (fclose(pf)) {
+      if (status) {
+        status = 0;
+        *pError = TTABLE_ERR_IO;
+      }
+    }
+    pf = NULL;
+  }
+  
+  /* Release buffers */
+  free(pTints);
+  pTints = NULL;
+  free(pSlots);
+  pSlots = NULL;
+  
+  /* Return status */
+  return status;
+}
+
+/*
+ * ttable_load function.
+ */
+int ttable_load(const char *pPath, int *pError, int tcount) {
+  
+  int dummy = 0;
+  int status = 1;
+  int fd = -1;
+  void *pm = MAP_FAILED;
+  size_t msize = 0;
+  const uint32_t *ph = NULL;
+  uint64_t expect = 0;
+  struct stat st;
+  
+  /* Initialize structures */
+  memset(&st, 0, sizeof(struct stat));
+  
+  /* Check parameters and state */
+  if ((pPath == NULL) || (tcount < 0)) {
+    abort();
+  }
+  if ((m_table_count > 0) || (m_pMap != NULL)) {
+    abort();
+  }
+  
+  /* If error pointer is NULL, set to dummy */
+  if (pError == NULL) {
+    pError = &dummy;
+  }
+  *pError = TTABLE_ERR_NONE;
+  
+  /* Open the file and get its size */
+  fd = open(pPath, O_RDONLY);
+  if (fd < 0) {
+    status = 0;
+    *pError = TTABLE_ERR_OPEN;
+  }
+  
+  if (status) {
+    if (fstat(fd, &st)) {
+      status = 0;
+      *pError = TTABLE_ERR_IO;
+    }
+  }
+  
+  if (status) {
+    if ((st.st_size < (off_t) (TTABLE_BIN_HEADER * sizeof(uint32_t))) ||
+        ((uint64_t) st.st_size > UINT32_MAX)) {
+      status = 0;
+      *pError = TTABLE_ERR_BIN;
+    } else {
+      msize = (size_t) st.st_size;
+    }
+  }
+  
+  /* Map the whole file; the mapping stays valid after the file is
+   * closed */
+  if (status) {
+    pm = mmap(NULL, msize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (pm == MAP_FAILED) {
+      status = 0;
+      *pError = TTABLE_ERR_IO;
+    }
+  }
+  
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+  
+  /* Check the magic value, the byte order, the version, and the
+   * checksum */
+  if (status) {
+    ph = (const uint32_t *) pm;
+    if (ph[0] != TTABLE_BIN_MAGIC) {
+      status = 0;
+      if (ph[0] == ((TTABLE_BIN_MAGIC >> 24) |
+                    ((TTABLE_BIN_MAGIC >> 8) & UINT32_C(0xff00)) |
+                    ((TTABLE_BIN_MAGIC << 8) & UINT32_C(0xff0000)) |
+                    (TTABLE_BIN_MAGIC << 24))) {
+        *pError = TTABLE_ERR_BYTE;
+      } else {
+        *pError = TTABLE_ERR_BIN;
+      }
+    }
+  }
+  
+  if (status) {
+    if ((ph[1] != TTABLE_BIN_VERSION) ||
+        (ph[TTABLE_BIN_HEADER - 1] != binChecksum(ph))) {
+      status = 0;
+      *pError = TTABLE_ERR_BIN;
+    }
+  }
+  
+  /* Check that the counts are consistent with each other and with the
+   * size of the file; the hash index must be a power of two with at
+   * least one empty slot */
+  if (status) {
+    if ((ph[2] > MAX_RECORDS) || (ph[4] > ph[2]) ||
+        (ph[3] <= ph[2]) || ((ph[3] & (ph[3] - 1)) != 0)) {
+      status = 0;
+      *pError = TTABLE_ERR_BIN;
+    }
+  }
+  
+  if (status) {
+    expect = ((uint64_t) TTABLE_BIN_HEADER) +
+              (((uint64_t) ph[2]) * TTABLE_BIN_RECORD) +
+              ((uint64_t) ph[3]) +
+              (((uint64_t) ph[4]) * 256);
+    expect *= sizeof(uint32_t);
+    if ((expect != (uint64_t) ph[6]) || (expect != (uint64_t) msize)) {
+      status = 0;
+      *pError = TTABLE_ERR_BIN;
+    }
+  }
+  
+  /* Range-check texture indices */
+  if (status) {
+    if (ph[5] > (uint32_t) tcount) {
+      status = 0;
+      *pError = TTABLE_ERR_TEX;
+    }
+  }
+  
+  /* Use the table, or unmap the file if there was an error */
+  if (status) {
+    m_pMap = ph;
+    m_bin_count = ph[2];
+    m_bin_mask = ph[3] - 1;
+    m_pBinRec = &(ph[TTABLE_BIN_HEADER]);
+    m_pBinSlot = &(m_pBinRec[
+                    ((size_t) m_bin_count) * TTABLE_BIN_RECORD]);
+    m_pBinTint = &(m_pBinSlot[ph[3]]);
+    
+  } else if (pm != MAP_FAILED) {
+    munmap(pm, msize);
+    pm = MAP_FAILED;
+  }
+  
+  /* Return status */
+  return status;
 }
@@ -5,6 +5,47 @@
  * ttable.h
  * 
  * Texture table module of Lilac.
+ * 
+ * The table is either parsed from a text file with ttable_parse(), or
+ * loaded from a compiled table file with ttable_load().  Compiled
+ * table files are written by ttable_compile() from a table that has
+ * already been parsed, and they are meant to be generated once for
+ * large tables that are used by many jobs.
+ * 
+ * A compiled table file is mapped into memory instead of being read,
+ * and only its header is validated when it is loaded, so loading takes
+ * the same time no matter how many records there are.  The file holds
+ * the records sorted by RGB index, a hash index that finds records in
+ * constant time, and for each distinct tint a table of the 256 possible
+ * results of colorizing with that tint (see pixel_colorize_gray()).
+ * 
+ * All values in a compiled table file are 32-bit unsigned integers in
+ * the byte order of the machine that compiled it:
+ * 
+ *   (1) A header of TTABLE_BIN_HEADER words, which are the magic value
+ *       TTABLE_BIN_MAGIC, the format version TTABLE_BIN_VERSION, the
+ *       record count, the number of hash slots, the number of tint
+ *       tables, the greatest texture index used by any record, the
+ *       total size of the file in bytes, reserved words that are zero,
+ *       and in the last word an FNV-1a checksum of the bytes of all
+ *       the other header words.
+ * 
+ *   (2) The records in ascending order of RGB index, each of which is
+ *       TTABLE_BIN_RECORD words: the RGB index, the texture index, the
+ *       shading rate plus 256 times the drawing rate, the RGB tint,
+ *       and the index of the tint table or 0xffffffff if colorizing is
+ *       disabled.
+ * 
+ *   (3) The hash slots, which are a power of two in number, each of
+ *       which holds a record index or 0xffffffff if empty.  See the
+ *       implementation for the hash function, which uses linear
+ *       probing.
+ * 
+ *   (4) The tint tables, each of which is 256 packed ARGB colors.
+ * 
+ * Files compiled on a machine with a different byte order are rejected.
+ * The records of a compiled table file are trusted, so the file should
+ * not be modified after it is compiled.
  */
 
 #include <stddef.h>
@@ -30,6 +71,19 @@
 #define TTABLE_ERR_RECS (12)  /* Too many records */
 #define TTABLE_ERR_DUP  (13)  /* Duplicate record */
 #define TTABLE_ERR_DRAW (14)  /* Drawing rate out of range */
+#define TTABLE_ERR_BIN  (15)  /* Not a valid compiled table */
+#define TTABLE_ERR_BYTE (16)  /* Compiled table has wrong byte order */
+
+/*
+ * Constants of the compiled table format.
+ * 
+ * The header and record sizes are in 32-bit words.  See the top of this
+ * header for the layout of the file.
+ */
+#define TTABLE_BIN_MAGIC   UINT32_C(0x4c54424c)
+#define TTABLE_BIN_VERSION (1)
+#define TTABLE_BIN_HEADER  (16)
+#define TTABLE_BIN_RECORD  (5)
 
 /*
  * Shading record structure.
@@ -77,6 +131,16 @@ typedef struct {
    */
   uint32_t rgbtint;
   
+  /*
+   * The precomputed results of colorizing each grayscale level with
+   * the RGB tint, indexed by the value of pixel_gray().
+   * 
+   * This is only available for tables loaded with ttable_load().  It
+   * is NULL otherwise, and it is always NULL if the colorizer is
+   * disabled for this texture.
+   */
+  const uint32_t *pTint;
+  
 } SHADEREC;
 
 /*
@@ -116,8 +180,19 @@ const char *ttable_errorString(int code);
  * within the table.
  * 
  * The return value indicates whether the file was completely parsed or
- * not.  If the file was not completely parsed, some records may have
- * been added.
+ * not.  If the file was not completely parsed, none of its records
+ * are added.
+ * 
+ * The file is mapped into memory, or read in one piece if it can't be
+ * mapped, and each line is tokenized in place without copying.
+ * 
+ * The records are collected as the file is parsed, then sorted once
+ * and checked for duplicate RGB indices in a single pass, so tables
+ * with many records load in O(n log n) time.  The table may hold a
+ * record for every possible RGB index.  Errors are reported the same
+ * as if the records were checked one at a time in file order, so a
+ * duplicate record is reported at the line of its second occurrence
+ * unless an error was found earlier in the file.
  * 
  * The error value is zero if successful, otherwise a TTABLE_ERR code.
  * Use ttable_errorString() to get an error message.
@@ -150,13 +225,100 @@ int ttable_parse(
  * in with the RGB index to query.
  * 
  * This function will always fill in the other fields besides rgbidx.
+ * For compiled tables, the record is found through the hash index in
+ * constant time.  Otherwise, it is found with a binary search.
  * If rgbidx is invalid or it is not in the table, default values will
  * be filled in for the other fields.
  * 
+ * The return value is the index of the record in the table that was
+ * used, which can be passed to ttable_get().  If the default values
+ * were filled in, -1 is returned.
+ * 
  * Parameters:
  * 
  *   psr - the shading record to fill in
+ * 
+ * Return:
+ * 
+ *   the index of the matching record, or -1 if there is none
+ */
+int ttable_query(SHADEREC *psr);
+
+/*
+ * Return the number of records currently in the table.
+ * 
+ * Return:
+ * 
+ *   the number of records
+ */
+int ttable_count(void);
+
+/*
+ * Get a copy of a record in the table.
+ * 
+ * i is the index of the record, which must be zero or greater and less
+ * than ttable_count().  Records are sorted in ascending order of RGB
+ * index.
+ * 
+ * Parameters:
+ * 
+ *   i - the index of the record
+ * 
+ *   psr - the shading record to fill in
+ */
+void ttable_get(int i, SHADEREC *psr);
+
+/*
+ * Write the records currently in the table to a compiled table file.
+ * 
+ * pPath is the path of the file to write, which is overwritten if it
+ * already exists.  See the top of this header for the format.
+ * 
+ * pError is either NULL or a pointer to an integer to receive an error
+ * code in case of error.
+ * 
+ * Parameters:
+ * 
+ *   pPath - path to the compiled table file to write
+ * 
+ *   pError - pointer to error code location or NULL
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
+ */
+int ttable_compile(const char *pPath, int *pError);
+
+/*
+ * Load a compiled table file into the texture table.
+ * 
+ * The table must be empty, and this function may not be used if
+ * ttable_parse() has added records.  A fault occurs otherwise.
+ * 
+ * The file is mapped into memory, and it stays mapped until the
+ * program ends.  Only the header is validated.  The file must have the
+ * byte order of this machine, and its size must match the header.
+ * 
+ * tcount is the total number of virtual textures that have been
+ * defined.  If any record uses a texture index greater than that, the
+ * load fails with TTABLE_ERR_TEX.
+ * 
+ * pError is either NULL or a pointer to an integer to receive an error
+ * code in case of error.
+ * 
+ * Parameters:
+ * 
+ *   pPath - path to the compiled table file to load
+ * 
+ *   pError - pointer to error code location or NULL
+ * 
+ *   tcount - the total number of virtual textures that have been
+ *   defined
+ * 
+ * Return:
+ * 
+ *   non-zero if successful, zero if error
  */
-void ttable_query(SHADEREC *psr);
+int ttable_load(const char *pPath, int *pError, int tcount);
 
 #endif